@@ -45,6 +45,11 @@ void main()
     if (mat_flags.x > 0.0)
     {
         diffuse = texture2D(s_texture, uv);
+        if (mat_flags.z > 0.0)
+        {
+            // alpha is a distance field. 0.5 is the edge
+            diffuse.w = smoothstep(0.5 - mat_flags.z, 0.5 + mat_flags.z, diffuse.w);
+        }
     }
     vec4 out_color = phong(diffuse, vnl, reflection, view_direction);
     out_color.w = diffuse.w;
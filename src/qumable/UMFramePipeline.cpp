@@ -0,0 +1,195 @@
+/**
+ * @file UMFramePipeline.cpp
+ * stages of a frame with per-stage timing
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMFramePipeline.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+namespace
+{
+	template <class Duration>
+	double to_milliseconds(const Duration& duration)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / 1000.0;
+	}
+
+	/**
+	 * value at a percentile of sorted values
+	 */
+	double percentile(const std::vector<double>& sorted, double rate)
+	{
+		const int last = static_cast<int>(sorted.size()) - 1;
+		const int index = static_cast<int>(last * rate + 0.5);
+		return sorted[(std::min)((std::max)(index, 0), last)];
+	}
+
+	void print_latency(const char* name, const qumable::UMFramePipeline::Latency& latency)
+	{
+		printf("%-10s p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms  avg %8.3f ms\n",
+			name, latency.p50, latency.p99, latency.maximum, latency.average);
+	}
+
+} // anonymouse namespace
+
+namespace qumable
+{
+
+/**
+ * constructor
+ */
+UMFramePipeline::UMFramePipeline(int history_count)
+	: history_count_((std::max)(history_count, 1))
+	, frame_count_(0)
+	, current_(0)
+	, dump_interval_(0.0)
+	, dump_time_(Clock::now())
+{
+	frame_history_.resize(history_count_, 0.0);
+	start_history_.resize(history_count_);
+}
+
+/**
+ * add a stage to the end of the frame
+ */
+int UMFramePipeline::add_stage(const std::string& name, StageFunction function)
+{
+	Stage stage;
+	stage.name = name;
+	stage.function = function;
+	stage.history.resize(history_count_, 0.0);
+	stage_list_.push_back(stage);
+	clear_history();
+	return stage_count() - 1;
+}
+
+/**
+ * run all stages once
+ */
+bool UMFramePipeline::run_frame()
+{
+	const Clock::time_point start = Clock::now();
+	Clock::time_point stage_start = start;
+	bool is_completed = true;
+	for (int i = 0, size = stage_count(); i < size; ++i)
+	{
+		Stage& stage = stage_list_[i];
+		if (!is_completed)
+		{
+			stage.history[current_] = 0.0;
+			continue;
+		}
+		is_completed = stage.function();
+		const Clock::time_point stage_end = Clock::now();
+		stage.history[current_] = to_milliseconds(stage_end - stage_start);
+		stage_start = stage_end;
+	}
+	frame_history_[current_] = to_milliseconds(stage_start - start);
+	start_history_[current_] = start;
+	current_ = (current_ + 1) % history_count_;
+	++frame_count_;
+
+	if (dump_interval_ > 0.0 && to_milliseconds(stage_start - dump_time_) >= dump_interval_ * 1000.0)
+	{
+		print();
+		dump_time_ = stage_start;
+	}
+	return is_completed;
+}
+
+/**
+ * get frames kept in the ring buffer
+ */
+int UMFramePipeline::history_size() const
+{
+	return (std::min)(frame_count_, history_count_);
+}
+
+/**
+ * get latency of whole frames in the ring buffer
+ */
+UMFramePipeline::Latency UMFramePipeline::frame_latency() const
+{
+	return latency(frame_history_, history_size());
+}
+
+/**
+ * get latency of a stage in the ring buffer
+ */
+UMFramePipeline::Latency UMFramePipeline::stage_latency(int index) const
+{
+	if (index < 0 || index >= stage_count()) return Latency();
+	return latency(stage_list_[index].history, history_size());
+}
+
+/**
+ * get frames per second of frames in the ring buffer
+ */
+double UMFramePipeline::frames_per_second() const
+{
+	const int size = history_size();
+	if (size < 2) return 0.0;
+	const int newest = (current_ + history_count_ - 1) % history_count_;
+	const int oldest = (current_ + history_count_ - size) % history_count_;
+	const double milliseconds = to_milliseconds(start_history_[newest] - start_history_[oldest]);
+	if (milliseconds <= 0.0) return 0.0;
+	return (size - 1) * 1000.0 / milliseconds;
+}
+
+/**
+ * clear recorded times
+ */
+void UMFramePipeline::clear_history()
+{
+	frame_count_ = 0;
+	current_ = 0;
+	dump_time_ = Clock::now();
+}
+
+/**
+ * print latencies to stdout
+ */
+void UMFramePipeline::print() const
+{
+	if (history_size() == 0)
+	{
+		printf("no frames\n");
+		return;
+	}
+	printf("last %d frames, %.1f frames per second\n", history_size(), frames_per_second());
+	print_latency("frame", frame_latency());
+	for (int i = 0, size = stage_count(); i < size; ++i)
+	{
+		print_latency(stage_name(i).c_str(), stage_latency(i));
+	}
+}
+
+/**
+ * latency of the first size values
+ */
+UMFramePipeline::Latency UMFramePipeline::latency(const std::vector<double>& history, int size)
+{
+	Latency result;
+	if (size <= 0) return result;
+	std::vector<double> sorted(history.begin(), history.begin() + size);
+	std::sort(sorted.begin(), sorted.end());
+	result.p50 = percentile(sorted, 0.5);
+	result.p99 = percentile(sorted, 0.99);
+	result.maximum = sorted.back();
+	double total = 0.0;
+	for (int i = 0; i < size; ++i)
+	{
+		total += sorted[i];
+	}
+	result.average = total / size;
+	return result;
+}
+
+} // qumable
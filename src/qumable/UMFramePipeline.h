@@ -0,0 +1,150 @@
+/**
+ * @file UMFramePipeline.h
+ * stages of a frame with per-stage timing
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include "UMMacro.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+
+namespace qumable
+{
+
+class UMFramePipeline;
+typedef std::shared_ptr<UMFramePipeline> UMFramePipelinePtr;
+
+/**
+ * runs stages of a frame in order and records wall time of each stage
+ * @note stages do not depend on a window. the last frames are kept in a ring buffer.
+ */
+class UMFramePipeline
+{
+	DISALLOW_COPY_AND_ASSIGN(UMFramePipeline);
+public:
+	/**
+	 * a stage. returns false to skip the remaining stages of the frame.
+	 */
+	typedef std::function<bool()> StageFunction;
+
+	/**
+	 * latency in milliseconds
+	 */
+	struct Latency
+	{
+		Latency() : p50(0.0), p99(0.0), maximum(0.0), average(0.0) {}
+		double p50;
+		double p99;
+		double maximum;
+		double average;
+	};
+
+	/**
+	 * constructor
+	 * @param [in] history_count frames kept in the ring buffer
+	 */
+	explicit UMFramePipeline(int history_count);
+
+	~UMFramePipeline() {}
+
+	/**
+	 * add a stage to the end of the frame
+	 * @retval index of the stage
+	 */
+	int add_stage(const std::string& name, StageFunction function);
+
+	/**
+	 * run all stages once
+	 * @retval false if a stage skipped the remaining stages
+	 */
+	bool run_frame();
+
+	/**
+	 * get stage count
+	 */
+	int stage_count() const { return static_cast<int>(stage_list_.size()); }
+
+	/**
+	 * get stage name
+	 */
+	const std::string& stage_name(int index) const { return stage_list_[index].name; }
+
+	/**
+	 * get frames run since clear_history
+	 */
+	int frame_count() const { return frame_count_; }
+
+	/**
+	 * get frames kept in the ring buffer
+	 */
+	int history_size() const;
+
+	/**
+	 * get latency of whole frames in the ring buffer
+	 */
+	Latency frame_latency() const;
+
+	/**
+	 * get latency of a stage in the ring buffer
+	 * @note skipped stages are counted as 0 ms
+	 */
+	Latency stage_latency(int index) const;
+
+	/**
+	 * get frames per second of frames in the ring buffer
+	 * @note includes time outside of stages, e.g. swap buffers
+	 */
+	double frames_per_second() const;
+
+	/**
+	 * clear recorded times
+	 */
+	void clear_history();
+
+	/**
+	 * print latencies periodically from run_frame
+	 * @param [in] seconds interval. 0 disables.
+	 */
+	void set_dump_interval(double seconds) { dump_interval_ = seconds; }
+
+	/**
+	 * print latencies to stdout
+	 */
+	void print() const;
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct Stage
+	{
+		std::string name;
+		StageFunction function;
+		/// milliseconds of the last frames
+		std::vector<double> history;
+	};
+	typedef std::vector<Stage> StageList;
+
+	static Latency latency(const std::vector<double>& history, int size);
+
+	StageList stage_list_;
+	/// milliseconds of the last frames
+	std::vector<double> frame_history_;
+	/// start time of the last frames
+	std::vector<Clock::time_point> start_history_;
+	int history_count_;
+	int frame_count_;
+	int current_;
+	double dump_interval_;
+	Clock::time_point dump_time_;
+};
+
+} // qumable
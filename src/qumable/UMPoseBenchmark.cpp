@@ -0,0 +1,162 @@
+/**
+ * @file UMPoseBenchmark.cpp
+ * measure pose to draw-ready buffer latency by replaying a pose stream
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMPoseBenchmark.h"
+#include "UMPoseStream.h"
+#include "UMScene.h"
+#include "UMMesh.h"
+#include "UMMeshGroup.h"
+#include "UMOpenGLIO.h"
+#include "UMTransformHierarchy.h"
+
+#include <stdio.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+namespace
+{
+	using namespace umdraw;
+	using namespace qumable;
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double to_milliseconds(const Clock::duration& duration)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / 1000.0;
+	}
+
+	void add_time(UMPoseBenchmark::Stage& stage, double time)
+	{
+		stage.total += time;
+		stage.maximum = (std::max)(stage.maximum, time);
+	}
+
+	void print_stage(const char* name, const UMPoseBenchmark::Stage& stage, int frame_count)
+	{
+		printf("%-8s avg %8.3f ms  max %8.3f ms\n", name, stage.total / frame_count, stage.maximum);
+	}
+
+} // anonymouse namespace
+
+namespace qumable
+{
+
+/**
+ * replay a pose stream on a character as fast as possible
+ */
+bool UMPoseBenchmark::run(
+	Result& result,
+	const umstring& model_path,
+	const umstring& pose_path,
+	int repeat_count)
+{
+	result = Result();
+
+	UMPosePlayer player;
+	if (!player.load(pose_path)) return false;
+	player.set_frame_rate(-1.0);
+
+	UMScenePtr scene = std::make_shared<UMScene>();
+	if (!scene->load(model_path)) return false;
+	if (scene->node_list().empty()) return false;
+
+	UMTransformHierarchy& hierarchy = scene->mutable_transform_hierarchy();
+	const int node_count = (std::min)(player.node_count(), hierarchy.node_count());
+
+	UMMeshList mesh_list;
+	UMMeshGroupList::const_iterator it = scene->mesh_group_list().begin();
+	for (; it != scene->mesh_group_list().end(); ++it)
+	{
+		const UMMeshList& group_mesh_list = (*it)->mesh_list();
+		mesh_list.insert(mesh_list.end(), group_mesh_list.begin(), group_mesh_list.end());
+	}
+	const int mesh_count = static_cast<int>(mesh_list.size());
+	std::vector<std::vector<UMVec3f> > vertex_arrays(mesh_count);
+	std::vector<std::vector<UMVec3f> > normal_arrays(mesh_count);
+	std::vector<unsigned char> is_deformed(mesh_count, 0);
+
+	result.node_count = node_count;
+	for (int i = 0; i < mesh_count; ++i)
+	{
+		result.vertex_count += static_cast<int>(mesh_list[i]->vertex_list().size());
+	}
+
+	for (int repeat = 0; repeat < repeat_count; ++repeat)
+	{
+		player.rewind();
+		while (player.update())
+		{
+			const int last_frame = hierarchy.frame();
+			const Clock::time_point start = Clock::now();
+
+			for (int i = 0; i < node_count; ++i)
+			{
+				hierarchy.set_local_transform(i, player.local_matrix(i));
+			}
+			hierarchy.update();
+			const Clock::time_point posed = Clock::now();
+
+			for (int i = 0; i < mesh_count; ++i)
+			{
+				is_deformed[i] = hierarchy.is_deformed_since(mesh_list[i], last_frame) ? 1 : 0;
+				if (is_deformed[i])
+				{
+					mesh_list[i]->update();
+				}
+			}
+			const Clock::time_point skinned = Clock::now();
+
+			for (int i = 0; i < mesh_count; ++i)
+			{
+				if (!is_deformed[i]) continue;
+				UMOpenGLIO::create_vertex_array(vertex_arrays[i], mesh_list[i]);
+				if (!mesh_list[i]->normal_list().empty())
+				{
+					UMOpenGLIO::create_normal_array(normal_arrays[i], mesh_list[i]);
+				}
+			}
+			const Clock::time_point buffered = Clock::now();
+
+			add_time(result.pose, to_milliseconds(posed - start));
+			add_time(result.skin, to_milliseconds(skinned - posed));
+			add_time(result.buffer, to_milliseconds(buffered - skinned));
+			add_time(result.latency, to_milliseconds(buffered - start));
+			++result.frame_count;
+		}
+	}
+	return result.frame_count > 0;
+}
+
+/**
+ * print result to stdout
+ */
+void UMPoseBenchmark::print(const Result& result)
+{
+	if (result.frame_count == 0)
+	{
+		printf("no frames\n");
+		return;
+	}
+	printf("frames %d, nodes %d, vertices %d\n",
+		result.frame_count,
+		result.node_count,
+		result.vertex_count);
+	print_stage("pose", result.pose, result.frame_count);
+	print_stage("skin", result.skin, result.frame_count);
+	print_stage("buffer", result.buffer, result.frame_count);
+	print_stage("latency", result.latency, result.frame_count);
+	if (result.latency.total > 0.0)
+	{
+		printf("%.1f frames per second\n", result.frame_count * 1000.0 / result.latency.total);
+	}
+}
+
+} // qumable
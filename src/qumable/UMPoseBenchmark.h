@@ -0,0 +1,79 @@
+/**
+ * @file UMPoseBenchmark.h
+ * measure pose to draw-ready buffer latency by replaying a pose stream
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include "UMMacro.h"
+#include <memory>
+
+namespace qumable
+{
+
+/**
+ * pose stream benchmark
+ * @note runs without QUMA device and OpenGL context.
+ */
+class UMPoseBenchmark
+{
+	DISALLOW_COPY_AND_ASSIGN(UMPoseBenchmark);
+public:
+
+	/**
+	 * time of a stage in milliseconds
+	 */
+	struct Stage
+	{
+		Stage() : total(0.0), maximum(0.0) {}
+		double total;
+		double maximum;
+	};
+
+	/**
+	 * benchmark result
+	 */
+	struct Result
+	{
+		Result() : frame_count(0), node_count(0), vertex_count(0) {}
+		int frame_count;
+		int node_count;
+		int vertex_count;
+		/// local matrices to global matrices
+		Stage pose;
+		/// global matrices to skinned meshes
+		Stage skin;
+		/// skinned meshes to vertex and normal arrays
+		Stage buffer;
+		/// whole latency from pose to buffers
+		Stage latency;
+	};
+
+	/**
+	 * replay a pose stream on a character as fast as possible
+	 * @param [out] result measured time
+	 * @param [in] model_path absolute path of a character model
+	 * @param [in] pose_path absolute path of a pose stream
+	 * @param [in] repeat_count times to replay the stream
+	 */
+	static bool run(
+		Result& result,
+		const umstring& model_path,
+		const umstring& pose_path,
+		int repeat_count);
+
+	/**
+	 * print result to stdout
+	 */
+	static void print(const Result& result);
+
+private:
+	UMPoseBenchmark() {}
+};
+
+} // qumable
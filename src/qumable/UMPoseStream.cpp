@@ -0,0 +1,266 @@
+/**
+ * @file UMPoseStream.cpp
+ * record and replay local matrices of a character
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMPoseStream.h"
+#include "UMTime.h"
+#include <string.h>
+#include <iterator>
+#include <algorithm>
+
+namespace
+{
+	const char magic[4] = { 'U', 'M', 'P', 'S' };
+	const unsigned int stream_version = 1;
+	const int header_size = 12;
+
+	/// floats per node
+	const int matrix_float_count = 12;
+
+	int frame_float_count(int node_count)
+	{
+		return 1 + node_count * matrix_float_count;
+	}
+
+	double elapsed_seconds(unsigned int start_time)
+	{
+		return (umbase::UMTime::current_time() - start_time) / 1000.0;
+	}
+
+} // anonymouse namespace
+
+namespace qumable
+{
+
+/**
+ * constructor
+ */
+UMPoseRecorder::UMPoseRecorder()
+	: node_count_(0)
+	, frame_count_(0)
+	, start_time_(0)
+{
+}
+
+/**
+ * destructor
+ */
+UMPoseRecorder::~UMPoseRecorder()
+{
+	close();
+}
+
+/**
+ * open a file and write header
+ */
+bool UMPoseRecorder::open(const umstring& path, int node_count)
+{
+	close();
+	if (node_count <= 0) return false;
+	ofs_.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!ofs_.good()) return false;
+
+	const unsigned int count = static_cast<unsigned int>(node_count);
+	ofs_.write(magic, sizeof(magic));
+	ofs_.write(reinterpret_cast<const char*>(&stream_version), sizeof(stream_version));
+	ofs_.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+	node_count_ = node_count;
+	frame_count_ = 0;
+	frame_.assign(frame_float_count(node_count), 0.0f);
+	start_time_ = umbase::UMTime::current_time();
+	return ofs_.good();
+}
+
+/**
+ * close file
+ */
+void UMPoseRecorder::close()
+{
+	if (ofs_.is_open())
+	{
+		ofs_.close();
+	}
+	node_count_ = 0;
+	frame_.clear();
+}
+
+/**
+ * set local matrix of current frame
+ */
+void UMPoseRecorder::set_local_matrix(int index, const UMMat44d& local_matrix)
+{
+	if (index < 0 || index >= node_count_) return;
+	float* dst = &frame_[1 + index * matrix_float_count];
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			dst[i * 3 + k] = static_cast<float>(local_matrix.m[i][k]);
+		}
+	}
+}
+
+/**
+ * write current frame
+ */
+bool UMPoseRecorder::write_frame()
+{
+	if (!ofs_.is_open()) return false;
+	frame_[0] = static_cast<float>(elapsed_seconds(start_time_));
+	ofs_.write(reinterpret_cast<const char*>(&frame_[0]), frame_.size() * sizeof(float));
+	if (!ofs_.good()) return false;
+	++frame_count_;
+	return true;
+}
+
+/**
+ * constructor
+ */
+UMPosePlayer::UMPosePlayer()
+	: node_count_(0)
+	, frame_count_(0)
+	, current_frame_(-1)
+	, frame_rate_(0.0)
+	, is_loop_(false)
+	, start_time_(0)
+{
+}
+
+/**
+ * load a file
+ */
+bool UMPosePlayer::load(const umstring& path)
+{
+	frame_list_.clear();
+	node_count_ = 0;
+	frame_count_ = 0;
+	current_frame_ = -1;
+
+	std::ifstream ifs(path.c_str(), std::ios::in | std::ios::binary);
+	if (!ifs.good()) return false;
+	const std::string buffer((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	if (buffer.size() < header_size) return false;
+	if (memcmp(buffer.data(), magic, sizeof(magic)) != 0) return false;
+
+	unsigned int version = 0;
+	unsigned int node_count = 0;
+	memcpy(&version, buffer.data() + 4, sizeof(version));
+	memcpy(&node_count, buffer.data() + 8, sizeof(node_count));
+	if (version != stream_version || node_count == 0) return false;
+
+	const size_t frame_size = frame_float_count(node_count) * sizeof(float);
+	const size_t frame_count = (buffer.size() - header_size) / frame_size;
+	if (frame_count == 0) return false;
+
+	// a broken last frame is dropped
+	frame_list_.resize(frame_count * frame_float_count(node_count));
+	memcpy(&frame_list_[0], buffer.data() + header_size, frame_count * frame_size);
+	node_count_ = static_cast<int>(node_count);
+	frame_count_ = static_cast<int>(frame_count);
+	rewind();
+	return true;
+}
+
+/**
+ * start playback from the first frame
+ */
+void UMPosePlayer::rewind()
+{
+	current_frame_ = -1;
+	start_time_ = umbase::UMTime::current_time();
+}
+
+/**
+ * advance current frame by playback rate
+ */
+bool UMPosePlayer::update()
+{
+	if (frame_count_ == 0) return false;
+
+	int frame = current_frame_;
+	if (frame_rate_ < 0.0)
+	{
+		frame = current_frame_ + 1;
+	}
+	else if (frame_rate_ > 0.0)
+	{
+		frame = static_cast<int>(elapsed_seconds(start_time_) * frame_rate_);
+	}
+	else
+	{
+		// recorded timing
+		double time = frame_time(0) + elapsed_seconds(start_time_);
+		if (is_loop_ && time > frame_time(frame_count_ - 1))
+		{
+			rewind();
+			frame = 0;
+			// time from the new start
+			time = frame_time(0) + elapsed_seconds(start_time_);
+		}
+		frame = (std::max)(frame, 0);
+		while (frame + 1 < frame_count_ && frame_time(frame + 1) <= time)
+		{
+			++frame;
+		}
+	}
+
+	if (frame >= frame_count_)
+	{
+		if (is_loop_)
+		{
+			rewind();
+			frame = 0;
+		}
+		else
+		{
+			frame = frame_count_ - 1;
+		}
+	}
+	if (frame == current_frame_) return false;
+	current_frame_ = frame;
+	return true;
+}
+
+/**
+ * is playback finished or not
+ */
+bool UMPosePlayer::is_end() const
+{
+	return !is_loop_ && current_frame_ >= frame_count_ - 1;
+}
+
+/**
+ * get recorded time of a frame in seconds
+ */
+double UMPosePlayer::frame_time(int frame) const
+{
+	if (frame < 0 || frame >= frame_count_) return 0.0;
+	return frame_list_[frame * frame_float_count(node_count_)];
+}
+
+/**
+ * get local matrix of current frame
+ */
+UMMat44d UMPosePlayer::local_matrix(int index) const
+{
+	UMMat44d matrix;
+	if (current_frame_ < 0 || index < 0 || index >= node_count_) return matrix;
+	const float* src = &frame_list_[current_frame_ * frame_float_count(node_count_) + 1 + index * matrix_float_count];
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			matrix.m[i][k] = src[i * 3 + k];
+		}
+	}
+	return matrix;
+}
+
+} // qumable
@@ -0,0 +1,166 @@
+/**
+ * @file UMPoseStream.h
+ * record and replay local matrices of a character
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMMatrix.h"
+#include <memory>
+#include <vector>
+#include <fstream>
+
+namespace qumable
+{
+
+class UMPoseRecorder;
+typedef std::shared_ptr<UMPoseRecorder> UMPoseRecorderPtr;
+
+class UMPosePlayer;
+typedef std::shared_ptr<UMPosePlayer> UMPosePlayerPtr;
+
+/**
+ * pose stream recorder
+ * @note header is "UMPS", version and node count as 32bit values.
+ * each frame is time in seconds and 4x3 float local matrices of all nodes.
+ * the last column is always (0, 0, 0, 1) and is not stored.
+ */
+class UMPoseRecorder
+{
+	DISALLOW_COPY_AND_ASSIGN(UMPoseRecorder);
+public:
+	UMPoseRecorder();
+	~UMPoseRecorder();
+
+	/**
+	 * open a file and write header
+	 * @param [in] path absolute file path
+	 * @param [in] node_count nodes per frame
+	 */
+	bool open(const umstring& path, int node_count);
+
+	/**
+	 * close file
+	 */
+	void close();
+
+	/**
+	 * is recording or not
+	 */
+	bool is_open() const { return ofs_.is_open(); }
+
+	/**
+	 * set local matrix of current frame
+	 */
+	void set_local_matrix(int index, const UMMat44d& local_matrix);
+
+	/**
+	 * write current frame
+	 */
+	bool write_frame();
+
+	/**
+	 * get written frame count
+	 */
+	int frame_count() const { return frame_count_; }
+
+private:
+	std::ofstream ofs_;
+	std::vector<float> frame_;
+	int node_count_;
+	int frame_count_;
+	unsigned int start_time_;
+};
+
+/**
+ * pose stream player
+ */
+class UMPosePlayer
+{
+	DISALLOW_COPY_AND_ASSIGN(UMPosePlayer);
+public:
+	UMPosePlayer();
+	~UMPosePlayer() {}
+
+	/**
+	 * load a file
+	 * @param [in] path absolute file path
+	 */
+	bool load(const umstring& path);
+
+	/**
+	 * set playback rate
+	 * @param [in] fps frames per second. 0 means recorded timing,
+	 * negative means one frame for each update as fast as possible.
+	 */
+	void set_frame_rate(double fps) { frame_rate_ = fps; }
+
+	/**
+	 * get playback rate
+	 */
+	double frame_rate() const { return frame_rate_; }
+
+	/**
+	 * set loop playback
+	 */
+	void set_loop(bool is_loop) { is_loop_ = is_loop; }
+
+	/**
+	 * start playback from the first frame
+	 */
+	void rewind();
+
+	/**
+	 * advance current frame by playback rate
+	 * @retval current frame is changed or not
+	 */
+	bool update();
+
+	/**
+	 * is playback finished or not
+	 */
+	bool is_end() const;
+
+	/**
+	 * get node count
+	 */
+	int node_count() const { return node_count_; }
+
+	/**
+	 * get frame count
+	 */
+	int frame_count() const { return frame_count_; }
+
+	/**
+	 * get current frame
+	 */
+	int current_frame() const { return current_frame_; }
+
+	/**
+	 * get recorded time of a frame in seconds
+	 */
+	double frame_time(int frame) const;
+
+	/**
+	 * get local matrix of current frame
+	 */
+	UMMat44d local_matrix(int index) const;
+
+private:
+	std::vector<float> frame_list_;
+	int node_count_;
+	int frame_count_;
+	int current_frame_;
+	double frame_rate_;
+	bool is_loop_;
+	unsigned int start_time_;
+};
+
+} // qumable
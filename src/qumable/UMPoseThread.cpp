@@ -0,0 +1,88 @@
+/**
+ * @file UMPoseThread.cpp
+ * acquire pose and deform a scene on a thread while drawing
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMPoseThread.h"
+#include "UMOpenGLIO.h"
+
+namespace qumable
+{
+	using namespace umdraw;
+
+/**
+ * destructor
+ */
+UMPoseThread::~UMPoseThread()
+{
+	stop();
+}
+
+/**
+ * start the thread
+ */
+bool UMPoseThread::start(UMScenePtr scene, AcquireFunction acquire_function)
+{
+	if (is_running_) return false;
+	if (!scene) return false;
+
+	scene_ = scene;
+	acquire_function_ = acquire_function;
+	buffer_ = std::make_shared<UMSceneSnapshotBuffer>();
+	scene_->set_snapshot_buffer(buffer_);
+	is_running_ = true;
+	thread_ = std::thread([this] { run(); });
+	return true;
+}
+
+/**
+ * stop the thread and detach the snapshot buffer
+ */
+void UMPoseThread::stop()
+{
+	if (!is_running_) return;
+	buffer_->stop();
+	if (thread_.joinable())
+	{
+		thread_.join();
+	}
+	scene_->set_snapshot_buffer(UMSceneSnapshotBufferPtr());
+	scene_ = UMScenePtr();
+	buffer_ = UMSceneSnapshotBufferPtr();
+	acquire_function_ = AcquireFunction();
+	is_running_ = false;
+}
+
+/**
+ * produce snapshots one frame ahead of the draw thread
+ */
+void UMPoseThread::run()
+{
+	int last_frame = -1;
+	while (buffer_->wait_acquired())
+	{
+		{
+			std::lock_guard<std::mutex> lock(scene_mutex_);
+			UMSceneSnapshot& snapshot = buffer_->back();
+			if (scene_->is_enable_deform() && (!acquire_function_ || acquire_function_()))
+			{
+				UMOpenGLIO::deform_to_snapshot(snapshot, scene_, last_frame);
+				last_frame = snapshot.frame;
+			}
+			else
+			{
+				// nothing to upload
+				snapshot.is_mesh_deformed.assign(snapshot.is_mesh_deformed.size(), 0);
+				snapshot.is_node_changed.assign(snapshot.is_node_changed.size(), 0);
+			}
+		}
+		buffer_->publish();
+	}
+}
+
+} // qumable
@@ -0,0 +1,82 @@
+/**
+ * @file UMPoseThread.h
+ * acquire pose and deform a scene on a thread while drawing
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include "UMMacro.h"
+#include "UMScene.h"
+#include "UMSceneSnapshot.h"
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+namespace qumable
+{
+
+class UMPoseThread;
+typedef std::shared_ptr<UMPoseThread> UMPoseThreadPtr;
+
+/**
+ * deforms frame N+1 of a scene while the draw thread draws frame N
+ * @note deformed arrays are handed off by the snapshot buffer of the scene.
+ */
+class UMPoseThread
+{
+	DISALLOW_COPY_AND_ASSIGN(UMPoseThread);
+public:
+	/**
+	 * acquires pose and updates the transform hierarchy of the scene
+	 * @retval false to leave the scene untouched in this frame
+	 */
+	typedef std::function<bool()> AcquireFunction;
+
+	UMPoseThread() { is_running_ = false; }
+
+	~UMPoseThread();
+
+	/**
+	 * start the thread
+	 * @param [in] scene scene to deform. its snapshot buffer is set while running.
+	 * @param [in] acquire_function called on the thread before deformation
+	 */
+	bool start(umdraw::UMScenePtr scene, AcquireFunction acquire_function);
+
+	/**
+	 * stop the thread and detach the snapshot buffer
+	 * @note call from the draw thread
+	 */
+	void stop();
+
+	/**
+	 * get whether the thread is running
+	 * @note may be called from any thread
+	 */
+	bool is_running() const { return is_running_; }
+
+	/**
+	 * mutex held while the thread changes the scene
+	 * @note lock this to change poses from other threads
+	 */
+	std::mutex& scene_mutex() { return scene_mutex_; }
+
+private:
+	void run();
+
+	umdraw::UMScenePtr scene_;
+	umdraw::UMSceneSnapshotBufferPtr buffer_;
+	AcquireFunction acquire_function_;
+	std::thread thread_;
+	std::mutex scene_mutex_;
+	std::atomic<bool> is_running_;
+};
+
+} // qumable
@@ -20,6 +20,7 @@
 #include "UMOpenGLDrawParameter.h"
 #include "UMOpenGLCamera.h"
 #include "UMOpenGLLight.h"
+#include "UMPoseStream.h"
 
 #include <map>
 #include <fstream>
@@ -179,8 +180,29 @@ public:
 		return connection_map_;
 	}
 
+	bool start_recording(const umstring& path);
+
+	void stop_recording()
+	{
+		recorder_ = UMPoseRecorderPtr();
+	}
+
+	bool start_replay(const umstring& path, double fps);
+
+	void stop_replay()
+	{
+		player_ = UMPosePlayerPtr();
+	}
+
+	bool is_replaying() const
+	{
+		return !!player_;
+	}
+
 private:
 	bool init_quma();
+	bool update_from_player();
+	void record_pose();
 	void version();
 	bool load_quma_model();
 	bool load_character();
@@ -223,6 +245,8 @@ private:
 	UMMat44d character_scale_offset_;
 	typedef std::map<umdraw::UMNodePtr, std::string> ConnectionMap;
 	ConnectionMap connection_map_;
+	UMPoseRecorderPtr recorder_;
+	UMPosePlayerPtr player_;
 };
 
 QmPdkModelHandle UMQuma::Impl::model_handle_;
@@ -234,6 +258,7 @@ bool UMQuma::Impl::is_bone_mapping_done_(false);
 bool UMQuma::Impl::update()
 {
 	if (is_loading_) return true;
+	if (player_) return update_from_player();
 	QmPdkErrCode e;
 	QmPdkQumaHandle quma_handle = QMPDK_QUMA_HANDLE_ERROR;
 	QmPdkQumaButtonState state = QMPDK_QUMA_BUTTON_STATE_OFF;
@@ -284,42 +309,94 @@ bool UMQuma::Impl::update()
 							local_mat.m);
 
 						UMNodePtr node = *it;
-						node->mutable_local_transform() = to_double(local_mat);
+						UMMat44d local = to_double(local_mat);
 
 						if (!node->parent())
 						{
 							if (has_user_nodes_)
 							{
-								node->mutable_local_transform() = to_double(local_mat) * character_scale_offset_ ;
+								local = local * character_scale_offset_ ;
 							}
 							else
 							{
-								node->mutable_local_transform() = to_double(local_mat) * scale_offset_;
+								local = local * scale_offset_;
 							}
 						}
+						// only changed nodes are marked dirty
+						scene_->mutable_transform_hierarchy().set_local_transform(i, local);
 					}
 				}
 			
 				// global matrix 更新
-				{
-					UMNodeList::iterator it = scene_->mutable_node_list().begin();
-					for (int i = 0; it != scene_->mutable_node_list().end(); ++it, ++i)
-					{
-						UMMat44d global_mat;
-						UMNodePtr node = *it;
-						for (UMNodePtr n = node; n; n = n->parent())
-						{
-							global_mat = global_mat * n->local_transform();
-						}
-						node->mutable_global_transform() = global_mat;
-					}
-				}
+				scene_->mutable_transform_hierarchy().update();
+				record_pose();
 			}
 		}
 	}
 	return true;
 }
 
+/**
+ * update scene by pose stream
+ */
+bool UMQuma::Impl::update_from_player()
+{
+	if (!scene_ || scene_->node_list().empty()) return false;
+	if (!player_->update()) return true;
+
+	UMTransformHierarchy& hierarchy = scene_->mutable_transform_hierarchy();
+	const int node_count = (std::min)(player_->node_count(), hierarchy.node_count());
+	for (int i = 0; i < node_count; ++i)
+	{
+		hierarchy.set_local_transform(i, player_->local_matrix(i));
+	}
+	hierarchy.update();
+	return true;
+}
+
+/**
+ * write current local matrices to pose stream
+ */
+void UMQuma::Impl::record_pose()
+{
+	if (!recorder_ || !recorder_->is_open()) return;
+	const UMNodeList& node_list = scene_->node_list();
+	for (int i = 0, size = static_cast<int>(node_list.size()); i < size; ++i)
+	{
+		recorder_->set_local_matrix(i, node_list[i]->local_transform());
+	}
+	if (!recorder_->write_frame())
+	{
+		printf("[record_pose()] Error! Could not write pose stream.\n");
+		recorder_ = UMPoseRecorderPtr();
+	}
+}
+
+/**
+ * start recording pose stream
+ */
+bool UMQuma::Impl::start_recording(const umstring& path)
+{
+	if (!scene_ || scene_->node_list().empty()) return false;
+	UMPoseRecorderPtr recorder = std::make_shared<UMPoseRecorder>();
+	if (!recorder->open(path, static_cast<int>(scene_->node_list().size()))) return false;
+	recorder_ = recorder;
+	return true;
+}
+
+/**
+ * start replay pose stream
+ */
+bool UMQuma::Impl::start_replay(const umstring& path, double fps)
+{
+	UMPosePlayerPtr player = std::make_shared<UMPosePlayer>();
+	if (!player->load(path)) return false;
+	player->set_frame_rate(fps);
+	player->set_loop(true);
+	player_ = player;
+	return true;
+}
+
 /**
  * draw
  */ 
@@ -603,19 +680,8 @@ bool UMQuma::Impl::load_character()
 			}
 		}
 		// global matrix 更新
-		{
-			UMNodeList::iterator it = scene_->mutable_node_list().begin();
-			for (int i = 0; it != scene_->mutable_node_list().end(); ++it, ++i)
-			{
-				UMMat44d global_mat;
-				UMNodePtr node = *it;
-				for (UMNodePtr n = node; n; n = n->parent())
-				{
-					global_mat = global_mat * n->local_transform();
-				}
-				node->mutable_global_transform() = global_mat;
-			}
-		}
+		scene_->mutable_transform_hierarchy().build(scene_->node_list());
+		scene_->mutable_transform_hierarchy().update();
 	}
 	else
 	{
@@ -691,16 +757,8 @@ bool UMQuma::Impl::load_character()
 			}
 		}
 		// calc global transform
-		for (size_t i = 0; i < scene_->node_list().size(); ++i) 
-		{
-			UMMat44d global_mat;
-			UMNodePtr node = scene_->mutable_node_list().at(i);
-			for (UMNodePtr n = node; n; n = n->parent())
-			{
-				global_mat = global_mat * n->local_transform();
-			}
-			node->mutable_global_transform() = global_mat;
-		}
+		scene_->mutable_transform_hierarchy().build(scene_->node_list());
+		scene_->mutable_transform_hierarchy().update();
 	}
 	return true;
 }
@@ -1473,4 +1531,44 @@ const std::map<umdraw::UMNodePtr, std::string>& UMQuma::get_connection_map() con
 	return impl_->get_connection_map();
 }
 
+/**
+ * record local matrices of each update to a pose stream file
+ */
+bool UMQuma::start_recording(const std::u16string& path)
+{
+	return impl_->start_recording(path);
+}
+
+/**
+ * stop recording
+ */
+void UMQuma::stop_recording()
+{
+	impl_->stop_recording();
+}
+
+/**
+ * update from a pose stream file instead of QUMA device
+ */
+bool UMQuma::start_replay(const std::u16string& path, double fps)
+{
+	return impl_->start_replay(path, fps);
+}
+
+/**
+ * stop replay and use QUMA device
+ */
+void UMQuma::stop_replay()
+{
+	impl_->stop_replay();
+}
+
+/**
+ * is replaying or not
+ */
+bool UMQuma::is_replaying() const
+{
+	return impl_->is_replaying();
+}
+
 } // qumable
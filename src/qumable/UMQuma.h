@@ -83,6 +83,34 @@ public:
 
 	bool apply_nnb();
 
+	/**
+	 * record local matrices of each update to a pose stream file
+	 */
+	bool start_recording(const std::u16string& path);
+
+	/**
+	 * stop recording
+	 */
+	void stop_recording();
+
+	/**
+	 * update from a pose stream file instead of QUMA device
+	 * @param [in] path pose stream file
+	 * @param [in] fps frames per second. 0 means recorded timing,
+	 * negative means one frame for each update.
+	 */
+	bool start_replay(const std::u16string& path, double fps);
+
+	/**
+	 * stop replay and use QUMA device
+	 */
+	void stop_replay();
+
+	/**
+	 * is replaying or not
+	 */
+	bool is_replaying() const;
+
 	const std::map<umdraw::UMNodePtr, std::string>& get_connection_map() const;
 
 private:
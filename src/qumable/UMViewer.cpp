@@ -21,6 +21,7 @@
 #include "UMGUIScene.h"
 #include "UMLine.h"
 #include "UMGUIObject.h"
+#include "UMSceneLoader.h"
 
 #include <windows.h>
 #include <map>
@@ -48,6 +49,13 @@ int UMViewer::initial_height_(0);
 bool UMViewer::is_disable_update_(false);
 bool UMViewer::is_disable_update_quma_(false);
 bool UMViewer::is_wsio_loaded_(false);
+bool UMViewer::is_pose_thread_stop_requested_(false);
+bool UMViewer::is_draw_enabled_(true);
+bool UMViewer::is_pipelined_(false);
+double UMViewer::frame_dump_interval_(0.0);
+umstring UMViewer::record_pose_path_;
+umstring UMViewer::replay_pose_path_;
+double UMViewer::replay_pose_fps_(0.0);
 GLFWwindow* UMViewer::sub_window_(NULL);
 GLFWwindow* UMViewer::window_(NULL);
 UMScenePtr UMViewer::scene_;
@@ -55,83 +63,14 @@ UMCameraPtr UMViewer::temporary_camera_;
 UMQumaPtr UMViewer::quma_;
 UMMappingGUIPtr UMViewer::gui_scene_;
 int UMViewer::port_;
+int UMViewer::loading_percent_(-1);
 UMViewerPtr UMViewer::viewer_;
 static umwsio::UMWSIOPtr wsio_;
 
 	UMMaterialPtr line_mat;
 
-class UMFileLoadThread
-{
-public:
-	UMFileLoadThread() : is_loaded_(false) {}
-	~UMFileLoadThread() 
-	{
-		if (thread_.joinable())
-		{
-			thread_.join();
-		}
-	}
-
-	void load(
-		GLFWwindow * window,
-		int count,
-		const char** files,
-		UMViewerPtr viewer,
-		umdraw::UMScenePtr scene)
-	{
-		window_ = window;
-		count_ = count > 0 ? 1 : 0;
-		files_ = files;
-		viewer_ = viewer;
-		scene_ = scene;
-		scene_->set_enable_deform(false);
-		thread_ = std::thread([this] { do_(); });
-	}
-
-	void done()
-	{
-		if (thread_.joinable())
-		{
-			thread_.join();
-		}
-		viewer_->file_loaded_callback(window_);
-		window_ = NULL;
-		is_loaded_ = false;
-		count_ = 0;
-		files_ = NULL;
-		scene_->set_enable_deform(true);
-		viewer_ = UMViewerPtr();
-		scene_ = umdraw::UMScenePtr();
-	}
-
-	bool is_loaded() const { return is_loaded_; }
-
-private:
-
-	void do_()
-	{
-		scene_->clear_geometry();
-		for (int i = 0; i < count_; ++i)
-		{
-			printf("%d: '%s'\n", i + 1, files_[i]);
-			std::string utf8path(files_[i]);
-			umstring path = umbase::UMStringUtil::utf8_to_utf16(utf8path);
-			if (scene_->load(path))
-			{
-				is_loaded_ = true;
-			}
-		}
-	}
-	GLFWwindow* window_;
-	std::thread thread_;
-	bool is_loaded_;
-	int count_;
-	const char** files_;
-	UMViewerPtr viewer_;
-	umdraw::UMScenePtr scene_;
-};
-
-static UMFileLoadThread load_thread;
+/// loads dropped files while the current scene is drawn
+static umdraw::UMSceneLoader scene_loader;
 
 bool UMViewer::init(
 	GLFWwindow* window,
@@ -163,6 +102,7 @@ bool UMViewer::init(
 	
 	quma_ = std::make_shared<UMQuma>();
 	if (!quma_ || !quma_->init(scene_)) return false;
+	start_pose_files();
 	gui_scene->set_umdraw_scene(scene);
 	gui_scene->init(UMViewer::initial_width_, UMViewer::initial_height_);
 
@@ -266,12 +206,16 @@ UMViewerPtr UMViewer::create(
 void UMViewer::call_paint()
 {
 	if (!viewer_) return;
+	if (is_pose_thread_stop_requested_)
+	{
+		viewer_->pose_thread_.stop();
+		is_pose_thread_stop_requested_ = false;
+	}
 	viewer_->on_paint();
 
-	if (load_thread.is_loaded())
+	if (scene_loader.state() != UMSceneLoader::eIdle)
 	{
-		load_thread.done();
-		is_disable_update_quma_ = false;
+		update_scene_loader();
 	}
 	if (is_wsio_loaded_)
 	{
@@ -285,6 +229,11 @@ void UMViewer::update(umbase::UMEventType event_type, umbase::UMAny& parameter)
 	if (event_type == umwsio::eWSIOEventModelLoading)
 	{
 		is_disable_update_ = true;
+		// wait for the pose thread to leave the scene. it is stopped on the draw thread.
+		{
+			std::unique_lock<std::mutex> lock = lock_scene();
+		}
+		is_pose_thread_stop_requested_ = true;
 	}
 	else if (event_type == umwsio::eWSIOEventModelLoaded)
 	{
@@ -293,6 +242,7 @@ void UMViewer::update(umbase::UMEventType event_type, umbase::UMAny& parameter)
 	else if (event_type == umwsio::eWSIOEventConnect)
 	{
 		is_disable_update_ = true;
+		std::unique_lock<std::mutex> lock = lock_scene();
 		if (quma_ && quma_->connect())
 		{
 			std::string buffer;
@@ -310,6 +260,7 @@ void UMViewer::update(umbase::UMEventType event_type, umbase::UMAny& parameter)
 	else if (event_type == umwsio::eWSIOEventReconnect)
 	{
 		is_disable_update_ = true;
+		std::unique_lock<std::mutex> lock = lock_scene();
 		if (quma_)
 		{
 			const std::string& data = wsio_->nnb();
@@ -411,6 +362,7 @@ void UMViewer::file_loaded_callback(GLFWwindow * window)
 	
 	quma_ = std::make_shared<UMQuma>();
 	if (!quma_ || !quma_->init(scene_)) return;
+	start_pose_files();
 	gui_scene_->set_umdraw_scene(scene_);
 	gui_scene_->init(initial_width_, initial_height_);
 	
@@ -427,8 +379,43 @@ void UMViewer::file_loaded_callback(GLFWwindow * window)
 
 void UMViewer::drop_files_callback(GLFWwindow * window, int count, const char** files)
 {
-	is_disable_update_quma_ = true;
-	load_thread.load(window, count, files, viewer_, scene_);
+	if (count <= 0 || !scene_) return;
+	printf("1: '%s'\n", files[0]);
+	std::string utf8path(files[0]);
+	umstring path = umbase::UMStringUtil::utf8_to_utf16(utf8path);
+	// a previous drop still loading is canceled
+	scene_loader.start(path, scene_->width(), scene_->height());
+}
+
+/**
+ * show progress of the scene loader and swap the loaded scene in
+ */
+void UMViewer::update_scene_loader()
+{
+	const int percent = static_cast<int>(scene_loader.progress() * 100.0);
+	if (percent != loading_percent_)
+	{
+		loading_percent_ = percent;
+		char title[64];
+		sprintf(title, "qumable - loading %d%%", percent);
+		glfwSetWindowTitle(window_, title);
+	}
+	if (!scene_loader.update())
+	{
+		if (scene_loader.state() != UMSceneLoader::eFailed) return;
+		printf("failed to load\n");
+		scene_loader.take_scene();
+	}
+	else if (UMScenePtr staging = scene_loader.take_scene())
+	{
+		// stops the pose thread before the geometry is swapped.
+		// the view is closed and recreated by file_loaded_callback.
+		viewer_->pose_thread_.stop();
+		scene_->replace_geometry(*staging);
+		viewer_->file_loaded_callback(window_);
+	}
+	loading_percent_ = -1;
+	glfwSetWindowTitle(window_, "qumable");
 }
 
 UMDraw::DrawType UMViewer::draw_type()
@@ -438,6 +425,64 @@ UMDraw::DrawType UMViewer::draw_type()
 	return viewer_->drawer_->draw_type();
 }
 
+void UMViewer::set_draw_enabled(bool enabled)
+{
+	is_draw_enabled_ = enabled;
+}
+
+void UMViewer::set_frame_dump_interval(double seconds)
+{
+	frame_dump_interval_ = seconds;
+	if (viewer_ && viewer_->frame_pipeline_)
+	{
+		viewer_->frame_pipeline_->set_dump_interval(seconds);
+	}
+}
+
+void UMViewer::set_pipelined(bool pipelined)
+{
+	is_pipelined_ = pipelined;
+}
+
+void UMViewer::set_pose_recording(const umstring& path)
+{
+	record_pose_path_ = path;
+}
+
+void UMViewer::set_pose_replay(const umstring& path, double fps)
+{
+	replay_pose_path_ = path;
+	replay_pose_fps_ = fps;
+}
+
+/**
+ * start recording and replay of pose stream files on the current quma
+ */
+void UMViewer::start_pose_files()
+{
+	if (!quma_) return;
+	if (!replay_pose_path_.empty())
+	{
+		if (!quma_->start_replay(replay_pose_path_, replay_pose_fps_))
+		{
+			printf("failed to replay %s\n", umbase::UMStringUtil::utf16_to_utf8(replay_pose_path_).c_str());
+		}
+	}
+	if (!record_pose_path_.empty())
+	{
+		if (!quma_->start_recording(record_pose_path_))
+		{
+			printf("failed to record %s\n", umbase::UMStringUtil::utf16_to_utf8(record_pose_path_).c_str());
+		}
+	}
+}
+
+UMFramePipelinePtr UMViewer::frame_pipeline()
+{
+	if (!viewer_) return UMFramePipelinePtr();
+	return viewer_->frame_pipeline_;
+}
+
 /**
  * constructor
  */
@@ -446,9 +491,6 @@ UMViewer::UMViewer(UMDrawPtr drawer, UMGUIPtr gui)
 	, pre_y_(0.0)
 	, current_x_(0.0)
 	, current_y_(0.0)
-	, current_frames_(0)
-	, fps_base_time_(timeGetTime())
-	, motion_base_time_(timeGetTime())
 	, is_left_button_down_(false)
 	, is_right_button_down_(false)
 	, is_ctrl_button_down_(false)
@@ -456,6 +498,7 @@ UMViewer::UMViewer(UMDrawPtr drawer, UMGUIPtr gui)
 	, is_alt_down_(false)
 	, is_shift_down_(false)
 	, is_gui_drawing_(false)
+	, is_drawer_updated_(false)
 	, drawer_(drawer)
 	, gui_(gui)
 	, current_seconds_(0.0)
@@ -467,47 +510,86 @@ UMViewer::UMViewer(UMDrawPtr drawer, UMGUIPtr gui)
 		rt_->add_scene(scene_);
 		rt_->add_pick_node_list(scene_);
 	}
+	create_frame_pipeline();
 }
 
 /**
- * refresh frame
+ * create stages of a frame
  */
-bool UMViewer::on_paint()
+void UMViewer::create_frame_pipeline()
 {
-	if (is_disable_update_) return true;
-	
-	++current_frames_;
-	unsigned long current_time = static_cast<unsigned long>(timeGetTime());
-	unsigned long time_from_fps_base = current_time - fps_base_time_;
-	unsigned long time_from_motion_base = current_time - motion_base_time_;
-	if (time_from_fps_base > 1000)
-	{
-		int fps = (current_frames_ * 1000) / time_from_fps_base;
-		fps_base_time_ = current_time;
-		current_frames_ = 0;
-		//printf("fps %d \n", fps);
+	frame_pipeline_ = std::make_shared<UMFramePipeline>(600);
+	frame_pipeline_->set_dump_interval(frame_dump_interval_);
+	frame_pipeline_->add_stage("clear", [this]() {
+		return !is_draw_enabled_ || drawer_->clear();
+	});
+	// only the OpenGL scene takes deformed meshes from snapshots of the pose thread
+	if (is_pipelined_ && drawer_->draw_type() == UMDraw::eOpenGL)
+	{
+		// quma and publish run on the pose thread, one frame ahead of update and draw
+		pose_thread_.start(scene_, []() -> bool {
+			// scene is being replaced or quma is disconnecting
+			if (is_disable_update_) return false;
+			if (!is_disable_update_quma_ && quma_)
+			{
+				quma_->update();
+			}
+			if (wsio_)
+			{
+				wsio_->publish_pose();
+			}
+			return true;
+		});
 	}
-
-	if (drawer_->clear())
+	else
 	{
-		if (!is_disable_update_quma_)
-		{
-			quma_->update();
-		}
-		if (drawer_->update())
+		frame_pipeline_->add_stage("quma", [this]() {
+			if (!is_disable_update_quma_)
+			{
+				quma_->update();
+			}
+			return true;
+		});
+		frame_pipeline_->add_stage("publish", [this]() {
+			if (wsio_)
+			{
+				wsio_->publish_pose();
+			}
+			return true;
+		});
+	}
+	frame_pipeline_->add_stage("update", [this]() {
+		is_drawer_updated_ = drawer_->update();
+		return true;
+	});
+	frame_pipeline_->add_stage("draw", [this]() {
+		if (is_draw_enabled_ && is_drawer_updated_)
 		{
 			drawer_->draw();
 		}
+		return true;
+	});
+	frame_pipeline_->add_stage("gui", [this]() {
 		if (gui_ && gui_->update())
 		{
-			if (is_gui_drawing_)
+			if (is_draw_enabled_ && is_gui_drawing_)
 			{
 				gui_->draw();
 			}
 		}
 		return true;
-	}
-	return false;
+	});
+}
+
+/**
+ * refresh frame
+ */
+bool UMViewer::on_paint()
+{
+	if (is_disable_update_) return true;
+	
+	// clear, quma, publish, update, draw, gui
+	return frame_pipeline_->run_frame();
 }
 
 /**
@@ -637,10 +719,12 @@ void UMViewer::on_keyboard(GLFWwindow * window,int key, int action)
 	
 	if (is_ctrl_button_down_ && key == GLFW_KEY_S && action == GLFW_PRESS)
 	{
+		std::unique_lock<std::mutex> lock = lock_scene();
 		quma_->save_nnb(std::u16string());
 	}
 	if (is_ctrl_button_down_ && key == GLFW_KEY_C && action == GLFW_PRESS)
 	{
+		std::unique_lock<std::mutex> lock = lock_scene();
 		quma_->connect();
 	}
 }
@@ -692,8 +776,42 @@ void UMViewer::on_mouse(GLFWwindow * window, int button, int action)
 	}
 }
 
+/**
+ * lock the scene against the pose thread
+ * @note returns an empty lock if the pose thread is not running
+ */
+std::unique_lock<std::mutex> UMViewer::lock_scene()
+{
+	if (pose_thread_.is_running())
+	{
+		return std::unique_lock<std::mutex>(pose_thread_.scene_mutex());
+	}
+	return std::unique_lock<std::mutex>();
+}
+
+/**
+ * update rays to the current pose
+ * @note call with the scene locked
+ */
+void UMViewer::update_rt()
+{
+	if (!rt_) return;
+	if (scene_->is_enable_deform())
+	{
+		// bvhs are refit to the meshes changed since last update
+		rt_->update_scene();
+	}
+	else
+	{
+		// meshes are moved by their nodes only
+		rt_->update_transforms();
+	}
+}
+
 void UMViewer::pick_bone()
 {
+	std::unique_lock<std::mutex> lock = lock_scene();
+	update_rt();
 	UMNodePtr node = rt_->pick(current_x_, scene_->height() - current_y_);
 	if (node)
 	{
@@ -725,6 +843,7 @@ void UMViewer::unpick_bone()
 {
 	if (!scene_) return;
 	if (!pick_node_) return;
+	std::unique_lock<std::mutex> lock = lock_scene();
 
 	std::u16string controller_name;
 	gui_scene_->get_picked_bone_controller_name(controller_name);
@@ -884,6 +1003,7 @@ void UMViewer::on_resize(GLFWwindow *, int width, int height)
 
 void UMViewer::close_view()
 {
+	pose_thread_.stop();
 	gui_ = UMGUIPtr();
 	drawer_ = UMDrawPtr();
 }
@@ -893,6 +1013,7 @@ void UMViewer::close_view()
  */
 void UMViewer::on_close(GLFWwindow * window)
 {
+	pose_thread_.stop();
 	if (gui_) { gui_->dispose(); }
 	quma_ = UMQumaPtr();
 	gui_ = UMGUIPtr();
@@ -17,6 +17,9 @@
 #include "UMRT.h"
 #include "UMEvent.h"
 #include "UMListener.h"
+#include "UMFramePipeline.h"
+#include "UMPoseThread.h"
+#include <mutex>
 
 struct GLFWwindow;
 
@@ -93,6 +96,42 @@ public:
 	 * get current draw type
 	 */
 	static umdraw::UMDraw::DrawType draw_type();
+
+	/**
+	 * enable or disable draw and gui stages
+	 * @note update stages run even if disabled
+	 */
+	static void set_draw_enabled(bool enabled);
+
+	/**
+	 * print frame latencies periodically
+	 * @param [in] seconds interval. 0 disables.
+	 */
+	static void set_frame_dump_interval(double seconds);
+
+	/**
+	 * acquire pose and deform on a thread while drawing
+	 * @note applied to OpenGL viewers created after this call
+	 */
+	static void set_pipelined(bool pipelined);
+
+	/**
+	 * record poses of QUMA to a pose stream file
+	 * @note started for each loaded model. call before init.
+	 */
+	static void set_pose_recording(const umstring& path);
+
+	/**
+	 * replay poses from a pose stream file instead of QUMA
+	 * @param [in] fps frames per second. 0 means recorded timing
+	 * @note started for each loaded model. call before init.
+	 */
+	static void set_pose_replay(const umstring& path, double fps);
+
+	/**
+	 * get frame pipeline of the current viewer
+	 */
+	static UMFramePipelinePtr frame_pipeline();
 	
 	/**
 	 *
@@ -161,9 +200,17 @@ private:
 	static int width_;
 	static int height_;
 	static int port_;
+	static int loading_percent_;
 	static bool is_disable_update_;
 	static bool is_disable_update_quma_;
 	static bool is_wsio_loaded_;
+	static bool is_pose_thread_stop_requested_;
+	static bool is_draw_enabled_;
+	static bool is_pipelined_;
+	static double frame_dump_interval_;
+	static umstring record_pose_path_;
+	static umstring replay_pose_path_;
+	static double replay_pose_fps_;
 	static umdraw::UMScenePtr scene_;
 	static umdraw::UMCameraPtr temporary_camera_;
 	static UMMappingGUIPtr gui_scene_;
@@ -177,9 +224,6 @@ private:
 	double current_x_;
 	double current_y_;
 	double current_seconds_;
-	unsigned long fps_base_time_;
-	unsigned long motion_base_time_;
-	unsigned long current_frames_;
 	bool is_ctrl_button_down_;
 	bool is_left_button_down_;
 	bool is_right_button_down_;
@@ -187,11 +231,19 @@ private:
 	bool is_alt_down_;
 	bool is_shift_down_;
 	bool is_gui_drawing_;
+	bool is_drawer_updated_;
+	UMFramePipelinePtr frame_pipeline_;
+	UMPoseThread pose_thread_;
 	umdraw::UMDrawPtr drawer_;
 	umgui::UMGUIPtr gui_;
 	umrt::UMRTPtr rt_;
 	umdraw::UMNodePtr pick_node_;
 
+	static void update_scene_loader();
+	static void start_pose_files();
+	void create_frame_pipeline();
+	std::unique_lock<std::mutex> lock_scene();
+	void update_rt();
 	void pick_bone();
 	void on_pick_bone();
 	void unpick_bone();
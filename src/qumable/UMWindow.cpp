@@ -23,8 +23,12 @@
 #include "UMFont.h"
 #include "UMStringUtil.h"
 #include "UMTga.h"
+#include "UMPoseBenchmark.h"
+#include "UMRayBenchmark.h"
 #include <GL/glfw3.h>
 #include <GL/glfw3native.h>
+#include <string>
+#include <algorithm>
 
 
 namespace qumable
@@ -113,19 +117,22 @@ static umdraw::UMScenePtr create_initial_scene(int width, int height)
 		// load shader
 		{
 			umdraw::UMShaderEntry& entry = umdraw::UMShaderEntry::instance();
-			entry.set_gl_vertex_shader(UMResource::find_resource_data(resource, ("UMModelShader.vs")));
-			entry.set_gl_fragment_shader(UMResource::find_resource_data(resource, ("UMModelShader.fs")));
-			entry.set_gl_point_vertex_shader(UMResource::find_resource_data(resource, ("UMPointShader.vs")));
-			entry.set_gl_point_fragment_shader(UMResource::find_resource_data(resource, ("UMPointShader.fs")));
-			entry.set_gl_board_vertex_shader(UMResource::find_resource_data(resource, ("UMBoardShader.vs")));
-			entry.set_gl_board_fragment_shader(UMResource::find_resource_data(resource, ("UMBoardShader.fs")));
+			entry.set_gl_vertex_shader(resource.find_resource_memory("UMModelShader.vs").to_string());
+			entry.set_gl_fragment_shader(resource.find_resource_memory("UMModelShader.fs").to_string());
+			entry.set_gl_point_vertex_shader(resource.find_resource_memory("UMPointShader.vs").to_string());
+			entry.set_gl_point_fragment_shader(resource.find_resource_memory("UMPointShader.fs").to_string());
+			entry.set_gl_board_vertex_shader(resource.find_resource_memory("UMBoardShader.vs").to_string());
+			entry.set_gl_board_fragment_shader(resource.find_resource_memory("UMBoardShader.fs").to_string());
 		}
 
 		if (const umimage::UMFont* font = umimage::UMFont::instance())
 		{
+			// the font refers to the memory of the resource
+			const UMResource::Memory font_memory = resource.find_resource_memory("KodomoRounded.ttf");
 			if (font->load_font_from_memory(
 				umbase::UMStringUtil::utf8_to_utf16("KodomoRounded"), 
-				UMResource::find_resource_data(resource, ("KodomoRounded.ttf"))))
+				font_memory.data,
+				font_memory.size))
 			{
 				std::cout << "font load success!" << std::endl;
 			}
@@ -355,6 +362,41 @@ static void glewInfo()
  */
 int UMWindow::main(int argc, char** argv)
 {
+	// qumable --pose-benchmark model_file pose_file [repeat_count]
+	if (argc > 3 && std::string(argv[1]) == "--pose-benchmark")
+	{
+		UMPoseBenchmark::Result result;
+		const int repeat_count = argc > 4 ? atoi(argv[4]) : 1;
+		if (!UMPoseBenchmark::run(
+			result,
+			umbase::UMStringUtil::utf8_to_utf16(argv[2]),
+			umbase::UMStringUtil::utf8_to_utf16(argv[3]),
+			(std::max)(repeat_count, 1)))
+		{
+			printf("pose benchmark failed\n");
+			return EXIT_FAILURE;
+		}
+		UMPoseBenchmark::print(result);
+		return EXIT_SUCCESS;
+	}
+
+	// qumable --rt-benchmark model_file [repeat_count]
+	if (argc > 2 && std::string(argv[1]) == "--rt-benchmark")
+	{
+		umrt::UMRayBenchmark::Result result;
+		const int repeat_count = argc > 3 ? atoi(argv[3]) : 1;
+		if (!umrt::UMRayBenchmark::run(
+			result,
+			umbase::UMStringUtil::utf8_to_utf16(argv[2]),
+			(std::max)(repeat_count, 1)))
+		{
+			printf("rt benchmark failed\n");
+			return EXIT_FAILURE;
+		}
+		umrt::UMRayBenchmark::print(result);
+		return EXIT_SUCCESS;
+	}
+
 	//FreeConsole();
 	if (!glfwInit()) {
 		exit( EXIT_FAILURE );
@@ -367,9 +409,75 @@ int UMWindow::main(int argc, char** argv)
 	//glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	//glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	//glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	// qumable [port] [--offscreen frame_count] [--no-draw] [--frame-dump seconds] [--pipelined]
+	//         [--record-pose pose_file] [--replay-pose pose_file [fps]] [--distance-field-font]
 	int port = 9002;
-	if (argc > 1) {
-		port = atoi(argv[1]);
+	int frame_limit = 0;
+	bool is_offscreen = false;
+	bool is_draw_enabled = true;
+	double frame_dump_interval = 0.0;
+	bool is_pipelined = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg(argv[i]);
+		if (arg == "--offscreen" && (i + 1) < argc)
+		{
+			is_offscreen = true;
+			frame_limit = atoi(argv[++i]);
+		}
+		else if (arg == "--no-draw")
+		{
+			is_draw_enabled = false;
+		}
+		else if (arg == "--frame-dump" && (i + 1) < argc)
+		{
+			frame_dump_interval = atof(argv[++i]);
+		}
+		else if (arg == "--pipelined")
+		{
+			is_pipelined = true;
+		}
+		else if (arg == "--distance-field-font")
+		{
+			// one glyph atlas for all text sizes of the gui
+			if (const umimage::UMFont* font = umimage::UMFont::instance())
+			{
+				font->set_distance_field_enabled(true);
+			}
+		}
+		else if (arg == "--record-pose" && (i + 1) < argc)
+		{
+			UMViewer::set_pose_recording(umbase::UMStringUtil::utf8_to_utf16(argv[++i]));
+		}
+		else if (arg == "--replay-pose" && (i + 1) < argc)
+		{
+			const umstring path = umbase::UMStringUtil::utf8_to_utf16(argv[++i]);
+			// fps is optional
+			double fps = 0.0;
+			if ((i + 1) < argc)
+			{
+				char* end = NULL;
+				const double value = strtod(argv[i + 1], &end);
+				if (end != argv[i + 1] && *end == '\0')
+				{
+					fps = value;
+					++i;
+				}
+			}
+			UMViewer::set_pose_replay(path, fps);
+		}
+		else if (i == 1)
+		{
+			port = atoi(argv[i]);
+		}
+	}
+	// pose acquisition runs on a thread one frame ahead of drawing
+	UMViewer::set_pipelined(is_pipelined);
+
+	// offscreen window keeps a GL context without showing it
+	if (is_offscreen)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
 	}
 
 	// create main window
@@ -428,15 +536,27 @@ int UMWindow::main(int argc, char** argv)
 			}
 		}
 	}
-	glfwSwapInterval(1);
+	UMViewer::set_draw_enabled(is_draw_enabled);
+	UMViewer::set_frame_dump_interval(frame_dump_interval);
+	// offscreen frames are not limited by vsync
+	glfwSwapInterval(is_offscreen ? 0 : 1);
 
 	// main loop
-	for (;;) 
+	for (int frame = 0; ; ++frame) 
 	{
+		if (frame_limit > 0 && frame >= frame_limit)
+		{
+			if (UMFramePipelinePtr pipeline = UMViewer::frame_pipeline())
+			{
+				pipeline->print();
+			}
+			break;
+		}
+
 		// draw
 		UMViewer::call_paint();
 
-		if (UMViewer::draw_type() == umdraw::UMDraw::eOpenGL)
+		if (UMViewer::draw_type() == umdraw::UMDraw::eOpenGL && is_draw_enabled)
 		{
 			glfwSwapBuffers(window);
 		}
@@ -13,6 +13,7 @@
 #include <vector>
 #include <fstream>
 #include <iostream>
+#include <stdio.h>
 #include <snappy.h>
 #include <exception>
 #include <assert.h>
@@ -45,7 +46,24 @@ int main()
 	
 	umstring out_file = resource_path("cabbage_resource.pack");
 
-	umresource::UMResource::instance().pack(out_file, files);
+	umresource::UMResource::PackStatList stat_list;
+	if (!umresource::UMResource::instance().pack(out_file, files, &stat_list))
+	{
+		std::cout << "pack failed" << std::endl;
+		return 1;
+	}
+	for (size_t i = 0; i < stat_list.size(); ++i)
+	{
+		const umresource::UMResource::PackStat& stat = stat_list[i];
+		const double ratio = stat.size > 0 ? (100.0 * stat.packed_size / stat.size) : 100.0;
+		printf("%-24s %10u -> %10u (%5.1f%%) %8.3f ms%s\n",
+			UMStringUtil::utf16_to_utf8(stat.name).c_str(),
+			stat.size,
+			stat.packed_size,
+			ratio,
+			stat.milliseconds,
+			stat.is_unchanged ? " unchanged" : "");
+	}
 
 	// unpack test
 	umresource::UMResource::instance().unpack_to_memory(out_file);
@@ -0,0 +1,166 @@
+/**
+ * @file UMThreadPool.cpp
+ * persistent worker threads
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMThreadPool.h"
+
+#include <algorithm>
+
+namespace umbase
+{
+
+/**
+ * constructor
+ */
+UMThreadPool::UMThreadPool(unsigned int thread_count)
+	: thread_count_(1)
+#if !defined(WITH_EMSCRIPTEN)
+	, generation_(0)
+	, active_count_(0)
+	, running_count_(0)
+	, is_stopped_(false)
+#endif // !defined(WITH_EMSCRIPTEN)
+{
+#if !defined(WITH_EMSCRIPTEN)
+	is_running_ = false;
+	if (thread_count == 0)
+	{
+		thread_count = std::thread::hardware_concurrency();
+	}
+	thread_count_ = (std::max)(static_cast<int>(thread_count), 1);
+	threads_.reserve(thread_count_ - 1);
+	for (int i = 1; i < thread_count_; ++i)
+	{
+		threads_.push_back(std::thread(&UMThreadPool::work, this, i));
+	}
+#endif // !defined(WITH_EMSCRIPTEN)
+}
+
+/**
+ * destructor
+ */
+UMThreadPool::~UMThreadPool()
+{
+#if !defined(WITH_EMSCRIPTEN)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		is_stopped_ = true;
+	}
+	start_condition_.notify_all();
+	for (size_t i = 0; i < threads_.size(); ++i)
+	{
+		threads_[i].join();
+	}
+#endif // !defined(WITH_EMSCRIPTEN)
+}
+
+/**
+ * run function on workers and wait for all of them
+ */
+void UMThreadPool::run(int worker_count, const WorkerFunction& function)
+{
+	if (worker_count <= 0) return;
+#if !defined(WITH_EMSCRIPTEN)
+	worker_count = (std::min)(worker_count, thread_count_);
+	bool expected = false;
+	if (worker_count > 1 && is_running_.compare_exchange_strong(expected, true))
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			function_ = function;
+			active_count_ = worker_count;
+			running_count_ = worker_count - 1;
+			++generation_;
+		}
+		start_condition_.notify_all();
+		function(0);
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (running_count_ > 0)
+			{
+				done_condition_.wait(lock);
+			}
+			function_ = WorkerFunction();
+		}
+		is_running_ = false;
+		return;
+	}
+#endif // !defined(WITH_EMSCRIPTEN)
+	function(0);
+}
+
+/**
+ * run function(index) for each index in [0, count)
+ */
+void UMThreadPool::parallel_for(int count, const std::function<void (int)>& function)
+{
+	if (count <= 0) return;
+#if !defined(WITH_EMSCRIPTEN)
+	std::atomic<int> next(0);
+	run(count, [&](int) {
+		for (int i = next++; i < count; i = next++)
+		{
+			function(i);
+		}
+	});
+#else
+	for (int i = 0; i < count; ++i)
+	{
+		function(i);
+	}
+#endif // !defined(WITH_EMSCRIPTEN)
+}
+
+/**
+ * run function(begin, end) for ranges of [0, count)
+ */
+void UMThreadPool::parallel_for_range(int count, int min_range_count, const std::function<void (int, int)>& function)
+{
+	if (count <= 0) return;
+	const int range_count = (std::max)((std::min)(thread_count_, count / (std::max)(min_range_count, 1)), 1);
+	const int range = (count + range_count - 1) / range_count;
+	parallel_for(range_count, [&](int index) {
+		const int begin = (std::min)(index * range, count);
+		const int end = (std::min)(begin + range, count);
+		if (begin < end) function(begin, end);
+	});
+}
+
+#if !defined(WITH_EMSCRIPTEN)
+/**
+ * worker thread loop
+ */
+void UMThreadPool::work(int worker_index)
+{
+	unsigned int generation = 0;
+	for (;;)
+	{
+		WorkerFunction function;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (!is_stopped_ && generation == generation_)
+			{
+				start_condition_.wait(lock);
+			}
+			if (is_stopped_) return;
+			generation = generation_;
+			if (worker_index >= active_count_) continue;
+			function = function_;
+		}
+		function(worker_index);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			--running_count_;
+		}
+		done_condition_.notify_all();
+	}
+}
+#endif // !defined(WITH_EMSCRIPTEN)
+
+} // umbase
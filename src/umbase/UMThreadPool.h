@@ -0,0 +1,106 @@
+/**
+ * @file UMThreadPool.h
+ * persistent worker threads
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include "UMMacro.h"
+
+#if !defined(WITH_EMSCRIPTEN)
+	#include <thread>
+	#include <mutex>
+	#include <condition_variable>
+	#include <atomic>
+#endif
+
+namespace umbase
+{
+
+class UMThreadPool;
+typedef std::shared_ptr<UMThreadPool> UMThreadPoolPtr;
+
+/**
+ * worker threads which are created once and reused by each run
+ * @note the calling thread works as worker 0.
+ * a run while another run is in progress (from other threads or nested in a worker)
+ * is done only by the calling thread.
+ */
+class UMThreadPool
+{
+	DISALLOW_COPY_AND_ASSIGN(UMThreadPool);
+public:
+	/**
+	 * worker function
+	 * @param [in] worker_index 0 is the calling thread
+	 * @note workers share the work and take it until none is left,
+	 * since fewer workers than requested may be run.
+	 */
+	typedef std::function<void (int worker_index)> WorkerFunction;
+
+	/**
+	 * constructor
+	 * @param [in] thread_count worker count including the calling thread. 0 means hardware concurrency
+	 */
+	explicit UMThreadPool(unsigned int thread_count);
+
+	~UMThreadPool();
+
+	/**
+	 * get shared pool sized to hardware concurrency
+	 */
+	static UMThreadPool& instance() {
+		static UMThreadPool instance_(0);
+		return instance_;
+	}
+
+	/**
+	 * get worker count including the calling thread
+	 */
+	int thread_count() const { return thread_count_; }
+
+	/**
+	 * run function on workers and wait for all of them
+	 * @param [in] worker_count workers to run. clamped to thread_count()
+	 */
+	void run(int worker_count, const WorkerFunction& function);
+
+	/**
+	 * run function(index) for each index in [0, count) and wait for all of them
+	 * @note indices are taken one by one from a shared counter
+	 */
+	void parallel_for(int count, const std::function<void (int)>& function);
+
+	/**
+	 * run function(begin, end) for ranges of [0, count) and wait for all of them
+	 * @param [in] min_range_count items less than this are not split
+	 */
+	void parallel_for_range(int count, int min_range_count, const std::function<void (int, int)>& function);
+
+private:
+	int thread_count_;
+#if !defined(WITH_EMSCRIPTEN)
+	void work(int worker_index);
+
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable start_condition_;
+	std::condition_variable done_condition_;
+	WorkerFunction function_;
+	unsigned int generation_;
+	int active_count_;
+	int running_count_;
+	bool is_stopped_;
+	std::atomic<bool> is_running_;
+#endif // !defined(WITH_EMSCRIPTEN)
+};
+
+} // umbase
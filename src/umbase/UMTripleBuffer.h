@@ -0,0 +1,114 @@
+/**
+ * @file UMTripleBuffer.h
+ * hands off values from a producer thread to a consumer thread
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include "UMMacro.h"
+
+namespace umbase
+{
+
+/**
+ * triple buffer
+ * @note producer writes back() and publish(), consumer acquire() and reads front().
+ * buffers are reused, so each side must rewrite what it uses.
+ */
+template <class T>
+class UMTripleBuffer
+{
+	DISALLOW_COPY_AND_ASSIGN(UMTripleBuffer);
+public:
+	UMTripleBuffer()
+		: back_(0)
+		, middle_(1)
+		, front_(2)
+		, is_fresh_(false)
+		, is_stopped_(false)
+	{}
+
+	~UMTripleBuffer() {}
+
+	/**
+	 * get buffer which the producer writes
+	 */
+	T& back() { return buffers_[back_]; }
+
+	/**
+	 * publish back() to the consumer
+	 * @note a published buffer which is not acquired yet is overwritten
+	 */
+	void publish()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::swap(back_, middle_);
+		is_fresh_ = true;
+	}
+
+	/**
+	 * get the last published buffer as front()
+	 * @retval false if nothing is published since the last acquire
+	 */
+	bool acquire()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!is_fresh_) return false;
+			std::swap(front_, middle_);
+			is_fresh_ = false;
+		}
+		condition_.notify_all();
+		return true;
+	}
+
+	/**
+	 * get buffer which the consumer reads
+	 */
+	const T& front() const { return buffers_[front_]; }
+
+	/**
+	 * wait until the published buffer is acquired
+	 * @retval false if stopped
+	 */
+	bool wait_acquired()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (is_fresh_ && !is_stopped_)
+		{
+			condition_.wait(lock);
+		}
+		return !is_stopped_;
+	}
+
+	/**
+	 * wake up and stop wait_acquired
+	 */
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			is_stopped_ = true;
+		}
+		condition_.notify_all();
+	}
+
+private:
+	T buffers_[3];
+	int back_;
+	int middle_;
+	int front_;
+	bool is_fresh_;
+	bool is_stopped_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+};
+
+} // umbase
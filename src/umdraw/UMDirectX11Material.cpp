@@ -58,6 +58,7 @@ bool UMDirectX11Material::init(ID3D11Device *device_pointer)
 		set_ambient(to_dx(material->ambient()));
 		set_diffuse(to_dx(material->diffuse()));
 		set_specular(to_dx(material->specular()));
+		shader_flags_.z = static_cast<float>(material->distance_field_edge());
 
 		UMMaterial::TexturePathList::const_iterator it = material->texture_path_list().begin();
 		for (; it != material->texture_path_list().end(); ++it)
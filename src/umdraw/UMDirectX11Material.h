@@ -107,13 +107,13 @@ public:
 
 	/**
 	 * get shader flags
-	 * @note x is uvflag, yzw not defined now
+	 * @note x is uvflag, y is constant color, z is distance field edge, w not defined now
 	 */
 	const UMVec4f shader_flags() const { return shader_flags_; }
 
 	/** 
 	 * set shader flags
-	 * @note x is uvflag, yzw not defined now
+	 * @note x is uvflag, y is constant color, z is distance field edge, w not defined now
 	 */
 	void set_shader_flags(const UMVec4f& flags) { shader_flags_ = flags; }
 
@@ -132,8 +132,8 @@ void UMDirectX11Mesh::draw(ID3D11Device* device_pointer, umdraw::UMDirectX11Draw
 			if (material->diffuse_texture() && 
 				material->diffuse_texture()->sampler_state_pointer())
 			{
-				// uv on
-				material->set_shader_flags(UMVec4f(1.0f, 0.0f, 0.0f, 0.0f));
+				// uv on. keeps distance field edge
+				material->set_shader_flags(UMVec4f(1.0f, 0.0f, material->shader_flags().z, 0.0f));
 			}
 			else
 			{
@@ -389,7 +389,7 @@ public:
 					const int pos = y * width * 4 + x * 4;
 					if (desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM)
 					{
-						const UMVec4d& color = image.list()[ (height-y-1) * width + x ];
+						const UMVec4d color = image.pixel(x, height-y-1);
 						data_pointer[ pos + 0 ] = static_cast<int>(pow(color.x, inv_gamma) * 0xFF + 0.5);
 						data_pointer[ pos + 1 ] = static_cast<int>(pow(color.y, inv_gamma) * 0xFF + 0.5);
 						data_pointer[ pos + 2 ] = static_cast<int>(pow(color.z, inv_gamma) * 0xFF + 0.5);
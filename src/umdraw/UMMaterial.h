@@ -49,7 +49,8 @@ public:
 		diffuse_factor_(0.0), 
 		specular_factor_(0.0),
 		emissive_factor_(0.0),
-		ambient_factor_(0.0)
+		ambient_factor_(0.0),
+		distance_field_edge_(0.0)
 	{}
 
 	~UMMaterial() {}
@@ -113,6 +114,18 @@ public:
 	 * set polygon count
 	 */
 	void set_polygon_count(int count) { polygon_count_ = count; }
+
+	/**
+	 * get alpha range around the edge of a distance field texture
+	 * @retval 0 if the texture alpha is not a distance field
+	 */
+	double distance_field_edge() const { return distance_field_edge_; }
+
+	/**
+	 * set alpha range around the edge of a distance field texture
+	 * @note alpha of the texture is smoothed in (0.5 - edge, 0.5 + edge).
+	 */
+	void set_distance_field_edge(double edge) { distance_field_edge_ = edge; }
 private:
 	umstring name_;
 	UMVec4d ambient_;
@@ -128,6 +141,7 @@ private:
 	double specular_factor_;
 	double emissive_factor_;
 	double ambient_factor_;
+	double distance_field_edge_;
 
 	TextureList texture_list_;
 	TexturePathList texture_path_list_;
@@ -132,19 +132,6 @@ void UMMesh::update()
 	{
 		original_normal_list_ = normal_list_;
 	}
-	if (vertex_index_to_face_index_map_.empty())
-	{
-		const int fsize = static_cast<int>(face_list_.size());
-		for (int i = 0; i < fsize; ++i)
-		{
-			const UMVec3i& face = face_list_.at(i);
-			for (int k = 0; k < 3; ++k)
-			{
-				IndexPairList& pair_list = vertex_index_to_face_index_map_[face[k]];
-				pair_list.push_back(IndexPair(i, k));
-			}
-		}
-	}
 	
 	vertex_list_.clear();
 	vertex_list_.resize(original_vertex_list_.size());
@@ -156,6 +143,7 @@ void UMMesh::update()
 		// no skin
 		const UMMat44d& global_transform = UMNode::global_transform();
 		const UMMat44d& initial_global_transform = UMNode::initial_global_transform();
+		const UMMat44d initial_global_transform_inv = initial_global_transform.inverted();
 		UMMat44d global_rot = global_transform;
 		global_rot.m[3][0] = global_rot.m[3][1] = global_rot.m[3][2] = 0.0;
 		UMMat44d initial_global_rot = initial_global_transform;
@@ -164,70 +152,24 @@ void UMMesh::update()
 
 		for (int i = 0, isize = static_cast<int>(original_vertex_list_.size()); i < isize; ++i)
 		{
-			const UMVec3d& v = initial_global_transform.inverted() * original_vertex_list_[i];
+			const UMVec3d& v = initial_global_transform_inv * original_vertex_list_[i];
 			vertex_list_.at(i) = global_transform * v;
 		}
 		for (int i = 0, isize = static_cast<int>(original_normal_list_.size()); i < isize; ++i)
 		{
 			const UMVec3d& n = initial_global_rot_inv * original_normal_list_[i];
- 			normal_list_[i] = global_rot * n;
+ 			normal_list_[i] = (global_rot * n).normalized();
 		}
 	}
 	else
 	{
 		// skin deform
-		UMSkinList::iterator it = skin_list_.begin();
-		for (; it != skin_list_.end(); ++it)
-		{
-			UMSkin& skin = *it;
-			UMNodePtr link = skin.link_node();
-			if (link)
-			{
-				const UMMat44d& global_transform = link->global_transform();
-				const UMMat44d& initial_global_transform = link->initial_global_transform();
-
-				UMMat44d global_rot = global_transform;
-				global_rot.m[3][0] = global_rot.m[3][1] = global_rot.m[3][2] = 0.0;
-				UMMat44d initial_global_rot = initial_global_transform;
-				initial_global_rot.m[3][0] = initial_global_rot.m[3][1] = initial_global_rot.m[3][2] = 0.0;
-				UMMat44d initial_global_rot_inv = initial_global_rot.inverted();
-
-				UMSkin::IndexList::const_iterator st = skin.index_list().begin();
-				for (int k = 0; st != skin.index_list().end(); ++st, ++k)
-				{
-					int index = *st;
-					double weight = skin.weight_list().at(k);
-					const UMVec3d& v = initial_global_transform.inverted() * original_vertex_list_[index];
-					vertex_list_.at(index) += global_transform * v * weight;
-
-					if (original_normal_list_.size() > original_vertex_list_.size())
-					{
-						const IndexPairList& pair_list = vertex_index_to_face_index_map_[index];
-						const int pair_size = static_cast<int>(pair_list.size());
-						for (int p = 0; p < pair_size; ++p)
-						{
-							const IndexPair& pair = pair_list[p];
-							const int ni = pair.first * 3 + pair.second;
-							const UMVec3d& n = initial_global_rot_inv * original_normal_list_[ni];
- 							normal_list_[ni] += global_rot * n * weight;
-						}
-					}
-					else if (original_normal_list_.size() == original_vertex_list_.size())
-					{
-						const UMVec3d& n = initial_global_rot_inv * original_normal_list_[index];
-						normal_list_[index] += global_rot * n * weight;
-					}
-				}
-			}
-		}
-	}
-	
-	{
-		Vec4dList::iterator it = normal_list_.begin();
-		for (; it != normal_list_.end(); ++it)
+		if (!skin_deformer_)
 		{
-			*it = it->normalized();
+			skin_deformer_ = std::make_shared<UMSkinDeformer>();
+			skin_deformer_->init(skin_list_, original_vertex_list_, original_normal_list_, face_list_);
 		}
+		skin_deformer_->deform(skin_list_, vertex_list_, normal_list_);
 	}
 }
 
@@ -235,6 +177,7 @@ void UMMesh::clear_deform_cache()
 {
 	original_vertex_list_.clear();
 	original_normal_list_.clear();
+	skin_deformer_.reset();
 }
 
 } //umdraw
\ No newline at end of file
@@ -16,6 +16,7 @@
 #include "UMBox.h"
 #include "UMNode.h"
 #include "UMSkin.h"
+#include "UMSkinDeformer.h"
 
 #include <vector>
 
@@ -158,6 +159,8 @@ public:
 
 	/**
 	 * update from skin
+	 * @note weights are packed at the first update. 
+	 * call clear_deform_cache after the skins are changed.
 	 */
 	void update();
 	
@@ -182,9 +185,7 @@ private:
 	Vec2dList uv_list_;
 	IndexList uv_index_list_;
 	UMSkinList skin_list_;
-	typedef std::pair<int, int> IndexPair;
-	typedef std::vector<IndexPair> IndexPairList;
-	std::map<int, IndexPairList > vertex_index_to_face_index_map_;
+	UMSkinDeformerPtr skin_deformer_;
 
 	umbase::UMBox box_;
 	UMMaterialList material_list_;
@@ -108,10 +108,6 @@ namespace
 		UMOpenGLMeshPtr dst_mesh, 
 		UMMeshPtr src_mesh)
 	{
-		const UMMesh::Vec3iList& face_list = src_mesh->face_list();
-		const UMMesh::Vec3dList& vertex_list = src_mesh->vertex_list();
-		const size_t face_size = face_list.size();
-
 		unsigned int vertex_vbo = dst_mesh->vertex_vbo();
 		if (!dst_mesh->is_valid_vertex_vbo())
 		{
@@ -124,35 +120,9 @@ namespace
 		glBindBuffer(GL_ARRAY_BUFFER, vertex_vbo);
 
 		std::vector<UMVec3f> verts;
-		size_t vertex_size = vertex_list.size();
-
-		if (face_size > 0)
-		{
-			vertex_size = face_size * 3;
-			verts.resize(vertex_size);
-
-			for (size_t i = 0; i < face_size; ++i) {
-				const UMVec3i& face = face_list.at(i);
-				for (int k = 0; k < 3; ++k)
-				{
-					const UMVec3d& vertex = vertex_list.at(face[k]);
-					verts[i * 3 + k].x = static_cast<float>(vertex.x);
-					verts[i * 3 + k].y = static_cast<float>(vertex.y);
-					verts[i * 3 + k].z = static_cast<float>(vertex.z);
-				}
-			}
-		}
-		else
-		{
-			verts.resize(vertex_size);
+		UMOpenGLIO::create_vertex_array(verts, src_mesh);
+		const size_t vertex_size = verts.size();
 
-			for (size_t i = 0; i < vertex_size; ++i) {
-				const UMVec3d& vertex = vertex_list.at(i);
-				verts[i].x = static_cast<float>(vertex.x);
-				verts[i].y = static_cast<float>(vertex.y);
-				verts[i].z = static_cast<float>(vertex.z);
-			}
-		}
 		glBufferData(GL_ARRAY_BUFFER,
 			sizeof (UMVec3f) * vertex_size,
 			reinterpret_cast<const GLvoid*>( &(*verts.begin()) ), 
@@ -171,12 +141,6 @@ namespace
 		UMOpenGLMeshPtr dst_mesh, 
 		UMMeshPtr src_mesh)
 	{
-		const UMMesh::Vec3iList& face_list = src_mesh->face_list();
-		const UMMesh::Vec3dList& normal_list = src_mesh->normal_list();
-		const size_t face_size = face_list.size();
-		const size_t normal_size = face_size ? face_size * 3 : normal_list.size();
-		const bool is_vertex_sized_normal = src_mesh->vertex_list().size() == src_mesh->normal_list().size();
-
 		unsigned int normal_vbo = dst_mesh->normal_vbo();
 		if (!dst_mesh->is_valid_normal_vbo())
 		{
@@ -189,44 +153,8 @@ namespace
 		glBindBuffer(GL_ARRAY_BUFFER, normal_vbo);
 
 		std::vector<UMVec3f> normals;
-		normals.resize(normal_size);
-		if (is_vertex_sized_normal)
-		{
-			if (face_size > 0)
-			{
-				for (size_t i = 0; i < face_size; ++i) {
-					const UMVec3i& face = face_list.at(i);
-					for (int k = 0; k < 3; ++k)
-					{
-						const UMVec3d& normal = normal_list.at(face[k]);
-						normals[i * 3 + k].x = static_cast<float>(normal.x);
-						normals[i * 3 + k].y = static_cast<float>(normal.y);
-						normals[i * 3 + k].z = static_cast<float>(normal.z);
-					}
-				}
-			}
-			else
-			{
-				for (size_t i = 0; i < normal_size; ++i) {
-					const UMVec3d& normal = normal_list.at(i);
-					normals[i].x = static_cast<float>(normal.x);
-					normals[i].y = static_cast<float>(normal.y);
-					normals[i].z = static_cast<float>(normal.z);
-				}
-			}
-		}
-		else if (normal_list.size() == src_mesh->face_list().size() * 3)
-		{
-			for (size_t i = 0; i < face_size; ++i) {
-				for (int k = 0; k < 3; ++k)
-				{
-					const UMVec3d& normal = normal_list.at(i * 3 + k);
-					normals[i * 3 + k].x = static_cast<float>(normal.x);
-					normals[i * 3 + k].y = static_cast<float>(normal.y);
-					normals[i * 3 + k].z = static_cast<float>(normal.z);
-				}
-			}
-		}
+		UMOpenGLIO::create_normal_array(normals, src_mesh);
+		const size_t normal_size = normals.size();
 
 		glBufferData(GL_ARRAY_BUFFER,
 			sizeof (UMVec3f) * normal_size,
@@ -367,6 +295,29 @@ namespace
 		return true;
 	}
 
+	/**
+	 * upload an array to a vertex buffer
+	 */
+	bool load_array_buffer(
+		unsigned int& vbo,
+		bool is_valid_vbo,
+		const std::vector<UMVec3f>& array)
+	{
+		if (!is_valid_vbo)
+		{
+			glGenBuffers(1, &vbo);
+		}
+		if (vbo == 0) return false;
+
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER,
+			sizeof (UMVec3f) * array.size(),
+			reinterpret_cast<const GLvoid*>( &(*array.begin()) ), 
+			GL_STATIC_DRAW );
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return true;
+	}
+
 } // anonymouse namespace
 
 
@@ -453,6 +404,79 @@ UMOpenGLMeshPtr UMOpenGLIO::convert_mesh_to_gl_mesh(
 	return mesh;
 }
 
+/**
+ * create triangle vertex array to upload
+ */
+void UMOpenGLIO::create_vertex_array(
+	std::vector<UMVec3f>& dst,
+	UMMeshPtr src)
+{
+	const UMMesh::Vec3iList& face_list = src->face_list();
+	const UMMesh::Vec3dList& vertex_list = src->vertex_list();
+	const size_t face_size = face_list.size();
+	
+	if (face_size > 0)
+	{
+		dst.resize(face_size * 3);
+		for (size_t i = 0; i < face_size; ++i) {
+			const UMVec3i& face = face_list.at(i);
+			for (int k = 0; k < 3; ++k)
+			{
+				dst[i * 3 + k] = to_float(vertex_list.at(face[k]));
+			}
+		}
+	}
+	else
+	{
+		const size_t vertex_size = vertex_list.size();
+		dst.resize(vertex_size);
+		for (size_t i = 0; i < vertex_size; ++i) {
+			dst[i] = to_float(vertex_list.at(i));
+		}
+	}
+}
+
+/**
+ * create triangle normal array to upload
+ */
+void UMOpenGLIO::create_normal_array(
+	std::vector<UMVec3f>& dst,
+	UMMeshPtr src)
+{
+	const UMMesh::Vec3iList& face_list = src->face_list();
+	const UMMesh::Vec3dList& normal_list = src->normal_list();
+	const size_t face_size = face_list.size();
+	const size_t normal_size = face_size ? face_size * 3 : normal_list.size();
+	const bool is_vertex_sized_normal = src->vertex_list().size() == normal_list.size();
+
+	dst.assign(normal_size, UMVec3f(0.0f));
+	if (is_vertex_sized_normal)
+	{
+		if (face_size > 0)
+		{
+			for (size_t i = 0; i < face_size; ++i) {
+				const UMVec3i& face = face_list.at(i);
+				for (int k = 0; k < 3; ++k)
+				{
+					dst[i * 3 + k] = to_float(normal_list.at(face[k]));
+				}
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < normal_size; ++i) {
+				dst[i] = to_float(normal_list.at(i));
+			}
+		}
+	}
+	else if (normal_list.size() == face_size * 3)
+	{
+		for (size_t i = 0; i < normal_size; ++i) {
+			dst[i] = to_float(normal_list.at(i));
+		}
+	}
+}
+
 /**
  * convert umdraw mesh to OpenGL mesh
  */
@@ -477,6 +501,101 @@ bool UMOpenGLIO::deformed_mesh_to_gl_mesh(
 	return true;
 }
 
+/**
+ * deform meshes and nodes changed since last_frame and store arrays to upload
+ */
+void UMOpenGLIO::deform_to_snapshot(
+	UMSceneSnapshot& dst,
+	UMScenePtr scene,
+	int last_frame)
+{
+	const UMTransformHierarchy& hierarchy = scene->transform_hierarchy();
+
+	// deform mesh
+	int mesh_count = 0;
+	UMMeshGroupList::const_iterator it = scene->mesh_group_list().begin();
+	for (; it != scene->mesh_group_list().end(); ++it)
+	{
+		mesh_count += static_cast<int>((*it)->mesh_list().size());
+	}
+	dst.vertex_arrays.resize(mesh_count);
+	dst.normal_arrays.resize(mesh_count);
+	dst.is_mesh_deformed.assign(mesh_count, 0);
+	int index = 0;
+	for (it = scene->mesh_group_list().begin(); it != scene->mesh_group_list().end(); ++it)
+	{
+		UMMeshList::const_iterator mt = (*it)->mesh_list().begin();
+		for (; mt != (*it)->mesh_list().end(); ++mt, ++index)
+		{
+			UMMeshPtr mesh = *mt;
+			if (!mesh || !hierarchy.is_deformed_since(mesh, last_frame)) continue;
+			mesh->update();
+			dst.vertex_arrays[index].clear();
+			dst.normal_arrays[index].clear();
+			if (!mesh->vertex_list().empty())
+			{
+				create_vertex_array(dst.vertex_arrays[index], mesh);
+			}
+			if (!mesh->normal_list().empty())
+			{
+				create_normal_array(dst.normal_arrays[index], mesh);
+			}
+			dst.is_mesh_deformed[index] = 1;
+		}
+	}
+
+	// deform node
+	const int node_count = static_cast<int>(scene->node_list().size());
+	dst.node_arrays.resize(node_count);
+	dst.node_colors.resize(node_count);
+	dst.is_node_changed.assign(node_count, 0);
+	std::vector<UMVec3d> octahedron;
+	std::vector<UMVec3d> points;
+	for (int i = 0; i < node_count; ++i)
+	{
+		UMNodePtr node = scene->node_list().at(i);
+		if (!node || !hierarchy.is_changed_since(node, last_frame)) continue;
+		octahedron.clear();
+		points.clear();
+		if (!UMSoftwareIO::convert_node_to_octahedron(octahedron, points, node)) continue;
+		UMSceneSnapshot::Vec3fList& array = dst.node_arrays[i];
+		array.resize(points.size());
+		for (size_t k = 0; k < points.size(); ++k)
+		{
+			array[k] = to_float(points[k]);
+		}
+		dst.node_colors[i] = to_float(node->node_color());
+		dst.is_node_changed[i] = 1;
+	}
+	dst.frame = hierarchy.frame();
+}
+
+/**
+ * upload deformed arrays of a mesh in a snapshot
+ */
+bool UMOpenGLIO::snapshot_to_gl_mesh(
+	UMOpenGLMeshPtr deform_mesh,
+	const UMSceneSnapshot& snapshot,
+	int index)
+{
+	if (!deform_mesh) return false;
+	const UMSceneSnapshot::Vec3fList& vertices = snapshot.vertex_arrays.at(index);
+	if (!vertices.empty())
+	{
+		unsigned int vertex_vbo = deform_mesh->vertex_vbo();
+		if (!load_array_buffer(vertex_vbo, deform_mesh->is_valid_vertex_vbo(), vertices)) return false;
+		deform_mesh->set_vertex_vbo(vertex_vbo);
+	}
+	const UMSceneSnapshot::Vec3fList& normals = snapshot.normal_arrays.at(index);
+	if (!normals.empty())
+	{
+		unsigned int normal_vbo = deform_mesh->normal_vbo();
+		if (!load_array_buffer(normal_vbo, deform_mesh->is_valid_normal_vbo(), normals)) return false;
+		deform_mesh->set_normal_vbo(normal_vbo);
+	}
+	return true;
+}
+
 /**
  * convert umdraw mesh group to OpenGL mesh
  */
@@ -546,6 +665,26 @@ bool UMOpenGLIO::deformed_node_to_gl_node(
 	return false;
 }
 
+/**
+ * upload deformed points of a node in a snapshot
+ */
+bool UMOpenGLIO::snapshot_to_gl_node(
+	UMOpenGLNodePtr deform_node,
+	const UMSceneSnapshot& snapshot,
+	int index)
+{
+	if (!deform_node) { return false; }
+
+	const UMSceneSnapshot::Vec3fList& points = snapshot.node_arrays.at(index);
+	if (points.empty()) { return false; }
+	unsigned int vertex_vbo = deform_node->vertex_vbo();
+	if (!load_array_buffer(vertex_vbo, deform_node->is_valid_vertex_vbo(), points)) { return false; }
+	deform_node->set_vertex_vbo(vertex_vbo);
+	deform_node->set_vertex_count(static_cast<unsigned int>(points.size()));
+	deform_node->mutable_material_list().at(0)->set_diffuse(snapshot.node_colors.at(index));
+	return true;
+}
+
 /**
  * convert umdraw line to OpenGL line
  * @param [in] src source umdraw line
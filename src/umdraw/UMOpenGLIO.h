@@ -10,9 +10,11 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include "UMMacro.h"
 
 #include "UMOpenGLScene.h"
+#include "UMSceneSnapshot.h"
 
 namespace umio
 {
@@ -62,6 +64,24 @@ public:
 	static UMOpenGLMeshPtr convert_mesh_to_gl_mesh(
 		UMMeshPtr src);
 	
+	/**
+	 * create triangle vertex array to upload
+	 * @param [out] dst 3 vertices per face
+	 * @param [in] src source umdraw mesh
+	 */
+	static void create_vertex_array(
+		std::vector<UMVec3f>& dst,
+		UMMeshPtr src);
+
+	/**
+	 * create triangle normal array to upload
+	 * @param [out] dst 3 normals per face
+	 * @param [in] src source umdraw mesh
+	 */
+	static void create_normal_array(
+		std::vector<UMVec3f>& dst,
+		UMMeshPtr src);
+
 	/**
 	 * convert umdraw mesh to OpenGL mesh
 	 */
@@ -69,6 +89,27 @@ public:
 		UMOpenGLMeshPtr deform_mesh,
 		UMMeshPtr src);
 
+	/**
+	 * deform meshes and nodes changed since last_frame and store arrays to upload
+	 * @param [out] dst snapshot
+	 * @param [in] scene source scene
+	 * @param [in] last_frame frame of the transform hierarchy at the previous snapshot
+	 * @note no OpenGL call. runs on a thread other than the draw thread.
+	 */
+	static void deform_to_snapshot(
+		UMSceneSnapshot& dst,
+		UMScenePtr scene,
+		int last_frame);
+
+	/**
+	 * upload deformed arrays of a mesh in a snapshot
+	 * @param [in] index mesh index in the snapshot
+	 */
+	static bool snapshot_to_gl_mesh(
+		UMOpenGLMeshPtr deform_mesh,
+		const UMSceneSnapshot& snapshot,
+		int index);
+
 	/**
 	 * convert umdraw mesh group to OpenGL mesh
 	 * @param [in] src source umdraw mesh group
@@ -90,6 +131,15 @@ public:
 		UMOpenGLNodePtr deform_node,
 		UMNodePtr src);
 
+	/**
+	 * upload deformed points of a node in a snapshot
+	 * @param [in] index node index in the snapshot
+	 */
+	static bool snapshot_to_gl_node(
+		UMOpenGLNodePtr deform_node,
+		const UMSceneSnapshot& snapshot,
+		int index);
+
 	/**
 	 * convert umdraw line to OpenGL line
 	 * @param [in] src source umdraw line
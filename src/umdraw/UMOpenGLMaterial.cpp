@@ -49,6 +49,7 @@ public:
 			set_diffuse(to_gl(material->diffuse()));
 			set_specular(to_gl(material->specular()));
 			set_polygon_count(material->polygon_count());
+			shader_flags_.z = static_cast<float>(material->distance_field_edge());
 
 			UMMaterial::TexturePathList::const_iterator it = material->texture_path_list().begin();
 			for (; it != material->texture_path_list().end(); ++it)
@@ -68,7 +69,7 @@ public:
 				UMMaterial::TextureList::const_iterator it =  material->texture_list().begin();
 				for (; it != material->texture_list().end(); ++it)
 				{
-					if (diffuse_texture_->convert_from_image(*(*it)))
+					if (diffuse_texture_->upload_dirty_rects(*(*it)))
 					{
 						shader_flags_.x = 1.0;
 					}
@@ -81,6 +82,19 @@ public:
 
 	bool update()
 	{
+		UMMaterialPtr material = ummaterial();
+		if (!material) return false;
+		if (!material->texture_path_list().empty()) return true;
+
+		// images written after init (e.g. growing font atlas) are uploaded by changed rects
+		UMMaterial::TextureList::const_iterator it =  material->texture_list().begin();
+		for (; it != material->texture_list().end(); ++it)
+		{
+			if (*it && (*it)->is_dirty())
+			{
+				diffuse_texture_->upload_dirty_rects(*(*it));
+			}
+		}
 		return true;
 	}
 
@@ -232,7 +246,7 @@ void UMOpenGLMaterial::set_ambient(const UMVec4f& ambient)
 
 /**
  * get shader flags
- * @note x is uvflag, yzw not defined now
+ * @note x is uvflag, y is constant color, z is distance field edge, w not defined now
  */
 const UMVec4f& UMOpenGLMaterial::shader_flags() const
 {
@@ -241,7 +255,7 @@ const UMVec4f& UMOpenGLMaterial::shader_flags() const
 
 /** 
  * set shader flags
- * @note x is uvflag, yzw not defined now
+ * @note x is uvflag, y is constant color, z is distance field edge, w not defined now
  */
 void UMOpenGLMaterial::set_shader_flags(const UMVec4f& flags)
 {
@@ -471,7 +471,12 @@ void UMOpenGLMesh::Impl::draw(UMOpenGLDrawParameterPtr parameter)
  */
 bool UMOpenGLMesh::Impl::update()
 {
-	return false;
+	UMOpenGLMaterialList::iterator it = material_list_.begin();
+	for (; it != material_list_.end(); ++it)
+	{
+		(*it)->update();
+	}
+	return true;
 }
 
 
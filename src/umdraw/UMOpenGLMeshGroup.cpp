@@ -49,6 +49,11 @@ public:
 
 	bool update()
 	{
+		UMOpenGLMeshList::iterator it = gl_mesh_list_.begin();
+		for (; it != gl_mesh_list_.end(); ++it)
+		{
+			(*it)->update();
+		}
 		return true;
 	}
 
@@ -42,7 +42,7 @@ class UMOpenGLScene::Impl
 	DISALLOW_COPY_AND_ASSIGN(Impl);
 public:
 
-	Impl() {}
+	Impl() : mesh_transform_frame_(-1), node_transform_frame_(-1) {}
 
 	~Impl() {}
 
@@ -77,6 +77,8 @@ private:
 
 	void update_temporary_lines();
 
+	void update_by_snapshot(const UMSceneSnapshot& snapshot);
+
 	// umdraw scene
 	UMScenePtr scene_;
 	
@@ -90,6 +92,7 @@ private:
 	UMOpenGLLineList gl_line_list_;
 	UMOpenGLBoardList gl_board_list_;
 	UMOpenGLBoardPtr foreground_board_;
+	UMImagePtr foreground_image_;
 	UMOpenGLBoardPtr background_board_;
 	UMOpenGLLineList gl_temporary_line_list_;
 	UMLineList temporary_line_list_;
@@ -103,6 +106,10 @@ private:
 	UMOpenGLTexturePtr render_buffer_;
 	UMOpenGLTexturePtr frame_buffer_;
 	UMOpenGLTextureList frame_buffer_textures_;
+
+	// transform hierarchy frame of last update
+	int mesh_transform_frame_;
+	int node_transform_frame_;
 };
 
 /** 
@@ -180,8 +187,20 @@ bool UMOpenGLScene::Impl::update()
 {
 	if (!shader_manager_) return false;
 	
-	if (scene_ && scene_->is_enable_deform())
+	if (scene_ && scene_->is_enable_deform() && scene_->snapshot_buffer())
 	{
+		// meshes and nodes are deformed by another thread
+		UMSceneSnapshotBufferPtr buffer = scene_->snapshot_buffer();
+		if (buffer->acquire())
+		{
+			update_by_snapshot(buffer->front());
+		}
+	}
+	else if (scene_ && scene_->is_enable_deform())
+	{
+		// skip meshes and nodes which are not moved since last update
+		const UMTransformHierarchy& hierarchy = scene_->transform_hierarchy();
+
 		// deform mesh
 		if (scene_->is_visible(UMScene::eMesh))
 		{
@@ -194,7 +213,7 @@ bool UMOpenGLScene::Impl::update()
 				for (; mt != group->mutable_mesh_list().end(); ++mt)
 				{
 					UMMeshPtr mesh = *mt;
-					if (mesh)
+					if (mesh && hierarchy.is_deformed_since(mesh, mesh_transform_frame_))
 					{
 						mesh->update();
 					}
@@ -211,13 +230,14 @@ bool UMOpenGLScene::Impl::update()
 					for (int k = 0; mt != mesh_group->mesh_list().end(); ++mt, ++k)
 					{
 						UMOpenGLMeshPtr gl_mesh = gl_mesh_group->mutable_gl_mesh_list().at(k);
-						if (gl_mesh)
+						if (gl_mesh && hierarchy.is_deformed_since(*mt, mesh_transform_frame_))
 						{
 							UMOpenGLIO::deformed_mesh_to_gl_mesh(gl_mesh, *mt);
 						}
 					}
 				}
 			}
+			mesh_transform_frame_ = hierarchy.frame();
 		}
 
 		// deform node
@@ -229,12 +249,13 @@ bool UMOpenGLScene::Impl::update()
 				for (int i = 0; it != scene_->node_list().end(); ++it, ++i)
 				{
 					UMOpenGLNodePtr gl_node = gl_node_list_.at(i);
-					if (gl_node)
+					if (gl_node && hierarchy.is_changed_since(*it, node_transform_frame_))
 					{
 						UMOpenGLIO::deformed_node_to_gl_node(gl_node, *it);
 					}
 				}
 			}
+			node_transform_frame_ = hierarchy.frame();
 		}
 	}
 
@@ -280,6 +301,10 @@ bool UMOpenGLScene::Impl::update()
 	// update foreground
 	if (foreground_board_ && foreground_board_->texture())
 	{
+		if (foreground_image_)
+		{
+			foreground_board_->texture()->upload_dirty_rects(*foreground_image_);
+		}
 		foreground_board_->update();
 	}
 	// update boards
@@ -293,6 +318,49 @@ bool UMOpenGLScene::Impl::update()
 	return true;
 }
 
+/**
+ * upload snapshot deformed by another thread
+ */
+void UMOpenGLScene::Impl::update_by_snapshot(const UMSceneSnapshot& snapshot)
+{
+	// upload meshes
+	size_t gl_mesh_count = 0;
+	UMOpenGLMeshGroupList::iterator it = gl_mesh_group_list_.begin();
+	for (; it != gl_mesh_group_list_.end(); ++it)
+	{
+		gl_mesh_count += (*it)->gl_mesh_list().size();
+	}
+	if (gl_mesh_count == snapshot.is_mesh_deformed.size())
+	{
+		int index = 0;
+		for (it = gl_mesh_group_list_.begin(); it != gl_mesh_group_list_.end(); ++it)
+		{
+			UMOpenGLMeshList& gl_mesh_list = (*it)->mutable_gl_mesh_list();
+			for (size_t k = 0; k < gl_mesh_list.size(); ++k, ++index)
+			{
+				if (snapshot.is_mesh_deformed[index])
+				{
+					UMOpenGLIO::snapshot_to_gl_mesh(gl_mesh_list[k], snapshot, index);
+				}
+			}
+		}
+	}
+
+	// upload nodes
+	if (gl_node_list_.size() == snapshot.is_node_changed.size())
+	{
+		for (int i = 0, size = static_cast<int>(gl_node_list_.size()); i < size; ++i)
+		{
+			if (snapshot.is_node_changed[i])
+			{
+				UMOpenGLIO::snapshot_to_gl_node(gl_node_list_[i], snapshot, i);
+			}
+		}
+	}
+	mesh_transform_frame_ = snapshot.frame;
+	node_transform_frame_ = snapshot.frame;
+}
+
 /**
  * update temporary lines
  */
@@ -453,6 +521,8 @@ bool UMOpenGLScene::Impl::draw()
  */
 bool UMOpenGLScene::Impl::load(UMScenePtr scene)
 {
+	mesh_transform_frame_ = -1;
+	node_transform_frame_ = -1;
 	{
 		UMMeshGroupList::const_iterator it = scene->mesh_group_list().begin();
 		for (; it != scene->mesh_group_list().end(); ++it)
@@ -527,13 +597,20 @@ void UMOpenGLScene::Impl::update(umbase::UMEventType event_type, umbase::UMAny&
 			UMImagePtr image = umbase::any_cast<UMImagePtr>(parameter);
 			if (image)
 			{
-				UMOpenGLTexturePtr texture = std::make_shared<UMOpenGLTexture>(false);
-				texture->convert_from_image(*image);
-				foreground_board_->set_texture(texture);
+				// same image is updated by its changed rects only
+				UMOpenGLTexturePtr texture = foreground_board_->texture();
+				if (!texture || image != foreground_image_)
+				{
+					texture = std::make_shared<UMOpenGLTexture>(false);
+					foreground_board_->set_texture(texture);
+					foreground_image_ = image;
+				}
+				texture->upload_dirty_rects(*image);
 			}
 			else
 			{
 				foreground_board_->set_texture(UMOpenGLTexturePtr());
+				foreground_image_ = UMImagePtr();
 			}
 		}
 	}
@@ -142,6 +142,8 @@ public:
 		, id_(0)
 		, render_buffer_id_(0)
 		, frame_buffer_id_(0)
+		, width_(0)
+		, height_(0)
 		, listener_(new UMOpenGLTextureListener())
 	{
 	}
@@ -203,6 +205,11 @@ public:
 			is_valid_texture_ = true;
 			file_path_ = file_path;
 			image_ = texture_image_pool[file_path];
+			if (image_)
+			{
+				width_ = image_->width();
+				height_ = image_->height();
+			}
 			return true;
 		}
 
@@ -221,6 +228,8 @@ public:
 
 		const int width = image_->width();
 		const int height = image_->height();
+		width_ = width;
+		height_ = height;
 		glBindTexture(GL_TEXTURE_2D, id_);
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -231,10 +240,8 @@ public:
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &(*buffer.begin()));
 #else
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		gluBuild2DMipmaps(
-			GL_TEXTURE_2D, GL_RGBA, width, height,
-			GL_RGBA, GL_UNSIGNED_BYTE, &(*buffer.begin())
-		);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &(*buffer.begin()));
+		update_mipmap();
 #endif
 		glBindTexture(GL_TEXTURE_2D, 0);
 		
@@ -275,6 +282,8 @@ public:
 			is_valid_texture_ = true;
 			file_path_ = id;
 			image_ = texture_image_pool[id];
+			width_ = image.width();
+			height_ = image.height();
 			return true;
 		}
 
@@ -288,6 +297,8 @@ public:
 
 		const int width = image.width();
 		const int height = image.height();
+		width_ = width;
+		height_ = height;
 		glBindTexture(GL_TEXTURE_2D, id_);
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -298,10 +309,10 @@ public:
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &(*buffer.begin()));
 #else
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		gluBuild2DMipmaps(
-			GL_TEXTURE_2D, GL_RGBA, width, height,
-			GL_RGBA, GL_UNSIGNED_BYTE, &(*buffer.begin())
-		);
+		// level 0 keeps the image size, so that dirty rects are uploaded to the same coordinates.
+		// (gluBuild2DMipmaps rescales non power of two images)
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &(*buffer.begin()));
+		update_mipmap();
 #endif
 		glBindTexture(GL_TEXTURE_2D, 0);
 	
@@ -350,6 +361,8 @@ public:
 		unsigned int gl_format= (format.format == eRGBA) ? GL_RGBA : format.format;
 		glTexImage2D(GL_TEXTURE_2D, 0, gl_internal_format, width, height, 0, gl_format, gl_type, 0);
 		glBindTexture(GL_TEXTURE_2D, 0);
+		width_ = width;
+		height_ = height;
 	
 		connect_event();
 
@@ -447,8 +460,39 @@ public:
 	bool overwrite(const umimage::UMImage& image)
 	{
 		if (!can_overwrite_) return false;
+		if (!is_valid_texture_ || !image.is_valid()) return false;
+		if (image.width() != width_ || image.height() != height_) return false;
+
+		glBindTexture(GL_TEXTURE_2D, id_);
+		upload_rect(image, umbase::UMVec4ui(0, 0, width_, height_));
+		update_mipmap();
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return true;
+	}
 
-		return false;
+	bool upload_dirty_rects(umimage::UMImage& image)
+	{
+		if (!image.is_valid()) return false;
+		if (!is_valid_texture_)
+		{
+			// whole image is uploaded at the first time
+			umimage::UMImage::DirtyRectList rect_list;
+			image.take_dirty_rect_list(rect_list);
+			return convert_from_image(image);
+		}
+		if (image.width() != width_ || image.height() != height_) return false;
+
+		umimage::UMImage::DirtyRectList rect_list;
+		if (!image.take_dirty_rect_list(rect_list)) return true;
+
+		glBindTexture(GL_TEXTURE_2D, id_);
+		for (size_t i = 0; i < rect_list.size(); ++i)
+		{
+			upload_rect(image, rect_list[i]);
+		}
+		update_mipmap();
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return true;
 	}
 
 	unsigned int texture_id() const
@@ -481,6 +525,41 @@ public:
 	}
 
 private:
+	// upload a rect of image to the bound texture. rows are same to convert_from_image.
+	void upload_rect(const umimage::UMImage& image, const umbase::UMVec4ui& rect)
+	{
+		const umimage::UMImage::ConstView src = image.view().sub_view(rect);
+		if (src.width <= 0 || src.height <= 0) return;
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+#if !defined(WITH_EMSCRIPTEN)
+		// rgba8 rows are uploaded directly without conversion
+		if (src.format == umimage::UMImage::ePixelFormatRGBA8)
+		{
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, src.stride / 4);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, rect[0], rect[1], src.width, src.height, GL_RGBA, GL_UNSIGNED_BYTE, src.data);
+			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+			return;
+		}
+#endif // !defined(WITH_EMSCRIPTEN)
+		upload_buffer_.resize(src.width * src.height * 4);
+		umimage::UMImage::View dst;
+		dst.format = umimage::UMImage::ePixelFormatRGBA8;
+		dst.width = src.width;
+		dst.height = src.height;
+		dst.stride = src.width * 4;
+		dst.data = &(*upload_buffer_.begin());
+		umimage::UMImage::convert(dst, src);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, rect[0], rect[1], src.width, src.height, GL_RGBA, GL_UNSIGNED_BYTE, dst.data);
+	}
+
+	// regenerate mipmaps of the bound texture
+	void update_mipmap()
+	{
+#if !defined(WITH_EMSCRIPTEN)
+		glGenerateMipmap(GL_TEXTURE_2D);
+#endif // !defined(WITH_EMSCRIPTEN)
+	}
+
 	// connect event
 	void connect_event()
 	{
@@ -501,8 +580,11 @@ private:
 	unsigned int id_;
 	unsigned int render_buffer_id_;
 	unsigned int frame_buffer_id_;
+	int width_;
+	int height_;
 	umstring file_path_;
 	umimage::UMImagePtr image_;
+	umimage::UMImage::R8G8B8A8Buffer upload_buffer_;
 	std::vector<unsigned int> frame_buffer_attachments_;
 };
 
@@ -608,6 +690,14 @@ bool UMOpenGLTexture::overwrite(const umimage::UMImage& image)
 	return impl_->overwrite(image);
 }
 
+/**
+ * upload rects of image changed since the last upload
+ */
+bool UMOpenGLTexture::upload_dirty_rects(umimage::UMImage& image)
+{
+	return impl_->upload_dirty_rects(image);
+}
+
 /**
  * get texture id
  */
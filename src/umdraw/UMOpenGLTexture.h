@@ -112,6 +112,13 @@ public:
 	 */
 	bool overwrite(const umimage::UMImage& image);
 
+	/**
+	 * upload rects of image changed since the last upload
+	 * @param [in] image source image. its dirty rects are taken.
+	 * @info the whole image is uploaded by convert_from_image at the first time.
+	 */
+	bool upload_dirty_rects(umimage::UMImage& image);
+
 	/**
 	 * get texture id
 	 */
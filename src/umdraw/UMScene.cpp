@@ -76,6 +76,7 @@ bool UMScene::load(const umstring& absolute_file_path)
 		node_list_.clear();
 		return false;
 	}
+	transform_hierarchy_.build(node_list_);
 
 	return true;
 }
@@ -123,6 +124,7 @@ bool UMScene::load_from_memory(const std::string& src)
 		node_list_.clear();
 		return false;
 	}
+	transform_hierarchy_.build(node_list_);
 	
 	return true;
 }
@@ -206,6 +208,17 @@ void UMScene::clear_geometry()
 	mutable_node_list().clear();
 }
 
+/**
+ * replace meshes and nodes by those of a staging scene
+ */
+void UMScene::replace_geometry(UMScene& staging)
+{
+	mutable_mesh_group_list().swap(staging.mutable_mesh_group_list());
+	mutable_node_list().swap(staging.mutable_node_list());
+	staging.clear_geometry();
+	transform_hierarchy_.build(node_list_);
+}
+
 void UMScene::resize(int width, int height)
 {
 	if (!mutable_camera_list().empty())
@@ -19,6 +19,8 @@
 #include "UMLight.h"
 #include "UMMeshGroup.h"
 #include "UMNode.h"
+#include "UMTransformHierarchy.h"
+#include "UMSceneSnapshot.h"
 
 namespace umbase
 {
@@ -84,6 +86,12 @@ public:
 	 */
 	void clear_geometry();
 
+	/**
+	 * replace meshes and nodes by those of a staging scene
+	 * @param [in,out] staging loaded scene. its geometry is moved.
+	 */
+	void replace_geometry(UMScene& staging);
+
 	/**
 	 * get camera
 	 */
@@ -143,6 +151,17 @@ public:
 	 * get node list
 	 */
 	UMNodeList& mutable_node_list() { return node_list_; }
+
+	/**
+	 * get transform hierarchy of node list
+	 */
+	const UMTransformHierarchy& transform_hierarchy() const { return transform_hierarchy_; }
+
+	/**
+	 * get transform hierarchy of node list
+	 * @note build again after node list is changed
+	 */
+	UMTransformHierarchy& mutable_transform_hierarchy() { return transform_hierarchy_; }
 	
 	/**
 	 * get background color
@@ -210,6 +229,17 @@ public:
 	 * deformation is enable or not
 	 */
 	bool is_enable_deform() const { return is_enable_deform_; }
+
+	/**
+	 * set snapshot buffer deformed by another thread
+	 * @note the draw side uploads snapshots instead of deforming meshes if set
+	 */
+	void set_snapshot_buffer(UMSceneSnapshotBufferPtr buffer) { snapshot_buffer_ = buffer; }
+
+	/**
+	 * get snapshot buffer deformed by another thread
+	 */
+	UMSceneSnapshotBufferPtr snapshot_buffer() const { return snapshot_buffer_; }
 	
 	/** 
 	 *  get visibility
@@ -238,11 +268,13 @@ private:
 	int width_;
 	int height_;
 	bool is_enable_deform_;
+	UMSceneSnapshotBufferPtr snapshot_buffer_;
 
 	UMCameraList camera_list_;
 	UMLightList light_list_;
 
 	UMNodeList node_list_;
+	UMTransformHierarchy transform_hierarchy_;
 	UMMeshGroupList mesh_group_list_;
 	UMLineList line_list_;
 	UMImagePtr background_image_;
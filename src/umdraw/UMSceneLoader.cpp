@@ -0,0 +1,315 @@
+/**
+ * @file UMSceneLoader.cpp
+ * load a model into a staging scene on threads
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMSceneLoader.h"
+
+#include "UMEvent.h"
+#include "UMMesh.h"
+#include "UMMeshGroup.h"
+#include "UMStringUtil.h"
+#include "UMIO.h"
+#include "UMSoftwareIO.h"
+#include "UMSoftwareEventType.h"
+#include "UMThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#if !defined(WITH_EMSCRIPTEN)
+	#include <thread>
+#endif
+
+namespace
+{
+	/// progress when umio finished parsing
+	const double parsed_progress = 0.2;
+
+	/// progress when all meshes are published
+	const double published_progress = 0.9;
+
+} // anonymouse namespace
+
+namespace umdraw
+{
+
+/**
+ * a load of a file
+ */
+struct UMSceneLoader::Job
+{
+	Job()
+		: state(eLoading)
+		, is_canceled(false)
+		, is_parsed(false)
+		, mesh_count(0)
+		, published_mesh_count(0)
+	{}
+
+	umstring file_path;
+	UMScenePtr scene;
+	UMMeshGroupPtr mesh_group;
+	std::atomic<int> state;
+	std::atomic<bool> is_canceled;
+	std::atomic<bool> is_parsed;
+	std::atomic<int> mesh_count;
+	std::atomic<int> published_mesh_count;
+	/// guards mesh list of the staging scene
+	std::mutex mutex;
+#if !defined(WITH_EMSCRIPTEN)
+	std::thread thread;
+#endif
+};
+
+/**
+ * constructor
+ */
+UMSceneLoader::UMSceneLoader()
+	: notified_progress_(-1.0)
+	, is_loaded_notified_(false)
+	, progress_event_(std::make_shared<umbase::UMEvent>(eSoftwareEventLoadProgress))
+	, loaded_event_(std::make_shared<umbase::UMEvent>(eSoftwareEventLoaded))
+{
+}
+
+/**
+ * destructor
+ */
+UMSceneLoader::~UMSceneLoader()
+{
+	cancel();
+	join_canceled(true);
+}
+
+/**
+ * start loading
+ */
+bool UMSceneLoader::start(const umstring& absolute_file_path, int width, int height)
+{
+	cancel();
+	join_canceled(false);
+	if (absolute_file_path.empty()) return false;
+
+	JobPtr job = std::make_shared<Job>();
+	job->file_path = absolute_file_path;
+	job->scene = std::make_shared<UMScene>(width, height);
+	job->mesh_group = std::make_shared<UMMeshGroup>();
+	job->scene->mutable_mesh_group_list().push_back(job->mesh_group);
+	job_ = job;
+	notified_progress_ = -1.0;
+	is_loaded_notified_ = false;
+#if !defined(WITH_EMSCRIPTEN)
+	job->thread = std::thread(&UMSceneLoader::run, job);
+#else
+	run(job);
+#endif
+	return true;
+}
+
+/**
+ * cancel loading
+ */
+void UMSceneLoader::cancel()
+{
+	if (!job_) return;
+	job_->is_canceled = true;
+	canceled_list_.push_back(job_);
+	job_ = JobPtr();
+}
+
+/**
+ * notify progress and loaded events on the calling thread
+ */
+bool UMSceneLoader::update()
+{
+	join_canceled(false);
+	if (!job_) return false;
+
+	const double current_progress = progress();
+	if (current_progress != notified_progress_)
+	{
+		notified_progress_ = current_progress;
+		umbase::UMEvent::Parameter parameter(current_progress);
+		progress_event_->set_parameter(parameter);
+		progress_event_->notify();
+	}
+	const State current_state = state();
+	if (current_state == eLoaded && !is_loaded_notified_)
+	{
+		is_loaded_notified_ = true;
+		umbase::UMEvent::Parameter parameter(job_->scene);
+		loaded_event_->set_parameter(parameter);
+		loaded_event_->notify();
+	}
+	return current_state == eLoaded;
+}
+
+/**
+ * get state
+ */
+UMSceneLoader::State UMSceneLoader::state() const
+{
+	if (!job_) return eIdle;
+	return static_cast<State>(job_->state.load());
+}
+
+/**
+ * get progress from 0 to 1
+ */
+double UMSceneLoader::progress() const
+{
+	if (!job_) return 0.0;
+	if (job_->state != eLoading) return 1.0;
+	if (!job_->is_parsed) return 0.0;
+	const int mesh_count = job_->mesh_count;
+	if (mesh_count == 0) return parsed_progress;
+	return parsed_progress + (published_progress - parsed_progress) * job_->published_mesh_count / mesh_count;
+}
+
+/**
+ * get meshes in the file
+ */
+int UMSceneLoader::mesh_count() const
+{
+	if (!job_) return 0;
+	return job_->mesh_count;
+}
+
+/**
+ * get meshes published to the staging scene
+ */
+int UMSceneLoader::published_mesh_count() const
+{
+	if (!job_) return 0;
+	return job_->published_mesh_count;
+}
+
+/**
+ * get a copy of meshes published to the staging scene
+ */
+UMMeshList UMSceneLoader::published_mesh_list() const
+{
+	if (!job_) return UMMeshList();
+	std::lock_guard<std::mutex> lock(job_->mutex);
+	return job_->mesh_group->mesh_list();
+}
+
+/**
+ * take the loaded staging scene
+ */
+UMScenePtr UMSceneLoader::take_scene()
+{
+	if (!job_) return UMScenePtr();
+	if (job_->state == eLoading) return UMScenePtr();
+#if !defined(WITH_EMSCRIPTEN)
+	if (job_->thread.joinable())
+	{
+		job_->thread.join();
+	}
+#endif
+	UMScenePtr scene;
+	if (job_->state == eLoaded)
+	{
+		scene = job_->scene;
+	}
+	job_ = JobPtr();
+	return scene;
+}
+
+/**
+ * load on the job thread
+ */
+void UMSceneLoader::run(JobPtr job)
+{
+	const bool result = load(job);
+	job->state = (result && !job->is_canceled) ? eLoaded : eFailed;
+}
+
+/**
+ * parse, convert meshes in parallel and import nodes
+ */
+bool UMSceneLoader::load(JobPtr job)
+{
+	umio::UMIO io;
+	umio::UMIOSetting setting = umio::UMIOSetting();
+	setting.set_bl_imp_bool_prop(umio::UMIOSetting::eUMImpTriangulate, true);
+	setting.set_system_unit_type(umio::UMIOSetting::eFbxSystemUnitM);
+	umio::UMObjectPtr obj = io.load(umbase::UMStringUtil::utf16_to_utf8(job->file_path), setting);
+	if (!obj) return false;
+	if (job->is_canceled) return false;
+
+	// meshes in file order
+	std::vector<umio::UMMesh*> src_list;
+	umio::UMMesh::IDToMeshMap::iterator it = obj->mutable_mesh_map().begin();
+	for (; it != obj->mutable_mesh_map().end(); ++it)
+	{
+		src_list.push_back(&it->second);
+	}
+	const int mesh_count = static_cast<int>(src_list.size());
+	job->mesh_count = mesh_count;
+	job->is_parsed = true;
+	if (mesh_count == 0) return false;
+
+	// convert meshes on threads and publish them in file order
+	UMMeshList converted_list(mesh_count);
+	int published_count = 0;
+	umbase::UMThreadPool::instance().parallel_for(mesh_count, [&](int i) {
+		if (job->is_canceled) return;
+		UMMeshPtr mesh(std::make_shared<UMMesh>());
+		UMSoftwareIO::import_mesh(mesh, *src_list[i], job->file_path);
+
+		std::lock_guard<std::mutex> lock(job->mutex);
+		converted_list[i] = mesh;
+		while (published_count < mesh_count && converted_list[published_count])
+		{
+			job->mesh_group->mutable_mesh_list().push_back(converted_list[published_count]);
+			++published_count;
+		}
+		job->published_mesh_count = published_count;
+	});
+	if (job->is_canceled) return false;
+
+	if (!UMSoftwareIO::import_node_list(
+		job->scene->mutable_node_list(),
+		job->mesh_group->mutable_mesh_list(),
+		obj))
+	{
+		return false;
+	}
+	job->scene->mutable_transform_hierarchy().build(job->scene->node_list());
+	return true;
+}
+
+/**
+ * join canceled jobs
+ * @param [in] is_wait wait for jobs still parsing
+ */
+void UMSceneLoader::join_canceled(bool is_wait)
+{
+	std::vector<JobPtr>::iterator it = canceled_list_.begin();
+	while (it != canceled_list_.end())
+	{
+		JobPtr job = *it;
+		if (!is_wait && job->state == eLoading)
+		{
+			++it;
+			continue;
+		}
+#if !defined(WITH_EMSCRIPTEN)
+		if (job->thread.joinable())
+		{
+			job->thread.join();
+		}
+#endif
+		it = canceled_list_.erase(it);
+	}
+}
+
+} // umdraw
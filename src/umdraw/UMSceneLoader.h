@@ -0,0 +1,127 @@
+/**
+ * @file UMSceneLoader.h
+ * load a model into a staging scene on threads
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "UMMacro.h"
+#include "UMScene.h"
+
+namespace umdraw
+{
+
+class UMSceneLoader;
+typedef std::shared_ptr<UMSceneLoader> UMSceneLoaderPtr;
+
+/**
+ * loads a model into a staging scene while the current scene is drawn
+ * @note umio parses the file, then meshes are converted in parallel and
+ * published to the staging scene in file order.
+ * events are notified from update() on the calling thread.
+ */
+class UMSceneLoader
+{
+	DISALLOW_COPY_AND_ASSIGN(UMSceneLoader);
+public:
+	enum State
+	{
+		eIdle,
+		eLoading,
+		eLoaded,
+		eFailed
+	};
+
+	UMSceneLoader();
+
+	~UMSceneLoader();
+
+	/**
+	 * start loading. a running load is canceled.
+	 * @param [in] absolute_file_path model file path
+	 * @param [in] width staging scene width
+	 * @param [in] height staging scene height
+	 */
+	bool start(const umstring& absolute_file_path, int width, int height);
+
+	/**
+	 * cancel loading
+	 * @note returns without waiting. parsing in umio is not interrupted,
+	 * its thread exits after parsing.
+	 */
+	void cancel();
+
+	/**
+	 * notify progress and loaded events on the calling thread
+	 * @retval true if the staging scene is ready to take
+	 */
+	bool update();
+
+	/**
+	 * get state
+	 * @note a canceled load is idle
+	 */
+	State state() const;
+
+	/**
+	 * get progress from 0 to 1
+	 */
+	double progress() const;
+
+	/**
+	 * get meshes in the file. 0 while parsing.
+	 */
+	int mesh_count() const;
+
+	/**
+	 * get meshes published to the staging scene
+	 */
+	int published_mesh_count() const;
+
+	/**
+	 * get a copy of meshes published to the staging scene
+	 */
+	UMMeshList published_mesh_list() const;
+
+	/**
+	 * take the loaded staging scene and become idle
+	 * @retval empty if not loaded
+	 */
+	UMScenePtr take_scene();
+
+	/**
+	 * get progress event. parameter is progress as double.
+	 */
+	umbase::UMEventPtr progress_event() { return progress_event_; }
+
+	/**
+	 * get loaded event. parameter is the staging scene.
+	 */
+	umbase::UMEventPtr loaded_event() { return loaded_event_; }
+
+private:
+	struct Job;
+	typedef std::shared_ptr<Job> JobPtr;
+
+	static void run(JobPtr job);
+	static bool load(JobPtr job);
+	void join_canceled(bool is_wait);
+
+	JobPtr job_;
+	/// canceled jobs which may be still parsing
+	std::vector<JobPtr> canceled_list_;
+	double notified_progress_;
+	bool is_loaded_notified_;
+
+	umbase::UMEventPtr progress_event_;
+	umbase::UMEventPtr loaded_event_;
+};
+
+} // umdraw
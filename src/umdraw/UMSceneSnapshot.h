@@ -0,0 +1,51 @@
+/**
+ * @file UMSceneSnapshot.h
+ * deformed arrays of a scene handed off to the draw thread
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMTripleBuffer.h"
+
+namespace umdraw
+{
+
+/**
+ * deformed meshes and nodes of a frame
+ * @note meshes are ordered by mesh groups, nodes by the node list of the scene.
+ * arrays of meshes and nodes which are not changed are left old.
+ */
+struct UMSceneSnapshot
+{
+	typedef std::vector<UMVec3f> Vec3fList;
+
+	UMSceneSnapshot() : frame(-1) {}
+
+	/// frame of the transform hierarchy
+	int frame;
+	/// vertices per mesh to upload
+	std::vector<Vec3fList> vertex_arrays;
+	/// normals per mesh to upload
+	std::vector<Vec3fList> normal_arrays;
+	/// 1 if the mesh is deformed since the previous snapshot
+	std::vector<unsigned char> is_mesh_deformed;
+	/// octahedron points per node
+	std::vector<Vec3fList> node_arrays;
+	std::vector<UMVec4f> node_colors;
+	/// 1 if the node is changed since the previous snapshot
+	std::vector<unsigned char> is_node_changed;
+};
+
+typedef umbase::UMTripleBuffer<UMSceneSnapshot> UMSceneSnapshotBuffer;
+typedef std::shared_ptr<UMSceneSnapshotBuffer> UMSceneSnapshotBufferPtr;
+
+} // umdraw
@@ -44,7 +44,7 @@ public:
 	int link_node_id() const { return link_node_id_; }
 	void set_link_node_id(int link_node_id) { link_node_id_ = link_node_id; }
 
-	UMNodePtr link_node() { return link_node_; }
+	UMNodePtr link_node() const { return link_node_; }
 	void set_link_node(UMNodePtr node) { link_node_ = node; }
 
 private:
@@ -0,0 +1,309 @@
+/**
+ * @file UMSkinDeformer.cpp
+ * linear blend skinning
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMSkinDeformer.h"
+#include "UMNode.h"
+#include "UMMatrix.h"
+#include <algorithm>
+#include <functional>
+#include "UMThreadPool.h"
+#include <math.h>
+
+#if !defined(WITH_EMSCRIPTEN) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define UM_SKIN_SSE
+	#include <emmintrin.h>
+#endif
+
+namespace
+{
+	using namespace umdraw;
+
+	/// vertices more than this are deformed on worker threads
+	const int parallel_vertex_count = 8192;
+
+	typedef std::pair<float, int> WeightBone;
+	typedef std::vector<WeightBone> WeightBoneList;
+
+	bool greater_weight(const WeightBone& a, const WeightBone& b)
+	{
+		return a.first > b.first;
+	}
+
+	/**
+	 * pack influences of a vertex to 4 slots
+	 * @note when there are more than 4, the largest 4 are scaled to keep the sum.
+	 */
+	void pack_influence(UMSkinInfluence& influence, WeightBoneList& weights)
+	{
+		std::sort(weights.begin(), weights.end(), greater_weight);
+		float sum = 0.0f;
+		float packed_sum = 0.0f;
+		for (size_t i = 0; i < weights.size(); ++i)
+		{
+			sum += weights[i].first;
+			if (i < UMSkinInfluence::influence_count) packed_sum += weights[i].first;
+		}
+		const float scale = (packed_sum > 0.0f) ? sum / packed_sum : 1.0f;
+		for (int i = 0; i < UMSkinInfluence::influence_count; ++i)
+		{
+			if (i < static_cast<int>(weights.size()))
+			{
+				influence.bone[i] = weights[i].second;
+				influence.weight[i] = weights[i].first * scale;
+			}
+			else
+			{
+				influence.bone[i] = 0;
+				influence.weight[i] = 0.0f;
+			}
+		}
+	}
+
+#if defined(UM_SKIN_SSE)
+	/**
+	 * blend bone matrices by weights
+	 */
+	inline void blend_matrix(__m128 rows[4], const UMSkinInfluence& influence, const float* palette)
+	{
+		rows[0] = rows[1] = rows[2] = rows[3] = _mm_setzero_ps();
+		for (int i = 0; i < UMSkinInfluence::influence_count; ++i)
+		{
+			const float weight = influence.weight[i];
+			if (weight == 0.0f) break;
+			const __m128 w = _mm_set1_ps(weight);
+			const float* matrix = palette + influence.bone[i] * 16;
+			rows[0] = _mm_add_ps(rows[0], _mm_mul_ps(w, _mm_loadu_ps(matrix + 0)));
+			rows[1] = _mm_add_ps(rows[1], _mm_mul_ps(w, _mm_loadu_ps(matrix + 4)));
+			rows[2] = _mm_add_ps(rows[2], _mm_mul_ps(w, _mm_loadu_ps(matrix + 8)));
+			rows[3] = _mm_add_ps(rows[3], _mm_mul_ps(w, _mm_loadu_ps(matrix + 12)));
+		}
+	}
+
+	/**
+	 * transform x, y, z, w by rows
+	 */
+	inline __m128 transform(const __m128 rows[4], const float* v)
+	{
+		__m128 result = _mm_mul_ps(_mm_set1_ps(v[0]), rows[0]);
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(v[1]), rows[1]));
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(v[2]), rows[2]));
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(v[3]), rows[3]));
+		return result;
+	}
+#else
+	inline void blend_matrix(float rows[16], const UMSkinInfluence& influence, const float* palette)
+	{
+		std::fill(rows, rows + 16, 0.0f);
+		for (int i = 0; i < UMSkinInfluence::influence_count; ++i)
+		{
+			const float weight = influence.weight[i];
+			if (weight == 0.0f) break;
+			const float* matrix = palette + influence.bone[i] * 16;
+			for (int k = 0; k < 16; ++k)
+			{
+				rows[k] += weight * matrix[k];
+			}
+		}
+	}
+
+	inline void transform(float dst[4], const float rows[16], const float* v)
+	{
+		for (int k = 0; k < 4; ++k)
+		{
+			dst[k] = v[0] * rows[k] + v[1] * rows[4 + k] + v[2] * rows[8 + k] + v[3] * rows[12 + k];
+		}
+	}
+#endif // UM_SKIN_SSE
+
+	/**
+	 * deform points (w = 1) or normals (w = 0)
+	 */
+	void deform_range(
+		UMSkinDeformer::Vec3dList& dst,
+		const float* rest,
+		const UMSkinInfluenceList& influence_list,
+		const int* influence_index,
+		const float* palette,
+		bool is_normal,
+		int begin,
+		int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			const UMSkinInfluence& influence = influence_list[influence_index ? influence_index[i] : i];
+			float v[4];
+#if defined(UM_SKIN_SSE)
+			__m128 rows[4];
+			blend_matrix(rows, influence, palette);
+			_mm_storeu_ps(v, transform(rows, rest + i * 4));
+#else
+			float rows[16];
+			blend_matrix(rows, influence, palette);
+			transform(v, rows, rest + i * 4);
+#endif // UM_SKIN_SSE
+			if (is_normal)
+			{
+				const float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+				const float inv_length = length > 0.0f ? 1.0f / length : 0.0f;
+				v[0] *= inv_length;
+				v[1] *= inv_length;
+				v[2] *= inv_length;
+			}
+			dst[i] = UMVec3d(v[0], v[1], v[2]);
+		}
+	}
+
+} // anonymouse namespace
+
+namespace umdraw
+{
+
+/**
+ * constructor
+ */
+UMSkinDeformer::UMSkinDeformer()
+{
+}
+
+/**
+ * pack weights and rest pose
+ */
+bool UMSkinDeformer::init(
+	const UMSkinList& skin_list,
+	const Vec3dList& vertex_list,
+	const Vec3dList& normal_list,
+	const Vec3iList& face_list)
+{
+	palette_.clear();
+	influence_list_.clear();
+	rest_vertex_list_.clear();
+	rest_normal_list_.clear();
+	normal_vertex_index_list_.clear();
+	if (skin_list.empty()) return false;
+
+	// gather weights of each vertex
+	const int vertex_count = static_cast<int>(vertex_list.size());
+	std::vector<WeightBoneList> weights(vertex_count);
+	for (int bone = 0, bone_count = static_cast<int>(skin_list.size()); bone < bone_count; ++bone)
+	{
+		const UMSkin& skin = skin_list[bone];
+		const UMSkin::IndexList& index_list = skin.index_list();
+		const UMSkin::WeightList& weight_list = skin.weight_list();
+		for (size_t k = 0; k < index_list.size() && k < weight_list.size(); ++k)
+		{
+			const int index = index_list[k];
+			if (index < 0 || index >= vertex_count) continue;
+			weights[index].push_back(WeightBone(static_cast<float>(weight_list[k]), bone));
+		}
+	}
+	influence_list_.resize(vertex_count);
+	for (int i = 0; i < vertex_count; ++i)
+	{
+		pack_influence(influence_list_[i], weights[i]);
+	}
+
+	rest_vertex_list_.resize(vertex_count * 4);
+	for (int i = 0; i < vertex_count; ++i)
+	{
+		const UMVec3d& v = vertex_list[i];
+		rest_vertex_list_[i * 4 + 0] = static_cast<float>(v.x);
+		rest_vertex_list_[i * 4 + 1] = static_cast<float>(v.y);
+		rest_vertex_list_[i * 4 + 2] = static_cast<float>(v.z);
+		rest_vertex_list_[i * 4 + 3] = 1.0f;
+	}
+
+	// normals per face corner use influences of the corner vertex
+	const int normal_count = static_cast<int>(normal_list.size());
+	if (normal_count > vertex_count)
+	{
+		normal_vertex_index_list_.resize(normal_count, 0);
+		for (int i = 0, face_count = static_cast<int>(face_list.size()); i < face_count; ++i)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				const int corner = i * 3 + k;
+				if (corner < normal_count)
+				{
+					normal_vertex_index_list_[corner] = face_list[i][k];
+				}
+			}
+		}
+	}
+	if (normal_count > vertex_count || normal_count == vertex_count)
+	{
+		rest_normal_list_.resize(normal_count * 4);
+		for (int i = 0; i < normal_count; ++i)
+		{
+			const UMVec3d& n = normal_list[i];
+			rest_normal_list_[i * 4 + 0] = static_cast<float>(n.x);
+			rest_normal_list_[i * 4 + 1] = static_cast<float>(n.y);
+			rest_normal_list_[i * 4 + 2] = static_cast<float>(n.z);
+			rest_normal_list_[i * 4 + 3] = 0.0f;
+		}
+	}
+	return true;
+}
+
+/**
+ * compute skinning matrix of each bone
+ */
+void UMSkinDeformer::update_palette(UMSkinList& skin_list)
+{
+	const int bone_count = static_cast<int>(skin_list.size());
+	palette_.assign(bone_count * 16, 0.0f);
+	for (int bone = 0; bone < bone_count; ++bone)
+	{
+		UMNodePtr link = skin_list[bone].link_node();
+		// unlinked bones do not move vertices
+		if (!link) continue;
+		// row vectors. initial pose -> bone space -> current pose
+		const UMMat44d matrix = link->initial_global_transform().inverted() * link->global_transform();
+		float* dst = &palette_[bone * 16];
+		for (int i = 0; i < 4; ++i)
+		{
+			dst[i * 4 + 0] = static_cast<float>(matrix.m[i][0]);
+			dst[i * 4 + 1] = static_cast<float>(matrix.m[i][1]);
+			dst[i * 4 + 2] = static_cast<float>(matrix.m[i][2]);
+			dst[i * 4 + 3] = 0.0f;
+		}
+	}
+}
+
+/**
+ * deform vertices and normals by current bone transforms
+ */
+void UMSkinDeformer::deform(UMSkinList& skin_list, Vec3dList& vertex_list, Vec3dList& normal_list)
+{
+	if (influence_list_.empty()) return;
+	update_palette(skin_list);
+	if (palette_.empty()) return;
+
+	const float* palette = &palette_[0];
+	const UMSkinInfluenceList& influence_list = influence_list_;
+
+	const int vertex_count = static_cast<int>(influence_list_.size());
+	vertex_list.resize(vertex_count);
+	const float* rest_vertex = &rest_vertex_list_[0];
+	umbase::UMThreadPool& thread_pool = umbase::UMThreadPool::instance();
+	thread_pool.parallel_for_range(vertex_count, parallel_vertex_count, [&](int begin, int end) {
+		deform_range(vertex_list, rest_vertex, influence_list, NULL, palette, false, begin, end);
+	});
+
+	const int normal_count = static_cast<int>(rest_normal_list_.size() / 4);
+	if (normal_count == 0) return;
+	normal_list.resize(normal_count);
+	const float* rest_normal = &rest_normal_list_[0];
+	const int* normal_vertex_index = normal_vertex_index_list_.empty() ? NULL : &normal_vertex_index_list_[0];
+	thread_pool.parallel_for_range(normal_count, parallel_vertex_count, [&](int begin, int end) {
+		deform_range(normal_list, rest_normal, influence_list, normal_vertex_index, palette, true, begin, end);
+	});
+}
+
+} // umdraw
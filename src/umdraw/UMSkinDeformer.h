@@ -0,0 +1,94 @@
+/**
+ * @file UMSkinDeformer.h
+ * linear blend skinning
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMVector.h"
+#include "UMSkin.h"
+
+namespace umdraw
+{
+
+class UMSkinDeformer;
+typedef std::shared_ptr<UMSkinDeformer> UMSkinDeformerPtr;
+
+/**
+ * bone influences of a vertex
+ * @note sorted by weight. unused slots have zero weight.
+ */
+struct UMSkinInfluence
+{
+	enum { influence_count = 4 };
+	int bone[influence_count];
+	float weight[influence_count];
+};
+typedef std::vector<UMSkinInfluence> UMSkinInfluenceList;
+
+/**
+ * linear blend skinning
+ * @note weights are packed per vertex at init.
+ * deform computes one matrix per bone and blends them in float.
+ */
+class UMSkinDeformer
+{
+	DISALLOW_COPY_AND_ASSIGN(UMSkinDeformer);
+public:
+	typedef std::vector<UMVec3d> Vec3dList;
+	typedef std::vector<UMVec3i> Vec3iList;
+
+	UMSkinDeformer();
+	~UMSkinDeformer() {}
+
+	/**
+	 * pack weights and rest pose
+	 * @param [in] skin_list skins. a skin is a bone.
+	 * @param [in] vertex_list vertices at initial pose
+	 * @param [in] normal_list normals at initial pose. per vertex or per face corner.
+	 * @param [in] face_list faces
+	 * @retval success or fail
+	 */
+	bool init(
+		const UMSkinList& skin_list,
+		const Vec3dList& vertex_list,
+		const Vec3dList& normal_list,
+		const Vec3iList& face_list);
+
+	/**
+	 * deform vertices and normals by current bone transforms
+	 * @param [in] skin_list skins given to init
+	 * @param [out] vertex_list deformed vertices
+	 * @param [out] normal_list deformed normals
+	 */
+	void deform(UMSkinList& skin_list, Vec3dList& vertex_list, Vec3dList& normal_list);
+
+	/**
+	 * get packed influences
+	 */
+	const UMSkinInfluenceList& influence_list() const { return influence_list_; }
+
+private:
+	void update_palette(UMSkinList& skin_list);
+
+	/// 4x4 float per bone. rows are x, y, z axis and translation.
+	std::vector<float> palette_;
+	UMSkinInfluenceList influence_list_;
+	/// x, y, z, 1
+	std::vector<float> rest_vertex_list_;
+	/// x, y, z, 0
+	std::vector<float> rest_normal_list_;
+	/// vertex index of each normal
+	std::vector<int> normal_vertex_index_list_;
+};
+
+} // umdraw
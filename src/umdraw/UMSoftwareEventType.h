@@ -18,6 +18,8 @@ enum {
 	eSoftwareEventCameraChaged = 1,
 	eSoftwareEventForegroundChaged,
 	eSoftwareEventBackgroundChaged,
+	eSoftwareEventLoadProgress,
+	eSoftwareEventLoaded,
 };
 
 } // umdraw
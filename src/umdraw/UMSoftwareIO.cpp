@@ -8,6 +8,9 @@
  *
  */
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
 #include <assert.h>
 
 #include "UMIO.h"
@@ -21,6 +24,7 @@
 #include "UMImage.h"
 #include "UMLight.h"
 #include "UMMatrix.h"
+#include "UMThreadPool.h"
 
 namespace
 {
@@ -67,19 +71,31 @@ namespace
 	 */
 	void load_vertex_index(UMMeshPtr mesh, const umio::UMMesh& ummesh)
 	{
-		const int size = static_cast<int>(ummesh.vertex_index_list().size());
+		const umio::IntListVec& src = ummesh.vertex_index_list();
+		const int size = static_cast<int>(src.size());
 		mesh->mutable_face_list().resize(size);
+		UMVec3i* dst = size > 0 ? &mesh->mutable_face_list()[0] : NULL;
 		for (int i = 0; i < size; ++i)
 		{
-			const umio::IntList& index = ummesh.vertex_index_list().at(i);
-			UMVec3i umface( index.at(0), index.at(1), index.at(2) );
-			mesh->mutable_face_list().at(i) = umface;
+			const int* index = &src[i][0];
+			dst[i] = UMVec3i(index[0], index[1], index[2]);
 		}
-		mesh->mutable_vertex_index_list().resize(size);
+		mesh->mutable_vertex_index_list().assign(src.begin(), src.end());
+	}
+
+	/**
+	 * load 3 component rows from umio to umdraw
+	 */
+	void load_vec3_list(UMMesh::Vec3dList& dst, const umio::DoubleListVec& src, double scale)
+	{
+		const int size = static_cast<int>(src.size());
+		dst.resize(size);
+		if (size == 0) return;
+		UMVec3d* dst_data = &dst[0];
 		for (int i = 0; i < size; ++i)
 		{
-			const umio::IntList& index = ummesh.vertex_index_list().at(i);
-			mesh->mutable_vertex_index_list().at(i) = index;
+			const double* row = &src[i][0];
+			dst_data[i] = UMVec3d(row[0] * scale, row[1] * scale, row[2] * scale);
 		}
 	}
 
@@ -88,15 +104,7 @@ namespace
 	 */
 	void load_vertex(UMMeshPtr mesh, const umio::UMMesh& ummesh)
 	{
-		const int size = static_cast<int>(ummesh.vertex_list().size());
-		mesh->mutable_vertex_list().resize(size);
-		for (int i = 0; i < size; ++i)
-		{
-			const umio::DoubleList& vertex = ummesh.vertex_list().at(i);
-			UMVec3d umvertex( vertex.at(0), vertex.at(1), vertex.at(2) );
-			//printf("v %f %f %f.\n", umvertex.x, umvertex.y, umvertex.z);
-			mesh->mutable_vertex_list().at(i) = umvertex * import_scale_for_debug;
-		}
+		load_vec3_list(mesh->mutable_vertex_list(), ummesh.vertex_list(), import_scale_for_debug);
 	}
 	
 	/**
@@ -104,15 +112,7 @@ namespace
 	 */
 	void load_normal(UMMeshPtr mesh, const umio::UMMesh& ummesh)
 	{
-		const int size = static_cast<int>(ummesh.normal_list().size());
-		mesh->mutable_normal_list().resize(size);
-		for (int i = 0; i < size; ++i)
-		{
-			const umio::DoubleList& normal = ummesh.normal_list().at(i);
-			UMVec3d umnormal( normal.at(0), normal.at(1), normal.at(2) );
-			//printf("n %f %f %f.\n", umnormal.x, umnormal.y, umnormal.z);
-			mesh->mutable_normal_list().at(i) = umnormal;
-		}
+		load_vec3_list(mesh->mutable_normal_list(), ummesh.normal_list(), 1.0);
 	}
 	
 	/**
@@ -120,14 +120,15 @@ namespace
 	 */
 	void load_uv(UMMeshPtr mesh, const umio::UMMesh& ummesh)
 	{
-		const int size = static_cast<int>(ummesh.uv_list().size());
+		const umio::DoubleListVec& src = ummesh.uv_list();
+		const int size = static_cast<int>(src.size());
 		mesh->mutable_uv_list().resize(size);
+		if (size == 0) return;
+		UMVec2d* dst = &mesh->mutable_uv_list()[0];
 		for (int i = 0; i < size; ++i)
 		{
-			const umio::DoubleList& uv = ummesh.uv_list().at(i);
-			UMVec2d umuv( uv.at(0), uv.at(1) );
-			//printf("uv %f %f.\n", umuv.x, umuv.y);
-			mesh->mutable_uv_list().at(i) = umuv;
+			const double* row = &src[i][0];
+			dst[i] = UMVec2d(row[0], row[1]);
 		}
 	}
 	
@@ -161,6 +162,20 @@ namespace
 	{
 		const int size = static_cast<int>(ummesh.material_list().size());
 		mesh->mutable_material_list().resize(size);
+
+		// polygons per material in one pass
+		std::vector<int> polygon_count_list(size, 0);
+		{
+			const umio::IntList& material_index = ummesh.material_index_list();
+			for (size_t i = 0, isize = material_index.size(); i < isize; ++i)
+			{
+				const int index = material_index[i];
+				if (index >= 0 && index < size)
+				{
+					++polygon_count_list[index];
+				}
+			}
+		}
 		
 		//printf("material size  %d .\n", size);
 		for (int i = 0; i < size; ++i)
@@ -200,12 +215,7 @@ namespace
 #endif
 			}
 
-			const int polygon_count = static_cast<int>(std::count(
-				ummesh.material_index_list().begin(), 
-				ummesh.material_index_list().end(),
-				i));
-
-			ummaterial->set_polygon_count(polygon_count);
+			ummaterial->set_polygon_count(polygon_count_list[i]);
 			mesh->mutable_material_list().at(i) = ummaterial;
 		}
 
@@ -366,26 +376,44 @@ bool UMSoftwareIO::import_mesh_list(UMMeshList& dst, const umio::UMObjectPtr src
 {
 	if (!src) return false;
 
-	bool result = false;
+	// meshes are independent, so they are converted on threads
+	std::vector<umio::UMMesh*> src_list;
+	src_list.reserve(src->mutable_mesh_map().size());
 	umio::UMMesh::IDToMeshMap::iterator it = src->mutable_mesh_map().begin();
 	for (; it != src->mutable_mesh_map().end(); ++it)
 	{
-		umio::UMMesh& ummesh = it->second;
-
-		UMMeshPtr mesh(std::make_shared<UMMesh>());
-		dst.push_back(mesh);
-		result = true;
-		
-		sort_by_material(ummesh);
-		load_material(absolute_file_path, mesh, ummesh);
-		load_vertex_index(mesh, ummesh);
-		load_vertex(mesh, ummesh);
-		load_normal(mesh, ummesh);
-		load_uv(mesh, ummesh);
-		load_skin(mesh, ummesh);
-		mesh->update_box();
+		src_list.push_back(&it->second);
 	}
-	return result;
+	const int mesh_count = static_cast<int>(src_list.size());
+	const size_t first = dst.size();
+	dst.reserve(first + mesh_count);
+	for (int i = 0; i < mesh_count; ++i)
+	{
+		dst.push_back(std::make_shared<UMMesh>());
+	}
+	// meshes of uneven size are balanced by taking them one by one
+	umbase::UMThreadPool::instance().parallel_for(mesh_count, [&](int i) {
+		import_mesh(dst[first + i], *src_list[i], absolute_file_path);
+	});
+	return mesh_count > 0;
+}
+
+/** 
+ * import a umdraw mesh
+ */
+bool UMSoftwareIO::import_mesh(UMMeshPtr dst, umio::UMMesh& src, const umstring& absolute_file_path)
+{
+	if (!dst) return false;
+
+	sort_by_material(src);
+	load_material(absolute_file_path, dst, src);
+	load_vertex_index(dst, src);
+	load_vertex(dst, src);
+	load_normal(dst, src);
+	load_uv(dst, src);
+	load_skin(dst, src);
+	dst->update_box();
+	return true;
 }
 
 /** 
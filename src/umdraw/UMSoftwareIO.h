@@ -15,6 +15,7 @@ namespace umio
 {
 	class UMObject;
 	typedef std::shared_ptr<UMObject> UMObjectPtr;
+	class UMMesh;
 };
 
 namespace umdraw
@@ -48,6 +49,18 @@ public:
 		const umio::UMObjectPtr src,
 		const umstring& absolute_file_path);
 	
+	/** 
+	 * import a umdraw mesh
+	 * @param [out] dst distination mesh
+	 * @param [in,out] src source mesh. elements are sorted by material.
+	 * @param [in] absolute_file_path file path
+	 * @note meshes of an object can be imported on different threads
+	 */
+	static bool import_mesh(
+		UMMeshPtr dst,
+		umio::UMMesh& src,
+		const umstring& absolute_file_path);
+
 	/** 
 	 * import umdraw node list
 	 * @param [out] dst distination mesh list
@@ -0,0 +1,229 @@
+/**
+ * @file UMTransformHierarchy.cpp
+ * flattened node hierarchy for global transform update
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMTransformHierarchy.h"
+#include "UMMesh.h"
+#include "UMSkin.h"
+
+namespace umdraw
+{
+
+/**
+ * constructor
+ */
+UMTransformHierarchy::UMTransformHierarchy()
+	: frame_(0)
+{
+}
+
+/**
+ * clear all nodes
+ */
+void UMTransformHierarchy::clear()
+{
+	node_list_.clear();
+	parent_list_.clear();
+	position_list_.clear();
+	index_list_.clear();
+	dirty_list_.clear();
+	changed_frame_list_.clear();
+	changed_root_list_.clear();
+	position_map_.clear();
+}
+
+/**
+ * build from node list
+ */
+void UMTransformHierarchy::build(const UMNodeList& node_list)
+{
+	clear();
+	const int node_count = static_cast<int>(node_list.size());
+	std::map<const UMNode*, int> index_map;
+	for (int i = 0; i < node_count; ++i)
+	{
+		index_map[node_list[i].get()] = i;
+	}
+
+	// depth first from each root, so that a parent is always before its children
+	std::vector<unsigned char> is_visited(node_count, 0);
+	std::vector<int> stack;
+	for (int i = 0; i < node_count; ++i)
+	{
+		int root = i;
+		// climb to the topmost ancestor in the list
+		for (UMNodePtr parent = node_list[root]->parent(); parent; parent = parent->parent())
+		{
+			std::map<const UMNode*, int>::const_iterator it = index_map.find(parent.get());
+			if (it != index_map.end())
+			{
+				root = it->second;
+			}
+		}
+		if (is_visited[root]) continue;
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			const int index = stack.back();
+			stack.pop_back();
+			if (is_visited[index]) continue;
+			is_visited[index] = 1;
+
+			UMNodePtr node = node_list[index];
+			int parent_position = -1;
+			if (UMNodePtr parent = node->parent())
+			{
+				std::map<const UMNode*, int>::const_iterator it = position_map_.find(parent.get());
+				if (it != position_map_.end())
+				{
+					parent_position = it->second;
+				}
+			}
+			position_map_[node.get()] = static_cast<int>(node_list_.size());
+			node_list_.push_back(node);
+			parent_list_.push_back(parent_position);
+			index_list_.push_back(index);
+
+			const UMNodeList& children = node->children();
+			for (UMNodeList::const_reverse_iterator ct = children.rbegin(); ct != children.rend(); ++ct)
+			{
+				std::map<const UMNode*, int>::const_iterator it = index_map.find(ct->get());
+				if (it != index_map.end() && !is_visited[it->second])
+				{
+					stack.push_back(it->second);
+				}
+			}
+		}
+	}
+
+	position_list_.resize(node_count);
+	for (int i = 0, size = static_cast<int>(index_list_.size()); i < size; ++i)
+	{
+		position_list_[index_list_[i]] = i;
+	}
+	dirty_list_.assign(node_list_.size(), 1);
+	// rebuilding is a change for users which checked the old nodes
+	++frame_;
+	changed_frame_list_.assign(node_list_.size(), frame_);
+}
+
+/**
+ * set local transform and mark the node dirty if it changed
+ */
+void UMTransformHierarchy::set_local_transform(int index, const UMMat44d& local_transform)
+{
+	if (index < 0 || index >= static_cast<int>(position_list_.size())) return;
+	const int position = position_list_[index];
+	UMMat44d& current = node_list_[position]->mutable_local_transform();
+	if (current == local_transform) return;
+	current = local_transform;
+	dirty_list_[position] = 1;
+}
+
+/**
+ * mark a node dirty
+ */
+void UMTransformHierarchy::set_dirty(int index)
+{
+	if (index < 0 || index >= static_cast<int>(position_list_.size())) return;
+	dirty_list_[position_list_[index]] = 1;
+}
+
+/**
+ * mark all nodes dirty
+ */
+void UMTransformHierarchy::set_all_dirty()
+{
+	dirty_list_.assign(node_list_.size(), 1);
+}
+
+/**
+ * update global transforms of dirty nodes and their descendants
+ */
+int UMTransformHierarchy::update()
+{
+	changed_root_list_.clear();
+	const int node_count = static_cast<int>(node_list_.size());
+	const int next_frame = frame_ + 1;
+	int updated_count = 0;
+	for (int i = 0; i < node_count; ++i)
+	{
+		const int parent = parent_list_[i];
+		const bool is_parent_changed = (parent >= 0 && changed_frame_list_[parent] == next_frame);
+		if (!dirty_list_[i] && !is_parent_changed) continue;
+		dirty_list_[i] = 0;
+
+		UMNode& node = *node_list_[i];
+		if (parent >= 0)
+		{
+			node.mutable_global_transform() = node.local_transform() * node_list_[parent]->global_transform();
+		}
+		else if (UMNodePtr outer_parent = node.parent())
+		{
+			// parent out of the hierarchy
+			node.mutable_global_transform() = node.local_transform() * outer_parent->global_transform();
+		}
+		else
+		{
+			node.mutable_global_transform() = node.local_transform();
+		}
+		changed_frame_list_[i] = next_frame;
+		if (!is_parent_changed)
+		{
+			changed_root_list_.push_back(index_list_[i]);
+		}
+		++updated_count;
+	}
+	if (updated_count > 0)
+	{
+		frame_ = next_frame;
+	}
+	return updated_count;
+}
+
+/**
+ * changed after the frame or not
+ */
+bool UMTransformHierarchy::is_changed_since(int index, int frame) const
+{
+	if (index < 0 || index >= static_cast<int>(position_list_.size())) return true;
+	return changed_frame_list_[position_list_[index]] > frame;
+}
+
+/**
+ * changed after the frame or not
+ */
+bool UMTransformHierarchy::is_changed_since(const UMNodePtr& node, int frame) const
+{
+	std::map<const UMNode*, int>::const_iterator it = position_map_.find(node.get());
+	if (it == position_map_.end()) return true;
+	return changed_frame_list_[it->second] > frame;
+}
+
+/**
+ * mesh or its skin links changed after the frame or not
+ */
+bool UMTransformHierarchy::is_deformed_since(const UMMeshPtr& mesh, int frame) const
+{
+	if (!mesh) return false;
+	if (frame < 0) return true;
+	if (mesh->skin_list().empty())
+	{
+		return is_changed_since(mesh, frame);
+	}
+	UMSkinList::const_iterator it = mesh->skin_list().begin();
+	for (; it != mesh->skin_list().end(); ++it)
+	{
+		UMNodePtr link = it->link_node();
+		if (link && is_changed_since(link, frame)) return true;
+	}
+	return false;
+}
+
+} // umdraw
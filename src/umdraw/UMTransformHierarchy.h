@@ -0,0 +1,130 @@
+/**
+ * @file UMTransformHierarchy.h
+ * flattened node hierarchy for global transform update
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <map>
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMNode.h"
+
+namespace umdraw
+{
+
+class UMMesh;
+typedef std::shared_ptr<UMMesh> UMMeshPtr;
+
+class UMTransformHierarchy;
+typedef std::shared_ptr<UMTransformHierarchy> UMTransformHierarchyPtr;
+
+/**
+ * flattened node hierarchy for global transform update
+ * @note nodes are ordered parent before child, and each global transform
+ * is computed once from its parent. only dirty nodes and their descendants are updated.
+ * each update is numbered as a frame, and users can ask what changed since a frame.
+ */
+class UMTransformHierarchy
+{
+	DISALLOW_COPY_AND_ASSIGN(UMTransformHierarchy);
+public:
+	UMTransformHierarchy();
+	~UMTransformHierarchy() {}
+
+	/**
+	 * build from node list
+	 * @param [in] node_list nodes. parents are found by UMNode::parent.
+	 * @note all nodes are dirty after build, and frame is increased.
+	 */
+	void build(const UMNodeList& node_list);
+
+	/**
+	 * clear all nodes
+	 */
+	void clear();
+
+	/**
+	 * get node count
+	 */
+	int node_count() const { return static_cast<int>(node_list_.size()); }
+
+	/**
+	 * set local transform and mark the node dirty
+	 * @note the node is left clean if the transform is not changed
+	 * @param [in] index index in the node list given to build
+	 * @param [in] local_transform local transform
+	 */
+	void set_local_transform(int index, const UMMat44d& local_transform);
+
+	/**
+	 * mark a node dirty
+	 * @param [in] index index in the node list given to build
+	 */
+	void set_dirty(int index);
+
+	/**
+	 * mark all nodes dirty
+	 */
+	void set_all_dirty();
+
+	/**
+	 * update global transforms of dirty nodes and their descendants
+	 * @retval updated node count
+	 */
+	int update();
+
+	/**
+	 * get current frame. increased by each update which changed nodes.
+	 */
+	int frame() const { return frame_; }
+
+	/**
+	 * changed after the frame or not
+	 * @param [in] index index in the node list given to build
+	 * @param [in] frame frame of last check. -1 means never.
+	 */
+	bool is_changed_since(int index, int frame) const;
+
+	/**
+	 * changed after the frame or not
+	 * @note nodes out of the hierarchy are always changed
+	 */
+	bool is_changed_since(const UMNodePtr& node, int frame) const;
+
+	/**
+	 * mesh or its skin links changed after the frame or not
+	 */
+	bool is_deformed_since(const UMMeshPtr& mesh, int frame) const;
+
+	/**
+	 * get roots of subtrees updated by last update
+	 * @note indices in the node list given to build
+	 */
+	const std::vector<int>& changed_root_list() const { return changed_root_list_; }
+
+private:
+	/// nodes in parent before child order
+	UMNodeList node_list_;
+	/// parent position in node_list_. -1 is root
+	std::vector<int> parent_list_;
+	/// position in node_list_ of each index given to build
+	std::vector<int> position_list_;
+	/// index given to build of each position
+	std::vector<int> index_list_;
+	std::vector<unsigned char> dirty_list_;
+	/// frame when the node changed last
+	std::vector<int> changed_frame_list_;
+	std::vector<int> changed_root_list_;
+	std::map<const UMNode*, int> position_map_;
+	int frame_;
+};
+
+} // umdraw
@@ -101,8 +101,8 @@ UMGUIBoardPtr UMGUIBoard::create_color_circle_board(
 	// set color circle shader
 	umresource::UMResource& resource = umresource::UMResource::instance();
 	umdraw::UMShaderEntryPtr entry = std::make_shared<umdraw::UMShaderEntry>();
-	entry->set_gl_vertex_shader(umresource::UMResource::find_resource_data(resource, "UMColorCircle.vs"));
-	entry->set_gl_fragment_shader(umresource::UMResource::find_resource_data(resource, "UMColorCircle.fs"));
+	entry->set_gl_vertex_shader(resource.find_resource_memory("UMColorCircle.vs").to_string());
+	entry->set_gl_fragment_shader(resource.find_resource_memory("UMColorCircle.fs").to_string());
 	mesh->set_shader_entry(entry);
 	return board;
 }
@@ -296,6 +296,9 @@ int UMGUIBoard::add_text_panel(
 		umdraw::UMMeshPtr mesh = mesh_;
 		
 		const int height = font_size;
+		// distance field atlas is rendered at one size, and padded by the spread
+		const double atlas_scale = font->atlas_scale(font_size);
+		const int padding = font->atlas_padding();
 
 		// create text
 		for (size_t i = 0, size = text.size(); i < size; ++i)
@@ -305,18 +308,22 @@ int UMGUIBoard::add_text_panel(
 			const double uv_top = rect.w * inv_image_height;
 			const double uv_right = rect.z * inv_image_width;
 			const double uv_bottom = rect.y * inv_image_height;
-			const int width = (rect.z - rect.x);
-			//const int height = (rect.w - rect.y);
+			const int rect_width = static_cast<int>(rect.z - rect.x) - padding * 2;
+			const int rect_height = static_cast<int>(rect.w - rect.y) - padding * 2;
+			const int width = static_cast<int>(rect_width * atlas_scale + 0.5);
+			// quad is extended to the padding
+			const double padding_x = padding * atlas_scale;
+			const double padding_y = rect_height > 0 ? padding * height / static_cast<double>(rect_height) : 0.0;
 			
 			// front +z
 			// v0--v1
 			//  |   |
 			// v2--v3
 			UMVec3d point(x - hw, - y + hh - height, depth_);
-			UMVec3d v0 = UMVec3d(     0, 0, 0.0) + point;
-			UMVec3d v1 = UMVec3d( width, 0, 0.0) + point;
-			UMVec3d v2 = UMVec3d(     0, height, 0.0) + point;
-			UMVec3d v3 = UMVec3d( width, height, 0.0) + point;
+			UMVec3d v0 = UMVec3d(        -padding_x,         -padding_y, 0.0) + point;
+			UMVec3d v1 = UMVec3d(width + padding_x,          -padding_y, 0.0) + point;
+			UMVec3d v2 = UMVec3d(        -padding_x, height + padding_y, 0.0) + point;
+			UMVec3d v3 = UMVec3d(width + padding_x,  height + padding_y, 0.0) + point;
 			mesh->mutable_vertex_list().push_back(v0);
 			mesh->mutable_vertex_list().push_back(v1);
 			mesh->mutable_vertex_list().push_back(v2);
@@ -347,6 +354,8 @@ int UMGUIBoard::add_text_panel(
 		}
 
 		umdraw::UMMaterialPtr material = umdraw::UMMaterial::default_material();
+		// drawers threshold the alpha of a distance field
+		material->set_distance_field_edge(font->distance_field_edge(font_size));
 
 		material->set_polygon_count(material->polygon_count() + 2 * static_cast<int>(text.size()));
 		material->mutable_texture_list().push_back(image);
@@ -50,15 +50,50 @@ public:
 	 */
 	bool load_font_from_memory(const umstring& file_name, const std::string& data) const;
 
+	/**
+	 * load font from memory without copy
+	 * @note data must be alive while the font is used
+	 */
+	bool load_font_from_memory(const umstring& file_name, const char* data, size_t size) const;
+
 	/**
 	 * is font loaded
 	 */
 	bool is_font_loaded(const umstring& font_name) const;
 
 	/**
-	 * get font image. initialize is requred.
+	 * get font atlas including all characters of the text
+	 * @note atlases are kept per font and size. glyphs are cached.
 	 */
 	UMTextureAtlasPtr font_atlas(const umstring& font_name, const umtextstring& text, int font_size) const;
+
+	/**
+	 * render atlas glyphs as signed distance fields of one size
+	 * @note an atlas serves all font sizes. alpha 0.5 is the edge of a glyph.
+	 * set distance_field_edge to materials of the text, so that drawers threshold the alpha.
+	 */
+	void set_distance_field_enabled(bool enabled) const;
+
+	/**
+	 * get whether atlas glyphs are signed distance fields
+	 */
+	bool is_distance_field_enabled() const;
+
+	/**
+	 * get scale from text rects of an atlas to the font size
+	 */
+	double atlas_scale(int font_size) const;
+
+	/**
+	 * get padding pixels around each text rect of an atlas
+	 */
+	int atlas_padding() const;
+
+	/**
+	 * get alpha range of half a pixel at the font size around the edge
+	 * @retval 0 if atlas glyphs are not distance fields
+	 */
+	double distance_field_edge(int font_size) const;
 	
 	/**
 	 * create font image 
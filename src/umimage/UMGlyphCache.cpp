@@ -0,0 +1,185 @@
+/**
+ * @file UMGlyphCache.cpp
+ * rendered glyphs shared by font backends
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMGlyphCache.h"
+
+#include <algorithm>
+#include <math.h>
+#include "UMImage.h"
+
+namespace umimage
+{
+
+/**
+ * order of keys
+ */
+bool UMGlyphCache::Key::operator<(const Key& other) const
+{
+	if (codepoint != other.codepoint) return codepoint < other.codepoint;
+	if (font_size != other.font_size) return font_size < other.font_size;
+	return font_name < other.font_name;
+}
+
+/**
+ * get a glyph
+ */
+const UMGlyph* UMGlyphCache::glyph(
+	const umstring& font_name,
+	int font_size,
+	unsigned int codepoint,
+	const RenderFunction& render)
+{
+	const Key key(font_name, font_size, codepoint);
+	GlyphMap::const_iterator it = glyph_map_.find(key);
+	if (it != glyph_map_.end()) return &it->second;
+	if (missing_set_.find(key) != missing_set_.end()) return NULL;
+
+	UMGlyph glyph;
+	if (!render || !render(glyph))
+	{
+		missing_set_.insert(key);
+		return NULL;
+	}
+	UMGlyph& stored = glyph_map_[key];
+	stored = glyph;
+	return &stored;
+}
+
+/**
+ * convert coverage to a signed distance field in place
+ */
+void UMGlyphCache::convert_to_distance_field(
+	std::vector<unsigned char>& coverage,
+	int width,
+	int height,
+	int spread)
+{
+	if (spread <= 0 || width <= 0 || height <= 0) return;
+	if (static_cast<int>(coverage.size()) < width * height) return;
+
+	const std::vector<unsigned char> src(coverage);
+	const int max_distance2 = spread * spread;
+	const double scale = 127.0 / spread;
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			const bool is_inside = src[y * width + x] >= 128;
+			// nearest pixel of the other side in the spread
+			int distance2 = max_distance2;
+			const int y_begin = (std::max)(y - spread, 0);
+			const int y_end = (std::min)(y + spread, height - 1);
+			const int x_begin = (std::max)(x - spread, 0);
+			const int x_end = (std::min)(x + spread, width - 1);
+			for (int sy = y_begin; sy <= y_end; ++sy)
+			{
+				const int dy2 = (sy - y) * (sy - y);
+				if (dy2 >= distance2) continue;
+				const unsigned char* row = &src[sy * width];
+				for (int sx = x_begin; sx <= x_end; ++sx)
+				{
+					if ((row[sx] >= 128) == is_inside) continue;
+					const int d2 = dy2 + (sx - x) * (sx - x);
+					if (d2 < distance2)
+					{
+						distance2 = d2;
+					}
+				}
+			}
+			const double distance = sqrt(static_cast<double>(distance2)) - 0.5;
+			const double value = is_inside ? 128.0 + distance * scale : 127.0 - distance * scale;
+			coverage[y * width + x] = static_cast<unsigned char>((std::min)((std::max)(value, 0.0), 255.0));
+		}
+	}
+}
+
+/**
+ * draw a glyph as black on an RGBA8 image
+ */
+void UMGlyphCache::draw_glyph(UMImagePtr image, const UMGlyph& glyph, int x, int y)
+{
+	if (!image || image->format() != UMImage::ePixelFormatRGBA8) return;
+	const UMImage::View view = image->view();
+	for (int gy = 0; gy < glyph.height; ++gy)
+	{
+		const int iy = y + glyph.top + gy;
+		if (iy < 0 || iy >= view.height) continue;
+		const unsigned char* src = &glyph.coverage[gy * glyph.width];
+		unsigned char* row = view.row(iy);
+		for (int gx = 0; gx < glyph.width; ++gx)
+		{
+			const int ix = x + glyph.left + gx;
+			if (ix < 0 || ix >= view.width) continue;
+			const unsigned char value = 0xFF - src[gx];
+			row[ix * 4 + 0] = value;
+			row[ix * 4 + 1] = value;
+			row[ix * 4 + 2] = value;
+			row[ix * 4 + 3] = 0xFF;
+		}
+	}
+	const int left = (std::min)((std::max)(x + glyph.left, 0), view.width);
+	const int top = (std::min)((std::max)(y + glyph.top, 0), view.height);
+	const int right = (std::min)((std::max)(x + glyph.left + glyph.width, 0), view.width);
+	const int bottom = (std::min)((std::max)(y + glyph.top + glyph.height, 0), view.height);
+	if (left < right && top < bottom)
+	{
+		image->add_dirty_rect(UMVec4ui(left, top, right, bottom));
+	}
+}
+
+/**
+ * create RGBA8 image of a glyph
+ */
+UMImagePtr UMGlyphCache::create_glyph_image(const UMGlyph& glyph, int distance_field_spread)
+{
+	// outside ramp of the distance field needs the spread around the glyph
+	const int padding = (std::max)(distance_field_spread, 0);
+	const int image_width = (std::max)(glyph.advance, 0) + 2 + padding * 2;
+	const int image_height = (std::max)(glyph.top, 0) + glyph.height + 2 + padding * 2;
+
+	// coverage on the image, clipped
+	std::vector<unsigned char> canvas(image_width * image_height, 0);
+	for (int y = 0; y < glyph.height; ++y)
+	{
+		const int iy = y + glyph.top + padding;
+		if (iy < 0 || iy >= image_height) continue;
+		const unsigned char* src = &glyph.coverage[y * glyph.width];
+		unsigned char* dst = &canvas[iy * image_width];
+		for (int x = 0; x < glyph.width; ++x)
+		{
+			const int ix = x + glyph.left + padding;
+			if (ix < 0 || ix >= image_width) continue;
+			dst[ix] = src[x];
+		}
+	}
+	if (padding > 0)
+	{
+		convert_to_distance_field(canvas, image_width, image_height, padding);
+	}
+
+	UMImagePtr image(std::make_shared<UMImage>());
+	if (!image->init(image_width, image_height, UMImage::ePixelFormatRGBA8)) return UMImagePtr();
+	const UMImage::View view = image->view();
+	for (int y = 0; y < image_height; ++y)
+	{
+		unsigned char* row = view.row(y);
+		const unsigned char* src = &canvas[y * image_width];
+		for (int x = 0; x < image_width; ++x)
+		{
+			row[x * 4 + 0] = 0xFF;
+			row[x * 4 + 1] = 0xFF;
+			row[x * 4 + 2] = 0xFF;
+			row[x * 4 + 3] = src[x];
+		}
+	}
+	return image;
+}
+
+} // umimage
@@ -0,0 +1,126 @@
+/**
+ * @file UMGlyphCache.h
+ * rendered glyphs shared by font backends
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <functional>
+#include "UMMacro.h"
+
+namespace umimage
+{
+
+class UMImage;
+typedef std::shared_ptr<UMImage> UMImagePtr;
+
+/**
+ * metrics and coverage of a rendered glyph
+ * @note offsets are from the left-top of a line whose height is the font size
+ */
+struct UMGlyph
+{
+	UMGlyph() : width(0), height(0), left(0), top(0), advance(0), line_advance(0) {}
+	int width;
+	int height;
+	int left;
+	int top;
+	int advance;
+	int line_advance;
+	/// 8 bit coverage of width * height
+	std::vector<unsigned char> coverage;
+};
+
+/**
+ * glyphs keyed by (font, size, codepoint)
+ * @note glyphs are rendered once and never released until clear()
+ */
+class UMGlyphCache
+{
+	DISALLOW_COPY_AND_ASSIGN(UMGlyphCache);
+public:
+	/**
+	 * render a glyph with a font backend
+	 * @retval false if the font has no glyph
+	 */
+	typedef std::function<bool (UMGlyph&)> RenderFunction;
+
+	UMGlyphCache() {}
+	~UMGlyphCache() {}
+
+	/**
+	 * get a glyph. render and store it if not cached.
+	 * @retval NULL if rendering failed
+	 */
+	const UMGlyph* glyph(
+		const umstring& font_name,
+		int font_size,
+		unsigned int codepoint,
+		const RenderFunction& render);
+
+	/**
+	 * get glyph count
+	 */
+	int size() const { return static_cast<int>(glyph_map_.size()); }
+
+	/**
+	 * clear all glyphs
+	 */
+	void clear()
+	{
+		glyph_map_.clear();
+		missing_set_.clear();
+	}
+
+	/**
+	 * convert coverage to a signed distance field in place
+	 * @param [in] spread pixels mapped to 0 outside and 255 inside. edge is 128.
+	 */
+	static void convert_to_distance_field(
+		std::vector<unsigned char>& coverage,
+		int width,
+		int height,
+		int spread);
+
+	/**
+	 * draw a glyph as black on an RGBA8 image
+	 * @param [in] x left of the line
+	 * @param [in] y top of the line
+	 */
+	static void draw_glyph(UMImagePtr image, const UMGlyph& glyph, int x, int y);
+
+	/**
+	 * create RGBA8 image of a glyph as white with alpha
+	 * @note image is (advance + 2) x (top + height + 2), glyph is at (left, top).
+	 * for distance field, the image is padded by the spread on each side.
+	 * @param [in] distance_field_spread 0 for coverage, otherwise spread of distance field
+	 */
+	static UMImagePtr create_glyph_image(const UMGlyph& glyph, int distance_field_spread);
+
+private:
+	struct Key
+	{
+		Key(const umstring& font_name, int font_size, unsigned int codepoint)
+			: font_name(font_name), font_size(font_size), codepoint(codepoint) {}
+		umstring font_name;
+		int font_size;
+		unsigned int codepoint;
+		bool operator<(const Key& other) const;
+	};
+	typedef std::map<Key, UMGlyph> GlyphMap;
+	GlyphMap glyph_map_;
+	/// codepoints which the font cannot render
+	std::set<Key> missing_set_;
+};
+
+} // umimage
@@ -17,7 +17,19 @@
 #include <OpenImageIO/imageio.h>
 #endif
 
+#if !defined(WITH_EMSCRIPTEN) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define UM_IMAGE_SSE
+	#include <emmintrin.h>
+#endif
+
+#if defined(UM_IMAGE_SSE) && defined(__F16C__)
+	#define UM_IMAGE_F16C
+	#include <immintrin.h>
+#endif
+
 #include <memory>
+#include <string.h>
+#include <algorithm>
 #include "UMImage.h"
 #include "UMVector.h"
 #include "UMPath.h"
@@ -31,6 +43,321 @@ namespace umimage
 namespace
 {
 	unsigned int global_id_counter = 0;
+
+	typedef UMImage::PixelFormat PixelFormat;
+
+	/// rows of typed formats are aligned to this
+	const int row_alignment = 16;
+
+	/// pixels converted through float at a time
+	const int chunk_size = 256;
+
+	/// dirty rects are merged to a bounding box over this count
+	const size_t max_dirty_rect_count = 32;
+
+	unsigned int rect_area(const UMVec4ui& rect)
+	{
+		return (rect[2] - rect[0]) * (rect[3] - rect[1]);
+	}
+
+	UMVec4ui rect_union(const UMVec4ui& a, const UMVec4ui& b)
+	{
+		return UMVec4ui(
+			(std::min)(a[0], b[0]),
+			(std::min)(a[1], b[1]),
+			(std::max)(a[2], b[2]),
+			(std::max)(a[3], b[3]));
+	}
+
+	/**
+	 * two rects should be merged when the union covers no extra pixels.
+	 * e.g. neighboring tiles in a row.
+	 */
+	bool is_mergeable_rect(const UMVec4ui& a, const UMVec4ui& b)
+	{
+		if (a[0] > b[2] || b[0] > a[2] || a[1] > b[3] || b[1] > a[3]) return false;
+		const unsigned int left = (std::max)(a[0], b[0]);
+		const unsigned int top = (std::max)(a[1], b[1]);
+		const unsigned int right = (std::min)(a[2], b[2]);
+		const unsigned int bottom = (std::min)(a[3], b[3]);
+		const unsigned int overlap = (right - left) * (bottom - top);
+		return rect_area(rect_union(a, b)) + overlap <= rect_area(a) + rect_area(b);
+	}
+
+	/**
+	 * float to half float (round to nearest even)
+	 */
+	unsigned short float_to_half(float value)
+	{
+		unsigned int f = 0;
+		memcpy(&f, &value, sizeof(float));
+		const unsigned int sign = (f >> 16) & 0x8000;
+		f &= 0x7FFFFFFF;
+		// inf or nan
+		if (f >= 0x7F800000) return static_cast<unsigned short>(sign | 0x7C00 | (f > 0x7F800000 ? 0x200 : 0));
+		// 65520 or more rounds to inf
+		if (f >= 0x477FF000) return static_cast<unsigned short>(sign | 0x7C00);
+		// subnormal
+		if (f < 0x38800000)
+		{
+			if (f <= 0x33000000) return static_cast<unsigned short>(sign);
+			const unsigned int shift = 126 - (f >> 23);
+			const unsigned int mantissa = (f & 0x7FFFFF) | 0x800000;
+			const unsigned int remain = mantissa & ((1u << shift) - 1);
+			const unsigned int half_point = 1u << (shift - 1);
+			unsigned int h = mantissa >> shift;
+			if (remain > half_point || (remain == half_point && (h & 1))) ++h;
+			return static_cast<unsigned short>(sign | h);
+		}
+		unsigned int h = (f >> 13) - (112 << 10);
+		const unsigned int remain = f & 0x1FFF;
+		if (remain > 0x1000 || (remain == 0x1000 && (h & 1))) ++h;
+		return static_cast<unsigned short>(sign | h);
+	}
+
+	/**
+	 * half float to float
+	 */
+	float half_to_float(unsigned short value)
+	{
+		const unsigned int sign = (value & 0x8000) << 16;
+		const unsigned int exponent = (value >> 10) & 0x1F;
+		const unsigned int mantissa = value & 0x3FF;
+		unsigned int f = 0;
+		if (exponent == 0x1F)
+		{
+			f = sign | 0x7F800000 | (mantissa << 13);
+		}
+		else if (exponent != 0)
+		{
+			f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+		else
+		{
+			// zero or subnormal
+			const float result = mantissa * (1.0f / 16777216.0f);
+			return sign ? -result : result;
+		}
+		float result = 0.0f;
+		memcpy(&result, &f, sizeof(float));
+		return result;
+	}
+
+	/**
+	 * convert pixels to float rgba
+	 */
+	void to_float_row(float* dst, const unsigned char* src, PixelFormat format, int count)
+	{
+		const int value_count = count * 4;
+		int i = 0;
+		if (format == UMImage::ePixelFormatRGBA64F)
+		{
+			const double* values = reinterpret_cast<const double*>(src);
+#ifdef UM_IMAGE_SSE
+			for (; i + 4 <= value_count; i += 4)
+			{
+				const __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(values + i));
+				const __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(values + i + 2));
+				_mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+			}
+#endif // UM_IMAGE_SSE
+			for (; i < value_count; ++i)
+			{
+				dst[i] = static_cast<float>(values[i]);
+			}
+		}
+		else if (format == UMImage::ePixelFormatRGBA8)
+		{
+			const float inv_ff = 1.0f / 255.0f;
+#ifdef UM_IMAGE_SSE
+			const __m128 scale = _mm_set1_ps(inv_ff);
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 16 <= value_count; i += 16)
+			{
+				const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+				const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+				_mm_storeu_ps(dst + i + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+				_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+				_mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+				_mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+			}
+#endif // UM_IMAGE_SSE
+			for (; i < value_count; ++i)
+			{
+				dst[i] = src[i] * inv_ff;
+			}
+		}
+		else if (format == UMImage::ePixelFormatRGBA16F)
+		{
+			const unsigned short* values = reinterpret_cast<const unsigned short*>(src);
+#ifdef UM_IMAGE_F16C
+			for (; i + 4 <= value_count; i += 4)
+			{
+				_mm_storeu_ps(dst + i, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(values + i))));
+			}
+#endif // UM_IMAGE_F16C
+			for (; i < value_count; ++i)
+			{
+				dst[i] = half_to_float(values[i]);
+			}
+		}
+		else
+		{
+			memcpy(dst, src, value_count * sizeof(float));
+		}
+	}
+
+	/**
+	 * convert float rgba to pixels
+	 * @note 8 bit values are clamped to [0, 1] and rounded.
+	 */
+	void from_float_row(unsigned char* dst, PixelFormat format, const float* src, int count)
+	{
+		const int value_count = count * 4;
+		int i = 0;
+		if (format == UMImage::ePixelFormatRGBA64F)
+		{
+			double* values = reinterpret_cast<double*>(dst);
+#ifdef UM_IMAGE_SSE
+			for (; i + 4 <= value_count; i += 4)
+			{
+				const __m128 v = _mm_loadu_ps(src + i);
+				_mm_storeu_pd(values + i, _mm_cvtps_pd(v));
+				_mm_storeu_pd(values + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+			}
+#endif // UM_IMAGE_SSE
+			for (; i < value_count; ++i)
+			{
+				values[i] = src[i];
+			}
+		}
+		else if (format == UMImage::ePixelFormatRGBA8)
+		{
+#ifdef UM_IMAGE_SSE
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 scale = _mm_set1_ps(255.0f);
+			const __m128 half = _mm_set1_ps(0.5f);
+			for (; i + 16 <= value_count; i += 16)
+			{
+				__m128i v[4];
+				for (int k = 0; k < 4; ++k)
+				{
+					// max returns zero for nan
+					const __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + k * 4), zero), one);
+					v[k] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, scale), half));
+				}
+				const __m128i lo = _mm_packs_epi32(v[0], v[1]);
+				const __m128i hi = _mm_packs_epi32(v[2], v[3]);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+			}
+#endif // UM_IMAGE_SSE
+			for (; i < value_count; ++i)
+			{
+				const float value = src[i] > 0.0f ? (src[i] < 1.0f ? src[i] : 1.0f) : 0.0f;
+				dst[i] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+			}
+		}
+		else if (format == UMImage::ePixelFormatRGBA16F)
+		{
+			unsigned short* values = reinterpret_cast<unsigned short*>(dst);
+#ifdef UM_IMAGE_F16C
+			for (; i + 4 <= value_count; i += 4)
+			{
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(values + i), _mm_cvtps_ph(_mm_loadu_ps(src + i), 0));
+			}
+#endif // UM_IMAGE_F16C
+			for (; i < value_count; ++i)
+			{
+				values[i] = float_to_half(src[i]);
+			}
+		}
+		else
+		{
+			memcpy(dst, src, value_count * sizeof(float));
+		}
+	}
+
+	/**
+	 * convert a row of pixels
+	 */
+	void convert_row(unsigned char* dst, PixelFormat dst_format, const unsigned char* src, PixelFormat src_format, int count)
+	{
+		if (dst_format == src_format)
+		{
+			memcpy(dst, src, count * UMImage::pixel_size(src_format));
+		}
+		else if (src_format == UMImage::ePixelFormatRGBA32F)
+		{
+			from_float_row(dst, dst_format, reinterpret_cast<const float*>(src), count);
+		}
+		else if (dst_format == UMImage::ePixelFormatRGBA32F)
+		{
+			to_float_row(reinterpret_cast<float*>(dst), src, src_format, count);
+		}
+		else
+		{
+			const int dst_size = UMImage::pixel_size(dst_format);
+			const int src_size = UMImage::pixel_size(src_format);
+			float values[chunk_size * 4];
+			for (int i = 0; i < count; i += chunk_size)
+			{
+				const int chunk_count = (std::min)(chunk_size, count - i);
+				to_float_row(values, src + i * src_size, src_format, chunk_count);
+				from_float_row(dst + i * dst_size, dst_format, values, chunk_count);
+			}
+		}
+	}
+
+	/**
+	 * create rgb buffer through 8 bit rgba rows
+	 */
+	void create_rgb_buffer(std::vector<unsigned char>& img, const UMImage& image, bool is_bgr)
+	{
+		const int width = image.width();
+		const int height = image.height();
+		img.resize(width * height * 3);
+		if (img.empty()) return;
+		std::vector<unsigned char> row(width * 4);
+		UMImage::View row_view;
+		row_view.format = UMImage::ePixelFormatRGBA8;
+		row_view.width = width;
+		row_view.height = 1;
+		row_view.stride = width * 4;
+		row_view.data = &row[0];
+		const UMImage::ConstView src = image.view();
+		const int r = is_bgr ? 2 : 0;
+		const int b = is_bgr ? 0 : 2;
+		for (int y = 0; y < height; ++y)
+		{
+			UMImage::convert(row_view, src.sub_view(UMVec4ui(0, y, width, y + 1)));
+			for (int x = 0; x < width; ++x)
+			{
+				const int pos = width * y + x;
+				img[pos * 3 + 0] = row[x * 4 + r];
+				img[pos * 3 + 1] = row[x * 4 + 1];
+				img[pos * 3 + 2] = row[x * 4 + b];
+			}
+		}
+	}
+
+	/**
+	 * create 8 bit rgba image from rgba bytes
+	 */
+	UMImagePtr create_rgba8_image(const unsigned char* buffer, int width, int height)
+	{
+		UMImagePtr image  = std::make_shared<UMImage>();
+		if (!image->init(width, height, UMImage::ePixelFormatRGBA8)) return UMImagePtr();
+		UMImage::ConstView src;
+		src.format = UMImage::ePixelFormatRGBA8;
+		src.width = width;
+		src.height = height;
+		src.stride = width * 4;
+		src.data = buffer;
+		UMImage::convert(image->view(), src);
+		return image;
+	}
 	
 #ifdef WITH_OIIO
 	OIIO_NAMESPACE_USING
@@ -55,36 +382,22 @@ namespace
 		delete in;
 		in = NULL;
 
-		UMImagePtr image  = std::make_shared<UMImage>();
-		if (image->init(width, height))
+		if (channels == 4)
 		{
-			UMImage::ImageBuffer& dst = image->mutable_list();
-			double inv_ff = 1.0 / (double)0xFF;
-			for (int i = 0; i < height; ++i)
+			return create_rgba8_image(&buffer[0], width, height);
+		}
+		std::vector<unsigned char> rgba(width * height * 4, 0);
+		if (channels == 3)
+		{
+			for (int i = 0, size = width * height; i < size; ++i)
 			{
-				for (int k = 0; k < width; ++k)
-				{
-					int pos =  i * width + k;
-					if (channels == 3)
-					{
-						double r = buffer[pos*3 + 0] * inv_ff;
-						double g = buffer[pos*3 + 1] * inv_ff;
-						double b = buffer[pos*3 + 2] * inv_ff;
-						double a = 1.0;
-						dst[ i * width + k] = UMVec4d(r, g, b, a);
-					}
-					else if (channels == 4)
-					{
-						double r = buffer[pos*4 + 0] * inv_ff;
-						double g = buffer[pos*4 + 1] * inv_ff;
-						double b = buffer[pos*4 + 2] * inv_ff;
-						double a = buffer[pos*4 + 3] * inv_ff;
-						dst[ i * width + k] = UMVec4d(r, g, b, a);
-					}
-				}
+				rgba[i * 4 + 0] = buffer[i * 3 + 0];
+				rgba[i * 4 + 1] = buffer[i * 3 + 1];
+				rgba[i * 4 + 2] = buffer[i * 3 + 2];
+				rgba[i * 4 + 3] = 0xFF;
 			}
 		}
-		return image;
+		return create_rgba8_image(rgba.empty() ? NULL : &rgba[0], width, height);
 	}
 #endif
 
@@ -97,40 +410,37 @@ namespace
 		unsigned char* buffer = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha);
 		if (!buffer) return UMImagePtr();
 
-		UMImagePtr image  = std::make_shared<UMImage>();
-		if (image->init(width, height))
-		{
-			UMImage::ImageBuffer& dst = image->mutable_list();
-			double inv_ff = 1.0 / (double)0xFF;
-			for (int i = 0; i < height; ++i)
-			{
-				for (int k = 0; k < width; ++k)
-				{
-					int pos =  i * width + k;
-					if (channels == 3)
-					{
-						double r = buffer[pos*4 + 0] * inv_ff;
-						double g = buffer[pos*4 + 1] * inv_ff;
-						double b = buffer[pos*4 + 2] * inv_ff;
-						double a = 1.0;
-						dst[ i * width + k] = UMVec4d(r, g, b, a);
-					}
-					else if (channels == 4)
-					{
-						double r = buffer[pos*4 + 0] * inv_ff;
-						double g = buffer[pos*4 + 1] * inv_ff;
-						double b = buffer[pos*4 + 2] * inv_ff;
-						double a = buffer[pos*4 + 3] * inv_ff;
-						dst[ i * width + k] = UMVec4d(r, g, b, a);
-					}
-				}
-			}
-		}
+		// stb expands rgb to rgba with opaque alpha
+		UMImagePtr image = create_rgba8_image(buffer, width, height);
 		free(buffer);
 		return image;
 	}
 }
 
+/**
+ * view of a rect in this view
+ */
+UMImage::View UMImage::View::sub_view(const UMVec4ui& rect) const
+{
+	View view(*this);
+	view.data = data + rect[1] * stride + rect[0] * pixel_size(format);
+	view.width = rect[2] - rect[0];
+	view.height = rect[3] - rect[1];
+	return view;
+}
+
+/**
+ * view of a rect in this view
+ */
+UMImage::ConstView UMImage::ConstView::sub_view(const UMVec4ui& rect) const
+{
+	ConstView view(*this);
+	view.data = data + rect[1] * stride + rect[0] * pixel_size(format);
+	view.width = rect[2] - rect[0];
+	view.height = rect[3] - rect[1];
+	return view;
+}
+
 /**
  * constructor
  */
@@ -138,6 +448,9 @@ UMImage::UMImage()
 	: width_(0)
 	, height_(0)
 	, id_(global_id_counter++)
+	, format_(ePixelFormatRGBA64F)
+	, pixel_offset_(0)
+	, stride_(0)
 	, image_change_event_(new umbase::UMEvent(eImageEventImageChaged))
 {
 }
@@ -178,35 +491,8 @@ UMImagePtr UMImage::load_from_memory(const std::string& data)
 		STBI_rgb_alpha);
 	if (!buffer) return UMImagePtr();
 
-	UMImagePtr image  = std::make_shared<UMImage>();
-	if (image->init(width, height))
-	{
-		ImageBuffer& dst = image->mutable_list();
-		double inv_ff = 1.0 / (double)0xFF;
-		for (int i = 0; i < height; ++i)
-		{
-			for (int k = 0; k < width; ++k)
-			{
-				int pos =  i * width + k;
-				if (channels == 3)
-				{
-					double r = buffer[pos*4 + 0] * inv_ff;
-					double g = buffer[pos*4 + 1] * inv_ff;
-					double b = buffer[pos*4 + 2] * inv_ff;
-					double a = 1.0;
-					dst[ i * width + k] = UMVec4d(r, g, b, a);
-				}
-				else if (channels == 4)
-				{
-					double r = buffer[pos*4 + 0] * inv_ff;
-					double g = buffer[pos*4 + 1] * inv_ff;
-					double b = buffer[pos*4 + 2] * inv_ff;
-					double a = buffer[pos*4 + 3] * inv_ff;
-					dst[ i * width + k] = UMVec4d(r, g, b, a);
-				}
-			}
-		}
-	}
+	// stb expands rgb to rgba with opaque alpha
+	UMImagePtr image = create_rgba8_image(buffer, width, height);
 	free(buffer);
 	return image;
 }
@@ -272,57 +558,202 @@ bool UMImage::save(const umstring& filepath, UMImagePtr src, ImageType type)
  */
 bool UMImage::init(int width, int height)
 {
+	return init(width, height, ePixelFormatRGBA64F);
+}
+
+/**
+ * init image with a pixel format
+ */
+bool UMImage::init(int width, int height, PixelFormat format)
+{
+	if (width < 0 || height < 0) return false;
 	width_ = width;
 	height_ = height;
+	format_ = format;
 	buffer_.clear();
-	buffer_.resize(width * height);
+	pixel_buffer_.clear();
+	pixel_offset_ = 0;
+	stride_ = 0;
+	{
+		std::lock_guard<std::mutex> lock(dirty_mutex_);
+		dirty_rect_list_.clear();
+	}
+	if (format == ePixelFormatRGBA64F)
+	{
+		buffer_.resize(width * height);
+		add_dirty_rect(UMVec4ui(0, 0, width, height));
+		return true;
+	}
+	const int row_size = width * pixel_size(format);
+	stride_ = (row_size + row_alignment - 1) & ~(row_alignment - 1);
+	pixel_buffer_.resize(static_cast<size_t>(stride_) * height + row_alignment);
+	const size_t address = reinterpret_cast<size_t>(&pixel_buffer_[0]);
+	pixel_offset_ = (row_alignment - (address & (row_alignment - 1))) & (row_alignment - 1);
+	add_dirty_rect(UMVec4ui(0, 0, width, height));
 	return true;
 }
+
+/**
+ * get bytes of a pixel
+ */
+int UMImage::pixel_size(PixelFormat format)
+{
+	switch (format)
+	{
+	case ePixelFormatRGBA8: return 4;
+	case ePixelFormatRGBA16F: return 8;
+	case ePixelFormatRGBA32F: return 16;
+	default: return sizeof(UMVec4d);
+	}
+}
+
+/**
+ * validate image
+ */
+bool UMImage::is_valid() const
+{
+	if (format_ == ePixelFormatRGBA64F)
+	{
+		return (width_ * height_ == static_cast<int>(buffer_.size()));
+	}
+	return stride_ >= width_ * pixel_size(format_) 
+		&& pixel_buffer_.size() >= pixel_offset_ + static_cast<size_t>(stride_) * height_;
+}
+
+/**
+ * get view of all pixels
+ */
+UMImage::View UMImage::view()
+{
+	View view;
+	view.format = format_;
+	view.width = width_;
+	view.height = height_;
+	if (format_ == ePixelFormatRGBA64F)
+	{
+		view.stride = width_ * static_cast<int>(sizeof(UMVec4d));
+		view.data = buffer_.empty() ? NULL : reinterpret_cast<unsigned char*>(&buffer_[0]);
+	}
+	else
+	{
+		view.stride = stride_;
+		view.data = pixel_buffer_.empty() ? NULL : &pixel_buffer_[pixel_offset_];
+	}
+	return view;
+}
+
+/**
+ * get view of all pixels
+ */
+UMImage::ConstView UMImage::view() const
+{
+	return const_cast<UMImage*>(this)->view();
+}
+
+/**
+ * get a pixel in any format
+ */
+UMVec4d UMImage::pixel(int x, int y) const
+{
+	if (x < 0 || y < 0 || x >= width_ || y >= height_ || !is_valid()) return UMVec4d(0);
+	if (format_ == ePixelFormatRGBA64F)
+	{
+		return buffer_[y * width_ + x];
+	}
+	float color[4];
+	to_float_row(color, view().row(y) + x * pixel_size(format_), format_, 1);
+	return UMVec4d(color[0], color[1], color[2], color[3]);
+}
+
+/**
+ * set a pixel in any format
+ */
+void UMImage::set_pixel(int x, int y, const UMVec4d& color)
+{
+	if (x < 0 || y < 0 || x >= width_ || y >= height_ || !is_valid()) return;
+	if (format_ == ePixelFormatRGBA64F)
+	{
+		buffer_[y * width_ + x] = color;
+		return;
+	}
+	const float values[4] = { 
+		static_cast<float>(color.x), 
+		static_cast<float>(color.y), 
+		static_cast<float>(color.z), 
+		static_cast<float>(color.w) };
+	from_float_row(view().row(y) + x * pixel_size(format_), format_, values, 1);
+}
+
+/**
+ * convert pixels between formats
+ */
+bool UMImage::convert(const View& dst, const ConstView& src, bool vertical_flip)
+{
+	if (dst.width != src.width || dst.height != src.height) return false;
+	if (dst.width <= 0 || dst.height <= 0) return true;
+	if (!dst.data || !src.data) return false;
+	for (int y = 0; y < dst.height; ++y)
+	{
+		const int src_y = vertical_flip ? (src.height - y - 1) : y;
+		convert_row(dst.row(y), dst.format, src.row(src_y), src.format, dst.width);
+	}
+	return true;
+}
+
+/**
+ * create image of another format
+ */
+UMImagePtr UMImage::create_converted_image(PixelFormat format) const
+{
+	if (!is_valid()) return UMImagePtr();
+	UMImagePtr dst(std::make_shared<UMImage>());
+	if (!dst->init(width(), height(), format)) return UMImagePtr();
+	if (!convert(dst->view(), view())) return UMImagePtr();
+	return dst;
+}
+
 /**
  * create r8g8b8a8 buffer
  */
 void UMImage::create_r8g8b8a8_buffer(UMImage::R8G8B8A8Buffer& img) const 
 {
 	img.resize(width() * height() * 4);
-	for (int y = 0; y < height(); ++y)
-	{
-		for (int x = 0; x < width(); ++x)
-		{
-			const int pos = width() * y + x;
-			const UMVec4d& col = list().at(pos);
-			img[pos * 4 + 0] = static_cast<int>(col.x * 255.0 + 0.5);
-			img[pos * 4 + 1] = static_cast<int>(col.y * 255.0 + 0.5);
-			img[pos * 4 + 2] = static_cast<int>(col.z * 255.0 + 0.5);
-			img[pos * 4 + 3] = static_cast<int>(col.w * 255.0 + 0.5);
-		}
-	}
+	if (img.empty() || !is_valid()) return;
+	View dst;
+	dst.format = ePixelFormatRGBA8;
+	dst.width = width();
+	dst.height = height();
+	dst.stride = width() * 4;
+	dst.data = &img[0];
+	convert(dst, view());
 }
 
 /**
  * create buffer by rect
+ * @note rows are flipped. pixels out of this image are zero.
  */
 void UMImage::create_r8g8b8a8_buffer(R8G8B8A8Buffer& img, const UMVec4ui& src_rect) const
 {
-	const double inv_gamma = 1.0;
-	int w = src_rect[2] - src_rect[0];
-	int h = src_rect[3] - src_rect[1];
-
-	int y = src_rect[1];
-	img.resize(w * h * 4);
-	for (int i = 0; i < h; ++y, ++i)
+	const int w = static_cast<int>(src_rect[2]) - static_cast<int>(src_rect[0]);
+	const int h = static_cast<int>(src_rect[3]) - static_cast<int>(src_rect[1]);
+	if (w <= 0 || h <= 0 || !is_valid()) 
 	{
-		int x = src_rect[0];
-		for (int k = 0; k < w; ++x, ++k)
-		{
-			int src_pos = width() * (height() - y - 1) + x;
-			int dst_pos = w * i + k;
-			const UMVec4d col = list().at(src_pos);
-			img[dst_pos * 4 + 0] = static_cast<int>(pow(col.x, inv_gamma) * 0xFF + 0.5);
-			img[dst_pos * 4 + 1] = static_cast<int>(pow(col.y, inv_gamma) * 0xFF + 0.5);
-			img[dst_pos * 4 + 2] = static_cast<int>(pow(col.z, inv_gamma) * 0xFF + 0.5);
-			img[dst_pos * 4 + 3] = static_cast<int>(pow(col.w, inv_gamma) * 0xFF + 0.5);
-		}
+		img.clear();
+		return;
 	}
+	img.assign(w * h * 4, 0);
+
+	const unsigned int right = (std::min)(src_rect[2], static_cast<unsigned int>(width()));
+	const unsigned int bottom = (std::min)(src_rect[3], static_cast<unsigned int>(height()));
+	if (src_rect[0] >= right || src_rect[1] >= bottom) return;
+	View dst;
+	dst.format = ePixelFormatRGBA8;
+	dst.width = right - src_rect[0];
+	dst.height = bottom - src_rect[1];
+	dst.stride = w * 4;
+	dst.data = &img[0];
+	const UMVec4ui flipped_rect(src_rect[0], height() - bottom, right, height() - src_rect[1]);
+	convert(dst, view().sub_view(flipped_rect), true);
 }
 
 /**
@@ -330,19 +761,7 @@ void UMImage::create_r8g8b8a8_buffer(R8G8B8A8Buffer& img, const UMVec4ui& src_re
  */
 void UMImage::create_r8g8b8_buffer(UMImage::R8G8B8Buffer& img) const 
 {
-	const double inv_gamma = 1.0;// / 2.2;
-	img.resize(width() * height() * 3);
-	for (int y = 0; y < height(); ++y)
-	{
-		for (int x = 0; x < width(); ++x)
-		{
-			int pos = width() * y + x;
-			const UMVec4d col = list().at(pos);
-			img[pos * 3 + 0] = static_cast<int>(pow(col.x, inv_gamma) * 0xFF + 0.5);
-			img[pos * 3 + 1] = static_cast<int>(pow(col.y, inv_gamma) * 0xFF + 0.5);
-			img[pos * 3 + 2] = static_cast<int>(pow(col.z, inv_gamma) * 0xFF + 0.5);
-		}
-	}
+	create_rgb_buffer(img, *this, false);
 }
 
 /**
@@ -350,19 +769,7 @@ void UMImage::create_r8g8b8_buffer(UMImage::R8G8B8Buffer& img) const
  */
 void UMImage::create_b8g8r8_buffer(UMImage::B8G8R8Buffer& img) const 
 {
-	const double inv_gamma = 1.0;// / 2.2;
-	img.resize(width() * height() * 3);
-	for (int y = 0; y < height(); ++y)
-	{
-		for (int x = 0; x < width(); ++x)
-		{
-			int pos = width() * y + x;
-			const UMVec4d col = list().at(pos);
-			img[pos * 3 + 0] = static_cast<int>(pow(col.z, inv_gamma) * 0xFF + 0.5);
-			img[pos * 3 + 1] = static_cast<int>(pow(col.y, inv_gamma) * 0xFF + 0.5);
-			img[pos * 3 + 2] = static_cast<int>(pow(col.x, inv_gamma) * 0xFF + 0.5);
-		}
-	}
+	create_rgb_buffer(img, *this, true);
 }
 
 /**
@@ -370,14 +777,7 @@ void UMImage::create_b8g8r8_buffer(UMImage::B8G8R8Buffer& img) const
  */
 void UMImage::clear()
 {
-	for (int y = 0; y < height(); ++y)
-	{
-		for (int x = 0; x < width(); ++x)
-		{
-			int pos = width() * y + x;
-			mutable_list().at(pos) = UMVec4d(0);
-		}
-	}
+	fill(UMVec4d(0));
 }
 
 /**
@@ -388,22 +788,23 @@ UMImagePtr UMImage::create_flip_image(bool horizon, bool vertical) const
 	if (!is_valid()) return UMImagePtr();
 	
 	UMImagePtr dst(std::make_shared<UMImage>());
-	dst->mutable_list().resize(list().size());
-	dst->set_width(width());
-	dst->set_height(height());
+	if (!dst->init(width(), height(), format())) return UMImagePtr();
 
+	const ConstView src_view = view();
+	const View dst_view = dst->view();
+	const int size = pixel_size(format());
 	for (int y = 0; y < height(); ++y)
 	{
+		const unsigned char* src_row = src_view.row(y);
+		unsigned char* dst_row = dst_view.row(vertical ? (height() - y - 1) : y);
+		if (!horizon)
+		{
+			memcpy(dst_row, src_row, width() * size);
+			continue;
+		}
 		for (int x = 0; x < width(); ++x)
 		{
-			int dstx = x;
-			int dsty = y;
-			if (horizon) { dstx = width() - x - 1; }
-			if (vertical) { dsty = height() - y - 1; }
-			
-			int src_pos = width() * y + x;
-			int dst_pos = width() * dsty + dstx;
-			dst->mutable_list().at(dst_pos) = list().at(src_pos);
+			memcpy(dst_row + (width() - x - 1) * size, src_row + x * size, size);
 		}
 	}
 	return dst;
@@ -429,27 +830,105 @@ bool UMImage::copy(UMImagePtr dst, const UMVec4ui& dst_rect)
 	if (dst->height() < bottom) return false;
 	if (width_ != width) return false;
 	if (height_ != height) return false;
+	if (!is_valid() || !dst->is_valid()) return false;
 	
-	for (int y = top; y < bottom; ++y)
+	// converts if formats are different
+	if (!convert(dst->view().sub_view(dst_rect), view())) return false;
+	dst->add_dirty_rect(dst_rect);
+	return true;
+}
+
+/**
+ * fill image
+ */
+void UMImage::fill(const UMVec4d& color)
+{
+	if (format_ == ePixelFormatRGBA64F)
 	{
-		for (int x = left; x < right; ++x)
+		std::fill(buffer_.begin(), buffer_.end(), color);
+		add_dirty_rect(UMVec4ui(0, 0, width_, height_));
+		return;
+	}
+	if (!is_valid()) return;
+	const float values[4] = { 
+		static_cast<float>(color.x), 
+		static_cast<float>(color.y), 
+		static_cast<float>(color.z), 
+		static_cast<float>(color.w) };
+	unsigned char pixel[16];
+	from_float_row(pixel, format_, values, 1);
+	const int size = pixel_size(format_);
+	const View dst = view();
+	for (int y = 0; y < height_; ++y)
+	{
+		unsigned char* row = dst.row(y);
+		for (int x = 0; x < width_; ++x)
 		{
-			dst->mutable_list().at(y * dst->width() + x)
-				= buffer_.at( (y-top) * width_ + (x-left) );
+			memcpy(row + x * size, pixel, size);
 		}
 	}
-	return true;
+	add_dirty_rect(UMVec4ui(0, 0, width_, height_));
 }
 
 /**
- * fill image
+ * mark a rect as changed
  */
-void UMImage::fill(const UMVec4d& color)
+void UMImage::add_dirty_rect(const UMVec4ui& rect)
 {
-	for (UMImage::ImageBuffer::iterator it = mutable_list().begin(); it != mutable_list().end(); ++it)
+	UMVec4ui merged(
+		(std::min)(rect[0], static_cast<unsigned int>(width_)),
+		(std::min)(rect[1], static_cast<unsigned int>(height_)),
+		(std::min)(rect[2], static_cast<unsigned int>(width_)),
+		(std::min)(rect[3], static_cast<unsigned int>(height_)));
+	if (merged[0] >= merged[2] || merged[1] >= merged[3]) return;
+
+	std::lock_guard<std::mutex> lock(dirty_mutex_);
+	// merge until no rect can be merged
+	for (size_t i = 0; i < dirty_rect_list_.size(); )
 	{
-		(*it) = umbase::UMVec4d(color);
+		if (is_mergeable_rect(dirty_rect_list_[i], merged))
+		{
+			merged = rect_union(dirty_rect_list_[i], merged);
+			dirty_rect_list_[i] = dirty_rect_list_.back();
+			dirty_rect_list_.pop_back();
+			i = 0;
+		}
+		else
+		{
+			++i;
+		}
+	}
+	dirty_rect_list_.push_back(merged);
+
+	if (dirty_rect_list_.size() > max_dirty_rect_count)
+	{
+		UMVec4ui bounds = dirty_rect_list_[0];
+		for (size_t i = 1; i < dirty_rect_list_.size(); ++i)
+		{
+			bounds = rect_union(bounds, dirty_rect_list_[i]);
+		}
+		dirty_rect_list_.assign(1, bounds);
 	}
 }
 
+/**
+ * take rects changed since the last call
+ */
+bool UMImage::take_dirty_rect_list(DirtyRectList& rect_list)
+{
+	rect_list.clear();
+	std::lock_guard<std::mutex> lock(dirty_mutex_);
+	rect_list.swap(dirty_rect_list_);
+	return !rect_list.empty();
+}
+
+/**
+ * get whether any rect is changed
+ */
+bool UMImage::is_dirty() const
+{
+	std::lock_guard<std::mutex> lock(dirty_mutex_);
+	return !dirty_rect_list_.empty();
+}
+
 } // umimage
@@ -12,6 +12,7 @@
 
 #include <vector>
 #include <memory>
+#include <mutex>
 #include "UMMacro.h"
 #include "UMMathTypes.h"
 #include "UMVector.h"
@@ -41,6 +42,7 @@ public:
 	typedef std::vector<unsigned char> R8G8B8A8Buffer;
 	typedef std::vector<unsigned char> B8G8R8Buffer;
 	typedef std::vector<unsigned char> R8G8B8Buffer;
+	typedef std::vector<UMVec4ui> DirtyRectList;
 
 	enum ImageType {
 		eImageTypeBMP_RGB,
@@ -49,6 +51,61 @@ public:
 		eImageTypePNG_RGBA,
 	};
 	
+	/**
+	 * pixel storage format
+	 * @note ePixelFormatRGBA64F is stored in the UMVec4d list.
+	 * others are stored in rows aligned to 16 bytes.
+	 */
+	enum PixelFormat {
+		ePixelFormatRGBA64F,
+		ePixelFormatRGBA8,
+		ePixelFormatRGBA16F,
+		ePixelFormatRGBA32F,
+	};
+
+	/**
+	 * rows of pixels. a view does not own pixels.
+	 * @note stride is bytes from a row to the next row.
+	 */
+	struct View
+	{
+		View() : format(ePixelFormatRGBA64F), width(0), height(0), stride(0), data(NULL) {}
+		PixelFormat format;
+		int width;
+		int height;
+		int stride;
+		unsigned char* data;
+
+		unsigned char* row(int y) const { return data + y * stride; }
+
+		/**
+		 * view of a rect (left, top, right, bottom) in this view
+		 */
+		View sub_view(const UMVec4ui& rect) const;
+	};
+
+	/**
+	 * read only rows of pixels
+	 */
+	struct ConstView
+	{
+		ConstView() : format(ePixelFormatRGBA64F), width(0), height(0), stride(0), data(NULL) {}
+		ConstView(const View& view) 
+			: format(view.format), width(view.width), height(view.height), stride(view.stride), data(view.data) {}
+		PixelFormat format;
+		int width;
+		int height;
+		int stride;
+		const unsigned char* data;
+
+		const unsigned char* row(int y) const { return data + y * stride; }
+
+		/**
+		 * view of a rect (left, top, right, bottom) in this view
+		 */
+		ConstView sub_view(const UMVec4ui& rect) const;
+	};
+
 	UMImage();
 	
 	~UMImage();
@@ -75,19 +132,70 @@ public:
 
 	/**
 	 * init image
+	 * @note the format is ePixelFormatRGBA64F
 	 */
 	bool init(int width, int height);
 
+	/**
+	 * init image with a pixel format
+	 */
+	bool init(int width, int height, PixelFormat format);
+
+	/**
+	 * get pixel format
+	 */
+	PixelFormat format() const { return format_; }
+
+	/**
+	 * get bytes of a pixel
+	 */
+	static int pixel_size(PixelFormat format);
+
 	/**
 	 * get image buffer
+	 * @note only for ePixelFormatRGBA64F
 	 */
 	const ImageBuffer& list() const { return buffer_; } 
 	
 	/**
 	 * get image buffer
+	 * @note only for ePixelFormatRGBA64F
 	 */
 	ImageBuffer&  mutable_list() { return buffer_; }
 
+	/**
+	 * get view of all pixels
+	 */
+	View view();
+
+	/**
+	 * get view of all pixels
+	 */
+	ConstView view() const;
+
+	/**
+	 * get a pixel in any format
+	 */
+	UMVec4d pixel(int x, int y) const;
+
+	/**
+	 * set a pixel in any format
+	 */
+	void set_pixel(int x, int y, const UMVec4d& color);
+
+	/**
+	 * convert pixels between formats
+	 * @param [out] dst destination. width and height must be same to src
+	 * @param [in] src source
+	 * @param [in] vertical_flip flip rows or not
+	 */
+	static bool convert(const View& dst, const ConstView& src, bool vertical_flip = false);
+
+	/**
+	 * create image of another format
+	 */
+	UMImagePtr create_converted_image(PixelFormat format) const;
+
 	/**
 	 * create r8g8b8a8 buffer
 	 */
@@ -139,7 +247,7 @@ public:
 	 * validate image
 	 * @retval valid or invalid
 	 */
-	bool is_valid() const { return (width_ * height_ == static_cast<int>(buffer_.size())); }
+	bool is_valid() const;
 
 	/**
 	 * create flip image
@@ -160,6 +268,25 @@ public:
 	 * fill image
 	 */
 	void fill(const UMVec4d& color);
+
+	/**
+	 * mark a rect (left, top, right, bottom) as changed
+	 * @note thread safe. call this after writing pixels by view(), list() or set_pixel().
+	 * init(), fill() and copy() mark their rects by themselves.
+	 */
+	void add_dirty_rect(const UMVec4ui& rect);
+
+	/**
+	 * take rects changed since the last call
+	 * @param [out] rect_list changed rects. rows are same to view()
+	 * @retval any rect is changed or not
+	 */
+	bool take_dirty_rect_list(DirtyRectList& rect_list);
+
+	/**
+	 * get whether any rect is changed since the last take_dirty_rect_list
+	 */
+	bool is_dirty() const;
 	
 	/**
 	 * get image change event
@@ -170,7 +297,17 @@ private:
 	int width_;
 	int height_;
 	unsigned int id_;
+	PixelFormat format_;
 	ImageBuffer buffer_;
+	/// pixels of formats other than ePixelFormatRGBA64F
+	std::vector<unsigned char> pixel_buffer_;
+	/// offset to the 16 bytes aligned first row in pixel_buffer_
+	size_t pixel_offset_;
+	/// bytes of a row in pixel_buffer_
+	int stride_;
+	/// changed rects which are not overlapped each other
+	DirtyRectList dirty_rect_list_;
+	mutable std::mutex dirty_mutex_;
 	umbase::UMEventPtr image_change_event_;
 };
 
@@ -13,6 +13,7 @@
 #include "UMFont.h"
 
 #include <map>
+#include <algorithm>
 #define STB_TRUETYPE_IMPLEMENTATION
 #include <stb_truetype.h>
 #include <ctype.h>
@@ -29,6 +30,7 @@
 #include "UMStringUtil.h"
 #include "UMVector.h"
 #include "UMTextureAtlas.h"
+#include "UMGlyphCache.h"
 
 namespace
 {
@@ -43,21 +45,80 @@ namespace
 
 	const int initial_font_size = 32;
 
-	bool load_font_face_from_memory(const umstring& font_name, const std::string& data)
+	bool load_font_face_from_memory(const umstring& font_name, const char* data)
 	{
 		std::string name = umbase::UMStringUtil::utf16_to_utf8(font_name);
 		stbtt_fontinfo& font = font_face_map[font_name];
-		const unsigned char* buffer = reinterpret_cast<const unsigned char*>(data.c_str());
+		const unsigned char* buffer = reinterpret_cast<const unsigned char*>(data);
 		stbtt_InitFont(&font, buffer, stbtt_GetFontOffsetForIndex(buffer,0) );
 		return true;
 	}
 
 	typedef std::vector<umimage::UMTextureAtlasPtr> AtlasList;
-	AtlasList atlas_list;
+	// (font name, font size or 0 for distance field), atlases
+	typedef std::pair<umstring, int> AtlasKey;
+	typedef std::map<AtlasKey, AtlasList> AtlasMap;
+	AtlasMap atlas_map;
 
 	const int atlas_width = 256;
 	const int atlas_height = 256;
 
+	umimage::UMGlyphCache glyph_cache;
+
+	bool is_distance_field = false;
+	const int distance_field_size = initial_font_size;
+	const int distance_field_spread = 4;
+	const int distance_field_atlas_size = 512;
+
+	/**
+	 * render a glyph to 8 bit coverage
+	 */
+	bool render_glyph(const stbtt_fontinfo& font_face, int font_size, unsigned int codepoint, umimage::UMGlyph& glyph)
+	{
+		int bitmap_w = 0;
+		int bitmap_h = 0;
+		int ixoffset = 0;
+		int iyoffset = 0;
+		unsigned char* bitmap_buffer = stbtt_GetCodepointBitmap(
+			&font_face, 
+			0, 
+			stbtt_ScaleForPixelHeight(&font_face, static_cast<float>(font_size)),
+			codepoint,
+			&bitmap_w,
+			&bitmap_h,
+			&ixoffset,
+			&iyoffset);
+
+		// characters without outline, e.g. space, have no bitmap
+		if (!bitmap_buffer)
+		{
+			bitmap_w = 0;
+			bitmap_h = 0;
+		}
+		glyph.width = bitmap_w;
+		glyph.height = bitmap_h;
+		glyph.left = ixoffset;
+		glyph.top = iyoffset + font_size;
+		glyph.advance = bitmap_w + ixoffset;
+		glyph.line_advance = bitmap_h;
+		glyph.coverage.assign(bitmap_buffer, bitmap_buffer + bitmap_w * bitmap_h);
+		if (bitmap_buffer)
+		{
+			stbtt_FreeBitmap(bitmap_buffer, 0);
+		}
+		return true;
+	}
+
+	/**
+	 * get a glyph from the cache. rendered at the first time.
+	 */
+	const umimage::UMGlyph* cached_glyph(const umstring& font_name, const stbtt_fontinfo& font_face, int font_size, unsigned int codepoint)
+	{
+		return glyph_cache.glyph(font_name, font_size, codepoint, [&](umimage::UMGlyph& glyph) {
+			return render_glyph(font_face, font_size, codepoint, glyph);
+		});
+	}
+
 } // anonymouse namespace
 
 namespace umimage
@@ -70,7 +131,6 @@ namespace umimage
 UMFont::UMFont()
 {
 	is_valid_ = true;
-	atlas_list.push_back(std::make_shared<umimage::UMTextureAtlas>(atlas_width, atlas_height));
 }
 
 /**
@@ -107,62 +167,25 @@ UMImagePtr UMFont::font_image(const umstring& font_name, const umtextstring& tex
 	{
 		// create image
 		image = std::make_shared<UMImage>();
-		image->init(image_width, image_height);
+		image->init(image_width, image_height, UMImage::ePixelFormatRGBA8);
 		image->fill(umbase::UMVec4d(1));
 
 		// image  : base point is left-top.
 		const int image_w = image->width();
-		const int image_h = image->height();
-
-		// bitmap : base point is left-bottom.
-		int posx = 0;
-		int posy = 0;
 		int imagex = 0;
 		int imagey = 0;
 
-		const  stbtt_fontinfo& font_face = it->second;
-		
 		for (int i = 0; i < static_cast<int>(text.size()); ++i)
 		{
-			int bitmap_w = 0;
-			int bitmap_h = 0;
-			int ixoffset = 0;
-			int iyoffset = 0;
-
-			const int xsize = posx + bitmap_w;
-			const int ysize = posy + bitmap_h;
-			
-			unsigned char* bitmap_buffer = stbtt_GetCodepointBitmap(
-				&font_face, 
-				0, 
-				stbtt_ScaleForPixelHeight(&font_face, static_cast<float>(font_size)),
-				text[i],
-				&bitmap_w,
-				&bitmap_h,
-				&ixoffset,
-				&iyoffset);
-
-			for (int y = posy, iy = imagey; y < ysize; ++y, ++iy)
-			{
-				for (int x = posx, ix = imagex; x < xsize; ++x, ++ix)
-				{
-					const int buffer_pos = bitmap_w * (y - posy) + (x - posx);
-					const int image_pos = image_w * (iy + iyoffset) + (ix + ixoffset);
-					const double alpha = bitmap_buffer[buffer_pos] / static_cast<double>(0xFF);
-					const double inv_alpha = 1.0 - alpha;
-					// for alpha image
-					// image->mutable_list().at(image_pos) = umbase::UMVec4d(0, 0, 0, alpha);
-					image->mutable_list().at(image_pos) = umbase::UMVec4d(inv_alpha, inv_alpha, inv_alpha, 1.0);
-				};
-			}
-			posx += bitmap_w;
-			imagex += bitmap_w;
-			//imagex += advance_x;
+			const UMGlyph* glyph = cached_glyph(font_name, it->second, font_size, text[i]);
+			if (!glyph) continue;
+
+			UMGlyphCache::draw_glyph(image, *glyph, imagex, imagey);
+			imagex += glyph->width;
 			if (imagex >= image_w - font_size)
 			{
 				imagex = 0;
-				imagey += bitmap_h;
-				//imagey += advance_y;
+				imagey += glyph->line_advance;
 			}
 		}
 	}
@@ -201,8 +224,17 @@ bool UMFont::load_font_from_file(const umstring& font_name) const
  * load font from memory
  */
 bool UMFont::load_font_from_memory(const umstring& font_name, const std::string& data) const
+{
+	return load_font_from_memory(font_name, data.c_str(), data.size());
+}
+
+/**
+ * load font from memory without copy
+ */
+bool UMFont::load_font_from_memory(const umstring& font_name, const char* data, size_t size) const
 {
 	if (is_font_loaded(font_name)) return true;
+	if (!data || size == 0) return false;
 	if (load_font_face_from_memory(font_name, data))
 	{
 		return true;
@@ -219,32 +251,31 @@ bool UMFont::is_font_loaded(const umstring& font_name) const
 }
 
 /**
- * get font image
+ * get font atlas
  */
 UMTextureAtlasPtr UMFont::font_atlas(const umstring& font_name, const umtextstring& text, int font_size) const
 {
 	if (text.empty()) return UMTextureAtlasPtr();
-	bool is_found_font = is_font_loaded(font_name);
-	if (!is_found_font && font_face_map.empty()) return UMTextureAtlasPtr();
-
-	UMTextureAtlasPtr texture_atlas = atlas_list.back();
-	
-	stbtt_fontinfo font_face;
-	
-	if (is_found_font)
+	FontFaceMap::const_iterator it = font_face_map.find(font_name);
+	if (it == font_face_map.end())
 	{
-		font_face = font_face_map.find(font_name)->second;
+		// use first font
+		it = font_face_map.begin();
 	}
-	else
+	if (it == font_face_map.end()) return UMTextureAtlasPtr();
+
+	const int glyph_size = is_distance_field ? distance_field_size : font_size;
+	const int spread = is_distance_field ? distance_field_spread : 0;
+	const int width = is_distance_field ? distance_field_atlas_size : atlas_width;
+	const int height = is_distance_field ? distance_field_atlas_size : atlas_height;
+	// distance field atlases are shared by all sizes
+	AtlasList& atlas_list = atlas_map[AtlasKey(it->first, is_distance_field ? 0 : font_size)];
+	bool is_new_atlas = atlas_list.empty();
+	if (is_new_atlas)
 	{
-		font_face = font_face_map.begin()->second;
+		atlas_list.push_back(std::make_shared<UMTextureAtlas>(width, height));
 	}
-	
-	// bitmap : base point is left-bottom.
-	int posx = 0;
-	int posy = 0;
-	int imagex = 0;
-	int imagey = 0;
+	UMTextureAtlasPtr texture_atlas = atlas_list.back();
 
 	for (int i = 0; i < static_cast<int>(text.size()); ++i)
 	{
@@ -252,72 +283,68 @@ UMTextureAtlasPtr UMFont::font_atlas(const umstring& font_name, const umtextstri
 		{
 			continue;
 		}
+		const UMGlyph* glyph = cached_glyph(it->first, it->second, glyph_size, text[i]);
+		if (!glyph) continue;
 
-		int bitmap_w = 0;
-		int bitmap_h = 0;
-		int ixoffset = 0;
-		int iyoffset = 0;
-		
-		int ascent;
-		int descent;
-		int line_gap;
-		stbtt_GetFontVMetrics(&font_face, &ascent, &descent, &line_gap);
-
-		int bitmap_left;
-		int advance_x;
-		stbtt_GetCodepointHMetrics(&font_face, text[i], &advance_x, &bitmap_left);
+		UMImagePtr image = UMGlyphCache::create_glyph_image(*glyph, spread);
+		if (texture_atlas->add_text_image(image, text[i]))
+		{
+			continue;
+		}
+		// the glyph or the text is larger than an atlas
+		if (is_new_atlas) continue;
+
+		// put all characters of the text to a new atlas
+		texture_atlas = std::make_shared<UMTextureAtlas>(width, height);
+		atlas_list.push_back(texture_atlas);
+		is_new_atlas = true;
+		i = -1;
+	}
+	return texture_atlas;
+}
 
-		unsigned char* bitmap_buffer = stbtt_GetCodepointBitmap(
-			&font_face, 
-			0, 
-			stbtt_ScaleForPixelHeight(&font_face, static_cast<float>(font_size)),
-			text[i],
-			&bitmap_w,
-			&bitmap_h,
-			&ixoffset,
-			&iyoffset);
+/**
+ * render atlas glyphs as signed distance fields
+ */
+void UMFont::set_distance_field_enabled(bool enabled) const
+{
+	is_distance_field = enabled;
+}
 
-		iyoffset += font_size;
-		
-		const int xsize = posx + bitmap_w;
-		const int ysize = posy + bitmap_h;
-			
-		// create image
-		UMImagePtr image = std::make_shared<UMImage>();
-		image->init(bitmap_w + ixoffset + 2, bitmap_h + iyoffset + 2);
-		image->fill(umbase::UMVec4d(0));
+/**
+ * get whether atlas glyphs are signed distance fields
+ */
+bool UMFont::is_distance_field_enabled() const
+{
+	return is_distance_field;
+}
 
-		// image  : base point is left-top.
-		const int image_w = image->width();
-		const int image_h = image->height();
-			
-		for (int y = posy, iy = imagey; y < ysize; ++y, ++iy)
-		{
-			for (int x = posx, ix = imagex; x < xsize; ++x, ++ix)
-			{
-				const int buffer_pos = bitmap_w * (y - posy) + (x - posx);
-				const int image_pos = image_w * (iy + iyoffset) + (ix + ixoffset);
-				const double alpha = bitmap_buffer[buffer_pos] / static_cast<double>(0xFF);
-				const double inv_alpha = 1.0 - alpha;
-				// for alpha image
-				image->mutable_list().at(image_pos) = umbase::UMVec4d(1, 1, 1, alpha);
-				//image->mutable_list().at(image_pos) = umbase::UMVec4d(inv_alpha, inv_alpha, inv_alpha, 1.0);
-			};
-		}
+/**
+ * get scale from text rects of an atlas to the font size
+ */
+double UMFont::atlas_scale(int font_size) const
+{
+	if (!is_distance_field) return 1.0;
+	return font_size / static_cast<double>(distance_field_size);
+}
 
-		stbtt_FreeBitmap(bitmap_buffer, 0);
+/**
+ * get padding pixels around each text rect of an atlas
+ */
+int UMFont::atlas_padding() const
+{
+	return is_distance_field ? distance_field_spread : 0;
+}
 
-		if (!texture_atlas->add_text_image(image, text[i]))
-		{
-			UMTextureAtlasPtr new_atlas = std::make_shared<UMTextureAtlas>(atlas_width, atlas_height);
-			atlas_list.push_back(new_atlas);
-			if (font_atlas(font_name, text, font_size))
-			{
-				return new_atlas;
-			}
-		}
-	}
-	return texture_atlas;
+/**
+ * get alpha range of half a pixel at the font size around the edge
+ */
+double UMFont::distance_field_edge(int font_size) const
+{
+	if (!is_distance_field || font_size <= 0) return 0.0;
+	// alpha changes 127/255 in the spread of the atlas
+	const double alpha_per_pixel = 127.0 / 255.0 / distance_field_spread;
+	return 0.5 * alpha_per_pixel / atlas_scale(font_size);
 }
 
 } // umimage
@@ -113,7 +113,7 @@ public:
 		, atlas_image_(std::make_shared<UMImage>())
 		, root_(new UMTextureAtlasNode(width, height))
 	{
-		atlas_image_->init(width, height);
+		atlas_image_->init(width, height, UMImage::ePixelFormatRGBA8);
 	}
 
 	~AtlasImpl() {}
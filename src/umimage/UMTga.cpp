@@ -23,7 +23,7 @@ namespace umimage
  */
 bool UMTga::save(const std::string& path, const UMImage& image) const
 {
-	if (image.list().empty()) return false;
+	if (!image.is_valid() || image.width() * image.height() == 0) return false;
 
 	try
 	{
@@ -9,78 +9,250 @@
  *
  */
 
+#if !defined(WITH_EMSCRIPTEN)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // !defined(WITH_EMSCRIPTEN)
+
 #include <snappy.h>
 #include <exception>
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <string.h>
 #include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include "UMResource.h"
 #include "UMPath.h"
 #include "UMStringUtil.h"
+#include "UMThreadPool.h"
 
 namespace 
 {
-	bool compress(const umstring& file_name, std::istream &in, std::ostream &out) 
+	const unsigned int pack_version = 2;
+	const unsigned int header_size = 16;
+	const unsigned int toc_entry_size = 32;
+
+	/**
+	 * table of contents entry of v2 pack
+	 * @note a file is stored without compression if compressed_size == size.
+	 */
+	struct TocEntry
 	{
-		// header
+		unsigned int name_hash;
+		unsigned int name_offset;
+		unsigned int name_size;
+		unsigned int data_offset;
+		unsigned int compressed_size;
+		unsigned int size;
+		/// hash of uncompressed data (names and data of files for a folder) to skip unchanged files at packing
+		unsigned long long content_hash;
+	};
+
+	/**
+	 * file to pack
+	 */
+	struct PackEntry
+	{
+		std::string name;
+		std::string data;
+		unsigned int size;
+		unsigned int name_hash;
+		unsigned long long content_hash;
+	};
+
+	/**
+	 * FNV-1a hash of utf8 file name
+	 */
+	unsigned int name_hash(const char* name, size_t size)
+	{
+		unsigned int hash = 2166136261u;
+		for (size_t i = 0; i < size; ++i)
 		{
-			out.write("U", 1);
-			out.write("P", 1);
-			out.write("A", 1);
-			out.write("C", 1);
-			unsigned int version = 1;
-			out.write(reinterpret_cast<char* >(&version), 4); 
+			hash ^= static_cast<unsigned char>(name[i]);
+			hash *= 16777619u;
 		}
+		return hash;
+	}
 
-		umstring name = file_name;
-		unsigned int name_size = static_cast<unsigned int>(name.size() * 2);
+	/**
+	 * FNV-1a 64bit hash of file data
+	 * @param [in] hash hash to continue
+	 */
+	unsigned long long content_hash(const std::string& data, unsigned long long hash = 14695981039346656037ull)
+	{
+		for (size_t i = 0, size = data.size(); i < size; ++i)
 		{
-			// write name size
-			out.write(reinterpret_cast<char* >(&name_size), 4); 
-			// write name
-			out.write(reinterpret_cast<const char* >(name.c_str()), name_size);
+			hash ^= static_cast<unsigned char>(data[i]);
+			hash *= 1099511628211ull;
 		}
+		return hash;
+	}
 
-		unsigned int total_size = static_cast<unsigned int>(in.seekg(0, std::ios::end).tellg());
-		in.seekg(0, std::ios::beg);
+	bool is_less_hash(const PackEntry& a, const PackEntry& b)
+	{
+		return a.name_hash < b.name_hash;
+	}
 
-		std::vector<char> in_block(snappy::kBlockSize);
-		std::string out_buffer;
-		std::vector<char> test_buffer;
+	bool is_less_toc_hash(const TocEntry& entry, unsigned int hash)
+	{
+		return entry.name_hash < hash;
+	}
 
-		for (size_t pos = 0; pos < total_size;) 
+	void write_uint(std::ostream& out, unsigned int value)
+	{
+		out.write(reinterpret_cast<const char*>(&value), 4);
+	}
+
+	bool read_file(std::string& dst, const umstring& path)
+	{
+		std::ifstream in(path.c_str(), std::ios::binary);
+		if (!in) return false;
+		dst.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		return !in.bad();
+	}
+
+	/**
+	 * compress a file. it is stored as is if compression does not reduce size.
+	 */
+	void create_pack_entry(PackEntry& entry, const umstring& file_name, const std::string& data)
+	{
+		entry.name = umbase::UMStringUtil::utf16_to_utf8(file_name);
+		entry.name_hash = name_hash(entry.name.c_str(), entry.name.size());
+		entry.size = static_cast<unsigned int>(data.size());
+		entry.content_hash = content_hash(data);
+		snappy::Compress(data.c_str(), data.size(), &entry.data);
+		if (entry.data.size() >= data.size())
 		{
-			// read
-			in.read(&(*in_block.begin()), snappy::kBlockSize);
-			const size_t read_size = in.gcount();
-			pos += read_size;
-			if (read_size > 0)
-			{
-				// compress
-				unsigned int compressed_size = 
-					static_cast<unsigned int>(snappy::Compress(&(*in_block.begin()), read_size, &out_buffer));
+			entry.data = data;
+		}
+	}
 
-				// write compressed size
-				out.write(reinterpret_cast<char* >(&compressed_size), 4);
+	/**
+	 * write v2 pack
+	 */
+	bool write_pack(std::ostream& out, std::vector<PackEntry>& entry_list)
+	{
+		std::stable_sort(entry_list.begin(), entry_list.end(), is_less_hash);
+		const unsigned int entry_count = static_cast<unsigned int>(entry_list.size());
+		unsigned int name_table_size = 0;
+		for (size_t i = 0; i < entry_list.size(); ++i)
+		{
+			name_table_size += static_cast<unsigned int>(entry_list[i].name.size());
+		}
 
-				// write compressed data
-				out.write(out_buffer.c_str(), compressed_size);
-				if (out.bad()) { return false; }
+		// header
+		out.write("UPAC", 4);
+		write_uint(out, pack_version);
+		write_uint(out, entry_count);
+		write_uint(out, name_table_size);
 
-				out_buffer.clear();
-			}
-			if (in.fail() && pos != total_size) 
-			{
-				return false;
-			}
+		// table of contents
+		unsigned int name_offset = header_size + entry_count * toc_entry_size;
+		unsigned int data_offset = name_offset + name_table_size;
+		for (size_t i = 0; i < entry_list.size(); ++i)
+		{
+			const PackEntry& entry = entry_list[i];
+			write_uint(out, entry.name_hash);
+			write_uint(out, name_offset);
+			write_uint(out, static_cast<unsigned int>(entry.name.size()));
+			write_uint(out, data_offset);
+			write_uint(out, static_cast<unsigned int>(entry.data.size()));
+			write_uint(out, entry.size);
+			out.write(reinterpret_cast<const char*>(&entry.content_hash), 8);
+			name_offset += static_cast<unsigned int>(entry.name.size());
+			data_offset += static_cast<unsigned int>(entry.data.size());
 		}
 
-		// footer
+		// names
+		for (size_t i = 0; i < entry_list.size(); ++i)
 		{
-			int footer = -1;
-			out.write(reinterpret_cast<char* >(&footer), 4);
+			out.write(entry_list[i].name.c_str(), entry_list[i].name.size());
 		}
-		return true;
+
+		// data
+		for (size_t i = 0; i < entry_list.size(); ++i)
+		{
+			out.write(entry_list[i].data.c_str(), entry_list[i].data.size());
+		}
+		return !out.bad();
 	}
 
+	/**
+	 * read-only file mapping
+	 */
+	class MappedFile
+	{
+		DISALLOW_COPY_AND_ASSIGN(MappedFile);
+	public:
+#if !defined(WITH_EMSCRIPTEN)
+		MappedFile() : file_(INVALID_HANDLE_VALUE), mapping_(NULL), data_(NULL), size_(0) {}
+#else
+		MappedFile() : data_(NULL), size_(0) {}
+#endif // !defined(WITH_EMSCRIPTEN)
+		~MappedFile() { close(); }
+
+		bool open(const umstring& path)
+		{
+			close();
+#if !defined(WITH_EMSCRIPTEN)
+			std::wstring inpath = umbase::UMStringUtil::utf16_to_wstring(path);
+			file_ = ::CreateFileW(inpath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file_ == INVALID_HANDLE_VALUE) return false;
+			LARGE_INTEGER file_size;
+			if (!::GetFileSizeEx(file_, &file_size) || file_size.QuadPart == 0) { close(); return false; }
+			mapping_ = ::CreateFileMappingW(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (!mapping_) { close(); return false; }
+			data_ = static_cast<const char*>(::MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+			if (!data_) { close(); return false; }
+			size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+			const int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0) return false;
+			struct stat st;
+			if (::fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return false; }
+			void* data = ::mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			::close(fd);
+			if (data == MAP_FAILED) return false;
+			data_ = static_cast<const char*>(data);
+			size_ = static_cast<size_t>(st.st_size);
+#endif // !defined(WITH_EMSCRIPTEN)
+			return true;
+		}
+
+		void close()
+		{
+#if !defined(WITH_EMSCRIPTEN)
+			if (data_) { ::UnmapViewOfFile(data_); }
+			if (mapping_) { ::CloseHandle(mapping_); }
+			if (file_ != INVALID_HANDLE_VALUE) { ::CloseHandle(file_); }
+			file_ = INVALID_HANDLE_VALUE;
+			mapping_ = NULL;
+#else
+			if (data_) { ::munmap(const_cast<char*>(data_), size_); }
+#endif // !defined(WITH_EMSCRIPTEN)
+			data_ = NULL;
+			size_ = 0;
+		}
+
+		const char* data() const { return data_; }
+		size_t size() const { return size_; }
+
+	private:
+#if !defined(WITH_EMSCRIPTEN)
+		HANDLE file_;
+		HANDLE mapping_;
+#endif // !defined(WITH_EMSCRIPTEN)
+		const char* data_;
+		size_t size_;
+	};
+
 	bool uncompress_to_memory(
 		umresource::UMResource::UnpackedNameList& unpacked_name_list, 
 		umresource::UMResource::UnpackedDataList& unpacked_data_list, 
@@ -184,9 +356,142 @@ namespace
 namespace umresource
 {
 
+/**
+ * mapped v2 pack
+ */
+class UMResource::Pack
+{
+	DISALLOW_COPY_AND_ASSIGN(Pack);
+public:
+	Pack() {}
+	~Pack() {}
+
+	/**
+	 * map a pack and read table of contents
+	 */
+	bool open(const umstring& path)
+	{
+		if (!file_.open(path)) return false;
+		const char* data = file_.data();
+		const size_t size = file_.size();
+		if (size < header_size || memcmp(data, "UPAC", 4) != 0) return false;
+		unsigned int header[3];
+		memcpy(header, data + 4, sizeof(header));
+		const unsigned int version = header[0];
+		const unsigned int entry_count = header[1];
+		if (version != pack_version) return false;
+		if ((size - header_size) / toc_entry_size < entry_count) return false;
+
+		toc_.resize(entry_count);
+		if (entry_count > 0)
+		{
+			memcpy(&toc_[0], data + header_size, entry_count * toc_entry_size);
+		}
+		for (unsigned int i = 0; i < entry_count; ++i)
+		{
+			const TocEntry& entry = toc_[i];
+			if (entry.name_offset > size || entry.name_size > size - entry.name_offset) return false;
+			if (entry.data_offset > size || entry.compressed_size > size - entry.data_offset) return false;
+			if (entry.compressed_size > entry.size) return false;
+		}
+		cache_list_.resize(entry_count);
+		is_cached_list_.assign(entry_count, 0);
+		return true;
+	}
+
+	/**
+	 * find a file by name
+	 * @retval index of the file, or -1
+	 */
+	int find(const std::string& name) const
+	{
+		const unsigned int hash = name_hash(name.c_str(), name.size());
+		std::vector<TocEntry>::const_iterator it = std::lower_bound(toc_.begin(), toc_.end(), hash, is_less_toc_hash);
+		for (; it != toc_.end() && it->name_hash == hash; ++it)
+		{
+			if (it->name_size == name.size() && 
+				memcmp(file_.data() + it->name_offset, name.c_str(), name.size()) == 0)
+			{
+				return static_cast<int>(std::distance(toc_.begin(), it));
+			}
+		}
+		return -1;
+	}
+
+	/**
+	 * get memory of a file. compressed file is uncompressed at first time.
+	 */
+	Memory memory(int index)
+	{
+		const TocEntry& entry = toc_[index];
+		Memory memory;
+		if (is_stored(entry))
+		{
+			memory.data = file_.data() + entry.data_offset;
+			memory.size = entry.size;
+			return memory;
+		}
+		const std::string& buffer = data(index);
+		memory.data = buffer.c_str();
+		memory.size = buffer.size();
+		return memory;
+	}
+
+	/**
+	 * get a file as string. stored file is copied at first time.
+	 */
+	const std::string& data(int index)
+	{
+		if (!is_cached_list_[index])
+		{
+			const TocEntry& entry = toc_[index];
+			const char* src = file_.data() + entry.data_offset;
+			std::string& buffer = cache_list_[index];
+			if (is_stored(entry))
+			{
+				buffer.assign(src, entry.size);
+			}
+			else if (!snappy::Uncompress(src, entry.compressed_size, &buffer))
+			{
+				buffer.clear();
+			}
+			is_cached_list_[index] = 1;
+		}
+		return cache_list_[index];
+	}
+
+	/**
+	 * get table of contents entry of a file
+	 */
+	const TocEntry& entry(int index) const { return toc_[index]; }
+
+	/**
+	 * get packed data of a file
+	 */
+	const char* packed_data(int index) const { return file_.data() + toc_[index].data_offset; }
+
+private:
+	static bool is_stored(const TocEntry& entry) { return entry.compressed_size == entry.size; }
+
+	MappedFile file_;
+	std::vector<TocEntry> toc_;
+	std::vector<std::string> cache_list_;
+	std::vector<unsigned char> is_cached_list_;
+};
+
+/**
+ * constructor
+ */
 UMResource::UMResource()
 {
 }
+
+/**
+ * destructor
+ */
+UMResource::~UMResource()
+{
+}
 /**
  * get default resource path
  */
@@ -206,64 +511,114 @@ umstring UMResource::default_model_resource_path()
 /**
  * pack files to dst file
  */
-bool UMResource::pack(const umstring& dst_absolute_path, const FilePathList& src_absolute_path_list)
+bool UMResource::pack(const umstring& dst_absolute_path, const FilePathList& src_absolute_path_list, PackStatList* stat_list)
 {
 	try
 	{
-		std::ofstream out(dst_absolute_path.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
-
+		FilePathList path_list;
 		FilePathList::const_iterator it = src_absolute_path_list.begin();
 		for (; it != src_absolute_path_list.end(); ++it)
 		{
-			const umstring& path = *it;
-			if (umbase::UMPath::exists(path))
+			if (umbase::UMPath::exists(*it))
 			{
-				if (umbase::UMPath::is_folder(path))
-				{
-					// create inner resource file
-					umstring temp_path = umbase::UMPath::get_temp_absolute_path();
-					std::ofstream inner_out(temp_path.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+				path_list.push_back(*it);
+			}
+		}
+		const int file_count = static_cast<int>(path_list.size());
 
-					std::vector<umstring> dirs;
-					std::vector<umstring> files;
-					if (umbase::UMPath::get_child_path_list(dirs, files, path))
-					{
-						for (size_t i = 0; i < files.size(); ++i)
-						{
-							umstring& file_path = files.at(i);
-
-							std::ifstream in(file_path.c_str(), std::ios::binary);
-							if (!in) { assert(0); return false; }
-
-							const umstring file_name = umbase::UMPath::get_file_name(file_path);
-							if (!compress(file_name, in, inner_out))
-							{
-								assert(0);
-							}
-						}
-					}
-					
-					std::ifstream in(temp_path.c_str(), std::ios::binary);
-					if (!in) { assert(0); return false; }
-					const umstring folder_name = umbase::UMPath::get_file_name(path);
-					if (!compress(folder_name, in, out))
+		// previous pack to reuse unchanged files
+		PackPtr previous = std::make_shared<Pack>();
+		if (!previous->open(dst_absolute_path))
+		{
+			previous.reset();
+		}
+
+		std::vector<PackEntry> entry_list(file_count);
+		PackStatList stats(file_count);
+		std::atomic<bool> is_failed(false);
+		umbase::UMThreadPool::instance().parallel_for(file_count, [&](int index) {
+			typedef std::chrono::high_resolution_clock Clock;
+			const Clock::time_point start = Clock::now();
+			const umstring& path = path_list[index];
+			const bool is_folder = umbase::UMPath::is_folder(path);
+			std::string data;
+			unsigned long long hash = 0;
+			std::vector<umstring> files;
+			std::vector<std::string> file_data_list;
+			if (is_folder)
+			{
+				// hash raw files first, so that an unchanged folder is not compressed again
+				std::vector<umstring> dirs;
+				hash = content_hash(std::string());
+				if (umbase::UMPath::get_child_path_list(dirs, files, path))
+				{
+					file_data_list.resize(files.size());
+					for (size_t i = 0; i < files.size(); ++i)
 					{
-						assert(0);
+						if (!read_file(file_data_list[i], files.at(i))) { is_failed = true; return; }
+						const unsigned int size = static_cast<unsigned int>(file_data_list[i].size());
+						hash = content_hash(umbase::UMStringUtil::utf16_to_utf8(umbase::UMPath::get_file_name(files.at(i))), hash);
+						hash = content_hash(std::string(reinterpret_cast<const char*>(&size), sizeof(size)), hash);
+						hash = content_hash(file_data_list[i], hash);
 					}
-					umbase::UMPath::remove_file(temp_path);
 				}
-				else
-				{
-					std::ifstream in(path.c_str(), std::ios::binary);
-					if (!in) { assert(0); return false; }
+			}
+			else
+			{
+				if (!read_file(data, path)) { is_failed = true; return; }
+				hash = content_hash(data);
+			}
 
-					const umstring file_name = umbase::UMPath::get_file_name(path);
-					if (!compress(file_name, in, out))
+			PackEntry& entry = entry_list[index];
+			PackStat& stat = stats[index];
+			const umstring file_name = umbase::UMPath::get_file_name(path);
+			const std::string name = umbase::UMStringUtil::utf16_to_utf8(file_name);
+			const int previous_index = previous ? previous->find(name) : -1;
+			if (previous_index >= 0 && 
+				(is_folder || previous->entry(previous_index).size == data.size()) &&
+				previous->entry(previous_index).content_hash == hash)
+			{
+				// unchanged
+				const TocEntry& toc = previous->entry(previous_index);
+				entry.name = name;
+				entry.name_hash = toc.name_hash;
+				entry.size = toc.size;
+				entry.content_hash = hash;
+				entry.data.assign(previous->packed_data(previous_index), toc.compressed_size);
+				stat.is_unchanged = true;
+			}
+			else
+			{
+				if (is_folder)
+				{
+					// create inner pack
+					std::vector<PackEntry> inner_entry_list(files.size());
+					for (size_t i = 0; i < files.size(); ++i)
 					{
-						assert(0);
+						create_pack_entry(inner_entry_list[i], umbase::UMPath::get_file_name(files.at(i)), file_data_list[i]);
 					}
+					std::ostringstream inner_out(std::ios::out | std::ios::binary);
+					if (!write_pack(inner_out, inner_entry_list)) { is_failed = true; return; }
+					data = inner_out.str();
 				}
+				create_pack_entry(entry, file_name, data);
+				entry.content_hash = hash;
 			}
+			stat.name = file_name;
+			stat.size = entry.size;
+			stat.packed_size = static_cast<unsigned int>(entry.data.size());
+			stat.milliseconds = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1000.0;
+		});
+		if (is_failed) { assert(0); return false; }
+
+		// the file can not be rewritten while mapped
+		previous.reset();
+		std::ofstream out(dst_absolute_path.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+		if (!out) { assert(0); return false; }
+		if (!write_pack(out, entry_list)) { assert(0); return false; }
+		if (stat_list)
+		{
+			stat_list->swap(stats);
 		}
 	}
 	catch (...)//(const std::exception &ex) 
@@ -289,8 +644,26 @@ bool UMResource::unpack_to_memory(const umstring& src_absolute_path)
 {
 	try
 	{
-		std::ifstream in(src_absolute_path.c_str(), std::ios::binary);
-		uncompress_to_memory(unpacked_name_list_, unpacked_data_list_, in);
+		unsigned int version = 0;
+		{
+			std::ifstream in(src_absolute_path.c_str(), std::ios::binary);
+			char header[8];
+			if (!in.read(header, sizeof(header))) return false;
+			memcpy(&version, header + 4, sizeof(version));
+		}
+		if (version >= pack_version)
+		{
+			PackPtr pack = std::make_shared<Pack>();
+			if (!pack->open(src_absolute_path)) return false;
+			std::lock_guard<std::mutex> lock(mutex_);
+			pack_list_.push_back(pack);
+		}
+		else
+		{
+			std::ifstream in(src_absolute_path.c_str(), std::ios::binary);
+			std::lock_guard<std::mutex> lock(mutex_);
+			uncompress_to_memory(unpacked_name_list_, unpacked_data_list_, in);
+		}
 	}
 	catch (...)//(const std::exception &ex) 
 	{
@@ -305,6 +678,16 @@ bool UMResource::unpack_to_memory(const umstring& src_absolute_path)
  */
 const std::string& UMResource::find_resource_data(UMResource& resource, const std::string& name)
 {
+	std::lock_guard<std::mutex> lock(resource.mutex_);
+	for (PackList::const_iterator pt = resource.pack_list_.begin(); pt != resource.pack_list_.end(); ++pt)
+	{
+		const int index = (*pt)->find(name);
+		if (index >= 0)
+		{
+			return (*pt)->data(index);
+		}
+	}
+
 	UMResource::UnpackedNameList& name_list = resource.unpacked_name_list();
 	UMResource::UnpackedDataList& data_list = resource.unpacked_data_list();
 	umstring utf16name = umbase::UMStringUtil::utf8_to_utf16(name);
@@ -319,4 +702,30 @@ const std::string& UMResource::find_resource_data(UMResource& resource, const st
 	return none;
 }
 
+/**
+ * find resource memory
+ */
+UMResource::Memory UMResource::find_resource_memory(const std::string& name)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (PackList::const_iterator pt = pack_list_.begin(); pt != pack_list_.end(); ++pt)
+		{
+			const int index = (*pt)->find(name);
+			if (index >= 0)
+			{
+				return (*pt)->memory(index);
+			}
+		}
+	}
+	const std::string& data = find_resource_data(*this, name);
+	Memory memory;
+	if (!data.empty())
+	{
+		memory.data = data.c_str();
+		memory.size = data.size();
+	}
+	return memory;
+}
+
 } // umresource
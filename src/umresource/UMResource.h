@@ -15,17 +15,25 @@
 #include <map>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include "UMMacro.h"
 
 /// Uimac resource library
 namespace umresource
 {
 
+/**
+ * packed resource files
+ * @note v2 pack has a table of contents sorted by name hash.
+ * it is mapped to memory and each file is uncompressed on first access.
+ * v1 pack is uncompressed to memory at once.
+ */
 class UMResource
 {
 	DISALLOW_COPY_AND_ASSIGN(UMResource);
 public:
-	~UMResource() {}
+	~UMResource();
 
 	static UMResource& instance() {
 		static UMResource instance_;
@@ -37,6 +45,32 @@ public:
 	 */
 	static const std::string& find_resource_data(UMResource& resource, const std::string& name);
 
+	/**
+	 * memory of a resource file
+	 * @note valid while the resource is alive.
+	 */
+	struct Memory
+	{
+		Memory() : data(NULL), size(0) {}
+		const char* data;
+		size_t size;
+
+		/**
+		 * copy to a string
+		 */
+		std::string to_string() const
+		{
+			return data ? std::string(data, size) : std::string();
+		}
+	};
+
+	/**
+	 * find resource memory
+	 * @param [in] name utf8 file name
+	 * @retval memory of the file. stored files of v2 pack are not copied.
+	 */
+	Memory find_resource_memory(const std::string& name);
+
 	typedef std::vector<umstring> FilePathList;
 	typedef std::string Buffer;
 	typedef std::vector<Buffer> UnpackedDataList;
@@ -52,12 +86,30 @@ public:
 	 */
 	static umstring default_model_resource_path();
 
+	/**
+	 * result of packing a file
+	 */
+	struct PackStat
+	{
+		PackStat() : size(0), packed_size(0), milliseconds(0.0), is_unchanged(false) {}
+		umstring name;
+		unsigned int size;
+		unsigned int packed_size;
+		double milliseconds;
+		/// reused from the previous pack
+		bool is_unchanged;
+	};
+	typedef std::vector<PackStat> PackStatList;
+
 	/**
 	 * pack files to dst file
 	 * @param [in] dst_absolute_path distination file path
 	 * @param [in] src_absolute_path_list source file path list
+	 * @param [out] stat_list result of each file, or NULL
+	 * @note files are compressed in parallel.
+	 * files not changed from the existing dst pack are copied without compression.
 	 */
-	bool pack(const umstring& dst_absolute_path, const FilePathList& src_absolute_path_list);
+	bool pack(const umstring& dst_absolute_path, const FilePathList& src_absolute_path_list, PackStatList* stat_list = NULL);
 
 	/**
 	 * unpack files to dst directory
@@ -69,16 +121,17 @@ public:
 	/**
 	 * unpack files to memory
 	 * @param [in] src_absolute_path source file path
+	 * @note v2 pack is only mapped. files are uncompressed by find_resource_data.
 	 */
 	bool unpack_to_memory(const umstring& src_absolute_path);
 
 	/**
-	 * get unpacked data list
+	 * get unpacked data list of v1 packs
 	 */
 	UnpackedDataList& unpacked_data_list() { return unpacked_data_list_; }
 
 	/**
-	 * get unpacked name list
+	 * get unpacked name list of v1 packs
 	 */
 	UnpackedNameList& unpacked_name_list() { return unpacked_name_list_; }
 
@@ -86,6 +139,12 @@ private:
 	UMResource();
 	UnpackedDataList unpacked_data_list_;
 	UnpackedNameList unpacked_name_list_;
+
+	class Pack;
+	typedef std::shared_ptr<Pack> PackPtr;
+	typedef std::vector<PackPtr> PackList;
+	PackList pack_list_;
+	std::mutex mutex_;
 };
 
 } // umresource
@@ -51,10 +51,11 @@ bool UMAreaLight::sample(
 	UMVec3d& direction, 
 	umdraw::UMLightPtr light,
 	const UMShaderParameter& parameter, 
-	const UMVec2d& random_value)
+	UMSampler& sampler)
 {
 	if (UMAreaLightPtr area_light = std::dynamic_pointer_cast<UMAreaLight>(light))
 	{
+		const UMVec2d random_value = sampler.next_2d();
 		UMVec3d sample_point(
 			area_light->edge1_ * random_value.x + 
 			area_light->edge2_ * random_value.y + area_light->position());
@@ -17,6 +17,7 @@
 #include "UMMathTypes.h"
 #include "UMVector.h"
 #include "UMLight.h"
+#include "UMSampler.h"
 
 namespace umrt
 {
@@ -67,7 +68,7 @@ public:
 	 * @param [out] direction light direction
 	 * @param [in] light light
 	 * @param [in] parameter shader parameter on sample point
-	 * @param [in] random_value random value
+	 * @param [in,out] sampler sampler
 	 */
 	static bool sample(
 		UMVec3d& intensity, 
@@ -75,7 +76,7 @@ public:
 		UMVec3d& direction, 
 		umdraw::UMLightPtr light,
 		const UMShaderParameter& parameter,
-		const UMVec2d& random_value);
+		UMSampler& sampler);
 	
 	/**
 	 * get intensity from previous sample
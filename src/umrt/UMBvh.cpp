@@ -10,17 +10,30 @@
  */
 #include "UMBvh.h"
 #include <algorithm>
+#include <limits>
+#include <cfloat>
+#include <cmath>
+#include <thread>
 #include <assert.h>
 #include "UMMathTypes.h"
 #include "UMMath.h"
 #include "UMBox.h"
 #include "UMRay.h"
 
+#if !defined(WITH_EMSCRIPTEN) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define UM_BVH_SSE
+	#include <emmintrin.h>
+#endif
+
 namespace umrt
 {
 
-/**s
- * bvh node
+class UMBvhNode;
+typedef std::shared_ptr<UMBvhNode> UMBvhNodePtr;
+
+/**
+ * bvh node for building
+ * @note flattened to UMBvhFlatNode after building.
  */
 class UMBvhNode
 {
@@ -28,8 +41,7 @@ public:
 	UMBvhNode()
 		: axis_(0),
 		start_index_(0),
-		end_index_(0),
-		flat_index_(0)
+		end_index_(0)
 	{}
 
 	void init_as_leaf(const umbase::UMBox& box, int start_index, int end_index)
@@ -60,8 +72,6 @@ public:
 	unsigned char axis_;
 	int start_index_;
 	int end_index_;
-	// ordered index in flatten
-	int flat_index_;
 };
 
 }// umstructure
@@ -72,6 +82,28 @@ namespace
 	using namespace umdraw;
 	using namespace umbase;
 
+	/**
+	 * max primitive count in a flattened leaf
+	 */
+	const int max_flat_leaf_primitive_count = 0xFFFF;
+
+	/**
+	 * branch stack size of traversal
+	 * @note trees are built shallower than this. 
+	 * splitting equal counts below max depth adds at most 32 levels.
+	 */
+	const int branch_stack_size = 1024;
+
+	/**
+	 * leaf flag : has primitives which are not triangles
+	 */
+	const unsigned char flag_has_primitive = 1;
+
+	/**
+	 * SAH cost of a node traversal relative to a primitive intersection (value from pbrt)
+	 */
+	const double traversal_cost = 0.2;
+
 	/**
 	 * SAH const function
 	 * @param [in] area area of target prims' AABB
@@ -89,11 +121,40 @@ namespace
 		unsigned int parted_primitive_count2)
 	{
 		double inv_area = 1.0 / area;
-		return 0.2 // value from pbrt
+		return traversal_cost
 			+ ((parted_area1 * parted_primitive_count1)
 			+  (parted_area2 * parted_primitive_count2)) * inv_area;
 	}
 
+	/**
+	 * primitive information for building
+	 */
+	struct UMBvhPrimitiveInfo {
+		UMBvhPrimitiveInfo() : index(0) {}
+		UMBvhPrimitiveInfo(int index_, const umbase::UMBox& box_)
+			: index(index_),
+			box(box_),
+			centroid(box_.center())
+		{}
+		int index;
+		umbase::UMBox box;
+		umbase::UMVec3d centroid;
+	};
+	typedef std::vector<UMBvhPrimitiveInfo> UMBvhPrimitiveInfoList;
+
+	/**
+	 * building statistics
+	 */
+	struct UMBvhBuildStats {
+		UMBvhBuildStats() : node_count(0), max_depth(0) {}
+		void merge(const UMBvhBuildStats& stats) {
+			node_count += stats.node_count;
+			max_depth = (std::max)(max_depth, stats.max_depth);
+		}
+		unsigned int node_count;
+		int max_depth;
+	};
+
 	/**
 	 * primitive comparator
 	 */
@@ -104,8 +165,8 @@ namespace
 		{}
 		int axis;
 		double middle;
-		bool operator() (const UMPrimitivePtr a) const {
-			return a->box().center()[axis] < middle;
+		bool operator() (const UMBvhPrimitiveInfo& a) const {
+			return a.centroid[axis] < middle;
 		}
 	};
 
@@ -117,11 +178,28 @@ namespace
 			: axis(axis_)
 		{}
 		int axis;
-		bool operator() (const UMPrimitivePtr a, const UMPrimitivePtr b) const {
-			return a->box().center()[axis] < b->box().center()[axis];
+		bool operator() (const UMBvhPrimitiveInfo& a, const UMBvhPrimitiveInfo& b) const {
+			return a.centroid[axis] < b.centroid[axis];
 		}
 	};
 	
+	/**
+	 * bucket index of a primitive
+	 */
+	int bucket_index(const UMBvhPrimitiveInfo& info, int bucket_count, int axis, const umbase::UMBox& centroid)
+	{
+		int b = static_cast<int>(bucket_count * (
+			(info.centroid[axis] - centroid.minimum()[axis]) /
+			(centroid.maximum()[axis] - centroid.minimum()[axis])
+			));
+		if (b >= bucket_count) { b = bucket_count-1; }
+		if (b < 0) { b = 0; }
+		return b;
+	}
+
+	/**
+	 * primitive comparator
+	 */
 	struct compare_bucket {
 		compare_bucket(int split, int num, int axis_, const umbase::UMBox &b)
 			: centroid(b),
@@ -129,7 +207,9 @@ namespace
 			bucket_count(num),
 			axis(axis_)
 		{ }
-		bool operator()(const UMPrimitivePtr p) const;
+		bool operator()(const UMBvhPrimitiveInfo& info) const {
+			return bucket_index(info, bucket_count, axis, centroid) <= split_bucket;
+		}
 
 		int split_bucket;
 		int bucket_count;
@@ -137,25 +217,6 @@ namespace
 		const umbase::UMBox &centroid;
 	};
 
-	bool compare_bucket::operator()(const UMPrimitivePtr p) const {
-		int b = static_cast<int>(bucket_count * (
-			(p->box().center()[axis] - centroid.minimum()[axis]) /
-			(centroid.maximum()[axis] - centroid.minimum()[axis])
-			));
-
-		if (b == bucket_count)  { b = bucket_count-1; }
-		assert(b >= 0 && b < bucket_count);
-		return b <= split_bucket;
-	}
-
-	struct compare_point {
-		compare_point(int axis_) : axis(axis_) {}
-		bool operator()(const UMPrimitivePtr a, const UMPrimitivePtr b) const {
-			return a->box().center()[axis] < b->box().center()[axis];
-		}
-		int axis;
-	};
-
 	int maximum_axis(const umbase::UMBox& box) { 
 		umbase::UMVec3d v =box.maximum() - box.minimum();
 		if (v.x > v.y && v.x > v.z) {
@@ -168,235 +229,323 @@ namespace
 	}
 
 	/**
-	 *
-	 * @param [out] ordered_primitives
-	 * @param [in] scene
-	 * @param [in] start
-	 * @param [in] end
+	 * split at middle of the centroid box.
+	 * @param [in,out] infos primitive informations
+	 * @param [in] start start index
+	 * @param [in] end end index
+	 * @param [in] axis split axis
+	 * @param [in] box_centroid box of centroids
+	 * @retval middle index
 	 */
-	UMBvhNodePtr build_middle_split(
-		unsigned int& total_node_count,
-		UMPrimitiveList& ordered_primitives, 
-		UMPrimitiveList& primitives, 
-		int start, 
+	int split_middle(
+		UMBvhPrimitiveInfoList& infos,
+		int start,
 		int end,
-		int& depth)
+		int axis,
+		const umbase::UMBox& box_centroid)
+	{
+		const double middle = box_centroid.center()[axis];
+		UMBvhPrimitiveInfoList::iterator it = std::partition(
+			infos.begin() + start, 
+			infos.begin() + end, 
+			before_middle(axis, middle));
+		int middle_index = static_cast<int>(std::distance(infos.begin(), it));
+		if (middle_index == start || middle_index == end) {
+			// split equal counts
+			middle_index = (start + end) / 2;
+			std::nth_element(
+				infos.begin() + start,
+				infos.begin() + middle_index,
+				infos.begin() + end,
+				before_less(axis));
+		}
+		return middle_index;
+	}
+
+	/**
+	 * split by binned SAH.
+	 * @param [in,out] infos primitive informations
+	 * @param [in] start start index
+	 * @param [in] end end index
+	 * @param [in] axis split axis
+	 * @param [in] box_all box of primitives
+	 * @param [in] box_centroid box of centroids
+	 * @param [in] option build option
+	 * @retval middle index. returns -1 if creating a leaf is cheaper.
+	 */
+	int split_sah(
+		UMBvhPrimitiveInfoList& infos,
+		int start,
+		int end,
+		int axis,
+		const umbase::UMBox& box_all,
+		const umbase::UMBox& box_centroid,
+		const UMBvhBuildOption& option)
 	{
 		const int count = end - start;
+		const int bucket_count = (std::max)(2, option.bucket_count);
 		
-		++total_node_count;
-
-		umbase::UMBox box_centroid;
+		struct BucketInfo {
+			BucketInfo() : count(0) {}
+			int count;
+			umbase::UMBox bounds;
+		};
+		std::vector<BucketInfo> buckets(bucket_count);
+		
+		// binning
 		for (int i = start; i < end; ++i)
 		{
-			UMPrimitivePtr primitive = primitives.at(i);
-			box_centroid.extend(primitive->box().center());
+			const UMBvhPrimitiveInfo& info = infos[i];
+			BucketInfo& bucket = buckets[bucket_index(info, bucket_count, axis, box_centroid)];
+			++bucket.count;
+			bucket.bounds.extend(info.box);
 		}
 
-		const int axis = maximum_axis(box_centroid);
-		
-		UMBvhNodePtr node(std::make_shared<UMBvhNode>());
-
-		// create leaf
-		if (depth == 0 || count <= 4 || box_centroid.maximum()[axis] == box_centroid.minimum()[axis])
+		// sweep from right to left, then left to right
+		std::vector<double> right_area(bucket_count);
+		std::vector<int> right_count(bucket_count);
 		{
-			const int start_index = static_cast<int>(ordered_primitives.size());
-			umbase::UMBox box_all;
-			for (int i = start; i < end; ++i)
+			umbase::UMBox box;
+			int right = 0;
+			for (int i = bucket_count - 1; i > 0; --i)
 			{
-				UMPrimitivePtr primitive = primitives.at(i);
-				box_all.extend(primitive->box());
-				ordered_primitives.push_back(primitive);
+				box.extend(buckets[i].bounds);
+				right += buckets[i].count;
+				right_area[i] = right > 0 ? box.area() : 0.0;
+				right_count[i] = right;
 			}
-			node->init_as_leaf(box_all, start_index, start_index + count);
-			return node;
 		}
-
-		// create branch
-		umbase::UMVec3d centroid = box_centroid.center();
-		UMPrimitiveList::iterator middle = std::partition(
-			primitives.begin() + start, 
-			primitives.begin() + end, 
-			before_middle(axis, centroid[axis]));
-		int middle_index = static_cast<int>(std::distance(primitives.begin(), middle));
-		if (middle_index == start || middle_index == end) {
-			// split equal counts
-			middle_index = (start + end) / 2;
-			std::nth_element(
-				primitives.begin() + start,
-				primitives.begin() + middle_index,
-				primitives.begin() + end,
-				before_less(axis));
+		
+		const double area = box_all.area();
+		double min_cost = (std::numeric_limits<double>::max)();
+		int min_cost_split = 0;
+		{
+			umbase::UMBox box;
+			int left = 0;
+			for (int i = 0; i < bucket_count - 1; ++i)
+			{
+				box.extend(buckets[i].bounds);
+				left += buckets[i].count;
+				const double left_area = left > 0 ? box.area() : 0.0;
+				const double cost = sah(
+					area,
+					left_area, left,
+					right_area[i + 1], right_count[i + 1]);
+				if (cost < min_cost)
+				{
+					min_cost = cost;
+					min_cost_split = i;
+				}
+			}
 		}
 
-		int left_depth = depth - 1;
-		int right_depth = depth - 1;
-		node->init_as_branch(
-			build_middle_split(total_node_count, ordered_primitives, primitives, start, middle_index, left_depth),
-			build_middle_split(total_node_count, ordered_primitives, primitives, middle_index, end, right_depth),
-			axis);
-
-		if (left_depth < right_depth)
+		// either create leaf or split primitives at selected SAH bucket
+		if (count <= option.max_leaf_primitive_count && count <= max_flat_leaf_primitive_count && min_cost >= count)
 		{
-			depth = left_depth;
+			return -1;
 		}
-		else
+		UMBvhPrimitiveInfoList::iterator it = std::partition(
+			infos.begin() + start, 
+			infos.begin() + end, 
+			compare_bucket(min_cost_split, bucket_count, axis, box_centroid));
+		int middle_index = static_cast<int>(std::distance(infos.begin(), it));
+		if (middle_index <= start || middle_index >= end)
 		{
-			depth = right_depth;
+			middle_index = split_middle(infos, start, end, axis, box_centroid);
 		}
-
-		return node;
+		return middle_index;
 	}
-	
+
 	/**
-	 *
-	 * @param [out] ordered_primitives
-	 * @param [in] scene
-	 * @param [in] start
-	 * @param [in] end
+	 * build bvh node tree
+	 * @param [out] stats building statistics
+	 * @param [in,out] infos primitive informations. partitioned in place.
+	 * @param [in] start start index
+	 * @param [in] end end index
+	 * @param [in] depth current depth
+	 * @param [in] thread_depth remaining depth to spawn threads
+	 * @param [in] option build option
 	 */
-	UMBvhNodePtr build_sah(
-		unsigned int& total_node_count,
-		UMPrimitiveList& ordered_primitives, 
-		UMPrimitiveList& primitives, 
+	UMBvhNodePtr build_recursive(
+		UMBvhBuildStats& stats,
+		UMBvhPrimitiveInfoList& infos,
 		int start, 
 		int end,
-		int& depth)
+		int depth,
+		int thread_depth,
+		const UMBvhBuildOption& option)
 	{
 		const int count = end - start;
 		
-		++total_node_count;
+		++stats.node_count;
+		stats.max_depth = (std::max)(stats.max_depth, depth);
 		
 		umbase::UMBox box_all;
 		umbase::UMBox box_centroid;
 		for (int i = start; i < end; ++i)
 		{
-			UMPrimitivePtr primitive = primitives.at(i);
-			box_all.extend(primitive->box());
-			box_centroid.extend(primitive->box().center());
+			box_all.extend(infos[i].box);
+			box_centroid.extend(infos[i].centroid);
 		}
 		const int axis = maximum_axis(box_centroid);
+		const bool is_degenerate = box_centroid.maximum()[axis] == box_centroid.minimum()[axis];
 		
 		UMBvhNodePtr node(std::make_shared<UMBvhNode>());
 		
 		// create leaf
-		if (depth == 0 || box_centroid.maximum()[axis] == box_centroid.minimum()[axis])
+		const bool can_be_leaf = count <= max_flat_leaf_primitive_count;
+		if (count <= 1
+			|| (can_be_leaf && (depth >= option.max_depth || is_degenerate))
+			|| (option.split_method == UMBvhBuildOption::eSplitMiddle && count <= option.max_leaf_primitive_count))
 		{
-			const int start_index = static_cast<int>(ordered_primitives.size());
-			for (int i = start; i < end; ++i)
-			{
-				UMPrimitivePtr primitive = primitives.at(i);
-				ordered_primitives.push_back(primitive);
-			}
-			node->init_as_leaf(box_all, start_index, start_index + count);
+			node->init_as_leaf(box_all, start, end);
 			return node;
 		}
-		
-		// Partition primitives into two sets and build children
-		int middle_index = (start + end) / 2;
-		{
-			// Allocate _BucketInfo_ for SAH partition buckets
-			const int buckets_count = 12;
-			struct BucketInfo {
-				BucketInfo() { count = 0; }
-				int count;
-				umbase::UMBox bounds;
-			};
-			BucketInfo buckets[buckets_count];
-			
-			// Initialize _BucketInfo_ for SAH partition buckets
-			for (int i = start; i < end; ++i)
-			{
-				int b = static_cast<int>(buckets_count * 
-					((primitives.at(i)->box().center()[axis] - box_centroid.minimum()[axis]) /
-					(box_centroid.maximum()[axis] - box_centroid.minimum()[axis])));
-				if (b == buckets_count) { 
-					b = buckets_count-1;
-				}
-				assert(b >= 0 && b < buckets_count);
-				buckets[b].count++;
-				buckets[b].bounds.extend(primitives[i]->box());
-			}
-			
-			// Compute costs for splitting after each bucket
-			double cost[buckets_count-1];
-			for (int i = 0; i < buckets_count-1; ++i) {
-				umbase::UMBox b0;
-				umbase::UMBox b1;
-				int count0 = 0;
-				int count1 = 0;
-				for (int k = 0; k <= i; ++k) {
-					b0.extend(buckets[k].bounds);
-					count0 += buckets[k].count;
-				}
-				for (int k = i+1; k < buckets_count; ++k) {
-					b1.extend(buckets[k].bounds);
-					count1 += buckets[k].count;
-				}
-				cost[i] = sah(
-					box_all.area(),
-					b0.area(), count0,
-					b1.area(), count1);
-			}
-			
-			// Find bucket to split at that minimizes SAH metric
-			double min_cost = cost[0];
-			unsigned int min_cost_split = 0;
-			for (int i = 1; i < buckets_count-1; ++i) {
-				if (cost[i] < min_cost) {
-					min_cost = cost[i];
-					min_cost_split = i;
-				}
-			}
-			
-			// Either create leaf or split primitives at selected SAH bucket
-			if (count > 255 || min_cost < count) {
-				UMPrimitiveList::iterator middle = std::partition(
-					primitives.begin() + start, 
-					primitives.begin() + end, 
-					compare_bucket(min_cost_split, buckets_count, axis, box_centroid));
-				middle_index = static_cast<int>(std::distance(primitives.begin(), middle));
-				if (middle_index <= start || middle_index >= end)
-				{
-					middle_index = (start + end) / 2;
-				}
-			}
-			else
+
+		int middle_index = 0;
+		if (is_degenerate)
+		{
+			// all centroids are same. split equal counts
+			middle_index = (start + end) / 2;
+		}
+		else if (depth >= option.max_depth)
+		{
+			// too many primitives for a leaf at max depth. split equal counts
+			middle_index = (start + end) / 2;
+			std::nth_element(
+				infos.begin() + start,
+				infos.begin() + middle_index,
+				infos.begin() + end,
+				before_less(axis));
+		}
+		else if (option.split_method == UMBvhBuildOption::eSplitSAH)
+		{
+			middle_index = split_sah(infos, start, end, axis, box_all, box_centroid, option);
+			if (middle_index < 0)
 			{
-				// create leaf
-				int start_index = static_cast<int>(ordered_primitives.size());
-				for (int i = start; i < end; ++i) {
-					UMPrimitivePtr primitive = primitives.at(i);
-					ordered_primitives.push_back(primitive);
-				}
-				node->init_as_leaf(box_all, start_index, start_index + count);
+				node->init_as_leaf(box_all, start, end);
 				return node;
 			}
 		}
+		else
+		{
+			middle_index = split_middle(infos, start, end, axis, box_centroid);
+		}
 
-		--depth;
-		node->init_as_branch(
-			build_sah(total_node_count, ordered_primitives, primitives, start, middle_index, depth),
-			build_sah(total_node_count, ordered_primitives, primitives, middle_index, end, depth),
-			axis);
-
+		// create branch
+		UMBvhNodePtr left;
+		UMBvhNodePtr right;
+		UMBvhBuildStats right_stats;
+		if (thread_depth > 0 && count >= option.parallel_primitive_count)
+		{
+			// build left subtree on another thread
+			UMBvhBuildStats left_stats;
+			std::thread left_thread([&]() {
+				left = build_recursive(left_stats, infos, start, middle_index, depth + 1, thread_depth - 1, option);
+			});
+			right = build_recursive(right_stats, infos, middle_index, end, depth + 1, thread_depth - 1, option);
+			left_thread.join();
+			stats.merge(left_stats);
+		}
+		else
+		{
+			left = build_recursive(stats, infos, start, middle_index, depth + 1, 0, option);
+			right = build_recursive(right_stats, infos, middle_index, end, depth + 1, 0, option);
+		}
+		stats.merge(right_stats);
+		node->init_as_branch(left, right, axis);
 		return node;
 	}
 
 	/**
-	 * @param [out] dst_node_list destination node list
-	 * @param [in] root recursive root
-	 * @param [in] offset current index
+	 * round down double to float
 	 */
-	void flatten(UMBvhNodeList& dst_node_list, UMBvhNodePtr root, unsigned int& offset)
+	float round_down(double value)
 	{
-		if (!root) return;
-		root->flat_index_ = offset;
-		dst_node_list.at(root->flat_index_) = root;
-		++offset;
+		if (value < -FLT_MAX) return -(std::numeric_limits<float>::infinity)();
+		const float f = static_cast<float>(value);
+		if (f > value) {
+			return f - (std::abs(f) * FLT_EPSILON + FLT_MIN);
+		}
+		return f;
+	}
+	
+	/**
+	 * round up double to float
+	 */
+	float round_up(double value)
+	{
+		if (value > FLT_MAX) return (std::numeric_limits<float>::infinity)();
+		const float f = static_cast<float>(value);
+		if (f < value) {
+			return f + (std::abs(f) * FLT_EPSILON + FLT_MIN);
+		}
+		return f;
+	}
 
-		flatten(dst_node_list, root->left_, offset);
-		flatten(dst_node_list, root->right_, offset);
+	/**
+	 * surface area of a flat node
+	 */
+	double surface_area(const UMBvhFlatNode& node)
+	{
+		const double dx = static_cast<double>(node.maximum[0]) - node.minimum[0];
+		const double dy = static_cast<double>(node.maximum[1]) - node.minimum[1];
+		const double dz = static_cast<double>(node.maximum[2]) - node.minimum[2];
+		return 2.0 * (dx * dy + dy * dz + dz * dx);
+	}
+
+	/**
+	 * set box to a flat node
+	 */
+	void set_node_box(UMBvhFlatNode& node, const umbase::UMBox& box)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			node.minimum[i] = round_down(box.minimum()[i]);
+			node.maximum[i] = round_up(box.maximum()[i]);
+		}
+	}
+
+	/**
+	 * @param [out] dst_node_list destination node list
+	 * @param [in] soup packed triangles
+	 * @param [in] node recursive root
+	 * @param [in,out] offset current index
+	 * @retval flattened index of node
+	 */
+	unsigned int flatten(
+		UMBvhFlatNodeList& dst_node_list, 
+		const UMTriangleSoup& soup,
+		const UMBvhNodePtr& node, 
+		unsigned int& offset)
+	{
+		const unsigned int index = offset++;
+		UMBvhFlatNode& flat_node = dst_node_list[index];
+		set_node_box(flat_node, node->box_);
+		flat_node.axis = node->axis_;
+		flat_node.flags = 0;
+		if (node->is_leaf())
+		{
+			flat_node.offset = node->start_index_;
+			flat_node.primitive_count = static_cast<unsigned short>(node->end_index_ - node->start_index_);
+			for (int i = node->start_index_; i < node->end_index_; ++i)
+			{
+				if (!soup.is_triangle(i))
+				{
+					flat_node.flags |= flag_has_primitive;
+					break;
+				}
+			}
+		}
+		else
+		{
+			flat_node.primitive_count = 0;
+			// left child is always next to this node
+			flatten(dst_node_list, soup, node->left_, offset);
+			// dst_node_list is presized, so flat_node is still valid here
+			flat_node.offset = flatten(dst_node_list, soup, node->right_, offset);
+		}
+		return index;
 	}
 
 } // anonymouse namespace
@@ -404,78 +553,288 @@ namespace
 namespace umrt
 {
 
-static bool intersect_box(
-	const umbase::UMBox& bounds, 
-	const UMRay& ray,
-	const umbase::UMVec3d& inv_dir, 
-	const umbase::UMVec3i& dir_is_negative,
-	double closest_distance)
+static inline bool intersect_box(
+	const UMBvhFlatNode& node, 
+	const float origin[3],
+	const float inv_dir[3], 
+	const int dir_is_negative[3],
+	float interval_min,
+	float interval_max)
 {
-	double interval_min = ray.tmin();
-	double interval_max = closest_distance;
-
 	// intersection of x and y slabs
-	double txmin =  (bounds[  dir_is_negative[0]].x - ray.origin().x) * inv_dir.x;
-	double txmax =  (bounds[1-dir_is_negative[0]].x - ray.origin().x) * inv_dir.x;
+	float txmin = ((dir_is_negative[0] ? node.maximum[0] : node.minimum[0]) - origin[0]) * inv_dir[0];
+	float txmax = ((dir_is_negative[0] ? node.minimum[0] : node.maximum[0]) - origin[0]) * inv_dir[0];
 	if (txmin > interval_min) interval_min = txmin;
 	if (txmax < interval_max) interval_max = txmax;
 	if (interval_min > interval_max) return false;
 	
-	double tymin = (bounds[  dir_is_negative[1]].y - ray.origin().y) * inv_dir.y;
-	double tymax = (bounds[1-dir_is_negative[1]].y - ray.origin().y) * inv_dir.y;
+	float tymin = ((dir_is_negative[1] ? node.maximum[1] : node.minimum[1]) - origin[1]) * inv_dir[1];
+	float tymax = ((dir_is_negative[1] ? node.minimum[1] : node.maximum[1]) - origin[1]) * inv_dir[1];
 	if (tymin > interval_min) interval_min = tymin;
 	if (tymax < interval_max) interval_max = tymax;
 	if (interval_min > interval_max) return false;
 
 	// intersection against z slab
-	double tzmin = (bounds[  dir_is_negative[2]].z - ray.origin().z) * inv_dir.z;
-	double tzmax = (bounds[1-dir_is_negative[2]].z - ray.origin().z) * inv_dir.z;;
+	float tzmin = ((dir_is_negative[2] ? node.maximum[2] : node.minimum[2]) - origin[2]) * inv_dir[2];
+	float tzmax = ((dir_is_negative[2] ? node.minimum[2] : node.maximum[2]) - origin[2]) * inv_dir[2];
 	if (tzmin > interval_min) interval_min = tzmin;
 	if (tzmax < interval_max) interval_max = tzmax;
-	return (interval_min <= interval_max) ;
+	return (interval_min <= interval_max);
+}
+
+/**
+ * box intersection of a ray packet
+ * @retval mask of lanes which hit
+ */
+static inline int intersect_box_packet(
+	const UMBvhFlatNode& node,
+	const UMTriangleSoupRayPacket& packet,
+	const float interval_max[],
+	int active_mask)
+{
+#if defined(UM_BVH_SSE)
+	__m128 tnear = _mm_loadu_ps(packet.tmin);
+	__m128 tfar = _mm_loadu_ps(interval_max);
+	for (int i = 0; i < 3; ++i)
+	{
+		const __m128 origin = _mm_loadu_ps(packet.origin[i]);
+		const __m128 inv_dir = _mm_loadu_ps(packet.inv_direction[i]);
+		const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minimum[i]), origin), inv_dir);
+		const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maximum[i]), origin), inv_dir);
+		// a NaN slab (0 * inf) keeps the current interval
+		tnear = _mm_max_ps(_mm_min_ps(t0, t1), tnear);
+		tfar = _mm_min_ps(_mm_max_ps(t0, t1), tfar);
+	}
+	return _mm_movemask_ps(_mm_cmple_ps(tnear, tfar)) & active_mask;
+#else
+	int mask = 0;
+	for (int k = 0; k < UMTriangleSoupRayPacket::packet_size; ++k)
+	{
+		if (!(active_mask & (1 << k))) continue;
+		const float origin[3] = { packet.origin[0][k], packet.origin[1][k], packet.origin[2][k] };
+		const float inv_dir[3] = { packet.inv_direction[0][k], packet.inv_direction[1][k], packet.inv_direction[2][k] };
+		const int dir_is_negative[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+		if (intersect_box(node, origin, inv_dir, dir_is_negative, packet.tmin[k], interval_max[k]))
+		{
+			mask |= (1 << k);
+		}
+	}
+	return mask;
+#endif // UM_BVH_SSE
 }
 
 /**
  * build bvh from primitive list
  */
-bool UMBvh::build(UMPrimitiveList& primitives)
+bool UMBvh::build(UMPrimitiveList& primitives, const UMBvhBuildOption& option)
 {
 	ordered_primitives_.clear();
 	node_list_.clear();
+	branch_level_nodes_.clear();
+	branch_level_offsets_.clear();
+	triangle_soup_.clear();
+	box_.init();
+	build_sah_cost_ = 0.0;
 
 	const int primitive_count = static_cast<int>(primitives.size());
 	if (primitive_count <= 0) return false;
 	
-	ordered_primitives_.reserve(primitive_count);
-	unsigned int total_node_count = 0;
+	// gather boxes once
+	UMBvhPrimitiveInfoList infos(primitive_count);
+	for (int i = 0; i < primitive_count; ++i)
+	{
+		infos[i] = UMBvhPrimitiveInfo(i, primitives[i]->box());
+	}
+
+	// spawn threads until all hardware threads are used
+	int thread_depth = 0;
+#if !defined(WITH_EMSCRIPTEN)
+	if (option.parallel_primitive_count > 0)
+	{
+		for (unsigned int threads = std::thread::hardware_concurrency(); threads > 1; threads >>= 1)
+		{
+			++thread_depth;
+		}
+	}
+#endif // !defined(WITH_EMSCRIPTEN)
 
-	int max_depth = (std::numeric_limits<int>::max)();
+	// depth is limited by the branch stack of traversal
+	UMBvhBuildOption build_option(option);
+	build_option.max_depth = (std::min)(option.max_depth, branch_stack_size - 32);
 
 	// create bvh node tree
-	UMBvhNodePtr root = build_middle_split(
-	//UMBvhNodePtr root = build_sah(
-		total_node_count,
-		ordered_primitives_, 
-		primitives, 
+	UMBvhBuildStats stats;
+	UMBvhNodePtr root = build_recursive(
+		stats,
+		infos,
 		0, 
 		primitive_count,
-		max_depth);
+		0,
+		thread_depth,
+		build_option);
 
 	if (!root) return false;
-	if (total_node_count == 0) return false;
+	if (stats.node_count == 0) return false;
 
-	int depth = (std::numeric_limits<int>::max)() - max_depth;
-	printf("nodes : %d\n", total_node_count);
-	printf("max depth : %d\n", depth);
+	// leaves point to ranges of partitioned infos
+	ordered_primitives_.resize(primitive_count);
+	for (int i = 0; i < primitive_count; ++i)
+	{
+		ordered_primitives_[i] = primitives[infos[i].index];
+	}
+
+	// pack triangles in the same order
+	triangle_soup_.build(ordered_primitives_);
 
 	// flatten to list
-	node_list_.resize(total_node_count);
+	node_list_.resize(stats.node_count);
 	unsigned int offset = 0;
-	flatten(node_list_, root, offset);
+	flatten(node_list_, triangle_soup_, root, offset);
+	build_branch_levels();
+	box_ = root->box_;
+	build_sah_cost_ = sah_cost();
 
 	return true;
 }
 
+/**
+ * group branch nodes by depth, so that a level is refitted in parallel
+ */
+void UMBvh::build_branch_levels()
+{
+	const int node_count = static_cast<int>(node_list_.size());
+	std::vector<int> depth_list(node_count, 0);
+	int max_depth = 0;
+	// children are always after their parent
+	for (int i = 0; i < node_count; ++i)
+	{
+		const UMBvhFlatNode& node = node_list_[i];
+		if (node.primitive_count > 0) continue;
+		depth_list[i + 1] = depth_list[node.offset] = depth_list[i] + 1;
+		max_depth = (std::max)(max_depth, depth_list[i]);
+	}
+
+	// counting sort from the deepest level
+	branch_level_offsets_.assign(max_depth + 2, 0);
+	for (int i = 0; i < node_count; ++i)
+	{
+		if (node_list_[i].primitive_count > 0) continue;
+		++branch_level_offsets_[max_depth - depth_list[i] + 1];
+	}
+	for (int level = 1; level <= max_depth + 1; ++level)
+	{
+		branch_level_offsets_[level] += branch_level_offsets_[level - 1];
+	}
+	branch_level_nodes_.resize(branch_level_offsets_.back());
+	std::vector<int> cursor(branch_level_offsets_.begin(), branch_level_offsets_.end() - 1);
+	for (int i = 0; i < node_count; ++i)
+	{
+		if (node_list_[i].primitive_count > 0) continue;
+		branch_level_nodes_[cursor[max_depth - depth_list[i]]++] = i;
+	}
+}
+
+/**
+ * refit node boxes to moved primitives
+ */
+bool UMBvh::refit()
+{
+	if (node_list_.empty()) return false;
+
+	const int primitive_count = static_cast<int>(ordered_primitives_.size());
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < primitive_count; ++i)
+	{
+		ordered_primitives_[i]->update_box();
+	}
+	triangle_soup_.update();
+
+	// leaves
+	const int node_count = static_cast<int>(node_list_.size());
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < node_count; ++i)
+	{
+		UMBvhFlatNode& node = node_list_[i];
+		if (node.primitive_count == 0) continue;
+		umbase::UMBox box;
+		box.init();
+		for (unsigned int k = node.offset, end = node.offset + node.primitive_count; k < end; ++k)
+		{
+			box.extend(ordered_primitives_[k]->box());
+		}
+		set_node_box(node, box);
+	}
+
+	// branches level by level from bottom to top. nodes of a level are independent.
+	for (int level = 0, level_count = static_cast<int>(branch_level_offsets_.size()) - 1; level < level_count; ++level)
+	{
+		const int begin = branch_level_offsets_[level];
+		const int end = branch_level_offsets_[level + 1];
+#pragma omp parallel for schedule(static) if (end - begin > 1024)
+		for (int n = begin; n < end; ++n)
+		{
+			const int i = branch_level_nodes_[n];
+			UMBvhFlatNode& node = node_list_[i];
+			const UMBvhFlatNode& left = node_list_[i + 1];
+			const UMBvhFlatNode& right = node_list_[node.offset];
+			for (int k = 0; k < 3; ++k)
+			{
+				node.minimum[k] = (std::min)(left.minimum[k], right.minimum[k]);
+				node.maximum[k] = (std::max)(left.maximum[k], right.maximum[k]);
+			}
+		}
+	}
+
+	const UMBvhFlatNode& root = node_list_[0];
+	box_ = umbase::UMBox(
+		UMVec3d(root.minimum[0], root.minimum[1], root.minimum[2]),
+		UMVec3d(root.maximum[0], root.maximum[1], root.maximum[2]));
+	return true;
+}
+
+/**
+ * refit, or rebuild if the tree is degraded
+ */
+bool UMBvh::refit_or_rebuild(UMPrimitiveList& primitive_list, const UMBvhBuildOption& option)
+{
+	if (node_list_.empty() || ordered_primitives_.size() != primitive_list.size())
+	{
+		return build(primitive_list, option);
+	}
+	if (!refit()) return false;
+	if (sah_cost() > build_sah_cost_ * option.rebuild_cost_ratio)
+	{
+		return build(primitive_list, option);
+	}
+	return true;
+}
+
+/**
+ * get SAH cost of the tree
+ */
+double UMBvh::sah_cost() const
+{
+	if (node_list_.empty()) return 0.0;
+	const double root_area = surface_area(node_list_[0]);
+	if (root_area <= 0.0) return 0.0;
+
+	double cost = 0.0;
+	for (size_t i = 0, size = node_list_.size(); i < size; ++i)
+	{
+		const UMBvhFlatNode& node = node_list_[i];
+		const double area = surface_area(node);
+		if (node.primitive_count > 0)
+		{
+			cost += area * node.primitive_count;
+		}
+		else
+		{
+			cost += area * traversal_cost;
+		}
+	}
+	return cost / root_area;
+}
+
 /**
  * (for debug) get box list
  */
@@ -486,8 +845,10 @@ umbase::UMBoxList UMBvh::create_box_list() const
 	box_list.resize(box_count);
 	for (int i = 0; i < box_count; ++i)
 	{
-		const umbase::UMBox& box = node_list_.at(i)->box_;
-		umbase::UMBoxPtr newbox(new umbase::UMBox(box.minimum(), box.maximum()));
+		const UMBvhFlatNode& node = node_list_.at(i);
+		umbase::UMBoxPtr newbox(new umbase::UMBox(
+			UMVec3d(node.minimum[0], node.minimum[1], node.minimum[2]),
+			UMVec3d(node.maximum[0], node.maximum[1], node.maximum[2])));
 		box_list.at(i) = newbox;
 	}
 	return box_list;
@@ -500,64 +861,93 @@ bool UMBvh::intersects(const UMRay& ray, UMShaderParameter& param) const
 {
 	if (node_list_.empty()) return false;
 	
-	umbase::UMVec3d inv_dir(1.0 / ray.direction().x, 1.0 / ray.direction().y, 1.0 / ray.direction().z);
-	umbase::UMVec3i dir_is_negative(inv_dir.x < 0, inv_dir.y < 0, inv_dir.z < 0);
+	const UMVec3d& ray_origin = ray.origin();
+	const UMVec3d& ray_dir = ray.direction();
+	const float origin[3] = { 
+		static_cast<float>(ray_origin.x), 
+		static_cast<float>(ray_origin.y), 
+		static_cast<float>(ray_origin.z) };
+	const float inv_dir[3] = { 
+		static_cast<float>(1.0 / ray_dir.x), 
+		static_cast<float>(1.0 / ray_dir.y), 
+		static_cast<float>(1.0 / ray_dir.z) };
+	const int dir_is_negative[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+	const float tmin = static_cast<float>(ray.tmin());
 	
-	double closest_distance = (std::numeric_limits<double>::max)();
+	double closest_distance = ray.tmax();
+	float closest_box_distance = round_up(closest_distance);
 	UMShaderParameter parameter;
-	
-	int box_intersect_count = 0;
-	int triangle_intersect_count = 0;
+
+	const UMTriangleSoupRay soup_ray(ray);
+	float soup_closest_distance = closest_box_distance;
+	unsigned int soup_hit_index = 0;
+	float soup_u = 0.0f;
+	float soup_v = 0.0f;
+	bool is_soup_closest = false;
 
 	bool hit = false;
-	unsigned int branch_stack[1024];
+	unsigned int branch_stack[branch_stack_size];
 	unsigned int branch_stack_index = 0;
+	const UMBvhFlatNode* nodes = &node_list_[0];
 
-	unsigned int primitive_count = static_cast<unsigned int>(ordered_primitives_.size());
-
-	int count = 0;
 	for (unsigned int i = 0; ; )
 	{
-		const UMBvhNodePtr& node = node_list_[i];
-		//if (node->box_.intersects(ray))
-		if (intersect_box(node->box_, ray, inv_dir, dir_is_negative, closest_distance))
+		const UMBvhFlatNode& node = nodes[i];
+		if (intersect_box(node, origin, inv_dir, dir_is_negative, tmin, closest_box_distance))
 		{
-			++box_intersect_count;
-			if (node->is_leaf())
+			if (node.primitive_count > 0)
 			{
-				for (int k = node->start_index_; k < node->end_index_; ++k)
+				if (triangle_soup_.intersect_leaf(
+						soup_ray, node.offset, node.primitive_count, 
+						soup_closest_distance, soup_hit_index, soup_u, soup_v))
+				{
+					closest_distance = soup_closest_distance;
+					closest_box_distance = soup_closest_distance;
+					is_soup_closest = true;
+					hit = true;
+				}
+				if (node.flags & flag_has_primitive)
 				{
-					if (ordered_primitives_[k]->intersects(ray, parameter))
+					for (unsigned int k = node.offset, end = node.offset + node.primitive_count; k < end; ++k)
 					{
-						++triangle_intersect_count;
-						if (parameter.distance < closest_distance)
+						if (triangle_soup_.is_triangle(k)) continue;
+						// instances can cull by the closest hit so far
+						UMRay clipped_ray(ray);
+						clipped_ray.set_tmax(closest_distance);
+						if (ordered_primitives_[k]->intersects(clipped_ray, parameter))
 						{
-							++count;
-							closest_distance = parameter.distance;
-							param = parameter;
-							hit = true;
+							if (parameter.distance < closest_distance)
+							{
+								closest_distance = parameter.distance;
+								closest_box_distance = round_up(closest_distance);
+								soup_closest_distance = static_cast<float>(closest_distance);
+								param = parameter;
+								is_soup_closest = false;
+								hit = true;
+							}
 						}
 					}
 				}
-				// not hit. branch stack is empty.
+				// branch stack is empty.
 				if (branch_stack_index == 0) break;
-				// not hit. branch stack is exist. pop.
+				// branch stack is exist. pop.
 				i = branch_stack[--branch_stack_index];
 			}
 			// is branch
 			else
 			{
-				if (dir_is_negative[node->axis_])
+				// visit near child first
+				if (dir_is_negative[node.axis])
 				{
 					// push left branch index
 					branch_stack[branch_stack_index++] = i + 1;
 					// go to right
-					i = node->right_->flat_index_;
+					i = node.offset;
 				}
 				else
 				{
 					// push right branch index
-					branch_stack[branch_stack_index++] = node->right_->flat_index_;
+					branch_stack[branch_stack_index++] = node.offset;
 					// go to left
 					++i;
 				}
@@ -571,6 +961,11 @@ bool UMBvh::intersects(const UMRay& ray, UMShaderParameter& param) const
 			i = branch_stack[--branch_stack_index];
 		}
 	}
+	if (is_soup_closest)
+	{
+		// shade only the closest triangle
+		triangle_soup_.shade(ray, soup_hit_index, soup_closest_distance, soup_u, soup_v, param);
+	}
 	return hit;
 }
 
@@ -581,46 +976,67 @@ bool UMBvh::intersects(const UMRay& ray) const
 {
 	if (node_list_.empty()) return false;
 	
-	umbase::UMVec3d inv_dir(1.0 / ray.direction().x, 1.0 / ray.direction().y, 1.0 / ray.direction().z);
-	umbase::UMVec3i dir_is_negative(inv_dir.x < 0, inv_dir.y < 0, inv_dir.z < 0);
+	const UMVec3d& ray_origin = ray.origin();
+	const UMVec3d& ray_dir = ray.direction();
+	const float origin[3] = { 
+		static_cast<float>(ray_origin.x), 
+		static_cast<float>(ray_origin.y), 
+		static_cast<float>(ray_origin.z) };
+	const float inv_dir[3] = { 
+		static_cast<float>(1.0 / ray_dir.x), 
+		static_cast<float>(1.0 / ray_dir.y), 
+		static_cast<float>(1.0 / ray_dir.z) };
+	const int dir_is_negative[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+	const float tmin = static_cast<float>(ray.tmin());
+	const float tmax = round_up(ray.tmax());
+	const UMTriangleSoupRay soup_ray(ray);
 	
-	bool hit = false;
-	unsigned int branch_stack[1024];
+	unsigned int branch_stack[branch_stack_size];
 	unsigned int branch_stack_index = 0;
+	const UMBvhFlatNode* nodes = &node_list_[0];
+
 	for (unsigned int i = 0; ; )
 	{
-		const UMBvhNodePtr& node = node_list_[i];
-		//if (node->box_.intersects(ray))
-		if (intersect_box(node->box_, ray, inv_dir, dir_is_negative, ray.tmax()))
+		const UMBvhFlatNode& node = nodes[i];
+		if (intersect_box(node, origin, inv_dir, dir_is_negative, tmin, tmax))
 		{
-			if (node->is_leaf())
+			if (node.primitive_count > 0)
 			{
-				for (int k = node->start_index_; k < node->end_index_; ++k)
+				if (triangle_soup_.intersect_leaf_any(soup_ray, node.offset, node.primitive_count, tmax))
 				{
-					if (ordered_primitives_[k]->intersects(ray))
+					return true;
+				}
+				if (node.flags & flag_has_primitive)
+				{
+					for (unsigned int k = node.offset, end = node.offset + node.primitive_count; k < end; ++k)
 					{
-						return true;
+						if (triangle_soup_.is_triangle(k)) continue;
+						if (ordered_primitives_[k]->intersects(ray))
+						{
+							return true;
+						}
 					}
 				}
-				// not hit. branch stack is empty.
+				// branch stack is empty.
 				if (branch_stack_index == 0) break;
-				// not hit. branch stack is exist. pop.
+				// branch stack is exist. pop.
 				i = branch_stack[--branch_stack_index];
 			}
 			// is branch
 			else
 			{
-				if (dir_is_negative[node->axis_])
+				// visit near child first
+				if (dir_is_negative[node.axis])
 				{
 					// push left branch index
 					branch_stack[branch_stack_index++] = i + 1;
 					// go to right
-					i = node->right_->flat_index_;
+					i = node.offset;
 				}
 				else
 				{
 					// push right branch index
-					branch_stack[branch_stack_index++] = node->right_->flat_index_;
+					branch_stack[branch_stack_index++] = node.offset;
 					// go to left
 					++i;
 				}
@@ -638,16 +1054,308 @@ bool UMBvh::intersects(const UMRay& ray) const
 }
 
 /**
- * get box
+ * closest triangle intersection against a triangle soup
  */
-const umbase::UMBox& UMBvh::box() const
+template <class T>
+bool UMBvh::intersects_triangle_soup(
+	const UMTriangleSoupT<T>& soup,
+	const UMRay& ray,
+	T& distance,
+	unsigned int& hit_index) const
+{
+	if (node_list_.empty() || soup.size() != ordered_primitives_.size()) return false;
+
+	const UMVec3d& ray_origin = ray.origin();
+	const UMVec3d& ray_dir = ray.direction();
+	const float origin[3] = { 
+		static_cast<float>(ray_origin.x), 
+		static_cast<float>(ray_origin.y), 
+		static_cast<float>(ray_origin.z) };
+	const float inv_dir[3] = { 
+		static_cast<float>(1.0 / ray_dir.x), 
+		static_cast<float>(1.0 / ray_dir.y), 
+		static_cast<float>(1.0 / ray_dir.z) };
+	const int dir_is_negative[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+	const float tmin = static_cast<float>(ray.tmin());
+
+	const UMTriangleSoupRayT<T> soup_ray(ray);
+	T closest_distance = static_cast<T>(ray.tmax());
+	float closest_box_distance = round_up(ray.tmax());
+	T u = 0;
+	T v = 0;
+
+	bool hit = false;
+	unsigned int branch_stack[branch_stack_size];
+	unsigned int branch_stack_index = 0;
+	const UMBvhFlatNode* nodes = &node_list_[0];
+
+	for (unsigned int i = 0; ; )
+	{
+		const UMBvhFlatNode& node = nodes[i];
+		if (intersect_box(node, origin, inv_dir, dir_is_negative, tmin, closest_box_distance))
+		{
+			if (node.primitive_count > 0)
+			{
+				if (soup.intersect_leaf(soup_ray, node.offset, node.primitive_count, closest_distance, hit_index, u, v))
+				{
+					closest_box_distance = round_up(closest_distance);
+					hit = true;
+				}
+				if (branch_stack_index == 0) break;
+				i = branch_stack[--branch_stack_index];
+			}
+			else
+			{
+				// visit near child first
+				if (dir_is_negative[node.axis])
+				{
+					branch_stack[branch_stack_index++] = i + 1;
+					i = node.offset;
+				}
+				else
+				{
+					branch_stack[branch_stack_index++] = node.offset;
+					++i;
+				}
+			}
+		}
+		else
+		{
+			if (branch_stack_index == 0) break;
+			i = branch_stack[--branch_stack_index];
+		}
+	}
+	if (hit)
+	{
+		distance = closest_distance;
+	}
+	return hit;
+}
+
+template bool UMBvh::intersects_triangle_soup<float>(
+	const UMTriangleSoupT<float>&, const UMRay&, float&, unsigned int&) const;
+template bool UMBvh::intersects_triangle_soup<double>(
+	const UMTriangleSoupT<double>&, const UMRay&, double&, unsigned int&) const;
+
+/**
+ * packet ray intersection
+ */
+int UMBvh::intersects(const UMRay* rays, int count, UMShaderParameter* params) const
 {
-	if (!node_list_.empty())
+	if (node_list_.empty() || count <= 0) return 0;
+	assert(count <= UMTriangleSoupRayPacket::packet_size);
+	
+	const UMTriangleSoupRayPacket packet(rays, count);
+	const int packet_mask = (1 << count) - 1;
+	// near child is decided by the first ray. rays should be coherent.
+	const int dir_is_negative[3] = { 
+		packet.inv_direction[0][0] < 0, 
+		packet.inv_direction[1][0] < 0, 
+		packet.inv_direction[2][0] < 0 };
+
+	double closest_distance[UMTriangleSoupRayPacket::packet_size];
+	float closest_box_distance[UMTriangleSoupRayPacket::packet_size];
+	float soup_closest_distance[UMTriangleSoupRayPacket::packet_size];
+	unsigned int soup_hit_index[UMTriangleSoupRayPacket::packet_size];
+	float soup_u[UMTriangleSoupRayPacket::packet_size];
+	float soup_v[UMTriangleSoupRayPacket::packet_size];
+	for (int k = 0; k < UMTriangleSoupRayPacket::packet_size; ++k)
 	{
-		return (*node_list_.begin())->box_;
+		closest_distance[k] = rays[k < count ? k : count - 1].tmax();
+		closest_box_distance[k] = round_up(closest_distance[k]);
+		soup_closest_distance[k] = closest_box_distance[k];
+		soup_hit_index[k] = 0;
+		soup_u[k] = 0.0f;
+		soup_v[k] = 0.0f;
 	}
-	static umbase::UMBox empty;
-	return empty;
+	UMShaderParameter parameters[UMTriangleSoupRayPacket::packet_size];
+	int soup_closest_mask = 0;
+	int hit_mask = 0;
+
+	unsigned int branch_stack[branch_stack_size];
+	unsigned int branch_stack_index = 0;
+	const UMBvhFlatNode* nodes = &node_list_[0];
+
+	for (unsigned int i = 0; ; )
+	{
+		const UMBvhFlatNode& node = nodes[i];
+		const int mask = intersect_box_packet(node, packet, closest_box_distance, packet_mask);
+		if (mask)
+		{
+			if (node.primitive_count > 0)
+			{
+				const int soup_hit_mask = triangle_soup_.intersect_leaf_packet(
+						packet, node.offset, node.primitive_count, mask,
+						soup_closest_distance, soup_hit_index, soup_u, soup_v);
+				for (int k = 0; k < count; ++k)
+				{
+					if (!(soup_hit_mask & (1 << k))) continue;
+					closest_distance[k] = soup_closest_distance[k];
+					closest_box_distance[k] = soup_closest_distance[k];
+					soup_closest_mask |= (1 << k);
+				}
+				hit_mask |= soup_hit_mask;
+				if (node.flags & flag_has_primitive)
+				{
+					// lanes which missed this leaf can not hit
+					UMRay clipped_rays[UMTriangleSoupRayPacket::packet_size];
+					for (int k = 0; k < count; ++k)
+					{
+						clipped_rays[k] = rays[k];
+						clipped_rays[k].set_tmax((mask & (1 << k)) ? closest_distance[k] : 0.0);
+					}
+					for (unsigned int n = node.offset, end = node.offset + node.primitive_count; n < end; ++n)
+					{
+						if (triangle_soup_.is_triangle(n)) continue;
+						const int primitive_mask = mask & ordered_primitives_[n]->intersects(clipped_rays, count, parameters);
+						for (int k = 0; k < count; ++k)
+						{
+							if (!(primitive_mask & (1 << k))) continue;
+							if (parameters[k].distance < closest_distance[k])
+							{
+								closest_distance[k] = parameters[k].distance;
+								closest_box_distance[k] = round_up(closest_distance[k]);
+								soup_closest_distance[k] = static_cast<float>(closest_distance[k]);
+								clipped_rays[k].set_tmax(closest_distance[k]);
+								params[k] = parameters[k];
+								soup_closest_mask &= ~(1 << k);
+								hit_mask |= (1 << k);
+							}
+						}
+					}
+				}
+				// branch stack is empty.
+				if (branch_stack_index == 0) break;
+				// branch stack is exist. pop.
+				i = branch_stack[--branch_stack_index];
+			}
+			// is branch
+			else
+			{
+				// visit near child first
+				if (dir_is_negative[node.axis])
+				{
+					// push left branch index
+					branch_stack[branch_stack_index++] = i + 1;
+					// go to right
+					i = node.offset;
+				}
+				else
+				{
+					// push right branch index
+					branch_stack[branch_stack_index++] = node.offset;
+					// go to left
+					++i;
+				}
+			}
+		}
+		else
+		{
+			// not hit. branch stack is empty.
+			if (branch_stack_index == 0) break;
+			// not hit. branch stack is exist. pop.
+			i = branch_stack[--branch_stack_index];
+		}
+	}
+	for (int k = 0; k < count; ++k)
+	{
+		if (soup_closest_mask & (1 << k))
+		{
+			// shade only the closest triangle
+			triangle_soup_.shade(rays[k], soup_hit_index[k], soup_closest_distance[k], soup_u[k], soup_v[k], params[k]);
+		}
+	}
+	return hit_mask;
+}
+
+/**
+ * packet ray intersection
+ */
+int UMBvh::intersects(const UMRay* rays, int count) const
+{
+	if (node_list_.empty() || count <= 0) return 0;
+	assert(count <= UMTriangleSoupRayPacket::packet_size);
+	
+	const UMTriangleSoupRayPacket packet(rays, count);
+	const int dir_is_negative[3] = { 
+		packet.inv_direction[0][0] < 0, 
+		packet.inv_direction[1][0] < 0, 
+		packet.inv_direction[2][0] < 0 };
+	float tmax[UMTriangleSoupRayPacket::packet_size];
+	for (int k = 0; k < UMTriangleSoupRayPacket::packet_size; ++k)
+	{
+		tmax[k] = round_up(rays[k < count ? k : count - 1].tmax());
+	}
+	// lanes not occluded yet
+	int active_mask = (1 << count) - 1;
+
+	unsigned int branch_stack[branch_stack_size];
+	unsigned int branch_stack_index = 0;
+	const UMBvhFlatNode* nodes = &node_list_[0];
+
+	for (unsigned int i = 0; ; )
+	{
+		const UMBvhFlatNode& node = nodes[i];
+		const int mask = intersect_box_packet(node, packet, tmax, active_mask);
+		if (mask)
+		{
+			if (node.primitive_count > 0)
+			{
+				active_mask &= ~triangle_soup_.intersect_leaf_packet_any(
+					packet, node.offset, node.primitive_count, mask, tmax);
+				if (node.flags & flag_has_primitive)
+				{
+					for (unsigned int n = node.offset, end = node.offset + node.primitive_count; n < end; ++n)
+					{
+						if (!(mask & active_mask)) break;
+						if (triangle_soup_.is_triangle(n)) continue;
+						active_mask &= ~(mask & ordered_primitives_[n]->intersects(rays, count));
+					}
+				}
+				// all rays are occluded
+				if (active_mask == 0) break;
+				// branch stack is empty.
+				if (branch_stack_index == 0) break;
+				// branch stack is exist. pop.
+				i = branch_stack[--branch_stack_index];
+			}
+			// is branch
+			else
+			{
+				// visit near child first
+				if (dir_is_negative[node.axis])
+				{
+					// push left branch index
+					branch_stack[branch_stack_index++] = i + 1;
+					// go to right
+					i = node.offset;
+				}
+				else
+				{
+					// push right branch index
+					branch_stack[branch_stack_index++] = node.offset;
+					// go to left
+					++i;
+				}
+			}
+		}
+		else
+		{
+			// not hit. branch stack is empty.
+			if (branch_stack_index == 0) break;
+			// not hit. branch stack is exist. pop.
+			i = branch_stack[--branch_stack_index];
+		}
+	}
+	return ~active_mask & ((1 << count) - 1);
+}
+
+/**
+ * get box
+ */
+const umbase::UMBox& UMBvh::box() const
+{
+	return box_;
 }
 
 } // umrt
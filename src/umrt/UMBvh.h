@@ -19,6 +19,7 @@
 #include "UMScene.h"
 #include "UMShaderParameter.h"
 #include "UMPrimitive.h"
+#include "UMTriangleSoup.h"
 
 namespace umrt
 {
@@ -30,9 +31,85 @@ typedef std::weak_ptr<UMBvh> UMBvhWeakPtr;
 class UMScene;
 typedef std::shared_ptr<UMScene> UMScenePtr;
 
-class UMBvhNode;
-typedef std::shared_ptr<UMBvhNode> UMBvhNodePtr;
-typedef std::vector<UMBvhNodePtr> UMBvhNodeList;
+/**
+ * flattened bvh node
+ * @note 32 bytes. bounds are stored as float, rounded outward.
+ */
+struct UMBvhFlatNode
+{
+	/// minimum of bounds
+	float minimum[3];
+	/// maximum of bounds
+	float maximum[3];
+	/// leaf : first primitive index, branch : second child node index
+	unsigned int offset;
+	/// primitive count. 0 means branch
+	unsigned short primitive_count;
+	/// split axis
+	unsigned char axis;
+	/// leaf : 1 if it has primitives which are not triangles
+	unsigned char flags;
+};
+typedef std::vector<UMBvhFlatNode> UMBvhFlatNodeList;
+
+/**
+ * bvh build option
+ */
+class UMBvhBuildOption
+{
+public:
+	/**
+	 * split methods
+	 */
+	enum SplitMethod {
+		eSplitMiddle,
+		eSplitSAH,
+	};
+
+	UMBvhBuildOption()
+		: split_method(eSplitSAH)
+		, max_leaf_primitive_count(4)
+		, bucket_count(12)
+		, max_depth(64)
+		, parallel_primitive_count(4096)
+		, rebuild_cost_ratio(1.5)
+	{}
+	~UMBvhBuildOption() {}
+
+	/**
+	 * split method
+	 */
+	SplitMethod split_method;
+
+	/**
+	 * max primitive count in a leaf
+	 */
+	int max_leaf_primitive_count;
+
+	/**
+	 * bucket count for binned SAH
+	 */
+	int bucket_count;
+
+	/**
+	 * max depth of tree
+	 * @note limited by the branch stack of traversal. 
+	 * nodes which have too many primitives for a leaf are split deeper by equal counts.
+	 */
+	int max_depth;
+
+	/**
+	 * subtrees which have more primitives than this are built on worker threads.
+	 * 0 means single thread.
+	 */
+	int parallel_primitive_count;
+
+	/**
+	 * UMBvh::refit_or_rebuild rebuilds the tree
+	 * when SAH cost after refit exceeds this ratio of the cost at build.
+	 */
+	double rebuild_cost_ratio;
+};
 
 /**
  * a bounding volume hierarchy
@@ -52,11 +129,32 @@ public:
 	~UMBvh() {}
 	
 	/**
-	 * build bvh from scene
-	 * @param [in,out] scene scene
+	 * build bvh from primitive list
+	 * @param [in] primitive_list primitive list
+	 * @param [in] option build option
+	 * @retval success or fail
+	 */
+	bool build(UMPrimitiveList& primitive_list, const UMBvhBuildOption& option = UMBvhBuildOption());
+
+	/**
+	 * refit node boxes to moved primitives
+	 * @note keeps the tree topology. call after vertices are deformed.
 	 * @retval success or fail
 	 */
-	bool build(UMPrimitiveList& primitive_list);
+	bool refit();
+
+	/**
+	 * refit, or rebuild if the refitted tree is degraded
+	 * @param [in] primitive_list primitive list
+	 * @param [in] option build option
+	 * @retval success or fail
+	 */
+	bool refit_or_rebuild(UMPrimitiveList& primitive_list, const UMBvhBuildOption& option = UMBvhBuildOption());
+
+	/**
+	 * get SAH cost of the tree
+	 */
+	double sah_cost() const;
 
 	/**
 	 * (for debug) create box list
@@ -75,6 +173,39 @@ public:
 	 * @param [in] ray a ray
 	 */
 	virtual bool intersects(const UMRay& ray) const;
+
+	/**
+	 * closest triangle intersection against a triangle soup built from ordered_primitives
+	 * @note for validation of precision. primitives which are not triangles are ignored.
+	 * @param [in] soup packed triangles in the order of ordered_primitives
+	 * @param [in] ray a ray
+	 * @param [out] distance hit distance
+	 * @param [out] hit_index hit index of ordered_primitives
+	 */
+	template <class T>
+	bool intersects_triangle_soup(
+		const UMTriangleSoupT<T>& soup,
+		const UMRay& ray,
+		T& distance,
+		unsigned int& hit_index) const;
+
+	/**
+	 * packet ray intersection
+	 * @param [in] rays coherent rays
+	 * @param [in] count ray count. 1 to UMTriangleSoupRayPacket::packet_size
+	 * @param [in,out] params shading parameters of each ray
+	 * @retval mask of rays which hit
+	 */
+	virtual int intersects(const UMRay* rays, int count, UMShaderParameter* params) const;
+
+	/**
+	 * packet ray intersection
+	 * @note for shadow rays
+	 * @param [in] rays coherent rays
+	 * @param [in] count ray count. 1 to UMTriangleSoupRayPacket::packet_size
+	 * @retval mask of rays which hit
+	 */
+	virtual int intersects(const UMRay* rays, int count) const;
 	
 	/**
 	 * get box
@@ -88,11 +219,30 @@ public:
 	
 	UMPrimitiveList& ordered_primitives() { return ordered_primitives_; }
 
+	/**
+	 * get flattened node list
+	 */
+	const UMBvhFlatNodeList& node_list() const { return node_list_; }
+
+	/**
+	 * get packed triangles
+	 */
+	const UMTriangleSoup& triangle_soup() const { return triangle_soup_; }
+
 private:
-	UMBvh() {}
+	UMBvh() : build_sah_cost_(0.0) {}
+
+	void build_branch_levels();
 
-	UMBvhNodeList node_list_;
+	UMBvhFlatNodeList node_list_;
+	/// branch node indices from the deepest level to the root, for refit
+	std::vector<int> branch_level_nodes_;
+	/// start of each level in branch_level_nodes_, and the end
+	std::vector<int> branch_level_offsets_;
 	UMPrimitiveList ordered_primitives_;
+	UMTriangleSoup triangle_soup_;
+	umbase::UMBox box_;
+	double build_sah_cost_;
 
 	UMBvhPtr self_ptr() { return self_ptr_.lock(); }
 	UMBvhWeakPtr self_ptr_;
@@ -0,0 +1,228 @@
+/**
+ * @file UMBvhInstance.cpp
+ * a transformed instance of a bvh
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMBvhInstance.h"
+#include <assert.h>
+#include "UMBvh.h"
+#include "UMRay.h"
+#include "UMShaderParameter.h"
+
+namespace
+{
+	using namespace umrt;
+
+	/**
+	 * transform a direction
+	 */
+	UMVec3d transform_vector(const UMMat44d& mat, const UMVec3d& v)
+	{
+		return (mat * UMVec4d(v, 0.0)).xyz();
+	}
+
+	/**
+	 * transform a normal from base space to world space
+	 * @param [in] world_to_local inverse of the transform
+	 */
+	UMVec3d transform_normal(const UMMat44d& world_to_local, const UMVec3d& n)
+	{
+		const UMVec3d transformed(
+			n.x * world_to_local.m[0][0] + n.y * world_to_local.m[0][1] + n.z * world_to_local.m[0][2],
+			n.x * world_to_local.m[1][0] + n.y * world_to_local.m[1][1] + n.z * world_to_local.m[1][2],
+			n.x * world_to_local.m[2][0] + n.y * world_to_local.m[2][1] + n.z * world_to_local.m[2][2]);
+		return transformed.normalized();
+	}
+
+	bool is_identity(const UMMat44d& mat)
+	{
+		return mat == UMMat44d();
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * constructor
+ */
+UMBvhInstance::UMBvhInstance()
+	: is_identity_(true)
+{
+	bvh_ = UMBvh::create();
+	box_.init();
+}
+
+/**
+ * build bottom level bvh
+ */
+bool UMBvhInstance::build()
+{
+	UMPrimitiveList::iterator it = primitive_list_.begin();
+	for (; it != primitive_list_.end(); ++it)
+	{
+		(*it)->update_box();
+	}
+	if (!bvh_->build(primitive_list_)) return false;
+	update_box();
+	return true;
+}
+
+/**
+ * refit bottom level bvh to deformed primitives
+ */
+bool UMBvhInstance::refit()
+{
+	if (!bvh_->refit_or_rebuild(primitive_list_)) return false;
+	set_base_transform(transform_);
+	update_box();
+	return true;
+}
+
+/**
+ * set transform which the primitives are placed with
+ */
+void UMBvhInstance::set_base_transform(const UMMat44d& transform)
+{
+	base_transform_ = transform;
+	update_local_transform();
+}
+
+/**
+ * set current transform
+ */
+void UMBvhInstance::set_transform(const UMMat44d& transform)
+{
+	transform_ = transform;
+	update_local_transform();
+}
+
+/**
+ * update transform from base space to world space
+ */
+void UMBvhInstance::update_local_transform()
+{
+	// row vectors. base -> original -> world
+	local_to_world_ = base_transform_.inverted() * transform_;
+	world_to_local_ = local_to_world_.inverted();
+	is_identity_ = is_identity(local_to_world_);
+}
+
+/**
+ * update AABB
+ */
+void UMBvhInstance::update_box()
+{
+	box_.init();
+	const umbase::UMBox& local_box = bvh_->box();
+	if (local_box.is_empty()) return;
+	if (is_identity_)
+	{
+		box_ = local_box;
+		return;
+	}
+	for (int i = 0; i < 8; ++i)
+	{
+		const UMVec3d corner(
+			local_box[(i >> 0) & 1].x,
+			local_box[(i >> 1) & 1].y,
+			local_box[(i >> 2) & 1].z);
+		box_.extend(local_to_world_ * corner);
+	}
+}
+
+/**
+ * transform a ray to base space
+ * @note the direction is not normalized, so the distance is same in both spaces.
+ */
+void UMBvhInstance::to_local(UMRay& local_ray, const UMRay& ray) const
+{
+	local_ray.set_origin(world_to_local_ * ray.origin());
+	local_ray.set_direction(transform_vector(world_to_local_, ray.direction()));
+	local_ray.set_tmin(ray.tmin());
+	local_ray.set_tmax(ray.tmax());
+}
+
+/**
+ * transform shading parameters to world space
+ */
+void UMBvhInstance::to_world(UMShaderParameter& param, const UMRay& ray) const
+{
+	param.intersect_point = ray.origin() + ray.direction() * param.distance;
+	param.normal = transform_normal(world_to_local_, param.normal);
+	param.face_normal = transform_normal(world_to_local_, param.face_normal);
+}
+
+/**
+ * ray intersection
+ */
+bool UMBvhInstance::intersects(const UMRay& ray, UMShaderParameter& param) const
+{
+	if (is_identity_) return bvh_->intersects(ray, param);
+
+	UMRay local_ray;
+	to_local(local_ray, ray);
+	if (!bvh_->intersects(local_ray, param)) return false;
+	to_world(param, ray);
+	return true;
+}
+
+/**
+ * ray intersection
+ */
+bool UMBvhInstance::intersects(const UMRay& ray) const
+{
+	if (is_identity_) return bvh_->intersects(ray);
+
+	UMRay local_ray;
+	to_local(local_ray, ray);
+	return bvh_->intersects(local_ray);
+}
+
+/**
+ * packet ray intersection
+ */
+int UMBvhInstance::intersects(const UMRay* rays, int count, UMShaderParameter* params) const
+{
+	if (is_identity_) return bvh_->intersects(rays, count, params);
+
+	assert(count <= UMTriangleSoupRayPacket::packet_size);
+	UMRay local_rays[UMTriangleSoupRayPacket::packet_size];
+	for (int k = 0; k < count; ++k)
+	{
+		to_local(local_rays[k], rays[k]);
+	}
+	const int hit_mask = bvh_->intersects(local_rays, count, params);
+	for (int k = 0; k < count; ++k)
+	{
+		if (hit_mask & (1 << k))
+		{
+			to_world(params[k], rays[k]);
+		}
+	}
+	return hit_mask;
+}
+
+/**
+ * packet ray intersection
+ */
+int UMBvhInstance::intersects(const UMRay* rays, int count) const
+{
+	if (is_identity_) return bvh_->intersects(rays, count);
+
+	assert(count <= UMTriangleSoupRayPacket::packet_size);
+	UMRay local_rays[UMTriangleSoupRayPacket::packet_size];
+	for (int k = 0; k < count; ++k)
+	{
+		to_local(local_rays[k], rays[k]);
+	}
+	return bvh_->intersects(local_rays, count);
+}
+
+} // umrt
@@ -0,0 +1,150 @@
+/**
+ * @file UMBvhInstance.h
+ * a transformed instance of a bvh
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMMatrix.h"
+#include "UMBox.h"
+#include "UMPrimitive.h"
+
+namespace umrt
+{
+
+class UMBvh;
+typedef std::shared_ptr<UMBvh> UMBvhPtr;
+
+class UMBvhInstance;
+typedef std::shared_ptr<UMBvhInstance> UMBvhInstancePtr;
+typedef std::vector<UMBvhInstancePtr> UMBvhInstanceList;
+
+/**
+ * a transformed instance of a bottom level bvh
+ * @note primitives of the bvh are placed with the base transform.
+ * the instance moves them to the current transform without rebuilding the bvh.
+ */
+class UMBvhInstance : public UMPrimitive
+{
+	DISALLOW_COPY_AND_ASSIGN(UMBvhInstance);
+public:
+	UMBvhInstance();
+	~UMBvhInstance() {}
+
+	/**
+	 * build bottom level bvh
+	 * @retval success or fail
+	 */
+	bool build();
+
+	/**
+	 * refit bottom level bvh to deformed primitives
+	 * @note the primitives are placed with the current transform after deformation.
+	 * so the current transform becomes the base transform.
+	 * @retval success or fail
+	 */
+	bool refit();
+
+	/**
+	 * ray intersection
+	 * @param [in] ray a ray
+	 * @param [in,out] param shading parameters
+	 */
+	virtual bool intersects(const UMRay& ray, UMShaderParameter& param) const;
+
+	/**
+	 * ray intersection
+	 * @param [in] ray a ray
+	 */
+	virtual bool intersects(const UMRay& ray) const;
+
+	/**
+	 * packet ray intersection
+	 * @param [in] rays coherent rays
+	 * @param [in] count ray count
+	 * @param [in,out] params shading parameters of each ray
+	 * @retval mask of rays which hit
+	 */
+	virtual int intersects(const UMRay* rays, int count, UMShaderParameter* params) const;
+
+	/**
+	 * packet ray intersection
+	 * @param [in] rays coherent rays
+	 * @param [in] count ray count
+	 * @retval mask of rays which hit
+	 */
+	virtual int intersects(const UMRay* rays, int count) const;
+
+	/**
+	 * get box
+	 */
+	virtual const umbase::UMBox& box() const { return box_; }
+
+	/**
+	 * update AABB
+	 */
+	virtual void update_box();
+
+	/**
+	 * get primitive list of the bottom level bvh
+	 */
+	const UMPrimitiveList& primitive_list() const { return primitive_list_; }
+
+	/**
+	 * get primitive list of the bottom level bvh
+	 */
+	UMPrimitiveList& mutable_primitive_list() { return primitive_list_; }
+
+	/**
+	 * get bottom level bvh
+	 */
+	const UMBvhPtr& bvh() const { return bvh_; }
+
+	/**
+	 * get transform which the primitives are placed with
+	 */
+	const UMMat44d& base_transform() const { return base_transform_; }
+
+	/**
+	 * set transform which the primitives are placed with
+	 */
+	void set_base_transform(const UMMat44d& transform);
+
+	/**
+	 * get current transform
+	 */
+	const UMMat44d& transform() const { return transform_; }
+
+	/**
+	 * set current transform
+	 * @note call update_box and rebuild the top level bvh after this.
+	 */
+	void set_transform(const UMMat44d& transform);
+
+private:
+	void update_local_transform();
+	void to_local(UMRay& local_ray, const UMRay& ray) const;
+	void to_world(UMShaderParameter& param, const UMRay& ray) const;
+
+	UMBvhPtr bvh_;
+	UMPrimitiveList primitive_list_;
+	UMMat44d base_transform_;
+	UMMat44d transform_;
+	/// base space to world space
+	UMMat44d local_to_world_;
+	/// world space to base space
+	UMMat44d world_to_local_;
+	bool is_identity_;
+	umbase::UMBox box_;
+};
+
+} // umrt
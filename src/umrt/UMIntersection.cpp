@@ -0,0 +1,157 @@
+/**
+ * @file UMIntersection.cpp
+ * scene intersection
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMIntersection.h"
+#include "UMRay.h"
+#include "UMBvh.h"
+#include "UMSceneAccess.h"
+#include "UMTriangleSoup.h"
+
+#include <algorithm>
+
+namespace umrt
+{
+
+/**
+ * closest ray intersection
+ */
+bool UMIntersection::intersect(
+	const UMRay& ray, 
+	const UMSceneAccess& scene_access, 
+	UMIntersection& intersection)
+{
+	const UMBvhPtr& bvh = scene_access.bvh();
+	if (bvh && !bvh->node_list().empty())
+	{
+		if (bvh->intersects(ray, intersection.closest_parameter))
+		{
+			intersection.closest_distance = intersection.closest_parameter.distance;
+			return true;
+		}
+		return false;
+	}
+
+	// bvh is not built yet
+	bool hit = false;
+	UMShaderParameter parameter;
+	const UMPrimitiveList& primitive_list = scene_access.primitive_list();
+	for (UMPrimitiveList::const_iterator it = primitive_list.begin(); it != primitive_list.end(); ++it)
+	{
+		if ((*it)->intersects(ray, parameter))
+		{
+			if (parameter.distance < intersection.closest_distance) 
+			{
+				intersection.closest_distance = parameter.distance;
+				intersection.closest_parameter = parameter;
+				hit = true;
+			}
+		}
+	}
+	return hit;
+}
+
+/**
+ * any ray intersection
+ */
+bool UMIntersection::intersect(
+	const UMRay& ray, 
+	const UMSceneAccess& scene_access)
+{
+	const UMBvhPtr& bvh = scene_access.bvh();
+	if (bvh && !bvh->node_list().empty())
+	{
+		return bvh->intersects(ray);
+	}
+
+	// bvh is not built yet
+	UMShaderParameter parameter;
+	const UMPrimitiveList& primitive_list = scene_access.primitive_list();
+	for (UMPrimitiveList::const_iterator it = primitive_list.begin(); it != primitive_list.end(); ++it)
+	{
+		if ((*it)->intersects(ray, parameter) && parameter.distance <= ray.tmax())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * closest intersection of coherent rays
+ */
+void UMIntersection::intersect(
+	const UMRay* rays, 
+	int count,
+	const UMSceneAccess& scene_access, 
+	UMIntersection* intersections,
+	bool* hits)
+{
+	const UMBvhPtr& bvh = scene_access.bvh();
+	if (!bvh || bvh->node_list().empty())
+	{
+		// bvh is not built yet
+		for (int i = 0; i < count; ++i)
+		{
+			hits[i] = intersect(rays[i], scene_access, intersections[i]);
+		}
+		return;
+	}
+
+	const int packet_size = UMTriangleSoupRayPacket::packet_size;
+	for (int i = 0; i < count; i += packet_size)
+	{
+		const int packet_count = std::min(packet_size, count - i);
+		UMShaderParameter parameters[packet_size];
+		const int mask = bvh->intersects(&rays[i], packet_count, parameters);
+		for (int k = 0; k < packet_count; ++k)
+		{
+			hits[i + k] = (mask & (1 << k)) != 0;
+			if (hits[i + k])
+			{
+				intersections[i + k].closest_distance = parameters[k].distance;
+				intersections[i + k].closest_parameter = parameters[k];
+			}
+		}
+	}
+}
+
+/**
+ * any intersection of coherent rays
+ */
+void UMIntersection::intersect(
+	const UMRay* rays, 
+	int count,
+	const UMSceneAccess& scene_access, 
+	bool* hits)
+{
+	const UMBvhPtr& bvh = scene_access.bvh();
+	if (!bvh || bvh->node_list().empty())
+	{
+		// bvh is not built yet
+		for (int i = 0; i < count; ++i)
+		{
+			hits[i] = intersect(rays[i], scene_access);
+		}
+		return;
+	}
+
+	const int packet_size = UMTriangleSoupRayPacket::packet_size;
+	for (int i = 0; i < count; i += packet_size)
+	{
+		const int packet_count = std::min(packet_size, count - i);
+		const int mask = bvh->intersects(&rays[i], packet_count);
+		for (int k = 0; k < packet_count; ++k)
+		{
+			hits[i + k] = (mask & (1 << k)) != 0;
+		}
+	}
+}
+
+} // umrt
@@ -0,0 +1,101 @@
+/**
+ * @file UMIntersection.h
+ * scene intersection
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <limits>
+#include "UMMacro.h"
+#include "UMShaderParameter.h"
+#include "UMTriangleSoup.h"
+
+namespace umrt
+{
+
+class UMRay;
+class UMSceneAccess;
+
+/**
+ * scene intersection
+ * @note all renderers trace rays through this.
+ */
+class UMIntersection
+{
+	DISALLOW_COPY_AND_ASSIGN(UMIntersection);
+public:
+	/**
+	 * preferred ray count of packet intersection
+	 */
+	enum { packet_size = UMTriangleSoupRayPacket::packet_size };
+
+	UMIntersection() : 
+		closest_distance(std::numeric_limits<double>::max())
+	{}
+
+	~UMIntersection() {}
+
+	/**
+	 * closest ray intersection
+	 * @param [in] ray a ray
+	 * @param [in] scene_access target scene access
+	 * @param [out] intersection the closest hit
+	 * @retval hit or not
+	 */
+	static bool intersect(
+		const UMRay& ray, 
+		const UMSceneAccess& scene_access, 
+		UMIntersection& intersection);
+
+	/**
+	 * any ray intersection in [ray.tmin, ray.tmax]
+	 * @note for shadow rays. returns at the first hit.
+	 * @param [in] ray a ray
+	 * @param [in] scene_access target scene access
+	 * @retval hit or not
+	 */
+	static bool intersect(
+		const UMRay& ray, 
+		const UMSceneAccess& scene_access);
+
+	/**
+	 * closest intersection of coherent rays
+	 * @note rays are traced as packets through the bvh.
+	 * @param [in] rays rays
+	 * @param [in] count ray count
+	 * @param [in] scene_access target scene access
+	 * @param [out] intersections the closest hit of each ray
+	 * @param [out] hits hit or not of each ray
+	 */
+	static void intersect(
+		const UMRay* rays, 
+		int count,
+		const UMSceneAccess& scene_access, 
+		UMIntersection* intersections,
+		bool* hits);
+
+	/**
+	 * any intersection of coherent rays in [ray.tmin, ray.tmax]
+	 * @note for shadow rays. rays are traced as packets through the bvh.
+	 * @param [in] rays rays
+	 * @param [in] count ray count
+	 * @param [in] scene_access target scene access
+	 * @param [out] hits hit or not of each ray
+	 */
+	static void intersect(
+		const UMRay* rays, 
+		int count,
+		const UMSceneAccess& scene_access, 
+		bool* hits);
+
+	double closest_distance;
+	UMShaderParameter closest_parameter;
+};
+
+} // umrt
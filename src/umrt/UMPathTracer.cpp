@@ -16,6 +16,8 @@
 #include "UMScene.h"
 #include "UMSceneAccess.h"
 #include "UMAreaLight.h"
+#include "UMIntersection.h"
+#include "UMSampler.h"
 
 #include <limits>
 #include <algorithm>
@@ -31,22 +33,6 @@ namespace
 
 	const int minimum_path_depth = 2;
 	
-	unsigned int xor128()
-	{
-		static unsigned int x = 123456789;
-		static unsigned int y = 362436069;
-		static unsigned int z = 521288629;
-		static unsigned int w = 88675123;
-		unsigned int t = x ^ (x << 11);
-		x = y; y = z; z = w;
-		return w = w ^ (w >> 19) ^ t ^ (t >> 8);
-	}
-
-	double xor128d()
-	{
-		return xor128() / 4294967296.0;
-	}
-
 	UMVec4d map_one(UMVec4d src) {
 		double max = std::max(src.x, std::max(src.y, src.z));
 		if (max > 1.0) {
@@ -56,7 +42,32 @@ namespace
 		return src;
 	}
 
-	UMVec3d hemisphere(const UMVec3d& normal)
+	/// dark pixels do not need relative precision
+	const double min_luminance = 0.05;
+
+	/// max samples of a pixel in a progressive pass
+	const int max_pass_sample_count = 4;
+
+	double luminance(const UMVec3d& color)
+	{
+		return 0.2126 * color.x + 0.7152 * color.y + 0.0722 * color.z;
+	}
+
+	/**
+	 * relative standard error of mean luminance
+	 * @param [in] sum sum of luminance
+	 * @param [in] square_sum sum of squared luminance
+	 * @param [in] count sample count
+	 */
+	double relative_error(double sum, double square_sum, int count)
+	{
+		if (count < 2) return std::numeric_limits<double>::max();
+		const double mean = sum / count;
+		const double variance = std::max(0.0, (square_sum - sum * mean) / (count - 1));
+		return sqrt(variance / count) / std::max(mean, min_luminance);
+	}
+
+	UMVec3d hemisphere(const UMVec3d& normal, UMSampler& sampler)
 	{
 		UMVec3d u, v, w;
 		w = normal;
@@ -66,8 +77,9 @@ namespace
 			u = UMVec3d(1, 0, 0).cross(w).normalized();
 		}
 		v = w.cross(u);
-		const double r1 = 2 * M_PI * xor128d();
-		const double r2 = xor128d();
+		const UMVec2d random_value = sampler.next_2d();
+		const double r1 = 2 * M_PI * random_value.x;
+		const double r2 = random_value.y;
 		const double r2s = sqrt(r2);
 		UMVec3d dir = (u * cos(r1) * r2s + v * sin(r1) * r2s + w * sqrt(1.0 - r2)).normalized();
 		return dir;
@@ -78,71 +90,9 @@ namespace
 namespace umrt
 {
 
-class UMIntersection
-{
-	DISALLOW_COPY_AND_ASSIGN(UMIntersection);
-	public:
-		UMIntersection() : 
-			closest_distance(std::numeric_limits<double>::max())
-		{}
-
-		double closest_distance;
-		UMPrimitivePtr closest_primitive;
-		UMShaderParameter closest_parameter;
-
-	static bool intersect(
-		const UMRay& ray, 
-		UMSceneAccessPtr scene_access, 
-		UMShaderParameter& parameter, 
-		UMIntersection& intersection)
-	{
-		UMPrimitiveList::const_iterator it = scene_access->render_primitive_list().begin();
-		for (int i = 0; it != scene_access->render_primitive_list().end(); ++it, ++i)
-		{
-			UMPrimitivePtr primitive = *it;
-			if (primitive->intersects(ray, parameter))
-			{
-				if (parameter.distance < intersection.closest_distance) 
-				{
-					intersection.closest_distance = parameter.distance;
-					intersection.closest_primitive = primitive;
-					intersection.closest_parameter = parameter;
-				}
-			}
-		}
-		if (intersection.closest_primitive)
-		{
-			return true;
-		}
-		else
-		{
-			return false;
-		}
-	}
-
-	static bool intersect(
-		const UMRay& ray, 
-		UMSceneAccessPtr scene_access)
-	{
-		UMPrimitiveList::const_iterator it = scene_access->render_primitive_list().begin();
-		for (int i = 0; it != scene_access->render_primitive_list().end(); ++it, ++i)
-		{
-			UMPrimitivePtr primitive = *it;
-			if (primitive->intersects(ray))
-			{
-				return true;
-			}
-		}
-		return false;
-	}
-
-};
-
 UMPathTracer::UMPathTracer() : 
 	current_sample_count_(0),
-	current_subpixel_x_(0),
-	current_subpixel_y_(0),
-	max_sample_count_(0)
+	active_pixel_count_(0)
 	//sample_event_(std::make_shared<UMEvent>(eEventTypeRenderProgressSample))
 {
 	//mutable_event_list().push_back(sample_event_);
@@ -151,11 +101,11 @@ UMPathTracer::UMPathTracer() :
 /**
  * trace and return color of the hit point
  */
-UMVec3d UMPathTracer::trace(const UMRay& ray, UMSceneAccessPtr scene_access, UMShaderParameter& parameter)
+UMVec3d UMPathTracer::trace(const UMRay& ray, UMSceneAccessPtr scene_access, UMShaderParameter& parameter, UMSampler& sampler)
 {
 	umdraw::UMScenePtr scene = scene_access->scene();
 	UMIntersection intersection;
-	if (!UMIntersection::intersect(ray, scene_access, parameter, intersection)){
+	if (!UMIntersection::intersect(ray, *scene_access, intersection)){
 		return scene->background_color();
 	}
 
@@ -175,7 +125,7 @@ UMVec3d UMPathTracer::trace(const UMRay& ray, UMSceneAccessPtr scene_access, UMS
 	UMVec3d color = intersection.closest_parameter.emissive;
 
 	if (parameter.depth < (parameter.max_depth - minimum_path_depth)) {
-		if (xor128d() >= russian_roulette_probability)
+		if (sampler.next() >= russian_roulette_probability)
 		{
 			return color;
 		}
@@ -185,9 +135,9 @@ UMVec3d UMPathTracer::trace(const UMRay& ray, UMSceneAccessPtr scene_access, UMS
 	--parameter.depth;
 
 	// diffuse direct
-	color += illuminate_direct(ray, scene_access, intersection, parameter);
+	color += illuminate_direct(ray, scene_access, intersection, parameter, sampler);
 	// diffuse indirect
-	color += illuminate_indirect(ray, scene_access, intersection, parameter) / russian_roulette_probability;
+	color += illuminate_indirect(ray, scene_access, intersection, parameter, sampler) / russian_roulette_probability;
 
 	return color;
 }
@@ -199,7 +149,8 @@ UMVec3d UMPathTracer::illuminate_direct(
 	const UMRay& ray, 
 	UMSceneAccessPtr scene_access, 
 	const UMIntersection& intersection,
-	UMShaderParameter& parameter)
+	UMShaderParameter& parameter,
+	UMSampler& sampler)
 {
 	umdraw::UMScenePtr scene = scene_access->scene();
 	UMVec3d color(0);
@@ -212,13 +163,12 @@ UMVec3d UMPathTracer::illuminate_direct(
 		UMVec3d intensity;
 		UMVec3d sample_point;
 		UMVec3d direction;
-		UMVec2d random_value(xor128d(), xor128d());
-		if (UMAreaLight::sample(intensity, sample_point, direction, light, intersection.closest_parameter, random_value))
+		if (UMAreaLight::sample(intensity, sample_point, direction, light, intersection.closest_parameter, sampler))
 		{
 			UMVec3d p(intersection.closest_parameter.intersect_point);
 			UMRay shadow_ray(p, direction.normalized());
 			shadow_ray.set_tmax( (sample_point - p).length() );
-			if (!UMIntersection::intersect(shadow_ray, scene_access))
+			if (!UMIntersection::intersect(shadow_ray, *scene_access))
 			{
 				color += (intersection.closest_parameter.color * M_PI_INV).multiply(intensity);
 			}
@@ -234,14 +184,15 @@ UMVec3d UMPathTracer::illuminate_indirect(
 	const UMRay& ray, 
 	UMSceneAccessPtr scene_access, 
 	const UMIntersection& intersection,
-	UMShaderParameter& parameter)
+	UMShaderParameter& parameter,
+	UMSampler& sampler)
 {
 	UMVec3d color;
 	UMMaterialPtr mat = intersection.closest_parameter.material;
 
-	UMVec3d dir = hemisphere(parameter.normal);
+	UMVec3d dir = hemisphere(intersection.closest_parameter.normal, sampler);
 	UMRay next_ray(intersection.closest_parameter.intersect_point, dir);
-	UMVec3d traced_color = trace(next_ray, scene_access, parameter);
+	UMVec3d traced_color = trace(next_ray, scene_access, parameter, sampler);
 	// importance sampling
 	color = traced_color.multiply(intersection.closest_parameter.color);
 	return color;
@@ -258,32 +209,32 @@ bool UMPathTracer::render(UMSceneAccessPtr scene_access, UMRenderParameter& para
 	if (!scene->camera()) return false;
 
 	const int sample_count = parameter.sample_count();
-	//std::random_device random_device;
-	//std::vector<unsigned int> seed(2 * height_);
-	//std::generate(seed.begin(), seed.end(), std::ref(random_device));
+	UMImage::ImageBuffer& dst_buffer = parameter.output_image()->mutable_list();
 
-	for (int y = 0; y < height_; ++y)
-	{
-		//std::mt19937 mt(std::seed_seq(seed.begin() + 2 * y, seed.begin() +  2 * (y + 1)));
-
-		for (int x = 0; x < width_; ++x)
+	scheduler_->reset();
+	return scheduler_->run(0, 0, width_, height_, [&](const UMRenderTile& tile) {
+		UMSampler sampler(parameter.sampler_type(), parameter.seed());
+		for (int y = tile.y; y < tile.y + tile.height; ++y)
 		{
-			const int pos = width_ * y + x;
-			for (int s = 0; s < sample_count; ++s)
+			for (int x = tile.x; x < tile.x + tile.width; ++x)
 			{
-				UMVec2d sample_point(xor128d(),  xor128d());
-				sample_point.x += x;
-				sample_point.y += y;
-				UMRay ray;
-				scene_access->generate_ray(ray, sample_point);
-				UMShaderParameter shader_parameter;
-				UMVec3d color = trace(ray, scene_access, shader_parameter);
-				parameter.output_image()->mutable_list()[pos] += UMVec4d(color, 1.0);
+				const int pos = width_ * y + x;
+				for (int s = 0; s < sample_count; ++s)
+				{
+					sampler.start(pos, s);
+					UMVec2d sample_point = sampler.next_2d();
+					sample_point.x += x;
+					sample_point.y += y;
+					UMRay ray;
+					scene_access->generate_ray(ray, sample_point);
+					UMShaderParameter shader_parameter;
+					UMVec3d color = trace(ray, scene_access, shader_parameter, sampler);
+					dst_buffer[pos] += UMVec4d(color, 1.0);
+				}
 			}
 		}
-	}
-	
-	return true;
+		parameter.output_image()->add_dirty_rect(UMVec4ui(tile.x, tile.y, tile.x + tile.width, tile.y + tile.height));
+	});
 }
 
 /**
@@ -296,93 +247,98 @@ bool UMPathTracer::progress_render(UMSceneAccessPtr scene_access, UMRenderParame
 	if (width_ == 0 || height_ == 0) return false;
 	if (!scene->camera()) return false;
 	
-	const UMVec2i super_sampling = parameter.super_sampling_count();
-	
+	const int pixel_count = width_ * height_;
 	// end
-	if (current_sample_count_ == max_sample_count_ &&
-		current_subpixel_x_ == (super_sampling.x-1) &&
-		current_subpixel_y_ == (super_sampling.y-1)) 
+	if (current_sample_count_ > 0 && active_pixel_count_ == 0) 
 	{
-		current_subpixel_x_ = 0;
-		current_subpixel_y_ = 0;
 		return false;
 	}
 	// start
-	if (current_sample_count_ == 0 &&
-		current_subpixel_x_ == 0 &&
-		current_subpixel_y_ == 0) {
-		// init temporary image
-		current_subpixel_x_ = 0;
-		current_subpixel_y_ = 0;
-		temporary_image_.init(width_, height_);
-		max_sample_count_ = parameter.sample_count() / (super_sampling.x * super_sampling.y);
-	}
-	
-	bool is_end_subpixel = 
-		(current_subpixel_x_ == (super_sampling.x-1) &&
-		 current_subpixel_y_ == (super_sampling.y-1));
-	if (is_end_subpixel)
-	{
-		++current_sample_count_;
-		current_subpixel_x_ = 0;
-		current_subpixel_y_ = 0;
-	}
-	else
+	if (current_sample_count_ == 0)
 	{
-		if (current_subpixel_x_ == (super_sampling.x-1))
-		{
-			++current_subpixel_y_;
-			current_subpixel_x_ = 0;
-		}
-		else
-		{
-			++current_subpixel_x_;
-		}
+		temporary_image_.init(width_, height_);
+		luminance_square_buffer_.assign(pixel_count, 0.0);
+		converged_buffer_.assign(pixel_count, 0);
+		active_pixel_count_ = pixel_count;
 	}
-	const double inv_current_sample_count = 1.0 / current_sample_count_;
-	const double inv_current_subpixel_sample_count 
-		= 1.0 / (current_subpixel_x_ + 1)
-		* 1.0 / (current_subpixel_y_ + 1);
+	++current_sample_count_;
+
+	const UMVec2i super_sampling = parameter.super_sampling_count();
+	const int stratum_count = super_sampling.x * super_sampling.y;
 	const double inv_super_sampling_x = 1.0 / (double)super_sampling.x;
 	const double inv_super_sampling_y = 1.0 / (double)super_sampling.y;
+	const int max_sample_count = std::max(parameter.sample_count(), 1);
+	const int min_sample_count = std::max(parameter.min_sample_count(), 2);
+	const double error_threshold = parameter.error_threshold();
 	
-	//std::random_device random_device;
-	//std::vector<unsigned int> seed(2 * height_);
-	//std::generate(seed.begin(), seed.end(), std::ref(random_device));
-
-#pragma omp parallel for schedule(dynamic, 1) num_threads(8)
-	for (int y = 0; y < height_; ++y)
-	{
-		//std::mt19937 mt(std::seed_seq(seed.begin() + 2 * y, seed.begin() +  2 * (y + 1)));
-		for (int x = 0; x < width_; ++x)
+	const UMSampler::SamplerType sampler_type = parameter.sampler_type();
+	const unsigned int seed = parameter.seed();
+
+	UMImage::ImageBuffer& temporary_buffer = temporary_image_.mutable_list();
+	UMImage::ImageBuffer& dst_buffer = parameter.output_image()->mutable_list();
+	const bool is_finished = scheduler_->run(0, 0, width_, height_, [&](const UMRenderTile& tile) {
+		UMSampler sampler(sampler_type, seed);
+		for (int y = tile.y; y < tile.y + tile.height; ++y)
 		{
-			// target pixel
-			const int pos = width_ * y + x;
-			UMVec4d& current_color = temporary_image_.mutable_list()[pos];
-			UMVec4d& out_color = parameter.output_image()->mutable_list()[pos];
-			
-			// sample point
-			UMVec2d sample_point(x, y);
-			sample_point.x += current_subpixel_x_ * inv_super_sampling_x;
-			sample_point.y += current_subpixel_y_ * inv_super_sampling_y;
-			// generate camera ray
-			UMRay ray;
-			scene_access->generate_ray(ray, sample_point);
-			// trace
-			UMShaderParameter shader_param;
-			UMVec3d color = trace(ray, scene_access, shader_param);
-			// output
-			current_color += UMVec4d(color, 1.0);
-
-			if (is_end_subpixel)
+			for (int x = tile.x; x < tile.x + tile.width; ++x)
 			{
-				out_color = map_one(current_color 
-					* inv_current_sample_count
-					* inv_super_sampling_x
-					* inv_super_sampling_y);
+				// target pixel
+				const int pos = width_ * y + x;
+				if (converged_buffer_[pos]) continue;
+				UMVec4d& current_color = temporary_buffer[pos];
+				double& luminance_square = luminance_square_buffer_[pos];
+				
+				// noisy pixels get more samples
+				int sample_count = static_cast<int>(current_color.w);
+				int pass_sample_count = 1;
+				if (sample_count >= min_sample_count && error_threshold > 0.0)
+				{
+					const double error = relative_error(luminance(current_color.xyz()), luminance_square, sample_count);
+					pass_sample_count = static_cast<int>(std::min<double>(error / error_threshold, max_pass_sample_count));
+					pass_sample_count = std::max(pass_sample_count, 1);
+				}
+				pass_sample_count = std::min(pass_sample_count, max_sample_count - sample_count);
+
+				for (int s = 0; s < pass_sample_count; ++s, ++sample_count)
+				{
+					// jittered sample point in a subpixel
+					sampler.start(pos, sample_count);
+					const int stratum = sample_count % stratum_count;
+					const UMVec2d jitter = sampler.next_2d();
+					UMVec2d sample_point(x, y);
+					sample_point.x += ((stratum % super_sampling.x) + jitter.x) * inv_super_sampling_x;
+					sample_point.y += ((stratum / super_sampling.x) + jitter.y) * inv_super_sampling_y;
+					// generate camera ray
+					UMRay ray;
+					scene_access->generate_ray(ray, sample_point);
+					// trace
+					UMShaderParameter shader_param;
+					UMVec3d color = trace(ray, scene_access, shader_param, sampler);
+					current_color += UMVec4d(color, 1.0);
+					const double l = luminance(color);
+					luminance_square += l * l;
+				}
+
+				// output
+				dst_buffer[pos] = map_one(current_color / current_color.w);
+
+				if (sample_count >= max_sample_count)
+				{
+					converged_buffer_[pos] = 1;
+				}
+				else if (sample_count >= min_sample_count && error_threshold > 0.0)
+				{
+					const double error = relative_error(luminance(current_color.xyz()), luminance_square, sample_count);
+					converged_buffer_[pos] = error < error_threshold ? 1 : 0;
+				}
 			}
 		}
-	}
+		parameter.output_image()->add_dirty_rect(UMVec4ui(tile.x, tile.y, tile.x + tile.width, tile.y + tile.height));
+	});
+	if (!is_finished) return false;
+
+	active_pixel_count_ = static_cast<int>(
+		std::count(converged_buffer_.begin(), converged_buffer_.end(), 0));
 
 	//umbase::UMAny sample_count(current_sample_count_);
 	//sample_event_->set_parameter(sample_count);
@@ -34,6 +34,7 @@ typedef std::shared_ptr<UMSceneAccess> UMSceneAccessPtr;
 class UMScene;
 class UMRenderParameter;
 class UMIntersection;
+class UMSampler;
 
 /**
  * a pathtracer
@@ -52,6 +53,7 @@ public:
 	 */
 	virtual bool init() {
 		current_sample_count_ = 0;
+		scheduler_->reset();
 		return true;
 	}
 
@@ -72,6 +74,8 @@ public:
 	 * progressive render
 	 * @param [in] scene_access target scene access
 	 * @param [in,out] parameter parameters for rendering
+	 * @note samples are concentrated on noisy pixels. 
+	 * converged pixels stop sampling (see UMRenderParameter::error_threshold).
 	 * @retval true still render
 	 * @retval false render finished or failed
 	 */
@@ -84,7 +88,8 @@ private:
 	UMVec3d trace(
 		const UMRay& ray, 
 		UMSceneAccessPtr scene_access, 
-		UMShaderParameter& parameter);
+		UMShaderParameter& parameter,
+		UMSampler& sampler);
 
 	/**
 	 * direct lighting
@@ -93,7 +98,8 @@ private:
 		const UMRay& ray, 
 		UMSceneAccessPtr scene_access, 
 		const UMIntersection& intersection, 
-		UMShaderParameter& parameter);
+		UMShaderParameter& parameter,
+		UMSampler& sampler);
 
 	/**
 	 * indirect lighting
@@ -102,16 +108,19 @@ private:
 		const UMRay& ray, 
 		UMSceneAccessPtr scene_access, 
 		const UMIntersection& intersection, 
-		UMShaderParameter& parameter);
+		UMShaderParameter& parameter,
+		UMSampler& sampler);
 	
 
 	// for progress render
 	int current_sample_count_;
-	int current_subpixel_x_;
-	int current_subpixel_y_;
-	int max_sample_count_;
-	//UMRandomSampler sampler_;
+	int active_pixel_count_;
+	/// sum of samples. w is sample count
 	UMImage temporary_image_;
+	/// sum of squared luminance
+	std::vector<double> luminance_square_buffer_;
+	/// 1 if pixel stopped sampling
+	std::vector<unsigned char> converged_buffer_;
 	//UMEventPtr sample_event_;
 };
 
@@ -0,0 +1,50 @@
+/**
+ * @file UMPrimitive.cpp
+ * interface of primitive
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMPrimitive.h"
+#include "UMRay.h"
+#include "UMShaderParameter.h"
+
+namespace umrt
+{
+
+/**
+ * packet ray intersection
+ */
+int UMPrimitive::intersects(const UMRay* rays, int count, UMShaderParameter* params) const
+{
+	int hit_mask = 0;
+	for (int k = 0; k < count; ++k)
+	{
+		if (intersects(rays[k], params[k]))
+		{
+			hit_mask |= (1 << k);
+		}
+	}
+	return hit_mask;
+}
+
+/**
+ * packet ray intersection
+ */
+int UMPrimitive::intersects(const UMRay* rays, int count) const
+{
+	int hit_mask = 0;
+	for (int k = 0; k < count; ++k)
+	{
+		if (intersects(rays[k]))
+		{
+			hit_mask |= (1 << k);
+		}
+	}
+	return hit_mask;
+}
+
+} // umrt
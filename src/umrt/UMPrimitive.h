@@ -51,6 +51,25 @@ public:
 	 */
 	virtual bool intersects(const UMRay& ray) const = 0;
 
+	/**
+	 * packet ray intersection
+	 * @note intersects each ray by default
+	 * @param [in] rays coherent rays
+	 * @param [in] count ray count
+	 * @param [in,out] params shading parameters of each ray
+	 * @retval mask of rays which hit
+	 */
+	virtual int intersects(const UMRay* rays, int count, UMShaderParameter* params) const;
+
+	/**
+	 * packet ray intersection
+	 * @note intersects each ray by default
+	 * @param [in] rays coherent rays
+	 * @param [in] count ray count
+	 * @retval mask of rays which hit
+	 */
+	virtual int intersects(const UMRay* rays, int count) const;
+
 	/**
 	 * get box
 	 */
@@ -89,6 +89,24 @@ bool UMRT::add_abc_scene(umabc::UMAbcScenePtr scene)
 }
 
 
+/**
+ * update scene for deformed meshes
+ */
+bool UMRT::update_scene()
+{
+	if (!scene_access_) return false;
+	return scene_access_->refit_bvh();
+}
+
+/**
+ * update scene for moved mesh nodes
+ */
+bool UMRT::update_transforms()
+{
+	if (!scene_access_) return false;
+	return scene_access_->update_instances();
+}
+
 /**
  * render
  */
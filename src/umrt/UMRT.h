@@ -76,6 +76,17 @@ public:
 	 */
 	bool add_abc_scene(umabc::UMAbcScenePtr abc_scene);
 	
+	/**
+	 * update scene for deformed meshes
+	 */
+	bool update_scene();
+
+	/**
+	 * update scene for moved mesh nodes
+	 * @note rigid transforms only. rebuilds only the top level bvh.
+	 */
+	bool update_transforms();
+
 	/**
 	 * render
 	 */
@@ -0,0 +1,158 @@
+/**
+ * @file UMRayBenchmark.cpp
+ * compare float and double triangle intersection on camera rays
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMRayBenchmark.h"
+#include "UMScene.h"
+#include "UMSceneAccess.h"
+#include "UMBvh.h"
+#include "UMRay.h"
+#include "UMTriangleSoup.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+namespace
+{
+	using namespace umrt;
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	double to_milliseconds(const Clock::duration& duration)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / 1000.0;
+	}
+
+	/**
+	 * trace all rays and keep the last hits
+	 */
+	template <class T>
+	double trace(
+		std::vector<T>& distance_list,
+		std::vector<unsigned int>& hit_index_list,
+		const UMBvh& bvh,
+		const UMTriangleSoupT<T>& soup,
+		const std::vector<UMRay>& ray_list,
+		int repeat_count)
+	{
+		const int ray_count = static_cast<int>(ray_list.size());
+		distance_list.assign(ray_count, static_cast<T>(-1));
+		hit_index_list.assign(ray_count, 0);
+		const Clock::time_point start = Clock::now();
+		for (int repeat = 0; repeat < repeat_count; ++repeat)
+		{
+			for (int i = 0; i < ray_count; ++i)
+			{
+				if (!bvh.intersects_triangle_soup(soup, ray_list[i], distance_list[i], hit_index_list[i]))
+				{
+					distance_list[i] = static_cast<T>(-1);
+				}
+			}
+		}
+		return to_milliseconds(Clock::now() - start);
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * trace camera rays of a model with float and double
+ */
+bool UMRayBenchmark::run(
+	Result& result,
+	const umstring& model_path,
+	int repeat_count)
+{
+	result = Result();
+
+	umdraw::UMScenePtr scene = std::make_shared<umdraw::UMScene>();
+	if (!scene->load(model_path)) return false;
+
+	UMSceneAccess access;
+	if (!access.init()) return false;
+	access.add_scene(scene);
+
+	// flat tree of all triangles
+	UMPrimitiveList primitive_list = access.primitive_list();
+	if (primitive_list.empty()) return false;
+	UMBvhPtr bvh = UMBvh::create();
+	if (!bvh->build(primitive_list)) return false;
+
+	UMTriangleSoup float_soup;
+	UMTriangleSoupD double_soup;
+	float_soup.build(bvh->ordered_primitives());
+	double_soup.build(bvh->ordered_primitives());
+
+	const int width = scene->width();
+	const int height = scene->height();
+	std::vector<UMRay> ray_list(width * height);
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			access.generate_ray(ray_list[y * width + x], UMVec2d(x + 0.5, y + 0.5));
+		}
+	}
+
+	std::vector<float> float_distance_list;
+	std::vector<double> double_distance_list;
+	std::vector<unsigned int> float_index_list;
+	std::vector<unsigned int> double_index_list;
+	result.float_milliseconds = trace(float_distance_list, float_index_list, *bvh, float_soup, ray_list, repeat_count);
+	result.double_milliseconds = trace(double_distance_list, double_index_list, *bvh, double_soup, ray_list, repeat_count);
+
+	result.ray_count = static_cast<int>(ray_list.size()) * repeat_count;
+	result.triangle_count = static_cast<int>(primitive_list.size());
+	for (size_t i = 0, size = ray_list.size(); i < size; ++i)
+	{
+		const bool is_float_hit = float_distance_list[i] >= 0.0f;
+		const bool is_double_hit = double_distance_list[i] >= 0.0;
+		if (is_float_hit) ++result.float_hit_count;
+		if (is_double_hit) ++result.double_hit_count;
+		if (is_float_hit != is_double_hit || (is_float_hit && float_index_list[i] != double_index_list[i]))
+		{
+			++result.mismatch_count;
+		}
+		else if (is_double_hit && double_distance_list[i] > 0.0)
+		{
+			const double error = fabs(float_distance_list[i] - double_distance_list[i]) / double_distance_list[i];
+			result.max_distance_error = (std::max)(result.max_distance_error, error);
+		}
+	}
+	return true;
+}
+
+/**
+ * print result to stdout
+ */
+void UMRayBenchmark::print(const Result& result)
+{
+	if (result.ray_count == 0)
+	{
+		printf("no rays\n");
+		return;
+	}
+	printf("rays %d, triangles %d\n", result.ray_count, result.triangle_count);
+	printf("float   %10.3f ms  %8.3f Mrays/s  hits %d\n",
+		result.float_milliseconds,
+		result.float_milliseconds > 0.0 ? result.ray_count / result.float_milliseconds / 1000.0 : 0.0,
+		result.float_hit_count);
+	printf("double  %10.3f ms  %8.3f Mrays/s  hits %d\n",
+		result.double_milliseconds,
+		result.double_milliseconds > 0.0 ? result.ray_count / result.double_milliseconds / 1000.0 : 0.0,
+		result.double_hit_count);
+	printf("mismatch %d, max distance error %g\n", result.mismatch_count, result.max_distance_error);
+}
+
+} // umrt
@@ -0,0 +1,76 @@
+/**
+ * @file UMRayBenchmark.h
+ * compare float and double triangle intersection on camera rays
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include "UMMacro.h"
+#include <memory>
+
+namespace umrt
+{
+
+/**
+ * ray intersection benchmark
+ * @note runs without OpenGL context.
+ * the same bvh and the same camera rays are used for float and double.
+ */
+class UMRayBenchmark
+{
+	DISALLOW_COPY_AND_ASSIGN(UMRayBenchmark);
+public:
+
+	/**
+	 * benchmark result
+	 */
+	struct Result
+	{
+		Result() 
+			: ray_count(0)
+			, triangle_count(0)
+			, float_hit_count(0)
+			, double_hit_count(0)
+			, mismatch_count(0)
+			, max_distance_error(0.0)
+			, float_milliseconds(0.0)
+			, double_milliseconds(0.0)
+		{}
+		int ray_count;
+		int triangle_count;
+		int float_hit_count;
+		int double_hit_count;
+		/// rays which hit different triangles
+		int mismatch_count;
+		/// max relative distance error of float on the same triangle
+		double max_distance_error;
+		double float_milliseconds;
+		double double_milliseconds;
+	};
+
+	/**
+	 * trace camera rays of a model with float and double
+	 * @param [out] result measured time and differences
+	 * @param [in] model_path absolute path of a model
+	 * @param [in] repeat_count times to trace all rays
+	 */
+	static bool run(
+		Result& result,
+		const umstring& model_path,
+		int repeat_count);
+
+	/**
+	 * print result to stdout
+	 */
+	static void print(const Result& result);
+
+private:
+	UMRayBenchmark() {}
+};
+
+} // umrt
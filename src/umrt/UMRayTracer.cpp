@@ -15,6 +15,8 @@
 #include "UMScene.h"
 #include "UMVector.h"
 #include "UMStringUtil.h"
+#include "UMIntersection.h"
+#include "UMSampler.h"
 
 #include <limits>
 #include <algorithm>
@@ -30,22 +32,6 @@ namespace
 	using namespace umrt;
 	using namespace umdraw;
 	
-	unsigned int xor128()
-	{
-		static unsigned int x = 123456789;
-		static unsigned int y = 362436069;
-		static unsigned int z = 521288629;
-		static unsigned int w = 88675123;
-		unsigned int t = x ^ (x << 11);
-		x = y; y = z; z = w;
-		return w = w ^ (w >> 19) ^ t ^ (t >> 8);
-	}
-
-	double xor128d()
-	{
-		return xor128() / 4294967296.0;
-	}
-
 	// definition
 	UMVec3d trace(const UMRay& ray, UMSceneAccessPtr scene_access, UMShaderParameter& parameter);
 
@@ -63,81 +49,65 @@ namespace
 		return normal * origin.dot(normal) * 2.0 - origin;
 	}
 	
-	class UMIntersection
+	/**
+	 * ray from a hit point to a light
+	 */
+	UMRay light_ray(const UMShaderParameter& parameter, const UMVec3d& light_position)
 	{
-		DISALLOW_COPY_AND_ASSIGN(UMIntersection);
-		public:
-			UMIntersection() : 
-				closest_distance(std::numeric_limits<double>::max())
-			{}
-
-			double closest_distance;
-			UMPrimitivePtr closest_primitive;
-			UMShaderParameter closest_parameter;
-	};
-
-	bool intersect(
-		const UMRay& ray, 
-		UMSceneAccessPtr scene_access, 
-		UMShaderParameter& parameter, 
-		UMIntersection& intersection)
+		UMVec3d to_light = light_position - parameter.intersect_point;
+		UMRay shadow_ray(parameter.intersect_point + parameter.normal * 0.00001, to_light.normalized());
+		shadow_ray.set_tmax(to_light.length());
+		return shadow_ray;
+	}
+
+	/**
+	 * lambert shading of an unoccluded light
+	 */
+	UMVec3d illuminate(const UMShaderParameter& parameter, const UMVec3d& L)
 	{
-		UMPrimitiveList::const_iterator it = scene_access->render_primitive_list().begin();
-		for (int i = 0; it != scene_access->render_primitive_list().end(); ++it, ++i)
-		{
-			UMPrimitivePtr primitive = *it;
-			if (primitive->intersects(ray, parameter))
-			{
-				if (parameter.distance < intersection.closest_distance) 
-				{
-					intersection.closest_distance = parameter.distance;
-					intersection.closest_primitive = primitive;
-					intersection.closest_parameter = parameter;
-				}
-			}
-		}
-		if (intersection.closest_primitive)
+		UMVec3d normal(parameter.normal.normalized());
+		return parameter.color * std::max(0.0, normal.dot(L));
+	}
+
+	/**
+	 * reflection
+	 */
+	UMVec3d reflection(const UMRay& ray, UMSceneAccessPtr scene_access, UMShaderParameter& parameter)
+	{
+		if (parameter.bounce > 0)
 		{
-			return true;
+			UMVec3d normal(parameter.normal.normalized());
+			UMShaderParameter refrect_parameter;
+			parameter.bounce--;
+			refrect_parameter.bounce = parameter.bounce;
+			UMVec3d refrection_dir = reflect(ray, normal).normalized();
+			UMRay reflection_ray(parameter.intersect_point + normal * 0.00001, refrection_dir);
+			UMVec3d color = trace(reflection_ray, scene_access, refrect_parameter);
+			//UMVec3d nl = parameter.normal.dot(refrection_dir);
+			return color;
 		}
-		return false;
+		return UMVec3d(0);
 	}
 
 	/**
 	 * shading function
 	 */
-	UMVec3d shade(const UMPrimitivePtr current, const UMRay& ray, UMSceneAccessPtr scene_access, UMShaderParameter& parameter)
+	UMVec3d shade(const UMRay& ray, UMSceneAccessPtr scene_access, UMShaderParameter& parameter)
 	{
 		umdraw::UMScenePtr scene = scene_access->scene();
-		UMVec3d normal(parameter.normal.normalized());
 		UMVec3d radiance(0);
 		UMLightList::const_iterator it = scene->light_list().begin();
 		for (; it != scene->light_list().end(); ++it)
 		{
-			UMVec3d light_position = (*it)->position();
-			UMVec3d L = (light_position - parameter.intersect_point).normalized();
-
 			// shadow ray
-			UMRay shadow_ray(parameter.intersect_point + parameter.normal * 0.00001, L);
-			UMIntersection intersection;
-			UMShaderParameter shadow_parameter;
-			if (!intersect(shadow_ray, scene_access, shadow_parameter, intersection))
+			UMRay shadow_ray = light_ray(parameter, (*it)->position());
+			if (!UMIntersection::intersect(shadow_ray, *scene_access))
 			{
-				radiance += parameter.color * std::max(0.0, normal.dot(L));
+				radiance += illuminate(parameter, shadow_ray.direction());
 			}
 		}
 		// reflection ray
-		if (parameter.bounce > 0)
-		{
-			UMShaderParameter refrect_parameter;
-			parameter.bounce--;
-			refrect_parameter.bounce = parameter.bounce;
-			UMVec3d refrection_dir = reflect(ray, normal).normalized();
-			UMRay reflection_ray(parameter.intersect_point + normal * 0.00001, refrection_dir);
-			UMVec3d color = trace(reflection_ray, scene_access, refrect_parameter);
-			//UMVec3d nl = parameter.normal.dot(refrection_dir);
-			radiance += color;
-		}
+		radiance += reflection(ray, scene_access, parameter);
 		
 		return map_one(radiance);
 	}
@@ -149,18 +119,68 @@ namespace
 	{
 		umdraw::UMScenePtr scene = scene_access->scene();
 		UMIntersection intersection;
-		//if (parameter.bounce == 1)
+		if (!UMIntersection::intersect(ray, *scene_access, intersection)){
+			return scene->background_color();
+		}
+		// caller can see the hit
+		parameter = intersection.closest_parameter;
+		return shade(ray, scene_access, intersection.closest_parameter);
+	}
+
+	/**
+	 * trace coherent rays and return colors of the hit points
+	 * @note camera rays and shadow rays are traced as packets.
+	 * reflection rays are incoherent, so they are traced one by one.
+	 * @param [in] rays rays. count is UMIntersection::packet_size at most
+	 * @param [in] count ray count
+	 * @param [in] scene_access scene access
+	 * @param [out] colors colors of each ray
+	 */
+	void trace_packet(const UMRay* rays, int count, UMSceneAccessPtr scene_access, UMVec3d* colors)
+	{
+		const int packet_size = UMIntersection::packet_size;
+		umdraw::UMScenePtr scene = scene_access->scene();
+		UMIntersection intersections[packet_size];
+		bool hits[packet_size];
+		UMIntersection::intersect(rays, count, *scene_access, intersections, hits);
+
+		UMVec3d radiance[packet_size];
+		UMLightList::const_iterator it = scene->light_list().begin();
+		for (; it != scene->light_list().end(); ++it)
 		{
-			if (!intersect(ray, scene_access, parameter, intersection)){
-				return scene->background_color();
+			// shadow rays of the hit lanes
+			UMRay shadow_rays[packet_size];
+			int lanes[packet_size];
+			int shadow_count = 0;
+			for (int k = 0; k < count; ++k)
+			{
+				if (!hits[k]) continue;
+				shadow_rays[shadow_count] = light_ray(intersections[k].closest_parameter, (*it)->position());
+				lanes[shadow_count] = k;
+				++shadow_count;
+			}
+			if (shadow_count == 0) break;
+			bool occluded[packet_size];
+			UMIntersection::intersect(shadow_rays, shadow_count, *scene_access, occluded);
+			for (int i = 0; i < shadow_count; ++i)
+			{
+				if (occluded[i]) continue;
+				const int k = lanes[i];
+				radiance[k] += illuminate(intersections[k].closest_parameter, shadow_rays[i].direction());
 			}
 		}
 
-		if (intersection.closest_primitive)
+		for (int k = 0; k < count; ++k)
 		{
-			return shade(intersection.closest_primitive, ray, scene_access, intersection.closest_parameter);
+			if (!hits[k])
+			{
+				colors[k] = scene->background_color();
+				continue;
+			}
+			// reflection ray
+			radiance[k] += reflection(rays[k], scene_access, intersections[k].closest_parameter);
+			colors[k] = map_one(radiance[k]);
 		}
-		return scene->background_color();
 	}
 
 }
@@ -300,11 +320,12 @@ public:
 class UMRayTracer::Impl
 {
 public:
-	Impl(int width, int height) 
+	Impl(int width, int height, UMRenderSchedulerPtr scheduler) 
 		:  current_x_(0)
 		, current_y_(0)
 		, width_(width)
 		, height_(height)
+		, scheduler_(scheduler)
 #ifdef WITH_OSL
 		, render_service_(new UMOSLRenderService())
 #else
@@ -344,6 +365,7 @@ public:
 	{
 		current_x_ = 0;
 		current_y_ = 0;
+		scheduler_->reset();
 		return true;
 	}
 
@@ -353,12 +375,15 @@ public:
 	}
 
 private:
+	void render_tile(const UMRenderTile& tile, UMSceneAccessPtr scene_access, UMRenderParameter& parameter);
+
 	OSL::RendererServices* render_service_;
 	// for progress render
 	int current_x_;
 	int current_y_;
 	int width_;
 	int height_;
+	UMRenderSchedulerPtr scheduler_;
 };
 
 #ifdef WITH_OSL
@@ -437,92 +462,103 @@ bool UMRayTracer::Impl::render(UMSceneAccessPtr scene_access, UMRenderParameter&
 	//OSL::ShadingSystem::destroy(shading_system);
 	//shading_system = NULL;
 
+	scheduler_->reset();
+	return scheduler_->run(0, 0, width_, height_, [&](const UMRenderTile& tile) {
+		render_tile(tile, scene_access, parameter);
+	});
+}
+
+bool UMRayTracer::Impl::progress_render(UMSceneAccessPtr scene_access, UMRenderParameter& parameter)
+{
+	umdraw::UMScenePtr scene = scene_access->scene();
+	if (!scene) return false;
+	if (width_ == 0 || height_ == 0) return false;
+	if (!scene->camera()) return false;
+	
+	const int ystep = 10;
+	
+	// end
+	if (current_y_ >= height_) { return false; }
+
+	const int rows = std::min(ystep, height_ - current_y_);
+	if (!scheduler_->run(0, current_y_, width_, rows, [&](const UMRenderTile& tile) {
+			render_tile(tile, scene_access, parameter);
+		}))
+	{
+		return false;
+	}
+	current_y_ += rows;
+	return true;
+}
+
+/**
+ * render a tile
+ */
+void UMRayTracer::Impl::render_tile(const UMRenderTile& tile, UMSceneAccessPtr scene_access, UMRenderParameter& parameter)
+{
 	const int sample_count = parameter.super_sampling_count().x * parameter.super_sampling_count().y;
 	const double inv_sample_count = 1.0 / sample_count;
 
 	UMImage::ImageBuffer& dst_buffer = parameter.output_image()->mutable_list();
+	UMSampler sampler(parameter.sampler_type(), parameter.seed());
+	const int packet_size = UMIntersection::packet_size;
+	UMRay rays[packet_size];
+	UMVec3d colors[packet_size];
 	
-//#pragma omp parallel for schedule(dynamic, 1) num_threads(4)
-	for (int y = 0; y < height_; ++y)
+	for (int y = tile.y; y < tile.y + tile.height; ++y)
 	{
 		if (sample_count > 1)
 		{
-			for (int x = 0; x < width_; ++x)
+			for (int x = tile.x; x < tile.x + tile.width; ++x)
 			{
 				const int pos = width_ * y + x;
-				for (int s = 0; s < sample_count; ++s)
+				// samples of a pixel are traced as packets
+				for (int s = 0; s < sample_count; s += packet_size)
 				{
-					UMVec2d sample_point(xor128d(), xor128d());
-					sample_point.x += x;
-					sample_point.y += y;
-					UMRay ray;
-					scene_access->generate_ray(ray, sample_point);
-					UMShaderParameter shader_parameter;
-					UMVec3d color = trace(ray, scene_access, shader_parameter);
-					dst_buffer[pos] += UMVec4d(color, 1.0);
+					const int count = std::min(packet_size, sample_count - s);
+					for (int k = 0; k < count; ++k)
+					{
+						sampler.start(pos, s + k);
+						UMVec2d sample_point = sampler.next_2d();
+						sample_point.x += x;
+						sample_point.y += y;
+						scene_access->generate_ray(rays[k], sample_point);
+					}
+					trace_packet(rays, count, scene_access, colors);
+					for (int k = 0; k < count; ++k)
+					{
+						dst_buffer[pos] += UMVec4d(colors[k], 1.0);
+					}
 				}
 				dst_buffer[pos] *= inv_sample_count;
 			}
 		}
 		else
 		{
-			for (int x = 0; x < width_; ++x)
+			// neighbor pixels are traced as packets
+			for (int x = tile.x; x < tile.x + tile.width; x += packet_size)
 			{
-				const int pos = width_ * y + x;
-				UMRay ray;
-				scene_access->generate_ray(ray, UMVec2d(x, y));
-				UMShaderParameter shader_parameter;
-				UMVec3d color = trace(ray, scene_access, shader_parameter);
-				dst_buffer[pos] = UMVec4d(color, 1.0);
-			}
-		}
-	}
-	return true;
-}
-
-bool UMRayTracer::Impl::progress_render(UMSceneAccessPtr scene_access, UMRenderParameter& parameter)
-{
-	umdraw::UMScenePtr scene = scene_access->scene();
-	if (!scene) return false;
-	if (width_ == 0 || height_ == 0) return false;
-	if (!scene->camera()) return false;
-	
-	const int ystep = 10;
-	
-	const int sample_count = parameter.super_sampling_count().x * parameter.super_sampling_count().y;
-	const double inv_sample_count = 1.0 / sample_count;
-	
-	for (int& y = current_y_, rows = (y + ystep); y < rows; ++y)
-	{
-		// end
-		if (y == height_) { return false; }
-		
-		for (int x = 0; x < width_; ++x)
-		{
-			const int pos = width_ * y + x;
-			for (int s = 0; s < sample_count; ++s)
-			{
-				UMVec2d sample_point(xor128d(), xor128d());
-				sample_point.x += x;
-				sample_point.y += y;
-				UMRay ray;
-				scene_access->generate_ray(ray, sample_point);
-				UMShaderParameter shader_parameter;
-				UMVec3d color = trace(ray, scene_access, shader_parameter);
-				parameter.output_image()->mutable_list()[pos] += UMVec4d(color, 1.0);
+				const int count = std::min(packet_size, tile.x + tile.width - x);
+				for (int k = 0; k < count; ++k)
+				{
+					scene_access->generate_ray(rays[k], UMVec2d(x + k, y));
+				}
+				trace_packet(rays, count, scene_access, colors);
+				for (int k = 0; k < count; ++k)
+				{
+					dst_buffer[width_ * y + x + k] = UMVec4d(colors[k], 1.0);
+				}
 			}
-			parameter.output_image()->mutable_list()[pos] *= inv_sample_count;
 		}
 	}
-	
-	return true;
+	parameter.output_image()->add_dirty_rect(UMVec4ui(tile.x, tile.y, tile.x + tile.width, tile.y + tile.height));
 }
 
 /**
  * constructor
  */
 UMRayTracer::UMRayTracer()
-	: impl_(new UMRayTracer::Impl(width(), height()))
+	: impl_(new UMRayTracer::Impl(width(), height(), scheduler()))
 {}
 
 /**
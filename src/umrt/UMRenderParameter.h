@@ -14,6 +14,7 @@
 #include "UMMacro.h"
 #include "UMImage.h"
 #include "UMVector.h"
+#include "UMSampler.h"
 
 namespace umrt
 {
@@ -28,12 +29,20 @@ public:
 	UMRenderParameter() 
 		: super_sampling_count_(2, 2)
 		, sample_count_(20)
+		, sampler_type_(UMSampler::eRandomSampler)
+		, seed_(0)
+		, error_threshold_(0.01)
+		, min_sample_count_(4)
 		, output_image_(std::make_shared<UMImage>())
 	{}
 
 	UMRenderParameter(int width, int height)
 		: super_sampling_count_(2, 2)
 		, sample_count_(20)
+		, sampler_type_(UMSampler::eRandomSampler)
+		, seed_(0)
+		, error_threshold_(0.01)
+		, min_sample_count_(4)
 		, output_image_(std::make_shared<UMImage>())
 	{
 		if (UMImagePtr image = output_image())
@@ -59,6 +68,49 @@ public:
 	 */
 	UMVec2i super_sampling_count() const { return super_sampling_count_; }
 
+	/**
+	 * get sampler type
+	 */
+	UMSampler::SamplerType sampler_type() const { return sampler_type_; }
+
+	/**
+	 * set sampler type
+	 */
+	void set_sampler_type(UMSampler::SamplerType type) { sampler_type_ = type; }
+
+	/**
+	 * get random seed
+	 */
+	unsigned int seed() const { return seed_; }
+
+	/**
+	 * set random seed
+	 * @note same seed makes same image
+	 */
+	void set_seed(unsigned int seed) { seed_ = seed; }
+
+	/**
+	 * get error threshold of progressive render
+	 */
+	double error_threshold() const { return error_threshold_; }
+
+	/**
+	 * set error threshold of progressive render
+	 * @note a pixel stops sampling when the relative standard error 
+	 * of its luminance is below this. 0 means no early termination.
+	 */
+	void set_error_threshold(double threshold) { error_threshold_ = threshold; }
+
+	/**
+	 * get sample count per pixel before convergence is tested
+	 */
+	int min_sample_count() const { return min_sample_count_; }
+
+	/**
+	 * set sample count per pixel before convergence is tested
+	 */
+	void set_min_sample_count(int count) { min_sample_count_ = count; }
+
 	/**
 	 * get osl file path(test)
 	 */
@@ -74,6 +126,10 @@ private:
 	//UMImagePtr temporary_image_;
 	int sample_count_;
 	UMVec2i super_sampling_count_;
+	UMSampler::SamplerType sampler_type_;
+	unsigned int seed_;
+	double error_threshold_;
+	int min_sample_count_;
 	umstring osl_filepath_;
 };
 
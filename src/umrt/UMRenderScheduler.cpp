@@ -0,0 +1,216 @@
+/**
+ * @file UMRenderScheduler.cpp
+ * tile based render scheduler
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMRenderScheduler.h"
+
+#include <algorithm>
+#include <deque>
+
+#if !defined(WITH_EMSCRIPTEN)
+	#include <thread>
+	#include <mutex>
+#endif
+
+namespace
+{
+	using namespace umrt;
+
+	const int default_tile_size = 32;
+
+	/**
+	 * split a rectangle into tiles
+	 */
+	void split_tiles(UMRenderTileList& tiles, int x, int y, int width, int height, int tile_size)
+	{
+		tiles.clear();
+		for (int ty = y; ty < y + height; ty += tile_size)
+		{
+			for (int tx = x; tx < x + width; tx += tile_size)
+			{
+				UMRenderTile tile;
+				tile.x = tx;
+				tile.y = ty;
+				tile.width = std::min(tile_size, x + width - tx);
+				tile.height = std::min(tile_size, y + height - ty);
+				tile.index = static_cast<int>(tiles.size());
+				tiles.push_back(tile);
+			}
+		}
+	}
+
+#if !defined(WITH_EMSCRIPTEN)
+	/**
+	 * tile queue of a worker
+	 */
+	class UMTileQueue
+	{
+		DISALLOW_COPY_AND_ASSIGN(UMTileQueue);
+	public:
+		UMTileQueue() {}
+
+		void push(int tile)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			tiles_.push_back(tile);
+		}
+
+		/**
+		 * pop own tile from the front
+		 */
+		bool pop(int& tile)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (tiles_.empty()) return false;
+			tile = tiles_.front();
+			tiles_.pop_front();
+			return true;
+		}
+
+		/**
+		 * steal a tile from the back
+		 */
+		bool steal(int& tile)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (tiles_.empty()) return false;
+			tile = tiles_.back();
+			tiles_.pop_back();
+			return true;
+		}
+
+	private:
+		std::mutex mutex_;
+		std::deque<int> tiles_;
+	};
+#endif // WITH_EMSCRIPTEN
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * constructor
+ */
+UMRenderScheduler::UMRenderScheduler()
+	: tile_size_(default_tile_size)
+	, thread_count_(0)
+{
+	is_cancelled_ = false;
+	set_thread_count(0);
+}
+
+/**
+ * set worker thread count
+ */
+void UMRenderScheduler::set_thread_count(unsigned int count)
+{
+#if !defined(WITH_EMSCRIPTEN)
+	if (count == 0)
+	{
+		count = std::thread::hardware_concurrency();
+	}
+	thread_count_ = count > 0 ? count : 1;
+	if (!thread_pool_ || thread_pool_->thread_count() != static_cast<int>(thread_count_))
+	{
+		thread_pool_ = std::make_shared<umbase::UMThreadPool>(thread_count_);
+	}
+#else
+	thread_count_ = 1;
+#endif
+}
+
+/**
+ * cancel current run
+ */
+void UMRenderScheduler::cancel()
+{
+	is_cancelled_ = true;
+}
+
+/**
+ * clear cancellation
+ */
+void UMRenderScheduler::reset()
+{
+	is_cancelled_ = false;
+}
+
+/**
+ * is cancelled
+ */
+bool UMRenderScheduler::is_cancelled() const
+{
+	return is_cancelled_;
+}
+
+/**
+ * render tiles in the rectangle and wait for all of them
+ */
+bool UMRenderScheduler::run(int x, int y, int width, int height, const TileFunction& render_tile)
+{
+	if (is_cancelled_) return false;
+	if (width <= 0 || height <= 0) return true;
+
+	UMRenderTileList tiles;
+	split_tiles(tiles, x, y, width, height, tile_size_);
+	const int tile_count = static_cast<int>(tiles.size());
+	const int worker_count = std::min(static_cast<int>(thread_count_), tile_count);
+
+#if !defined(WITH_EMSCRIPTEN)
+	if (worker_count > 1)
+	{
+		// deal tiles round robin, so that each worker starts at a different part of the image
+		std::vector<std::unique_ptr<UMTileQueue> > queues(worker_count);
+		for (int i = 0; i < worker_count; ++i)
+		{
+			queues[i].reset(new UMTileQueue());
+		}
+		for (int i = 0; i < tile_count; ++i)
+		{
+			queues[i % worker_count]->push(i);
+		}
+
+		const TileFunction& tile_finished = tile_finished_;
+		const std::atomic<bool>& is_cancelled = is_cancelled_;
+		auto worker = [&](int worker_index) {
+			int tile = 0;
+			for (;;)
+			{
+				if (is_cancelled) return;
+				bool found = queues[worker_index]->pop(tile);
+				for (int i = 1; !found && i < worker_count; ++i)
+				{
+					found = queues[(worker_index + i) % worker_count]->steal(tile);
+				}
+				// no tiles left anywhere
+				if (!found) return;
+
+				render_tile(tiles[tile]);
+				if (tile_finished) tile_finished(tiles[tile]);
+			}
+		};
+
+		// worker 0 steals all tiles if the pool runs fewer workers
+		thread_pool_->run(worker_count, worker);
+		return !is_cancelled_;
+	}
+#endif // WITH_EMSCRIPTEN
+
+	for (int i = 0; i < tile_count; ++i)
+	{
+		if (is_cancelled_) return false;
+		render_tile(tiles[i]);
+		if (tile_finished_) tile_finished_(tiles[i]);
+	}
+	return !is_cancelled_;
+}
+
+} // umrt
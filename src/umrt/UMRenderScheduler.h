@@ -0,0 +1,129 @@
+/**
+ * @file UMRenderScheduler.h
+ * tile based render scheduler
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include "UMMacro.h"
+#include "UMThreadPool.h"
+
+#if !defined(WITH_EMSCRIPTEN)
+	#include <atomic>
+#endif
+
+namespace umrt
+{
+
+class UMRenderScheduler;
+typedef std::shared_ptr<UMRenderScheduler> UMRenderSchedulerPtr;
+
+/**
+ * a rectangle of the frame buffer
+ */
+class UMRenderTile
+{
+public:
+	UMRenderTile() : x(0), y(0), width(0), height(0), index(0) {}
+
+	int x;
+	int y;
+	int width;
+	int height;
+	int index; //!< index in the tile list
+};
+typedef std::vector<UMRenderTile> UMRenderTileList;
+
+/**
+ * tile based render scheduler
+ * @note tiles are distributed to worker threads, and idle workers steal
+ * tiles from the others. worker threads are created once and reused by each run.
+ */
+class UMRenderScheduler
+{
+	DISALLOW_COPY_AND_ASSIGN(UMRenderScheduler);
+public:
+	typedef std::function<void (const UMRenderTile&)> TileFunction;
+
+	UMRenderScheduler();
+	~UMRenderScheduler() {}
+
+	/**
+	 * render tiles in the rectangle and wait for all of them
+	 * @param [in] x left of the rectangle
+	 * @param [in] y top of the rectangle
+	 * @param [in] width width of the rectangle
+	 * @param [in] height height of the rectangle
+	 * @param [in] render_tile render function called from worker threads
+	 * @retval true all tiles are rendered
+	 * @retval false cancelled
+	 * @note does nothing while cancelled. call reset() to render again.
+	 */
+	bool run(int x, int y, int width, int height, const TileFunction& render_tile);
+
+	/**
+	 * cancel current and following runs
+	 * @note rendering tiles are finished, remaining tiles are skipped.
+	 * can be called from any thread.
+	 */
+	void cancel();
+
+	/**
+	 * clear cancellation
+	 */
+	void reset();
+
+	/**
+	 * is cancelled
+	 */
+	bool is_cancelled() const;
+
+	/**
+	 * set a function called when each tile is finished
+	 * @note called from worker threads
+	 */
+	void set_tile_finished_function(const TileFunction& function) { tile_finished_ = function; }
+
+	/**
+	 * get tile size
+	 */
+	int tile_size() const { return tile_size_; }
+
+	/**
+	 * set tile size
+	 */
+	void set_tile_size(int size) { tile_size_ = size > 0 ? size : 1; }
+
+	/**
+	 * get worker thread count
+	 */
+	unsigned int thread_count() const { return thread_count_; }
+
+	/**
+	 * set worker thread count
+	 * @param [in] count thread count. 0 means hardware concurrency
+	 * @note worker threads are recreated when the count is changed
+	 */
+	void set_thread_count(unsigned int count);
+
+private:
+	int tile_size_;
+	unsigned int thread_count_;
+	TileFunction tile_finished_;
+	umbase::UMThreadPoolPtr thread_pool_;
+#if !defined(WITH_EMSCRIPTEN)
+	std::atomic<bool> is_cancelled_;
+#else
+	bool is_cancelled_;
+#endif
+};
+
+} // umrt
@@ -12,6 +12,7 @@
 
 #include <memory>
 #include "UMMacro.h"
+#include "UMRenderScheduler.h"
 //#include "UMEvent.h"
 //#include "UMListenerConnector.h"
 
@@ -49,7 +50,8 @@ public:
 	
 	UMRenderer() : 
 		width_(0), 
-		height_(0) {}
+		height_(0),
+		scheduler_(std::make_shared<UMRenderScheduler>()) {}
 	
 	virtual ~UMRenderer() {}
 
@@ -111,9 +113,21 @@ public:
 	 */
 	virtual int height() const { return height_; }
 
+	/**
+	 * get tile scheduler
+	 */
+	UMRenderSchedulerPtr scheduler() { return scheduler_; }
+
+	/**
+	 * cancel rendering
+	 * @note can be called from any thread. init() clears it.
+	 */
+	void cancel() { scheduler_->cancel(); }
+
 protected:
 	int width_;
 	int height_;
+	UMRenderSchedulerPtr scheduler_;
 };
 
 } // umrt
@@ -0,0 +1,132 @@
+/**
+ * @file UMSampler.cpp
+ * random number sampler
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMSampler.h"
+
+namespace
+{
+	const unsigned int prime_list[] = {
+		2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+		59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131
+	};
+	const unsigned int prime_count = sizeof(prime_list) / sizeof(prime_list[0]);
+
+	const double inv_uint_range = 1.0 / 4294967296.0;
+
+	/**
+	 * integer hash (murmur3 finalizer)
+	 */
+	unsigned int hash(unsigned int h)
+	{
+		h ^= h >> 16;
+		h *= 0x85ebca6b;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35;
+		h ^= h >> 16;
+		return h;
+	}
+
+	unsigned int hash(unsigned int a, unsigned int b, unsigned int c)
+	{
+		return hash(hash(hash(a) ^ b) ^ c);
+	}
+
+	/**
+	 * radical inverse of index in base
+	 */
+	double radical_inverse(unsigned int base, unsigned int index)
+	{
+		const double inv_base = 1.0 / base;
+		double inv_base_n = inv_base;
+		double result = 0.0;
+		while (index > 0)
+		{
+			result += (index % base) * inv_base_n;
+			index /= base;
+			inv_base_n *= inv_base;
+		}
+		return result;
+	}
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * constructor
+ */
+UMSampler::UMSampler(SamplerType type, unsigned int seed)
+	: type_(type)
+	, seed_(seed)
+	, pixel_index_(0)
+	, sample_index_(0)
+	, dimension_(0)
+	, x_(123456789)
+	, y_(362436069)
+	, z_(521288629)
+	, w_(88675123)
+{
+	start(0, 0);
+}
+
+/**
+ * start a sample
+ */
+void UMSampler::start(unsigned int pixel_index, unsigned int sample_index)
+{
+	pixel_index_ = pixel_index;
+	sample_index_ = sample_index;
+	dimension_ = 0;
+	// xorshift state must not be all zero. w_ is never zero.
+	x_ = hash(seed_, pixel_index, sample_index);
+	y_ = hash(x_ + 1);
+	z_ = hash(y_ + 1);
+	w_ = hash(z_ + 1) | 1;
+}
+
+/**
+ * xorshift
+ */
+unsigned int UMSampler::next_uint()
+{
+	unsigned int t = x_ ^ (x_ << 11);
+	x_ = y_; y_ = z_; z_ = w_;
+	return w_ = w_ ^ (w_ >> 19) ^ t ^ (t >> 8);
+}
+
+/**
+ * get next value in [0, 1)
+ */
+double UMSampler::next()
+{
+	const unsigned int dimension = dimension_++;
+	if (type_ == eHaltonSampler && dimension < prime_count)
+	{
+		// rotate per pixel to decorrelate neighbors (cranley-patterson)
+		const double offset = hash(seed_ ^ 0x9e3779b9, pixel_index_, dimension) * inv_uint_range;
+		double value = radical_inverse(prime_list[dimension], sample_index_) + offset;
+		if (value >= 1.0) value -= 1.0;
+		return value;
+	}
+	return next_uint() * inv_uint_range;
+}
+
+/**
+ * get next 2d value in [0, 1)
+ */
+UMVec2d UMSampler::next_2d()
+{
+	const double x = next();
+	const double y = next();
+	return UMVec2d(x, y);
+}
+
+} // umrt
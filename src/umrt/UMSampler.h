@@ -0,0 +1,85 @@
+/**
+ * @file UMSampler.h
+ * random number sampler
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMVector.h"
+
+namespace umrt
+{
+
+/**
+ * random number sampler
+ * @note not thread safe. make one for each thread (or pixel).
+ * the values depend only on the seed, the pixel and the sample index,
+ * so a render is reproducible regardless of the thread scheduling.
+ */
+class UMSampler
+{
+	DISALLOW_COPY_AND_ASSIGN(UMSampler);
+public:
+	enum SamplerType {
+		eRandomSampler, //!< xorshift
+		eHaltonSampler, //!< scrambled halton sequence
+	};
+
+	/**
+	 * @param [in] type sampler type
+	 * @param [in] seed seed of the whole render
+	 */
+	explicit UMSampler(SamplerType type = eRandomSampler, unsigned int seed = 0);
+
+	~UMSampler() {}
+
+	/**
+	 * start a sample
+	 * @param [in] pixel_index pixel index
+	 * @param [in] sample_index sample index of the pixel
+	 */
+	void start(unsigned int pixel_index, unsigned int sample_index);
+
+	/**
+	 * get next value in [0, 1)
+	 */
+	double next();
+
+	/**
+	 * get next 2d value in [0, 1)
+	 */
+	UMVec2d next_2d();
+
+	/**
+	 * get sampler type
+	 */
+	SamplerType type() const { return type_; }
+
+	/**
+	 * get seed
+	 */
+	unsigned int seed() const { return seed_; }
+
+private:
+	unsigned int next_uint();
+
+	SamplerType type_;
+	unsigned int seed_;
+	unsigned int pixel_index_;
+	unsigned int sample_index_;
+	unsigned int dimension_;
+	// xorshift state
+	unsigned int x_;
+	unsigned int y_;
+	unsigned int z_;
+	unsigned int w_;
+};
+
+} // umrt
@@ -20,6 +20,7 @@
 #include "UMPrimitive.h"
 #include "UMTriangle.h"
 #include "UMBvh.h"
+#include "UMBvhInstance.h"
 #include "UMSubdivision.h"
 #include "UMSoftwareIO.h"
 
@@ -175,6 +176,34 @@ namespace
 	{
 		return false;
 	}
+
+	/**
+	 * create an instance of the primitives from start_index
+	 */
+	UMBvhInstancePtr create_instance(
+		const UMPrimitiveList& primitive_list,
+		size_t start_index,
+		const UMMat44d& transform)
+	{
+		UMBvhInstancePtr instance(std::make_shared<UMBvhInstance>());
+		instance->mutable_primitive_list().assign(
+			primitive_list.begin() + start_index,
+			primitive_list.end());
+		instance->set_base_transform(transform);
+		instance->set_transform(transform);
+		return instance;
+	}
+
+	/**
+	 * top level bvh build option
+	 */
+	UMBvhBuildOption top_level_option()
+	{
+		UMBvhBuildOption option;
+		// an instance is far more expensive than a triangle
+		option.max_leaf_primitive_count = 1;
+		return option;
+	}
 }
 
 namespace umrt
@@ -185,6 +214,7 @@ namespace umrt
  * constructor
  */
 UMSceneAccess::UMSceneAccess()
+	: transform_frame_(-1)
 {
 	bvh_ = UMBvh::create();
 }
@@ -197,6 +227,8 @@ bool UMSceneAccess::init()
 	mutable_render_primitive_list().clear();
 	mutable_vertex_parameter_list().clear();
 	mutable_primitive_list().clear();
+	instance_list_.clear();
+	instance_mesh_list_.clear();
 	return true;
 }
 
@@ -219,10 +251,18 @@ void UMSceneAccess::add_scene(umdraw::UMScenePtr scene)
 			++mt)
 		{
 			UMMeshPtr mesh = *mt;
+			const size_t start_index = primitive_list().size();
 			create_triangle_and_vertex(
 				mutable_primitive_list(), 
 				mutable_vertex_parameter_list(),
 				mesh);
+			if (primitive_list().size() > start_index)
+			{
+				// vertices are placed with the current transform
+				instance_list_.push_back(
+					create_instance(primitive_list(), start_index, mesh->global_transform()));
+				instance_mesh_list_.push_back(mesh);
+			}
 		}
 	}
 	bool added = true;
@@ -247,11 +287,18 @@ void UMSceneAccess::add_abc_scene(umabc::UMAbcScenePtr scene)
 	if (!scene) return;
 	if (UMAbcObjectPtr root = scene->root_object())
 	{
+		const size_t start_index = primitive_list().size();
 		create_triangle_and_vertex_from_abc(
 			abc_mesh_list_,
 			mutable_primitive_list(), 
 			mutable_vertex_parameter_list(),
 			root);
+		if (primitive_list().size() > start_index)
+		{
+			instance_list_.push_back(
+				create_instance(primitive_list(), start_index, UMMat44d()));
+			instance_mesh_list_.push_back(UMMeshPtr());
+		}
 	}
 	abc_scene_ = scene;
 	bool added = true;
@@ -340,13 +387,22 @@ bool UMSceneAccess::update_bvh()
 	if (!bvh_) return false;
 	if (!scene_) return false;
 
-	UMPrimitiveList::iterator it = mutable_primitive_list().begin();
-	for (; it != mutable_primitive_list().end(); ++it)
+	// bottom level bvhs are built once
+	const int instance_count = static_cast<int>(instance_list_.size());
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < instance_count; ++i)
 	{
-		(*it)->update_box();
+		UMBvhInstancePtr instance = instance_list_[i];
+		if (instance->bvh()->node_list().empty())
+		{
+			instance->build();
+		}
 	}
 
-	if (bvh_->build(mutable_primitive_list()))
+	transform_frame_ = scene_->transform_hierarchy().frame();
+
+	UMPrimitiveList top_level_list(instance_list_.begin(), instance_list_.end());
+	if (bvh_->build(top_level_list, top_level_option()))
 	{
 		mutable_render_primitive_list().clear();
 		mutable_render_primitive_list().push_back(bvh_);
@@ -355,6 +411,82 @@ bool UMSceneAccess::update_bvh()
 	return false;
 }
 
+/** 
+ * refit bvh to deformed meshes
+ */
+bool UMSceneAccess::refit_bvh()
+{
+	if (!bvh_) return false;
+	if (!scene_) return false;
+
+	// deformed vertices are placed with the current transform.
+	// meshes not moved since last update are skipped.
+	const umdraw::UMTransformHierarchy& hierarchy = scene_->transform_hierarchy();
+	const int instance_count = static_cast<int>(instance_list_.size());
+	std::vector<UMBvhInstancePtr> refit_list;
+	refit_list.reserve(instance_count);
+	for (int i = 0; i < instance_count; ++i)
+	{
+		if (UMMeshPtr mesh = instance_mesh_list_[i])
+		{
+			if (!hierarchy.is_deformed_since(mesh, transform_frame_)
+				&& !hierarchy.is_changed_since(mesh, transform_frame_))
+			{
+				continue;
+			}
+			instance_list_[i]->set_transform(mesh->global_transform());
+		}
+		refit_list.push_back(instance_list_[i]);
+	}
+	transform_frame_ = hierarchy.frame();
+
+	const int refit_count = static_cast<int>(refit_list.size());
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < refit_count; ++i)
+	{
+		refit_list[i]->refit();
+	}
+
+	UMPrimitiveList top_level_list(instance_list_.begin(), instance_list_.end());
+	if (bvh_->refit_or_rebuild(top_level_list, top_level_option()))
+	{
+		mutable_render_primitive_list().clear();
+		mutable_render_primitive_list().push_back(bvh_);
+		return true;
+	}
+	return false;
+}
+
+/** 
+ * update bvh to moved mesh nodes
+ */
+bool UMSceneAccess::update_instances()
+{
+	if (!bvh_) return false;
+	if (!scene_) return false;
+
+	const int instance_count = static_cast<int>(instance_list_.size());
+	for (int i = 0; i < instance_count; ++i)
+	{
+		if (UMMeshPtr mesh = instance_mesh_list_[i])
+		{
+			UMBvhInstancePtr instance = instance_list_[i];
+			instance->set_transform(mesh->global_transform());
+			instance->update_box();
+		}
+	}
+	// moved meshes are not refit again by refit_bvh
+	transform_frame_ = scene_->transform_hierarchy().frame();
+
+	UMPrimitiveList top_level_list(instance_list_.begin(), instance_list_.end());
+	if (bvh_->build(top_level_list, top_level_option()))
+	{
+		mutable_render_primitive_list().clear();
+		mutable_render_primitive_list().push_back(bvh_);
+		return true;
+	}
+	return false;
+}
 	
 /** 
  * generate a camera ray
@@ -17,6 +17,7 @@
 #include "UMScene.h"
 #include "UMPrimitive.h"
 #include "UMVertexParameter.h"
+#include "UMBvhInstance.h"
 
 namespace umdraw
 {
@@ -136,10 +137,36 @@ public:
 	 */
 	UMBvhPtr bvh() { return bvh_; }
 
+	/**
+	 * get bvh
+	 */
+	const UMBvhPtr& bvh() const { return bvh_; }
+
 	/**
 	 * update bvh
 	 */
 	bool update_bvh();
+
+	/**
+	 * refit bvh to deformed meshes
+	 * @note keeps the trees unless they are degraded. 
+	 * meshes not moved since last update are skipped.
+	 * call update_bvh instead when primitives are added or removed.
+	 */
+	bool refit_bvh();
+
+	/**
+	 * update bvh to moved mesh nodes
+	 * @note only the top level bvh is rebuilt. 
+	 * for rigid transforms. mesh vertices need not be updated.
+	 * meshes deformed before this are not refit by a later refit_bvh.
+	 */
+	bool update_instances();
+
+	/**
+	 * get bvh instance list. one instance for each mesh.
+	 */
+	const UMBvhInstanceList& instance_list() const { return instance_list_; }
 	
 	
 	/** 
@@ -159,6 +186,13 @@ private:
 	UMPrimitiveList primitive_list_;
 	UMVertexParameterList vertex_parameter_list_;
 	UMBvhPtr bvh_;
+	
+	/// bottom level bvh of each mesh
+	UMBvhInstanceList instance_list_;
+	/// mesh of each instance. empty for abc meshes
+	umdraw::UMMeshList instance_mesh_list_;
+	/// transform hierarchy frame of last bvh update
+	int transform_frame_;
 };
 
 } // umrt
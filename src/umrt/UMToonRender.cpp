@@ -15,6 +15,8 @@
 #include "UMScene.h"
 #include "UMVector.h"
 #include "UMStringUtil.h"
+#include "UMIntersection.h"
+#include "UMSampler.h"
 
 #include "UMPathTracer.h"
 
@@ -28,22 +30,6 @@ namespace
 	using namespace umrt;
 	using namespace umdraw;
 	
-	unsigned int xor128()
-	{
-		static unsigned int x = 123456789;
-		static unsigned int y = 362436069;
-		static unsigned int z = 521288629;
-		static unsigned int w = 88675123;
-		unsigned int t = x ^ (x << 11);
-		x = y; y = z; z = w;
-		return w = w ^ (w >> 19) ^ t ^ (t >> 8);
-	}
-
-	double xor128d()
-	{
-		return xor128() / 4294967296.0;
-	}
-
 	// definition
 	UMVec3d trace(const UMRay& ray, UMSceneAccessPtr scene_access, UMShaderParameter& parameter);
 
@@ -61,50 +47,10 @@ namespace
 		return normal * origin.dot(normal) * 2.0 - origin;
 	}
 	
-	class UMIntersection
-	{
-		DISALLOW_COPY_AND_ASSIGN(UMIntersection);
-		public:
-			UMIntersection() : 
-				closest_distance(std::numeric_limits<double>::max())
-			{}
-
-			double closest_distance;
-			UMPrimitivePtr closest_primitive;
-			UMShaderParameter closest_parameter;
-	};
-
-	bool intersect(
-		const UMRay& ray, 
-		UMSceneAccessPtr scene_access, 
-		UMShaderParameter& parameter, 
-		UMIntersection& intersection)
-	{
-		UMPrimitiveList::const_iterator it = scene_access->render_primitive_list().begin();
-		for (int i = 0; it != scene_access->render_primitive_list().end(); ++it, ++i)
-		{
-			UMPrimitivePtr primitive = *it;
-			if (primitive->intersects(ray, parameter))
-			{
-				if (parameter.distance < intersection.closest_distance) 
-				{
-					intersection.closest_distance = parameter.distance;
-					intersection.closest_primitive = primitive;
-					intersection.closest_parameter = parameter;
-				}
-			}
-		}
-		if (intersection.closest_primitive)
-		{
-			return true;
-		}
-		return false;
-	}
-
 	/**
 	 * shading function
 	 */
-	UMVec3d shade(const UMPrimitivePtr current, const UMRay& ray, UMSceneAccessPtr scene_access, UMShaderParameter& parameter)
+	UMVec3d shade(const UMRay& ray, UMSceneAccessPtr scene_access, UMShaderParameter& parameter)
 	{
 		umdraw::UMScenePtr scene = scene_access->scene();
 		UMVec3d normal = parameter.normal;
@@ -118,9 +64,7 @@ namespace
 
 			// shadow ray
 			UMRay shadow_ray(parameter.intersect_point + normal * 0.00001, light_dir_from_point);
-			UMIntersection intersection;
-			UMShaderParameter shadow_parameter;
-			//if (!intersect(shadow_ray, scene_access, shadow_parameter, intersection))
+			//if (!UMIntersection::intersect(shadow_ray, *scene_access))
 			{
 				radiance += parameter.color * std::max(0.0, normal.dot(L));
 			}
@@ -148,18 +92,12 @@ namespace
 	{
 		umdraw::UMScenePtr scene = scene_access->scene();
 		UMIntersection intersection;
-		//if (parameter.bounce == 1)
-		{
-			if (!intersect(ray, scene_access, parameter, intersection)){
-				return scene->background_color();
-			}
+		if (!UMIntersection::intersect(ray, *scene_access, intersection)){
+			return scene->background_color();
 		}
-
-		if (intersection.closest_primitive)
-		{
-			return shade(intersection.closest_primitive, ray, scene_access, intersection.closest_parameter);
-		}
-		return scene->background_color();
+		// caller can see the hit
+		parameter = intersection.closest_parameter;
+		return shade(ray, scene_access, intersection.closest_parameter);
 	}
 
 	/**
@@ -210,12 +148,14 @@ namespace
 		int far_from_sample_rays = 0;
 		UMVec3d gradient_normals[number_of_stencil_ray];
 		const double distance_threshold = 3.0;
+		// stencil rays are coherent
+		UMIntersection intersections[number_of_stencil_ray];
+		bool hits[number_of_stencil_ray];
+		UMIntersection::intersect(&rays[0], number_of_stencil_ray, *scene_access, intersections, hits);
 		for (int i = 0; i < number_of_stencil_ray; ++i)
 		{
-			UMRay& ray = rays.at(i);
-			UMIntersection intersection;
-			UMShaderParameter shader_parameter;
-			if (intersect(ray, scene_access, shader_parameter, intersection))
+			const UMIntersection& intersection = intersections[i];
+			if (hits[i])
 			{
 				int material_id = intersection.closest_parameter.material->id();
 				if (sample_material != material_id)
@@ -303,11 +243,12 @@ namespace umrt
 class UMToonRender::Impl
 {
 public:
-	Impl(int width, int height) 
+	Impl(int width, int height, UMRenderSchedulerPtr scheduler) 
 		:  current_x_(0)
 		, current_y_(0)
 		, width_(width)
 		, height_(height)
+		, scheduler_(scheduler)
 	{}
 
 	virtual ~Impl()
@@ -338,6 +279,7 @@ public:
 	{
 		current_x_ = 0;
 		current_y_ = 0;
+		scheduler_->reset();
 		return true;
 	}
 
@@ -347,11 +289,16 @@ public:
 	}
 
 private:
+	void render_tile(const UMRenderTile& tile, UMSceneAccessPtr scene_access, UMRenderParameter& parameter);
+
+	void progress_render_tile(const UMRenderTile& tile, UMSceneAccessPtr scene_access, UMRenderParameter& parameter);
+
 	// for progress render
 	int current_x_;
 	int current_y_;
 	int width_;
 	int height_;
+	UMRenderSchedulerPtr scheduler_;
 };
 
 bool UMToonRender::Impl::render(UMSceneAccessPtr scene_access, UMRenderParameter& parameter)
@@ -361,20 +308,32 @@ bool UMToonRender::Impl::render(UMSceneAccessPtr scene_access, UMRenderParameter
 	if (width_ == 0 || height_ == 0) return false;
 	if (!scene->camera()) return false;
 	
-	const int sample_count = parameter.super_sampling_count().x * parameter.super_sampling_count().y;
-	const double inv_sample_count = 1.0 / sample_count;
-
-	UMImage::ImageBuffer& dst_buffer = parameter.output_image()->mutable_list();
-	
+	scheduler_->reset();
 	UMPathTracer path_tracer;
 	path_tracer.set_width(width_);
 	path_tracer.set_height(height_);
 	for (int i = 0; i < 20; ++i)
 	{
+		if (scheduler_->is_cancelled()) return false;
 		path_tracer.progress_render(scene_access, parameter);
 	}
 
-	for (int y = 0; y < height_; ++y)
+	return scheduler_->run(0, 0, width_, height_, [&](const UMRenderTile& tile) {
+		render_tile(tile, scene_access, parameter);
+	});
+}
+
+/**
+ * render a tile
+ */
+void UMToonRender::Impl::render_tile(const UMRenderTile& tile, UMSceneAccessPtr scene_access, UMRenderParameter& parameter)
+{
+	const int sample_count = parameter.super_sampling_count().x * parameter.super_sampling_count().y;
+	const double inv_sample_count = 1.0 / sample_count;
+
+	UMImage::ImageBuffer& dst_buffer = parameter.output_image()->mutable_list();
+
+	for (int y = tile.y; y < tile.y + tile.height; ++y)
 	{
 		//if (sample_count > 1)
 		//{
@@ -383,7 +342,8 @@ bool UMToonRender::Impl::render(UMSceneAccessPtr scene_access, UMRenderParameter
 		//		const int pos = width_ * y + x;
 		//		for (int s = 0; s < sample_count; ++s)
 		//		{
-		//			UMVec2d sample_point(xor128d(), xor128d());
+		//			sampler.start(pos, s);
+		//			UMVec2d sample_point = sampler.next_2d();
 		//			sample_point.x += x;
 		//			sample_point.y += y;
 		//			UMRay ray;
@@ -397,37 +357,53 @@ bool UMToonRender::Impl::render(UMSceneAccessPtr scene_access, UMRenderParameter
 		//}
 		//else
 		{
-			for (int x = 0; x < width_; ++x)
+			const int packet_size = UMIntersection::packet_size;
+			for (int x = tile.x; x < tile.x + tile.width; x += packet_size)
 			{
-				const int pos = width_ * y + x;
-				UMVec2d pixel(x, y);
-				UMRay ray;
-				scene_access->generate_ray(ray, pixel);
-				UMShaderParameter shader_parameter;
-				UMVec3d color = trace(ray, scene_access, shader_parameter);
-				//bool is_hit = shader_parameter.intersect_point != UMVec3d(0,0,0);
-				//if (is_hit)
-				//{
-				//	// hit camera ray.
-				//	dst_buffer[pos] = UMVec4d(color, 0.2);
-				//}
-				
-				double area = trace_cone(pixel, ray, scene_access, shader_parameter);
-				if (area > 0)
+				// camera rays of neighbor pixels are traced as a packet
+				const int count = std::min(packet_size, tile.x + tile.width - x);
+				UMRay rays[packet_size];
+				for (int k = 0; k < count; ++k)
 				{
-					//if (is_hit)
+					scene_access->generate_ray(rays[k], UMVec2d(x + k, y));
+				}
+				UMIntersection intersections[packet_size];
+				bool hits[packet_size];
+				UMIntersection::intersect(rays, count, *scene_access, intersections, hits);
+
+				for (int k = 0; k < count; ++k)
+				{
+					const int pos = width_ * y + x + k;
+					UMVec2d pixel(x + k, y);
+					UMShaderParameter shader_parameter;
+					if (hits[k])
 					{
-						dst_buffer[pos] = dst_buffer[pos].multiply(UMVec4d(UMVec3d(umbase::um_clip(1.0 - area)) , 1.0));
+						shader_parameter = intersections[k].closest_parameter;
 					}
-					////else
+					//bool is_hit = shader_parameter.intersect_point != UMVec3d(0,0,0);
+					//if (is_hit)
 					//{
-					//	dst_buffer[pos] = UMVec4d(UMVec3d(umbase::um_clip(1.0 - area)) , 1.0);
+					//	// hit camera ray.
+					//	dst_buffer[pos] = UMVec4d(shade(rays[k], scene_access, shader_parameter), 0.2);
 					//}
+					
+					double area = trace_cone(pixel, rays[k], scene_access, shader_parameter);
+					if (area > 0)
+					{
+						//if (is_hit)
+						{
+							dst_buffer[pos] = dst_buffer[pos].multiply(UMVec4d(UMVec3d(umbase::um_clip(1.0 - area)) , 1.0));
+						}
+						////else
+						//{
+						//	dst_buffer[pos] = UMVec4d(UMVec3d(umbase::um_clip(1.0 - area)) , 1.0);
+						//}
+					}
 				}
 			}
 		}
 	}
-	return true;
+	parameter.output_image()->add_dirty_rect(UMVec4ui(tile.x, tile.y, tile.x + tile.width, tile.y + tile.height));
 }
 
 bool UMToonRender::Impl::progress_render(UMSceneAccessPtr scene_access, UMRenderParameter& parameter)
@@ -439,20 +415,38 @@ bool UMToonRender::Impl::progress_render(UMSceneAccessPtr scene_access, UMRender
 	
 	const int ystep = 10;
 	
+	// end
+	if (current_y_ >= height_) { return false; }
+
+	const int rows = std::min(ystep, height_ - current_y_);
+	if (!scheduler_->run(0, current_y_, width_, rows, [&](const UMRenderTile& tile) {
+			progress_render_tile(tile, scene_access, parameter);
+		}))
+	{
+		return false;
+	}
+	current_y_ += rows;
+	return true;
+}
+
+/**
+ * progressive render a tile
+ */
+void UMToonRender::Impl::progress_render_tile(const UMRenderTile& tile, UMSceneAccessPtr scene_access, UMRenderParameter& parameter)
+{
 	const int sample_count = parameter.super_sampling_count().x * parameter.super_sampling_count().y;
 	const double inv_sample_count = 1.0 / sample_count;
+	UMSampler sampler(parameter.sampler_type(), parameter.seed());
 	
-	for (int& y = current_y_, rows = (y + ystep); y < rows; ++y)
+	for (int y = tile.y; y < tile.y + tile.height; ++y)
 	{
-		// end
-		if (y == height_) { return false; }
-		
-		for (int x = 0; x < width_; ++x)
+		for (int x = tile.x; x < tile.x + tile.width; ++x)
 		{
 			const int pos = width_ * y + x;
 			for (int s = 0; s < sample_count; ++s)
 			{
-				UMVec2d sample_point(xor128d(), xor128d());
+				sampler.start(pos, s);
+				UMVec2d sample_point = sampler.next_2d();
 				sample_point.x += x;
 				sample_point.y += y;
 				UMRay ray;
@@ -464,15 +458,14 @@ bool UMToonRender::Impl::progress_render(UMSceneAccessPtr scene_access, UMRender
 			parameter.output_image()->mutable_list()[pos] *= inv_sample_count;
 		}
 	}
-	
-	return true;
+	parameter.output_image()->add_dirty_rect(UMVec4ui(tile.x, tile.y, tile.x + tile.width, tile.y + tile.height));
 }
 
 /**
  * constructor
  */
 UMToonRender::UMToonRender()
-	: impl_(new UMToonRender::Impl(width(), height()))
+	: impl_(new UMToonRender::Impl(width(), height(), scheduler()))
 {}
 
 /**
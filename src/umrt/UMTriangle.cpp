@@ -10,6 +10,7 @@
  */
 #include "UMTriangle.h"
 #include "UMVector.h"
+#include <algorithm>
 
 #ifdef WITH_ALEMBIC
 	#include "UMAbcMesh.h"
@@ -171,126 +172,62 @@ bool UMTriangle::intersects(
  */
 bool UMTriangle::intersects(const UMRay& ray, UMShaderParameter& parameter) const
 {
-	UMMeshPtr me = mesh();
-	if (me)
+	UMVec3d v0, v1, v2;
+	if (vertices(v0, v1, v2))
 	{
-		// 3 points
-		const UMVec3d& v0 = me->vertex_list()[vertex_index_.x];
-		const UMVec3d& v1 = me->vertex_list()[vertex_index_.y];
-		const UMVec3d& v2 = me->vertex_list()[vertex_index_.z];
-
 		if (intersects(v0, v1, v2, ray, parameter))
 		{
-			parameter.face_index = face_index_;
-
-			const UMVec3d& n0 = me->normal_list()[vertex_index_.x];
-			const UMVec3d& n1 = me->normal_list()[vertex_index_.y];
-			const UMVec3d& n2 = me->normal_list()[vertex_index_.z];
-			parameter.normal = (n0 * parameter.uvw.x + n1 * parameter.uvw.y + n2 * parameter.uvw.z).normalized();
-			parameter.face_normal = (v1-v0).cross(v2-v0).normalized();
-
-			if (UMMaterialPtr material = me->material_from_face_index(face_index_))
-			{
-				parameter.material = material;
-
-				const UMVec4d& diffuse = material->diffuse();
-				parameter.color.x = diffuse.x;
-				parameter.color.y = diffuse.y;
-				parameter.color.z = diffuse.z;
-				parameter.emissive = material->emissive().xyz() * material->emissive_factor();
-				if (!me->uv_list().empty() && !material->texture_list().empty()) {
-					// uv
-					const int base = face_index_ * 3;
-					const UMVec2d& uv0 = me->uv_list()[base + 0];
-					const UMVec2d& uv1 = me->uv_list()[base + 1];
-					const UMVec2d& uv2 = me->uv_list()[base + 2];
-					UMVec2d uv = UMVec2d(
-						uv0 * parameter.uvw.x +
-						uv1 * parameter.uvw.y +
-						uv2 * parameter.uvw.z);
-					uv.x = umbase::um_clip(uv.x);
-					uv.y = umbase::um_clip(uv.y);
-					UMImagePtr texture = material->texture_list()[0];
-					const int x = static_cast<int>(texture->width() * uv.x);
-					const int y = static_cast<int>(texture->height() * uv.y);
-					const int pixel = y * texture->width() + x;
-					const UMVec4d& pixel_color = texture->list()[pixel];
-					parameter.uv = uv;
-					parameter.color.x = pixel_color.x;
-					parameter.color.y = pixel_color.y;
-					parameter.color.z = pixel_color.z;
-				}
-			}
+			shade(parameter);
 			return true;
 		}
 	}
-#ifdef WITH_ALEMBIC
-	if (umabc::UMAbcMeshPtr me = abc_mesh())
-	{
-		// 3 points
-		const Imath::V3f& v0 = me->vertex()->get()[vertex_index_.x];
-		const Imath::V3f& v1 = me->vertex()->get()[vertex_index_.y];
-		const Imath::V3f& v2 = me->vertex()->get()[vertex_index_.z];
+	return false;
+}
 
-		if (intersects(
-			UMVec3d(v0.x, v0.y, v0.z), 
-			UMVec3d(v1.x, v1.y, v1.z), 
-			UMVec3d(v2.x, v2.y, v2.z), ray, parameter))
-		{
-			const Imath::V3f& in0 = me->normals()[vertex_index_.x];
-			const Imath::V3f& in1 = me->normals()[vertex_index_.y];
-			const Imath::V3f& in2 = me->normals()[vertex_index_.z];
-			const UMVec3d n0(in0.x, in0.y, in0.z);
-			const UMVec3d n1(in1.x, in1.y, in1.z);
-			const UMVec3d n2(in2.x, in2.y, in2.z);
-			parameter.normal = (n0 * parameter.uvw.x + n1 * parameter.uvw.y + n2 * parameter.uvw.z).normalized();
-			
-			if (UMMaterialPtr material = me->material_from_face_index(face_index_))
-			{
-				parameter.material = material;
+/**
+ * ray triangle intersection
+ */
+bool UMTriangle::intersects(const UMRay& ray) const
+{
+	UMVec3d v0, v1, v2;
+	if (vertices(v0, v1, v2))
+	{
+		return intersects(v0, v1, v2, ray);
+	}
+	return false;
+}
 
-				const UMVec4d& diffuse = material->diffuse();
-				parameter.color.x = diffuse.x;
-				parameter.color.y = diffuse.y;
-				parameter.color.z = diffuse.z;
-				parameter.emissive = material->emissive().xyz() * material->emissive_factor();
-				if (me->uv().getVals()->get() && !material->texture_list().empty()) {
-					// uv
-					const int base = face_index_ * 3;
-					const Imath::V2f& uv0 = me->uv().getVals()->get()[base + 0];
-					const Imath::V2f& uv1 = me->uv().getVals()->get()[base + 2];
-					const Imath::V2f& uv2 = me->uv().getVals()->get()[base + 1];
-					UMVec2d uv = UMVec2d(
-						UMVec2d(uv0.x, uv0.y) * parameter.uvw.x +
-						UMVec2d(uv1.x, uv1.y) * parameter.uvw.y +
-						UMVec2d(uv2.x, uv2.y) * parameter.uvw.z);
-					uv.x = umbase::um_clip(uv.x);
-					uv.y = umbase::um_clip(1.0f - uv.y);
-					const UMImagePtr texture = material->texture_list()[0];
-					const int x = static_cast<int>(texture->width() * uv.x);
-					const int y = static_cast<int>(texture->height() * uv.y);
-					const int pixel = y * texture->width() + x;
-					if (pixel < texture->list().size())
-					{
-						const UMVec4d& pixel_color = texture->list()[pixel];
-						parameter.uv = uv;
-						parameter.color.x = pixel_color.x;
-						parameter.color.y = pixel_color.y;
-						parameter.color.z = pixel_color.z;
-					}
-				}
-			}
-			return true;
-		}
+/**
+ * get 3 points
+ */
+bool UMTriangle::vertices(UMVec3d& v0, UMVec3d& v1, UMVec3d& v2) const
+{
+	if (UMMeshPtr me = mesh())
+	{
+		v0 = me->vertex_list()[vertex_index_.x];
+		v1 = me->vertex_list()[vertex_index_.y];
+		v2 = me->vertex_list()[vertex_index_.z];
+		return true;
+	}
+#ifdef WITH_ALEMBIC
+	else if (umabc::UMAbcMeshPtr me = abc_mesh())
+	{
+		const Imath::V3f& iv0 = me->vertex()->get()[vertex_index_.x];
+		const Imath::V3f& iv1 = me->vertex()->get()[vertex_index_.y];
+		const Imath::V3f& iv2 = me->vertex()->get()[vertex_index_.z];
+		v0 = UMVec3d(iv0.x, iv0.y, iv0.z);
+		v1 = UMVec3d(iv1.x, iv1.y, iv1.z);
+		v2 = UMVec3d(iv2.x, iv2.y, iv2.z);
+		return true;
 	}
 #endif
 	return false;
 }
 
 /**
- * ray triangle intersection
+ * fill shading parameters at the hit point
  */
-bool UMTriangle::intersects(const UMRay& ray) const
+void UMTriangle::shade(UMShaderParameter& parameter) const
 {
 	if (UMMeshPtr me = mesh())
 	{
@@ -298,23 +235,96 @@ bool UMTriangle::intersects(const UMRay& ray) const
 		const UMVec3d& v0 = me->vertex_list()[vertex_index_.x];
 		const UMVec3d& v1 = me->vertex_list()[vertex_index_.y];
 		const UMVec3d& v2 = me->vertex_list()[vertex_index_.z];
-		return intersects(v0, v1, v2, ray);
+
+		parameter.face_index = face_index_;
+
+		const UMVec3d& n0 = me->normal_list()[vertex_index_.x];
+		const UMVec3d& n1 = me->normal_list()[vertex_index_.y];
+		const UMVec3d& n2 = me->normal_list()[vertex_index_.z];
+		parameter.normal = (n0 * parameter.uvw.x + n1 * parameter.uvw.y + n2 * parameter.uvw.z).normalized();
+		parameter.face_normal = (v1-v0).cross(v2-v0).normalized();
+
+		if (UMMaterialPtr material = me->material_from_face_index(face_index_))
+		{
+			parameter.material = material;
+
+			const UMVec4d& diffuse = material->diffuse();
+			parameter.color.x = diffuse.x;
+			parameter.color.y = diffuse.y;
+			parameter.color.z = diffuse.z;
+			parameter.emissive = material->emissive().xyz() * material->emissive_factor();
+			if (!me->uv_list().empty() && !material->texture_list().empty()) {
+				// uv
+				const int base = face_index_ * 3;
+				const UMVec2d& uv0 = me->uv_list()[base + 0];
+				const UMVec2d& uv1 = me->uv_list()[base + 1];
+				const UMVec2d& uv2 = me->uv_list()[base + 2];
+				UMVec2d uv = UMVec2d(
+					uv0 * parameter.uvw.x +
+					uv1 * parameter.uvw.y +
+					uv2 * parameter.uvw.z);
+				uv.x = umbase::um_clip(uv.x);
+				uv.y = umbase::um_clip(uv.y);
+				UMImagePtr texture = material->texture_list()[0];
+				// uv 1.0 is the last pixel
+				const int x = (std::min)(static_cast<int>(texture->width() * uv.x), texture->width() - 1);
+				const int y = (std::min)(static_cast<int>(texture->height() * uv.y), texture->height() - 1);
+				const UMVec4d pixel_color = texture->pixel(x, y);
+				parameter.uv = uv;
+				parameter.color.x = pixel_color.x;
+				parameter.color.y = pixel_color.y;
+				parameter.color.z = pixel_color.z;
+			}
+		}
+		return;
 	}
 #ifdef WITH_ALEMBIC
-	else if (umabc::UMAbcMeshPtr me = abc_mesh())
+	if (umabc::UMAbcMeshPtr me = abc_mesh())
 	{
-		// 3 points
-		const Imath::V3f& v0 = me->vertex()->get()[vertex_index_.x];
-		const Imath::V3f& v1 = me->vertex()->get()[vertex_index_.y];
-		const Imath::V3f& v2 = me->vertex()->get()[vertex_index_.z];
-		return intersects(
-			UMVec3d(v0.x, v0.y, v0.z), 
-			UMVec3d(v1.x, v1.y, v1.z), 
-			UMVec3d(v2.x, v2.y, v2.z), 
-			ray);
+		const Imath::V3f& in0 = me->normals()[vertex_index_.x];
+		const Imath::V3f& in1 = me->normals()[vertex_index_.y];
+		const Imath::V3f& in2 = me->normals()[vertex_index_.z];
+		const UMVec3d n0(in0.x, in0.y, in0.z);
+		const UMVec3d n1(in1.x, in1.y, in1.z);
+		const UMVec3d n2(in2.x, in2.y, in2.z);
+		parameter.normal = (n0 * parameter.uvw.x + n1 * parameter.uvw.y + n2 * parameter.uvw.z).normalized();
+		
+		if (UMMaterialPtr material = me->material_from_face_index(face_index_))
+		{
+			parameter.material = material;
+
+			const UMVec4d& diffuse = material->diffuse();
+			parameter.color.x = diffuse.x;
+			parameter.color.y = diffuse.y;
+			parameter.color.z = diffuse.z;
+			parameter.emissive = material->emissive().xyz() * material->emissive_factor();
+			if (me->uv().getVals()->get() && !material->texture_list().empty()) {
+				// uv
+				const int base = face_index_ * 3;
+				const Imath::V2f& uv0 = me->uv().getVals()->get()[base + 0];
+				const Imath::V2f& uv1 = me->uv().getVals()->get()[base + 2];
+				const Imath::V2f& uv2 = me->uv().getVals()->get()[base + 1];
+				UMVec2d uv = UMVec2d(
+					UMVec2d(uv0.x, uv0.y) * parameter.uvw.x +
+					UMVec2d(uv1.x, uv1.y) * parameter.uvw.y +
+					UMVec2d(uv2.x, uv2.y) * parameter.uvw.z);
+				uv.x = umbase::um_clip(uv.x);
+				uv.y = umbase::um_clip(1.0f - uv.y);
+				const UMImagePtr texture = material->texture_list()[0];
+				const int x = static_cast<int>(texture->width() * uv.x);
+				const int y = static_cast<int>(texture->height() * uv.y);
+				if (x < texture->width() && y < texture->height())
+				{
+					const UMVec4d pixel_color = texture->pixel(x, y);
+					parameter.uv = uv;
+					parameter.color.x = pixel_color.x;
+					parameter.color.y = pixel_color.y;
+					parameter.color.z = pixel_color.z;
+				}
+			}
+		}
 	}
 #endif
-	return false;
 }
 
 /**
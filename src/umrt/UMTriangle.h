@@ -97,6 +97,21 @@ public:
 	 */
 	virtual bool intersects(const UMRay& ray) const;
 	
+	/**
+	 * get 3 points
+	 * @param [out] v0 vertex 1
+	 * @param [out] v1 vertex 2
+	 * @param [out] v2 vertex 3
+	 * @retval success or fail
+	 */
+	bool vertices(UMVec3d& v0, UMVec3d& v1, UMVec3d& v2) const;
+
+	/**
+	 * fill shading parameters at the hit point
+	 * @param [in,out] parameter shading parameters. uvw must be set.
+	 */
+	void shade(UMShaderParameter& parameter) const;
+
 	/**
 	 * get box
 	 */
@@ -0,0 +1,896 @@
+/**
+ * @file UMTriangleSoup.cpp
+ * packed triangles for bvh leaves
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMTriangleSoup.h"
+#include "UMRay.h"
+#include "UMShaderParameter.h"
+#include <math.h>
+
+#if !defined(WITH_EMSCRIPTEN) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define UM_TRIANGLE_SOUP_SSE
+	#include <emmintrin.h>
+#endif
+
+#if defined(UM_TRIANGLE_SOUP_SSE) && defined(__AVX__)
+	#define UM_TRIANGLE_SOUP_AVX
+	#include <immintrin.h>
+#endif
+
+namespace
+{
+	using namespace umrt;
+
+	// triangles are loaded 8 at a time at most
+	const unsigned int padding_count = 7;
+
+	/**
+	 * vertex arrays in the permuted axes of a ray
+	 * @param [out] dst x, y, z of vertex 0, 1, 2 in kx, ky, kz order
+	 */
+	template <class T>
+	void permute_soa(const T* dst[9], const T* const soa[9], int kx, int ky, int kz)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			dst[i * 3 + 0] = soa[i * 3 + kx];
+			dst[i * 3 + 1] = soa[i * 3 + ky];
+			dst[i * 3 + 2] = soa[i * 3 + kz];
+		}
+	}
+
+	/**
+	 * test 1 triangle (watertight, front face only)
+	 * @param [in] soa permuted vertex arrays
+	 * @param [in] origin permuted ray origin
+	 */
+	template <class T>
+	bool intersect1(
+		const T* const soa[9],
+		unsigned int index,
+		const T origin[3],
+		const T shear[3],
+		T tmin,
+		T tmax,
+		T& t,
+		T& u,
+		T& v)
+	{
+		// vertices relative to the ray origin
+		const T akx = soa[0][index] - origin[0], aky = soa[1][index] - origin[1], akz = soa[2][index] - origin[2];
+		const T bkx = soa[3][index] - origin[0], bky = soa[4][index] - origin[1], bkz = soa[5][index] - origin[2];
+		const T ckx = soa[6][index] - origin[0], cky = soa[7][index] - origin[1], ckz = soa[8][index] - origin[2];
+
+		// shear onto the ray plane
+		const T ax = akx - shear[0] * akz, ay = aky - shear[1] * akz;
+		const T bx = bkx - shear[0] * bkz, by = bky - shear[1] * bkz;
+		const T cx = ckx - shear[0] * ckz, cy = cky - shear[1] * ckz;
+
+		// edge functions. a shared edge gives exactly negated values, so no ray passes between.
+		const T eu = cx * by - cy * bx;
+		const T ev = ax * cy - ay * cx;
+		const T ew = bx * ay - by * ax;
+		// back face or outside
+		if (eu < 0 || ev < 0 || ew < 0) return false;
+		const T det = eu + ev + ew;
+		// parallel or degenerate
+		if (!(det > 0)) return false;
+
+		const T distance = eu * (shear[2] * akz) + ev * (shear[2] * bkz) + ew * (shear[2] * ckz);
+		const T inv_det = 1 / det;
+		t = distance * inv_det;
+		u = ev * inv_det;
+		v = ew * inv_det;
+		return t > tmin && t < tmax;
+	}
+
+	/**
+	 * closest hit against triangles [start, start + count)
+	 */
+	template <class T>
+	bool intersect_range(
+		const T* const soa[9],
+		const UMTriangleSoupRayT<T>& ray,
+		unsigned int start,
+		unsigned int count,
+		T& closest_distance,
+		unsigned int& hit_index,
+		T& hit_u,
+		T& hit_v)
+	{
+		const T* psoa[9];
+		permute_soa(psoa, soa, ray.kx, ray.ky, ray.kz);
+		const T origin[3] = { ray.origin[ray.kx], ray.origin[ray.ky], ray.origin[ray.kz] };
+		bool hit = false;
+		for (unsigned int i = start, end = start + count; i < end; ++i)
+		{
+			T t, u, v;
+			if (intersect1(psoa, i, origin, ray.shear, ray.tmin, closest_distance, t, u, v))
+			{
+				closest_distance = t;
+				hit_index = i;
+				hit_u = u;
+				hit_v = v;
+				hit = true;
+			}
+		}
+		return hit;
+	}
+
+	/**
+	 * any hit against triangles [start, start + count)
+	 */
+	template <class T>
+	bool intersect_range_any(
+		const T* const soa[9],
+		const UMTriangleSoupRayT<T>& ray,
+		unsigned int start,
+		unsigned int count,
+		T tmax)
+	{
+		const T* psoa[9];
+		permute_soa(psoa, soa, ray.kx, ray.ky, ray.kz);
+		const T origin[3] = { ray.origin[ray.kx], ray.origin[ray.ky], ray.origin[ray.kz] };
+		for (unsigned int i = start, end = start + count; i < end; ++i)
+		{
+			T t, u, v;
+			if (intersect1(psoa, i, origin, ray.shear, ray.tmin, tmax, t, u, v)) return true;
+		}
+		return false;
+	}
+
+	/**
+	 * a lane of a packet as a ray of scalar type T
+	 */
+	template <class T>
+	UMTriangleSoupRayT<T> lane_ray(const UMTriangleSoupRayPacket& packet, int lane)
+	{
+		UMTriangleSoupRayT<T> ray;
+		for (int i = 0; i < 3; ++i)
+		{
+			ray.origin[i] = packet.origin[i][lane];
+			ray.direction[i] = packet.direction[i][lane];
+		}
+		ray.tmin = packet.tmin[lane];
+		ray.update_shear();
+		return ray;
+	}
+
+	/**
+	 * closest packet hit lane by lane
+	 */
+	template <class T>
+	int intersect_range_packet(
+		const T* const soa[9],
+		const UMTriangleSoupRayPacket& packet,
+		unsigned int start,
+		unsigned int count,
+		int active_mask,
+		float closest_distance[],
+		unsigned int hit_index[],
+		float hit_u[],
+		float hit_v[])
+	{
+		int hit_mask = 0;
+		for (int k = 0; k < UMTriangleSoupRayPacket::packet_size; ++k)
+		{
+			if (!(active_mask & (1 << k))) continue;
+			const UMTriangleSoupRayT<T> ray = lane_ray<T>(packet, k);
+			T closest = closest_distance[k];
+			T u = 0, v = 0;
+			if (intersect_range(soa, ray, start, count, closest, hit_index[k], u, v))
+			{
+				closest_distance[k] = static_cast<float>(closest);
+				hit_u[k] = static_cast<float>(u);
+				hit_v[k] = static_cast<float>(v);
+				hit_mask |= (1 << k);
+			}
+		}
+		return hit_mask;
+	}
+
+	/**
+	 * any packet hit lane by lane
+	 */
+	template <class T>
+	int intersect_range_packet_any(
+		const T* const soa[9],
+		const UMTriangleSoupRayPacket& packet,
+		unsigned int start,
+		unsigned int count,
+		int active_mask,
+		const float tmax[])
+	{
+		int hit_mask = 0;
+		for (int k = 0; k < UMTriangleSoupRayPacket::packet_size; ++k)
+		{
+			if (!(active_mask & (1 << k))) continue;
+			if (intersect_range_any(soa, lane_ray<T>(packet, k), start, count, static_cast<T>(tmax[k])))
+			{
+				hit_mask |= (1 << k);
+			}
+		}
+		return hit_mask;
+	}
+
+#ifdef UM_TRIANGLE_SOUP_SSE
+	/**
+	 * watertight test for 4 lanes, front face only
+	 * @param [in] a permuted vertex 0 relative to the ray origin
+	 * @param [in] b permuted vertex 1 relative to the ray origin
+	 * @param [in] c permuted vertex 2 relative to the ray origin
+	 * @retval hit mask vector
+	 */
+	__m128 intersect_lanes4(
+		const __m128 a[3],
+		const __m128 b[3],
+		const __m128 c[3],
+		const __m128 shear[3],
+		__m128 tmin,
+		__m128 tmax,
+		__m128& t,
+		__m128& u,
+		__m128& v)
+	{
+		const __m128 ax = _mm_sub_ps(a[0], _mm_mul_ps(shear[0], a[2]));
+		const __m128 ay = _mm_sub_ps(a[1], _mm_mul_ps(shear[1], a[2]));
+		const __m128 bx = _mm_sub_ps(b[0], _mm_mul_ps(shear[0], b[2]));
+		const __m128 by = _mm_sub_ps(b[1], _mm_mul_ps(shear[1], b[2]));
+		const __m128 cx = _mm_sub_ps(c[0], _mm_mul_ps(shear[0], c[2]));
+		const __m128 cy = _mm_sub_ps(c[1], _mm_mul_ps(shear[1], c[2]));
+
+		const __m128 eu = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+		const __m128 ev = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+		const __m128 ew = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+		const __m128 det = _mm_add_ps(_mm_add_ps(eu, ev), ew);
+		const __m128 distance = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(eu, _mm_mul_ps(shear[2], a[2])),
+			_mm_mul_ps(ev, _mm_mul_ps(shear[2], b[2]))),
+			_mm_mul_ps(ew, _mm_mul_ps(shear[2], c[2])));
+		const __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+		t = _mm_mul_ps(distance, inv_det);
+		u = _mm_mul_ps(ev, inv_det);
+		v = _mm_mul_ps(ew, inv_det);
+
+		const __m128 zero = _mm_setzero_ps();
+		__m128 mask = _mm_cmpge_ps(eu, zero);
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(ev, zero));
+		mask = _mm_and_ps(mask, _mm_cmpge_ps(ew, zero));
+		mask = _mm_and_ps(mask, _mm_cmpgt_ps(det, zero));
+		mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, tmin));
+		mask = _mm_and_ps(mask, _mm_cmplt_ps(t, tmax));
+		return mask;
+	}
+
+	/**
+	 * test 4 triangles against 1 ray
+	 * @param [in] soa permuted vertex arrays
+	 * @param [in] o permuted ray origin
+	 * @retval hit mask
+	 */
+	int intersect4(
+		const float* const soa[9],
+		unsigned int index,
+		const __m128 o[3],
+		const __m128 shear[3],
+		__m128 tmin,
+		__m128 tmax,
+		int remain,
+		__m128& t,
+		__m128& u,
+		__m128& v)
+	{
+		__m128 p[9];
+		for (int i = 0; i < 9; ++i)
+		{
+			p[i] = _mm_sub_ps(_mm_loadu_ps(soa[i] + index), o[i % 3]);
+		}
+		__m128 mask = intersect_lanes4(p, p + 3, p + 6, shear, tmin, tmax, t, u, v);
+		// lanes out of the leaf
+		mask = _mm_and_ps(mask, _mm_cmplt_ps(_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f), _mm_set1_ps(static_cast<float>(remain))));
+		return _mm_movemask_ps(mask);
+	}
+
+	/**
+	 * test 1 triangle against 4 rays
+	 * @param [in] soa permuted vertex arrays
+	 * @param [in] o permuted ray origins
+	 * @retval hit mask vector
+	 */
+	__m128 intersect_packet4(
+		const float* const soa[9],
+		unsigned int index,
+		const __m128 o[3],
+		const __m128 shear[3],
+		__m128 tmin,
+		__m128 tmax,
+		__m128& t,
+		__m128& u,
+		__m128& v)
+	{
+		__m128 p[9];
+		for (int i = 0; i < 9; ++i)
+		{
+			p[i] = _mm_sub_ps(_mm_set1_ps(soa[i][index]), o[i % 3]);
+		}
+		return intersect_lanes4(p, p + 3, p + 6, shear, tmin, tmax, t, u, v);
+	}
+
+	/**
+	 * bit mask to lane mask vector
+	 */
+	__m128 lane_mask4(int mask)
+	{
+		const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+		return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask), bits), bits));
+	}
+#endif // UM_TRIANGLE_SOUP_SSE
+
+#ifdef UM_TRIANGLE_SOUP_AVX
+	/**
+	 * test 8 triangles against 1 ray (watertight, front face only)
+	 * @param [in] soa permuted vertex arrays
+	 * @param [in] o permuted ray origin
+	 * @retval hit mask
+	 */
+	int intersect8(
+		const float* const soa[9],
+		unsigned int index,
+		const __m256 o[3],
+		const __m256 shear[3],
+		__m256 tmin,
+		__m256 tmax,
+		int remain,
+		__m256& t,
+		__m256& u,
+		__m256& v)
+	{
+		__m256 p[9];
+		for (int i = 0; i < 9; ++i)
+		{
+			p[i] = _mm256_sub_ps(_mm256_loadu_ps(soa[i] + index), o[i % 3]);
+		}
+		const __m256* a = p;
+		const __m256* b = p + 3;
+		const __m256* c = p + 6;
+		const __m256 ax = _mm256_sub_ps(a[0], _mm256_mul_ps(shear[0], a[2]));
+		const __m256 ay = _mm256_sub_ps(a[1], _mm256_mul_ps(shear[1], a[2]));
+		const __m256 bx = _mm256_sub_ps(b[0], _mm256_mul_ps(shear[0], b[2]));
+		const __m256 by = _mm256_sub_ps(b[1], _mm256_mul_ps(shear[1], b[2]));
+		const __m256 cx = _mm256_sub_ps(c[0], _mm256_mul_ps(shear[0], c[2]));
+		const __m256 cy = _mm256_sub_ps(c[1], _mm256_mul_ps(shear[1], c[2]));
+
+		const __m256 eu = _mm256_sub_ps(_mm256_mul_ps(cx, by), _mm256_mul_ps(cy, bx));
+		const __m256 ev = _mm256_sub_ps(_mm256_mul_ps(ax, cy), _mm256_mul_ps(ay, cx));
+		const __m256 ew = _mm256_sub_ps(_mm256_mul_ps(bx, ay), _mm256_mul_ps(by, ax));
+		const __m256 det = _mm256_add_ps(_mm256_add_ps(eu, ev), ew);
+		const __m256 distance = _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(eu, _mm256_mul_ps(shear[2], a[2])),
+			_mm256_mul_ps(ev, _mm256_mul_ps(shear[2], b[2]))),
+			_mm256_mul_ps(ew, _mm256_mul_ps(shear[2], c[2])));
+		const __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+		t = _mm256_mul_ps(distance, inv_det);
+		u = _mm256_mul_ps(ev, inv_det);
+		v = _mm256_mul_ps(ew, inv_det);
+
+		const __m256 zero = _mm256_setzero_ps();
+		__m256 mask = _mm256_cmp_ps(eu, zero, _CMP_GE_OQ);
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(ev, zero, _CMP_GE_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(ew, zero, _CMP_GE_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(det, zero, _CMP_GT_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, tmin, _CMP_GT_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, tmax, _CMP_LT_OQ));
+		// lanes out of the leaf
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(
+			_mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f),
+			_mm256_set1_ps(static_cast<float>(remain)), _CMP_LT_OQ));
+		return _mm256_movemask_ps(mask);
+	}
+#endif // UM_TRIANGLE_SOUP_AVX
+
+} // anonymouse namespace
+
+namespace umrt
+{
+
+/**
+ * constructor
+ */
+template <class T>
+UMTriangleSoupRayT<T>::UMTriangleSoupRayT(const UMRay& ray)
+	: tmin(static_cast<T>(ray.tmin()))
+{
+	origin[0] = static_cast<T>(ray.origin().x);
+	origin[1] = static_cast<T>(ray.origin().y);
+	origin[2] = static_cast<T>(ray.origin().z);
+	direction[0] = static_cast<T>(ray.direction().x);
+	direction[1] = static_cast<T>(ray.direction().y);
+	direction[2] = static_cast<T>(ray.direction().z);
+	update_shear();
+}
+
+/**
+ * compute axis permutation and shear from direction
+ */
+template <class T>
+void UMTriangleSoupRayT<T>::update_shear()
+{
+	const T x = fabs(direction[0]);
+	const T y = fabs(direction[1]);
+	const T z = fabs(direction[2]);
+	kz = (x > y) ? (x > z ? 0 : 2) : (y > z ? 1 : 2);
+	kx = (kz + 1) % 3;
+	ky = (kx + 1) % 3;
+	// keep winding of triangles
+	if (direction[kz] < 0)
+	{
+		const int k = kx;
+		kx = ky;
+		ky = k;
+	}
+	shear[0] = direction[kx] / direction[kz];
+	shear[1] = direction[ky] / direction[kz];
+	shear[2] = 1 / direction[kz];
+}
+
+/**
+ * constructor
+ */
+UMTriangleSoupRayPacket::UMTriangleSoupRayPacket(const UMRay* rays, int count)
+	: count(count)
+	, kx(0)
+	, ky(1)
+	, kz(2)
+	, is_same_axes(true)
+{
+	for (int i = 0; i < packet_size; ++i)
+	{
+		const UMRay& ray = rays[i < count ? i : count - 1];
+		const UMTriangleSoupRay lane(ray);
+		const UMVec3d& ray_dir = ray.direction();
+		for (int k = 0; k < 3; ++k)
+		{
+			origin[k][i] = lane.origin[k];
+			direction[k][i] = lane.direction[k];
+			shear[k][i] = lane.shear[k];
+		}
+		inv_direction[0][i] = static_cast<float>(1.0 / ray_dir.x);
+		inv_direction[1][i] = static_cast<float>(1.0 / ray_dir.y);
+		inv_direction[2][i] = static_cast<float>(1.0 / ray_dir.z);
+		tmin[i] = lane.tmin;
+		if (i == 0)
+		{
+			kx = lane.kx;
+			ky = lane.ky;
+			kz = lane.kz;
+		}
+		else if (lane.kx != kx || lane.ky != ky || lane.kz != kz)
+		{
+			is_same_axes = false;
+		}
+	}
+}
+
+/**
+ * get a lane as a single ray
+ */
+UMTriangleSoupRay UMTriangleSoupRayPacket::ray(int lane) const
+{
+	return lane_ray<float>(*this, lane);
+}
+
+/**
+ * build from primitive list
+ */
+template <class T>
+void UMTriangleSoupT<T>::build(const UMPrimitiveList& primitive_list)
+{
+	clear();
+	size_ = static_cast<unsigned int>(primitive_list.size());
+	const size_t padded_size = size_ + padding_count;
+	// padding is degenerate, so it never hits.
+	for (int i = 0; i < 9; ++i)
+	{
+		vertex_list_[i].resize(padded_size, 0);
+	}
+	triangle_list_.resize(size_);
+	for (unsigned int i = 0; i < size_; ++i)
+	{
+		triangle_list_[i] = std::dynamic_pointer_cast<UMTriangle>(primitive_list[i]);
+	}
+	update();
+}
+
+/**
+ * re-gather vertices of the primitives
+ */
+template <class T>
+void UMTriangleSoupT<T>::update()
+{
+	const int size = static_cast<int>(size_);
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < size; ++i)
+	{
+		UMVec3d v0(0), v1(0), v2(0);
+		if (const UMTrianglePtr& triangle = triangle_list_[i])
+		{
+			triangle->vertices(v0, v1, v2);
+		}
+		set_triangle(i, v0, v1, v2);
+	}
+}
+
+/**
+ * clear
+ */
+template <class T>
+void UMTriangleSoupT<T>::clear()
+{
+	size_ = 0;
+	for (int i = 0; i < 9; ++i)
+	{
+		vertex_list_[i].clear();
+	}
+	triangle_list_.clear();
+}
+
+/**
+ * set triangle
+ */
+template <class T>
+void UMTriangleSoupT<T>::set_triangle(unsigned int index, const UMVec3d& v0, const UMVec3d& v1, const UMVec3d& v2)
+{
+	const UMVec3d* vertices[3] = { &v0, &v1, &v2 };
+	for (int i = 0; i < 3; ++i)
+	{
+		vertex_list_[i * 3 + 0][index] = static_cast<T>(vertices[i]->x);
+		vertex_list_[i * 3 + 1][index] = static_cast<T>(vertices[i]->y);
+		vertex_list_[i * 3 + 2][index] = static_cast<T>(vertices[i]->z);
+	}
+}
+
+/**
+ * closest ray intersection
+ */
+template <class T>
+bool UMTriangleSoupT<T>::intersect_leaf(
+	const Ray& ray,
+	unsigned int start,
+	unsigned int count,
+	T& closest_distance,
+	unsigned int& hit_index,
+	T& hit_u,
+	T& hit_v) const
+{
+	if (count == 0) return false;
+	const T* soa[9];
+	for (int i = 0; i < 9; ++i) { soa[i] = &vertex_list_[i][0]; }
+	return intersect_range(soa, ray, start, count, closest_distance, hit_index, hit_u, hit_v);
+}
+
+/**
+ * any ray intersection
+ */
+template <class T>
+bool UMTriangleSoupT<T>::intersect_leaf_any(
+	const Ray& ray,
+	unsigned int start,
+	unsigned int count,
+	T tmax) const
+{
+	if (count == 0) return false;
+	const T* soa[9];
+	for (int i = 0; i < 9; ++i) { soa[i] = &vertex_list_[i][0]; }
+	return intersect_range_any(soa, ray, start, count, tmax);
+}
+
+/**
+ * closest packet intersection
+ */
+template <class T>
+int UMTriangleSoupT<T>::intersect_leaf_packet(
+	const UMTriangleSoupRayPacket& packet,
+	unsigned int start,
+	unsigned int count,
+	int active_mask,
+	float closest_distance[],
+	unsigned int hit_index[],
+	float hit_u[],
+	float hit_v[]) const
+{
+	if (count == 0 || active_mask == 0) return 0;
+	const T* soa[9];
+	for (int i = 0; i < 9; ++i) { soa[i] = &vertex_list_[i][0]; }
+	return intersect_range_packet(soa, packet, start, count, active_mask, closest_distance, hit_index, hit_u, hit_v);
+}
+
+/**
+ * any packet intersection
+ */
+template <class T>
+int UMTriangleSoupT<T>::intersect_leaf_packet_any(
+	const UMTriangleSoupRayPacket& packet,
+	unsigned int start,
+	unsigned int count,
+	int active_mask,
+	const float tmax[]) const
+{
+	if (count == 0 || active_mask == 0) return 0;
+	const T* soa[9];
+	for (int i = 0; i < 9; ++i) { soa[i] = &vertex_list_[i][0]; }
+	return intersect_range_packet_any(soa, packet, start, count, active_mask, tmax);
+}
+
+/**
+ * closest ray intersection
+ */
+template <>
+bool UMTriangleSoupT<float>::intersect_leaf(
+	const Ray& ray,
+	unsigned int start,
+	unsigned int count,
+	float& closest_distance,
+	unsigned int& hit_index,
+	float& hit_u,
+	float& hit_v) const
+{
+	if (count == 0) return false;
+	const float* soa[9];
+	for (int i = 0; i < 9; ++i) { soa[i] = &vertex_list_[i][0]; }
+
+#if defined(UM_TRIANGLE_SOUP_AVX)
+	const float* psoa[9];
+	permute_soa(psoa, soa, ray.kx, ray.ky, ray.kz);
+	const __m256 o[3] = {
+		_mm256_set1_ps(ray.origin[ray.kx]), _mm256_set1_ps(ray.origin[ray.ky]), _mm256_set1_ps(ray.origin[ray.kz]) };
+	const __m256 shear[3] = {
+		_mm256_set1_ps(ray.shear[0]), _mm256_set1_ps(ray.shear[1]), _mm256_set1_ps(ray.shear[2]) };
+	const __m256 tmin = _mm256_set1_ps(ray.tmin);
+	bool hit = false;
+	for (unsigned int i = 0; i < count; i += 8)
+	{
+		__m256 t, u, v;
+		const int mask = intersect8(psoa, start + i, o, shear, tmin, _mm256_set1_ps(closest_distance), count - i, t, u, v);
+		if (mask == 0) continue;
+		float ts[8], us[8], vs[8];
+		_mm256_storeu_ps(ts, t);
+		_mm256_storeu_ps(us, u);
+		_mm256_storeu_ps(vs, v);
+		for (int k = 0; k < 8; ++k)
+		{
+			if ((mask & (1 << k)) && ts[k] < closest_distance)
+			{
+				closest_distance = ts[k];
+				hit_index = start + i + k;
+				hit_u = us[k];
+				hit_v = vs[k];
+				hit = true;
+			}
+		}
+	}
+	return hit;
+#elif defined(UM_TRIANGLE_SOUP_SSE)
+	const float* psoa[9];
+	permute_soa(psoa, soa, ray.kx, ray.ky, ray.kz);
+	const __m128 o[3] = {
+		_mm_set1_ps(ray.origin[ray.kx]), _mm_set1_ps(ray.origin[ray.ky]), _mm_set1_ps(ray.origin[ray.kz]) };
+	const __m128 shear[3] = {
+		_mm_set1_ps(ray.shear[0]), _mm_set1_ps(ray.shear[1]), _mm_set1_ps(ray.shear[2]) };
+	const __m128 tmin = _mm_set1_ps(ray.tmin);
+	bool hit = false;
+	for (unsigned int i = 0; i < count; i += 4)
+	{
+		__m128 t, u, v;
+		const int mask = intersect4(psoa, start + i, o, shear, tmin, _mm_set1_ps(closest_distance), count - i, t, u, v);
+		if (mask == 0) continue;
+		float ts[4], us[4], vs[4];
+		_mm_storeu_ps(ts, t);
+		_mm_storeu_ps(us, u);
+		_mm_storeu_ps(vs, v);
+		for (int k = 0; k < 4; ++k)
+		{
+			if ((mask & (1 << k)) && ts[k] < closest_distance)
+			{
+				closest_distance = ts[k];
+				hit_index = start + i + k;
+				hit_u = us[k];
+				hit_v = vs[k];
+				hit = true;
+			}
+		}
+	}
+	return hit;
+#else
+	return intersect_range(soa, ray, start, count, closest_distance, hit_index, hit_u, hit_v);
+#endif
+}
+
+/**
+ * any ray intersection
+ */
+template <>
+bool UMTriangleSoupT<float>::intersect_leaf_any(
+	const Ray& ray,
+	unsigned int start,
+	unsigned int count,
+	float tmax) const
+{
+	if (count == 0) return false;
+	const float* soa[9];
+	for (int i = 0; i < 9; ++i) { soa[i] = &vertex_list_[i][0]; }
+
+#if defined(UM_TRIANGLE_SOUP_AVX)
+	const float* psoa[9];
+	permute_soa(psoa, soa, ray.kx, ray.ky, ray.kz);
+	const __m256 o[3] = {
+		_mm256_set1_ps(ray.origin[ray.kx]), _mm256_set1_ps(ray.origin[ray.ky]), _mm256_set1_ps(ray.origin[ray.kz]) };
+	const __m256 shear[3] = {
+		_mm256_set1_ps(ray.shear[0]), _mm256_set1_ps(ray.shear[1]), _mm256_set1_ps(ray.shear[2]) };
+	const __m256 tmin = _mm256_set1_ps(ray.tmin);
+	const __m256 tmax8 = _mm256_set1_ps(tmax);
+	for (unsigned int i = 0; i < count; i += 8)
+	{
+		__m256 t, u, v;
+		if (intersect8(psoa, start + i, o, shear, tmin, tmax8, count - i, t, u, v)) return true;
+	}
+	return false;
+#elif defined(UM_TRIANGLE_SOUP_SSE)
+	const float* psoa[9];
+	permute_soa(psoa, soa, ray.kx, ray.ky, ray.kz);
+	const __m128 o[3] = {
+		_mm_set1_ps(ray.origin[ray.kx]), _mm_set1_ps(ray.origin[ray.ky]), _mm_set1_ps(ray.origin[ray.kz]) };
+	const __m128 shear[3] = {
+		_mm_set1_ps(ray.shear[0]), _mm_set1_ps(ray.shear[1]), _mm_set1_ps(ray.shear[2]) };
+	const __m128 tmin = _mm_set1_ps(ray.tmin);
+	const __m128 tmax4 = _mm_set1_ps(tmax);
+	for (unsigned int i = 0; i < count; i += 4)
+	{
+		__m128 t, u, v;
+		if (intersect4(psoa, start + i, o, shear, tmin, tmax4, count - i, t, u, v)) return true;
+	}
+	return false;
+#else
+	return intersect_range_any(soa, ray, start, count, tmax);
+#endif
+}
+
+/**
+ * closest packet intersection
+ */
+template <>
+int UMTriangleSoupT<float>::intersect_leaf_packet(
+	const UMTriangleSoupRayPacket& packet,
+	unsigned int start,
+	unsigned int count,
+	int active_mask,
+	float closest_distance[],
+	unsigned int hit_index[],
+	float hit_u[],
+	float hit_v[]) const
+{
+	if (count == 0 || active_mask == 0) return 0;
+	const float* soa[9];
+	for (int i = 0; i < 9; ++i) { soa[i] = &vertex_list_[i][0]; }
+
+#if defined(UM_TRIANGLE_SOUP_SSE)
+	// lanes in different directions are tested one by one
+	if (packet.is_same_axes)
+	{
+		const float* psoa[9];
+		permute_soa(psoa, soa, packet.kx, packet.ky, packet.kz);
+		const __m128 o[3] = {
+			_mm_loadu_ps(packet.origin[packet.kx]), _mm_loadu_ps(packet.origin[packet.ky]), _mm_loadu_ps(packet.origin[packet.kz]) };
+		const __m128 shear[3] = {
+			_mm_loadu_ps(packet.shear[0]), _mm_loadu_ps(packet.shear[1]), _mm_loadu_ps(packet.shear[2]) };
+		const __m128 tmin = _mm_loadu_ps(packet.tmin);
+		const __m128 active = lane_mask4(active_mask);
+		__m128 closest = _mm_loadu_ps(closest_distance);
+		int hit_mask = 0;
+		for (unsigned int i = start, end = start + count; i < end; ++i)
+		{
+			__m128 t, u, v;
+			const __m128 mask = _mm_and_ps(intersect_packet4(psoa, i, o, shear, tmin, closest, t, u, v), active);
+			const int lanes = _mm_movemask_ps(mask);
+			if (lanes == 0) continue;
+			closest = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, closest));
+			float us[4], vs[4];
+			_mm_storeu_ps(us, u);
+			_mm_storeu_ps(vs, v);
+			for (int k = 0; k < 4; ++k)
+			{
+				if (lanes & (1 << k))
+				{
+					hit_index[k] = i;
+					hit_u[k] = us[k];
+					hit_v[k] = vs[k];
+				}
+			}
+			hit_mask |= lanes;
+		}
+		_mm_storeu_ps(closest_distance, closest);
+		return hit_mask;
+	}
+#endif // UM_TRIANGLE_SOUP_SSE
+	return intersect_range_packet(soa, packet, start, count, active_mask, closest_distance, hit_index, hit_u, hit_v);
+}
+
+/**
+ * any packet intersection
+ */
+template <>
+int UMTriangleSoupT<float>::intersect_leaf_packet_any(
+	const UMTriangleSoupRayPacket& packet,
+	unsigned int start,
+	unsigned int count,
+	int active_mask,
+	const float tmax[]) const
+{
+	if (count == 0 || active_mask == 0) return 0;
+	const float* soa[9];
+	for (int i = 0; i < 9; ++i) { soa[i] = &vertex_list_[i][0]; }
+
+#if defined(UM_TRIANGLE_SOUP_SSE)
+	// lanes in different directions are tested one by one
+	if (packet.is_same_axes)
+	{
+		const float* psoa[9];
+		permute_soa(psoa, soa, packet.kx, packet.ky, packet.kz);
+		const __m128 o[3] = {
+			_mm_loadu_ps(packet.origin[packet.kx]), _mm_loadu_ps(packet.origin[packet.ky]), _mm_loadu_ps(packet.origin[packet.kz]) };
+		const __m128 shear[3] = {
+			_mm_loadu_ps(packet.shear[0]), _mm_loadu_ps(packet.shear[1]), _mm_loadu_ps(packet.shear[2]) };
+		const __m128 tmin = _mm_loadu_ps(packet.tmin);
+		const __m128 tmax4 = _mm_loadu_ps(tmax);
+		int hit_mask = 0;
+		for (unsigned int i = start, end = start + count; i < end; ++i)
+		{
+			__m128 t, u, v;
+			hit_mask |= _mm_movemask_ps(intersect_packet4(psoa, i, o, shear, tmin, tmax4, t, u, v)) & active_mask;
+			// all lanes are occluded
+			if (hit_mask == active_mask) break;
+		}
+		return hit_mask;
+	}
+#endif // UM_TRIANGLE_SOUP_SSE
+	return intersect_range_packet_any(soa, packet, start, count, active_mask, tmax);
+}
+
+/**
+ * fill shading parameters of a hit
+ */
+template <class T>
+void UMTriangleSoupT<T>::shade(
+	const UMRay& ray,
+	unsigned int hit_index,
+	T distance,
+	T u,
+	T v,
+	UMShaderParameter& parameter) const
+{
+	parameter.distance = distance;
+	parameter.intersect_point = ray.origin() + ray.direction() * distance;
+	parameter.uvw.y = u;
+	parameter.uvw.z = v;
+	parameter.uvw.x = 1.0 - parameter.uvw.y - parameter.uvw.z;
+	const UMVec3d v0(vertex_list_[0][hit_index], vertex_list_[1][hit_index], vertex_list_[2][hit_index]);
+	const UMVec3d v1(vertex_list_[3][hit_index], vertex_list_[4][hit_index], vertex_list_[5][hit_index]);
+	const UMVec3d v2(vertex_list_[6][hit_index], vertex_list_[7][hit_index], vertex_list_[8][hit_index]);
+	parameter.face_normal = (v1 - v0).cross(v2 - v0).normalized();
+	if (const UMTrianglePtr& triangle = triangle_list_[hit_index])
+	{
+		triangle->shade(parameter);
+	}
+}
+
+template class UMTriangleSoupRayT<float>;
+template class UMTriangleSoupRayT<double>;
+template class UMTriangleSoupT<float>;
+template class UMTriangleSoupT<double>;
+
+} // umrt
@@ -0,0 +1,261 @@
+/**
+ * @file UMTriangleSoup.h
+ * packed triangles for bvh leaves
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMVector.h"
+#include "UMPrimitive.h"
+#include "UMTriangle.h"
+
+namespace umrt
+{
+
+class UMRay;
+class UMShaderParameter;
+
+/**
+ * ray data for UMTriangleSoupT
+ * @note axes are permuted so that z is the dominant direction,
+ * and triangles are sheared onto the plane of the ray (watertight intersection).
+ */
+template <class T>
+class UMTriangleSoupRayT
+{
+public:
+	UMTriangleSoupRayT() : tmin(0), kx(0), ky(1), kz(2)
+	{
+		origin[0] = origin[1] = origin[2] = 0;
+		direction[0] = direction[1] = 0;
+		direction[2] = 1;
+		shear[0] = shear[1] = 0;
+		shear[2] = 1;
+	}
+
+	/**
+	 * @param [in] ray source ray
+	 */
+	explicit UMTriangleSoupRayT(const UMRay& ray);
+
+	/**
+	 * compute axis permutation and shear from direction
+	 */
+	void update_shear();
+
+	T origin[3];
+	T direction[3];
+	T tmin;
+	/// permuted axes. kz is the dominant axis of direction
+	int kx, ky, kz;
+	/// shear constants. direction[kx] / direction[kz], direction[ky] / direction[kz], 1 / direction[kz]
+	T shear[3];
+};
+typedef UMTriangleSoupRayT<float> UMTriangleSoupRay;
+typedef UMTriangleSoupRayT<double> UMTriangleSoupRayD;
+
+/**
+ * packet of coherent rays for UMTriangleSoup
+ * @note structure of arrays. lanes over count are copies of the last ray.
+ */
+class UMTriangleSoupRayPacket
+{
+public:
+	enum { packet_size = 4 };
+
+	/**
+	 * @param [in] rays source rays
+	 * @param [in] count ray count. 1 to packet_size
+	 */
+	UMTriangleSoupRayPacket(const UMRay* rays, int count);
+
+	/**
+	 * get a lane as a single ray
+	 */
+	UMTriangleSoupRay ray(int lane) const;
+
+	float origin[3][packet_size];
+	float direction[3][packet_size];
+	float inv_direction[3][packet_size];
+	float tmin[packet_size];
+	/// shear constants of each lane. see UMTriangleSoupRay
+	float shear[3][packet_size];
+	/// permuted axes shared by all lanes
+	int kx, ky, kz;
+	/// all lanes have the same permuted axes or not
+	bool is_same_axes;
+	int count;
+};
+
+/**
+ * packed triangles for bvh leaves
+ * @note structure of arrays. the order is same as UMBvh::ordered_primitives.
+ * primitives which are not UMTriangle are stored as degenerate triangles,
+ * and must be tested through UMPrimitive.
+ * float is used for rendering. double is for validation.
+ * rays on a shared edge hit at least one of the triangles (watertight).
+ */
+template <class T>
+class UMTriangleSoupT
+{
+	DISALLOW_COPY_AND_ASSIGN(UMTriangleSoupT);
+public:
+	typedef UMTriangleSoupRayT<T> Ray;
+
+	UMTriangleSoupT() : size_(0) {}
+	~UMTriangleSoupT() {}
+
+	/**
+	 * build from primitive list
+	 * @param [in] primitive_list ordered primitive list
+	 */
+	void build(const UMPrimitiveList& primitive_list);
+
+	/**
+	 * re-gather vertices of the primitives
+	 */
+	void update();
+
+	/**
+	 * clear
+	 */
+	void clear();
+
+	/**
+	 * get triangle count including degenerate ones
+	 */
+	unsigned int size() const { return size_; }
+
+	/**
+	 * is the primitive at index a triangle
+	 */
+	bool is_triangle(unsigned int index) const { return !!triangle_list_[index]; }
+
+	/**
+	 * get source triangle
+	 */
+	UMTrianglePtr triangle(unsigned int index) const { return triangle_list_[index]; }
+
+	/**
+	 * closest ray intersection against triangles [start, start + count)
+	 * @param [in] ray ray data
+	 * @param [in] start start index
+	 * @param [in] count triangle count
+	 * @param [in,out] closest_distance closest distance
+	 * @param [out] hit_index hit triangle index
+	 * @param [out] hit_u barycentric u
+	 * @param [out] hit_v barycentric v
+	 * @retval true if found closer hit
+	 */
+	bool intersect_leaf(
+		const Ray& ray,
+		unsigned int start,
+		unsigned int count,
+		T& closest_distance,
+		unsigned int& hit_index,
+		T& hit_u,
+		T& hit_v) const;
+
+	/**
+	 * any ray intersection against triangles [start, start + count)
+	 * @param [in] ray ray data
+	 * @param [in] start start index
+	 * @param [in] count triangle count
+	 * @param [in] tmax max distance
+	 */
+	bool intersect_leaf_any(
+		const Ray& ray,
+		unsigned int start,
+		unsigned int count,
+		T tmax) const;
+
+	/**
+	 * closest packet intersection against triangles [start, start + count)
+	 * @param [in] packet ray packet
+	 * @param [in] start start index
+	 * @param [in] count triangle count
+	 * @param [in] active_mask mask of lanes to test
+	 * @param [in,out] closest_distance closest distance of each lane
+	 * @param [out] hit_index hit triangle index of each lane
+	 * @param [out] hit_u barycentric u of each lane
+	 * @param [out] hit_v barycentric v of each lane
+	 * @retval mask of lanes which found closer hit
+	 */
+	int intersect_leaf_packet(
+		const UMTriangleSoupRayPacket& packet,
+		unsigned int start,
+		unsigned int count,
+		int active_mask,
+		float closest_distance[],
+		unsigned int hit_index[],
+		float hit_u[],
+		float hit_v[]) const;
+
+	/**
+	 * any packet intersection against triangles [start, start + count)
+	 * @param [in] packet ray packet
+	 * @param [in] start start index
+	 * @param [in] count triangle count
+	 * @param [in] active_mask mask of lanes to test
+	 * @param [in] tmax max distance of each lane
+	 * @retval mask of lanes which hit
+	 */
+	int intersect_leaf_packet_any(
+		const UMTriangleSoupRayPacket& packet,
+		unsigned int start,
+		unsigned int count,
+		int active_mask,
+		const float tmax[]) const;
+
+	/**
+	 * fill shading parameters of a hit
+	 * @param [in] ray source ray
+	 * @param [in] hit_index hit triangle index
+	 * @param [in] distance hit distance
+	 * @param [in] u barycentric u
+	 * @param [in] v barycentric v
+	 * @param [out] parameter shading parameters
+	 */
+	void shade(
+		const UMRay& ray,
+		unsigned int hit_index,
+		T distance,
+		T u,
+		T v,
+		UMShaderParameter& parameter) const;
+
+private:
+	void set_triangle(unsigned int index, const UMVec3d& v0, const UMVec3d& v1, const UMVec3d& v2);
+
+	unsigned int size_;
+	// vertex x, y, z of vertex 0, 1, 2.
+	// vertices are not stored as edges so that shared edges are computed the same.
+	std::vector<T> vertex_list_[9];
+	UMTriangleList triangle_list_;
+};
+typedef UMTriangleSoupT<float> UMTriangleSoup;
+typedef UMTriangleSoupT<double> UMTriangleSoupD;
+
+// SIMD versions
+template <> bool UMTriangleSoupT<float>::intersect_leaf(
+	const Ray& ray, unsigned int start, unsigned int count,
+	float& closest_distance, unsigned int& hit_index, float& hit_u, float& hit_v) const;
+template <> bool UMTriangleSoupT<float>::intersect_leaf_any(
+	const Ray& ray, unsigned int start, unsigned int count, float tmax) const;
+template <> int UMTriangleSoupT<float>::intersect_leaf_packet(
+	const UMTriangleSoupRayPacket& packet, unsigned int start, unsigned int count, int active_mask,
+	float closest_distance[], unsigned int hit_index[], float hit_u[], float hit_v[]) const;
+template <> int UMTriangleSoupT<float>::intersect_leaf_packet_any(
+	const UMTriangleSoupRayPacket& packet, unsigned int start, unsigned int count, int active_mask,
+	const float tmax[]) const;
+
+} // umrt
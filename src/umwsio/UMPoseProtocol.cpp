@@ -0,0 +1,255 @@
+/**
+ * @file UMPoseProtocol.cpp
+ * binary pose stream protocol
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#include "UMPoseProtocol.h"
+#include "UMNode.h"
+#include "UMMatrix.h"
+#include <string.h>
+#include <math.h>
+
+namespace
+{
+	using namespace umdraw;
+	using namespace umwsio;
+
+	const unsigned short protocol_version = 1;
+	const float rotation_scale = 32767.0f;
+
+	template <class T>
+	void append(std::string& dst, const T& value)
+	{
+		dst.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	/**
+	 * rotation of a matrix without scale as quaternion (x, y, z, w)
+	 */
+	void to_quaternion(double q[4], const UMMat44d& m)
+	{
+		const double trace = m.m[0][0] + m.m[1][1] + m.m[2][2];
+		if (trace > 0.0)
+		{
+			const double s = 0.5 / sqrt(trace + 1.0);
+			q[3] = 0.25 / s;
+			q[0] = (m.m[1][2] - m.m[2][1]) * s;
+			q[1] = (m.m[2][0] - m.m[0][2]) * s;
+			q[2] = (m.m[0][1] - m.m[1][0]) * s;
+		}
+		else if (m.m[0][0] > m.m[1][1] && m.m[0][0] > m.m[2][2])
+		{
+			const double s = 2.0 * sqrt(1.0 + m.m[0][0] - m.m[1][1] - m.m[2][2]);
+			q[3] = (m.m[1][2] - m.m[2][1]) / s;
+			q[0] = 0.25 * s;
+			q[1] = (m.m[1][0] + m.m[0][1]) / s;
+			q[2] = (m.m[2][0] + m.m[0][2]) / s;
+		}
+		else if (m.m[1][1] > m.m[2][2])
+		{
+			const double s = 2.0 * sqrt(1.0 + m.m[1][1] - m.m[0][0] - m.m[2][2]);
+			q[3] = (m.m[2][0] - m.m[0][2]) / s;
+			q[0] = (m.m[1][0] + m.m[0][1]) / s;
+			q[1] = 0.25 * s;
+			q[2] = (m.m[2][1] + m.m[1][2]) / s;
+		}
+		else
+		{
+			const double s = 2.0 * sqrt(1.0 + m.m[2][2] - m.m[0][0] - m.m[1][1]);
+			q[3] = (m.m[0][1] - m.m[1][0]) / s;
+			q[0] = (m.m[2][0] + m.m[0][2]) / s;
+			q[1] = (m.m[2][1] + m.m[1][2]) / s;
+			q[2] = 0.25 * s;
+		}
+	}
+
+	/**
+	 * quantize rotation and translation of a matrix
+	 */
+	void quantize_matrix(short rotation[4], float translation[3], const UMMat44d& src)
+	{
+		UMMat44d mat = src;
+		umbase::um_matrix_remove_scale(mat, mat);
+		double q[4];
+		to_quaternion(q, mat);
+		const double length = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		// q and -q are the same rotation
+		const double scale = (length > 0.0 ? 1.0 / length : 0.0) * (q[3] < 0.0 ? -1.0 : 1.0);
+		for (int i = 0; i < 4; ++i)
+		{
+			const double v = q[i] * scale * rotation_scale;
+			rotation[i] = static_cast<short>(v < 0.0 ? v - 0.5 : v + 0.5);
+		}
+		for (int i = 0; i < 3; ++i)
+		{
+			translation[i] = static_cast<float>(src.m[3][i]);
+		}
+	}
+
+	bool is_same_joint(const UMPoseEncoder::Joint& a, const UMPoseEncoder::Joint& b)
+	{
+		return memcmp(&a, &b, sizeof(UMPoseEncoder::Joint)) == 0;
+	}
+
+} // anonymouse namespace
+
+namespace umwsio
+{
+
+/**
+ * copy current transforms of joints
+ */
+void UMPoseSnapshot::capture(const UMNodeList& joint_list, UMPoseTopologyPtr topology)
+{
+	this->topology = topology;
+	const size_t joint_count = joint_list.size();
+	global_list.resize(joint_count);
+	local_list.resize(joint_count);
+	for (size_t i = 0; i < joint_count; ++i)
+	{
+		const UMNodePtr& node = joint_list[i];
+		global_list[i] = node->global_transform();
+		local_list[i] = node->local_transform() * node->initial_local_transform().inverted();
+	}
+}
+
+/**
+ * constructor
+ */
+UMPoseSlot::UMPoseSlot()
+	: middle_(1)
+	, back_(0)
+	, front_(2)
+{
+}
+
+/**
+ * publish the written buffer
+ */
+void UMPoseSlot::publish()
+{
+	back_ = middle_.exchange(back_ | dirty_bit) & ~dirty_bit;
+}
+
+/**
+ * get the newest published snapshot
+ */
+const UMPoseSnapshot* UMPoseSlot::acquire()
+{
+	if (!(middle_.load() & dirty_bit)) return NULL;
+	front_ = middle_.exchange(front_) & ~dirty_bit;
+	return &buffers_[front_];
+}
+
+/**
+ * constructor
+ */
+UMPoseEncoder::UMPoseEncoder()
+	: topology_version_(-1)
+	, frame_number_(0)
+{
+}
+
+/**
+ * encode topology message
+ */
+void UMPoseEncoder::encode_topology(std::string& dst, const UMPoseTopology& topology)
+{
+	const size_t joint_count = topology.id_list.size();
+	dst.clear();
+	dst.append("UMPT", 4);
+	append(dst, protocol_version);
+	append(dst, static_cast<unsigned short>(joint_count));
+	for (size_t i = 0; i < joint_count; ++i)
+	{
+		const std::string& name = topology.name_list[i];
+		append(dst, topology.id_list[i]);
+		append(dst, topology.parent_id_list[i]);
+		append(dst, static_cast<unsigned short>(name.size()));
+		dst.append(name);
+	}
+}
+
+/**
+ * set the next frame
+ */
+bool UMPoseEncoder::set_frame(const UMPoseSnapshot& snapshot)
+{
+	const int joint_count = static_cast<int>(snapshot.global_list.size());
+	const int topology_version = snapshot.topology ? snapshot.topology->version : -1;
+	const bool is_new_topology = (topology_version != topology_version_);
+	topology_version_ = topology_version;
+	if (is_new_topology)
+	{
+		joint_list_.resize(joint_count);
+		all_list_.resize(joint_count);
+		for (int i = 0; i < joint_count; ++i)
+		{
+			all_list_[i] = static_cast<unsigned short>(i);
+		}
+	}
+
+	changed_list_.clear();
+	for (int i = 0; i < joint_count; ++i)
+	{
+		Joint joint;
+		memset(&joint, 0, sizeof(Joint));
+		quantize_matrix(joint.local_rotation, joint.local_translation, snapshot.local_list[i]);
+		quantize_matrix(joint.global_rotation, joint.global_translation, snapshot.global_list[i]);
+		if (is_new_topology || !is_same_joint(joint, joint_list_[i]))
+		{
+			joint_list_[i] = joint;
+			changed_list_.push_back(static_cast<unsigned short>(i));
+		}
+	}
+	if (changed_list_.empty() && !is_new_topology) return false;
+	++frame_number_;
+	return true;
+}
+
+/**
+ * encode joints changed from the previous frame
+ */
+void UMPoseEncoder::encode_delta_frame(std::string& dst) const
+{
+	encode_frame(dst, changed_list_);
+}
+
+/**
+ * encode all joints of current frame
+ */
+void UMPoseEncoder::encode_key_frame(std::string& dst) const
+{
+	encode_frame(dst, all_list_);
+}
+
+/**
+ * encode joints of current frame
+ */
+void UMPoseEncoder::encode_frame(std::string& dst, const std::vector<unsigned short>& index_list) const
+{
+	const size_t joint_size = sizeof(unsigned short) + sizeof(Joint);
+	dst.clear();
+	dst.reserve(12 + index_list.size() * joint_size);
+	dst.append("UMPF", 4);
+	append(dst, frame_number_);
+	append(dst, static_cast<unsigned short>(joint_list_.size()));
+	append(dst, static_cast<unsigned short>(index_list.size()));
+	for (size_t i = 0; i < index_list.size(); ++i)
+	{
+		const unsigned short index = index_list[i];
+		const Joint& joint = joint_list_[index];
+		append(dst, index);
+		dst.append(reinterpret_cast<const char*>(joint.local_rotation), sizeof(joint.local_rotation));
+		dst.append(reinterpret_cast<const char*>(joint.local_translation), sizeof(joint.local_translation));
+		dst.append(reinterpret_cast<const char*>(joint.global_rotation), sizeof(joint.global_rotation));
+		dst.append(reinterpret_cast<const char*>(joint.global_translation), sizeof(joint.global_translation));
+	}
+}
+
+} // umwsio
@@ -0,0 +1,192 @@
+/**
+ * @file UMPoseProtocol.h
+ * binary pose stream protocol
+ *
+ * @author tori31001 at gmail.com
+ *
+ * Copyright (C) 2013 Kazuma Hatta
+ * Licensed  under the MIT license. 
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "UMMacro.h"
+#include "UMMathTypes.h"
+#include "UMMatrix.h"
+
+namespace umdraw
+{
+	class UMNode;
+	typedef std::shared_ptr<UMNode> UMNodePtr;
+	typedef std::vector<UMNodePtr> UMNodeList;
+} // umdraw
+
+namespace umwsio
+{
+
+class UMPoseEncoder;
+typedef std::shared_ptr<UMPoseEncoder> UMPoseEncoderPtr;
+
+/**
+ * joints of pose stream
+ * @note shared by snapshots until the joints are changed.
+ */
+struct UMPoseTopology
+{
+	UMPoseTopology() : version(0) {}
+	int version;
+	std::vector<int> id_list;
+	/// -1 is root
+	std::vector<int> parent_id_list;
+	/// utf8
+	std::vector<std::string> name_list;
+};
+typedef std::shared_ptr<const UMPoseTopology> UMPoseTopologyPtr;
+
+/**
+ * pose of joints at a moment
+ */
+struct UMPoseSnapshot
+{
+	UMPoseTopologyPtr topology;
+	std::vector<UMMat44d> global_list;
+	/// difference from the initial local transform
+	std::vector<UMMat44d> local_list;
+
+	/**
+	 * copy current transforms of joints
+	 * @param [in] joint_list joints in the order of topology
+	 * @param [in] topology topology of the joints
+	 */
+	void capture(const umdraw::UMNodeList& joint_list, UMPoseTopologyPtr topology);
+};
+
+/**
+ * lock free slot to pass snapshots from one writer thread to one reader thread
+ * @note three buffers. the writer never waits for the reader,
+ * and the reader always gets the newest snapshot. older ones are dropped.
+ */
+class UMPoseSlot
+{
+	DISALLOW_COPY_AND_ASSIGN(UMPoseSlot);
+public:
+	UMPoseSlot();
+	~UMPoseSlot() {}
+
+	/**
+	 * get buffer to write. writer thread only.
+	 */
+	UMPoseSnapshot& back() { return buffers_[back_]; }
+
+	/**
+	 * publish the written buffer. writer thread only.
+	 */
+	void publish();
+
+	/**
+	 * get the newest published snapshot. reader thread only.
+	 * @retval new snapshot, or NULL if nothing is published since the last call
+	 */
+	const UMPoseSnapshot* acquire();
+
+	/**
+	 * get the snapshot returned by the last acquire. reader thread only.
+	 */
+	const UMPoseSnapshot& front() const { return buffers_[front_]; }
+
+private:
+	enum { dirty_bit = 4 };
+	UMPoseSnapshot buffers_[3];
+	/// index of the middle buffer and dirty_bit
+	std::atomic<int> middle_;
+	int back_;
+	int front_;
+};
+
+/**
+ * binary pose stream encoder
+ * @note all values are little endian.
+ *
+ * topology message, sent once for a joint list
+ *   "UMPT", uint16 version, uint16 joint count,
+ *   joints { int32 id, int32 parent id (-1 is none), uint16 name length, utf8 name }
+ *
+ * frame message, sent at the stream rate
+ *   "UMPF", uint32 frame number, uint16 joint count, uint16 changed joint count,
+ *   changed joints { uint16 joint index,
+ *     int16 x 4 local rotation, float x 3 local translation,
+ *     int16 x 4 global rotation, float x 3 global translation }
+ *
+ * rotations are quaternions (x, y, z, w) scaled by 32767 with w >= 0.
+ * local is the difference from the initial local transform.
+ * global has no scale.
+ * a key frame has all joints. other frames have joints changed from the previous frame.
+ */
+class UMPoseEncoder
+{
+	DISALLOW_COPY_AND_ASSIGN(UMPoseEncoder);
+public:
+	UMPoseEncoder();
+	~UMPoseEncoder() {}
+
+	/**
+	 * encode topology message
+	 * @param [out] dst encoded message
+	 * @param [in] topology joints
+	 */
+	static void encode_topology(std::string& dst, const UMPoseTopology& topology);
+
+	/**
+	 * set the next frame
+	 * @retval any joint is changed or not
+	 */
+	bool set_frame(const UMPoseSnapshot& snapshot);
+
+	/**
+	 * has frame or not
+	 */
+	bool has_frame() const { return frame_number_ > 0; }
+
+	/**
+	 * encode joints changed from the previous frame
+	 * @param [out] dst encoded message
+	 */
+	void encode_delta_frame(std::string& dst) const;
+
+	/**
+	 * encode all joints of current frame
+	 * @param [out] dst encoded message
+	 */
+	void encode_key_frame(std::string& dst) const;
+
+	/**
+	 * get frame number of current frame
+	 */
+	unsigned int frame_number() const { return frame_number_; }
+
+	/**
+	 * joint transform in a frame
+	 */
+	struct Joint
+	{
+		short local_rotation[4];
+		float local_translation[3];
+		short global_rotation[4];
+		float global_translation[3];
+	};
+
+private:
+	void encode_frame(std::string& dst, const std::vector<unsigned short>& index_list) const;
+
+	std::vector<Joint> joint_list_;
+	std::vector<unsigned short> changed_list_;
+	std::vector<unsigned short> all_list_;
+	int topology_version_;
+	unsigned int frame_number_;
+};
+
+} // umwsio
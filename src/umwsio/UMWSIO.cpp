@@ -18,7 +18,9 @@
 #include "UMObject.h"
 #include "UMStringUtil.h"
 #include "UMSoftwareIO.h"
+#include "UMPoseProtocol.h"
 #include <thread>
+#include <atomic>
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
 typedef websocketpp::lib::lock_guard<websocketpp::lib::mutex> scoped_lock;
@@ -34,6 +36,9 @@ namespace umwsio
 	using namespace umdraw;
 	using namespace websocketpp;
 
+/// frames are dropped for connections which have more unsent bytes than this
+static const size_t max_pose_stream_buffered_size = 32 * 1024;
+
 static umio::UMMat44d to_umio(const UMMat44d& mat)
 {
 	umio::UMMat44d dst;
@@ -63,6 +68,11 @@ public:
 		, is_importing_bone_(false)
 		, is_start_reconnect_(false)
 		, port_(9002)
+		, pose_stream_rate_(30.0)
+		, is_pose_timer_pending_(false)
+		, connection_version_(0)
+		, is_new_pose_(false)
+		, sent_topology_version_(-1)
 	{}
 	~Impl() 
 	{
@@ -85,24 +95,69 @@ public:
 		is_loaded_ = false;
 	}
 
+	/**
+	 * copy pose of connected nodes to the slot. called by the updating thread.
+	 */
+	void publish_pose()
+	{
+		if (!scene_) return;
+		const int connection_version = connection_version_;
+		if (!pose_topology_ || pose_topology_->version != connection_version)
+		{
+			std::map<umdraw::UMNodePtr, std::string> connection_map;
+			{
+				scoped_lock guard(lock_);
+				connection_map = connection_map_;
+			}
+			std::shared_ptr<UMPoseTopology> topology = std::make_shared<UMPoseTopology>();
+			topology->version = connection_version;
+			pose_joint_list_.clear();
+			UMNodeList::const_iterator it = scene_->node_list().begin();
+			for (; it != scene_->node_list().end(); ++it)
+			{
+				UMNodePtr node = *it;
+				if (connection_map.find(node) == connection_map.end()) continue;
+				pose_joint_list_.push_back(node);
+				topology->id_list.push_back(static_cast<int>(node->id()));
+				topology->parent_id_list.push_back(node->parent() ? static_cast<int>(node->parent()->id()) : -1);
+				topology->name_list.push_back(umbase::UMStringUtil::utf16_to_utf8(node->name()));
+			}
+			pose_topology_ = topology;
+		}
+		pose_slot_.back().capture(pose_joint_list_, pose_topology_);
+		pose_slot_.publish();
+	}
+
+	/**
+	 * get the newest published pose. websocket thread only.
+	 */
+	const UMPoseSnapshot& latest_pose()
+	{
+		if (pose_slot_.acquire())
+		{
+			is_new_pose_ = true;
+		}
+		return pose_slot_.front();
+	}
+
 	void create_skeleton_data(std::string& binary)
 	{
-		UMNodeList::const_iterator it = scene_->node_list().begin();
+		const UMPoseSnapshot& pose = latest_pose();
 		umio::UMIO io;
 		umio::UMIOSetting setting;
 		umio::UMObjectPtr obj = umio::UMObject::create_object();
 		int dst_size = 0;
-		for (; it != scene_->node_list().end(); ++it)
+		if (pose.topology)
 		{
-			UMNodePtr node = *it;
-			if (connection_map_.find(node) != connection_map_.end())
+			const UMPoseTopology& topology = *pose.topology;
+			for (size_t i = 0, size = pose.global_list.size(); i < size; ++i)
 			{
 				umio::UMSkeleton skeleton;
-				UMMat44d global = node->mutable_global_transform();
-				UMMat44d local_difference = node->mutable_local_transform() * node->mutable_initial_local_transform().inverted();
-				if (node->parent())
+				UMMat44d global = pose.global_list[i];
+				UMMat44d local_difference = pose.local_list[i];
+				if (topology.parent_id_list[i] >= 0)
 				{
-					skeleton.set_parent_id(node->parent()->id());
+					skeleton.set_parent_id(topology.parent_id_list[i]);
 				}
 				else
 				{
@@ -112,8 +167,8 @@ public:
 				}
 				skeleton.mutable_global_transform() = to_umio(global);
 				skeleton.mutable_local_transform() = to_umio(local_difference);
-				skeleton.set_id(node->id());
-				skeleton.set_name(umbase::UMStringUtil::utf16_to_utf8(node->name()));
+				skeleton.set_id(topology.id_list[i]);
+				skeleton.set_name(topology.name_list[i]);
 				obj->add_skeleton(skeleton);
 			}
 		}
@@ -138,6 +193,116 @@ public:
 		return false;
 	}
 
+	/**
+	 * start pushing pose frames to a connection
+	 * @note topology and a key frame are sent at the next push.
+	 */
+	void start_pose_stream(server* s, websocketpp::connection_hdl hdl)
+	{
+		pose_stream_map_[hdl] = PoseStreamState();
+		// a stream stopped and restarted within an interval still has its timer
+		if (!is_pose_timer_pending_)
+		{
+			set_pose_timer(s);
+		}
+	}
+
+	void set_pose_timer(server* s)
+	{
+		const double rate = pose_stream_rate_;
+		const long interval = static_cast<long>(1000.0 / (rate > 0.0 ? rate : 30.0));
+		s->set_timer(interval, bind(&UMWSIO::Impl::on_pose_timer, this, s, _1));
+		is_pose_timer_pending_ = true;
+	}
+
+	/**
+	 * encode the newest pose once and push it to all pose stream connections
+	 */
+	void on_pose_timer(server* s, const websocketpp::lib::error_code& timer_ec)
+	{
+		is_pose_timer_pending_ = false;
+		if (timer_ec) return;
+		if (pose_stream_map_.empty()) return;
+
+		const UMPoseSnapshot& pose = latest_pose();
+		bool has_delta_frame = false;
+		if (is_new_pose_)
+		{
+			is_new_pose_ = false;
+			if (pose.topology && pose.topology->version != sent_topology_version_)
+			{
+				UMPoseEncoder::encode_topology(pose_topology_message_, *pose.topology);
+				sent_topology_version_ = pose.topology->version;
+			}
+			has_delta_frame = pose_encoder_.set_frame(pose);
+		}
+		if (!pose_encoder_.has_frame())
+		{
+			set_pose_timer(s);
+			return;
+		}
+
+		// each frame is encoded at most once for all connections
+		bool is_delta_encoded = false;
+		bool is_key_encoded = false;
+		PoseStreamMap::iterator it = pose_stream_map_.begin();
+		while (it != pose_stream_map_.end())
+		{
+			websocketpp::lib::error_code ec;
+			PoseStreamState& state = it->second;
+			server::connection_ptr con = s->get_con_from_hdl(it->first, ec);
+			if (!ec && con->get_buffered_amount() > max_pose_stream_buffered_size)
+			{
+				// slow connection. drop this frame and resync by a key frame later.
+				state.needs_key_frame = true;
+				++it;
+				continue;
+			}
+			if (!ec && state.topology_version != sent_topology_version_)
+			{
+				s->send(it->first, pose_topology_message_.c_str(), pose_topology_message_.size(), websocketpp::frame::opcode::binary, ec);
+				state.topology_version = sent_topology_version_;
+				state.needs_key_frame = true;
+			}
+			if (!ec && state.needs_key_frame)
+			{
+				if (!is_key_encoded)
+				{
+					pose_encoder_.encode_key_frame(pose_key_frame_message_);
+					is_key_encoded = true;
+				}
+				s->send(it->first, pose_key_frame_message_.c_str(), pose_key_frame_message_.size(), websocketpp::frame::opcode::binary, ec);
+				state.needs_key_frame = false;
+			}
+			else if (!ec && has_delta_frame)
+			{
+				if (!is_delta_encoded)
+				{
+					pose_encoder_.encode_delta_frame(pose_delta_frame_message_);
+					is_delta_encoded = true;
+				}
+				s->send(it->first, pose_delta_frame_message_.c_str(), pose_delta_frame_message_.size(), websocketpp::frame::opcode::binary, ec);
+			}
+			if (ec)
+			{
+				pose_stream_map_.erase(it++);
+			}
+			else
+			{
+				++it;
+			}
+		}
+		if (!pose_stream_map_.empty())
+		{
+			set_pose_timer(s);
+		}
+	}
+
+	void on_close(websocketpp::connection_hdl hdl)
+	{
+		pose_stream_map_.erase(hdl);
+	}
+
 	void on_message(server* s, websocketpp::connection_hdl hdl, server::message_ptr msg) 
 	{
 		//scoped_lock guard(lock_);
@@ -150,6 +315,14 @@ public:
 			websocketpp::lib::error_code ec;
 			s->send(hdl, binary.c_str(), binary.size(), websocketpp::frame::opcode::binary, ec);
 		}
+		else if (payload == "start_pose_stream")
+		{
+			start_pose_stream(s, hdl);
+		}
+		else if (payload == "stop_pose_stream")
+		{
+			pose_stream_map_.erase(hdl);
+		}
 		else if (payload == "start_mapping")
 		{
 			websocketpp::lib::error_code ec;
@@ -263,13 +436,21 @@ public:
 	
 	void set_connection_map(const std::map<umdraw::UMNodePtr, std::string>& connections)
 	{
+		scoped_lock guard(lock_);
 		connection_map_ = connections;
+		++connection_version_;
+	}
+
+	void set_pose_stream_rate(double fps)
+	{
+		pose_stream_rate_ = fps;
 	}
 private:
 	void do_()
 	{
 		ioserver_.init_asio();
 		ioserver_.set_message_handler(bind(&UMWSIO::Impl::on_message, this, &ioserver_, _1, _2));
+		ioserver_.set_close_handler(bind(&UMWSIO::Impl::on_close, this, _1));
 		ioserver_.listen(port_);
 		ioserver_.start_accept();
 		ioserver_.run();
@@ -290,6 +471,32 @@ private:
 	std::string nnb_;
 	int port_;
 	std::map<umdraw::UMNodePtr, std::string> connection_map_;
+
+	std::atomic<int> connection_version_;
+
+	// pose publisher. written by the updating thread
+	UMPoseSlot pose_slot_;
+	UMPoseTopologyPtr pose_topology_;
+	UMNodeList pose_joint_list_;
+
+	// pose subscribers. websocket thread only
+	struct PoseStreamState
+	{
+		PoseStreamState() : topology_version(-1), needs_key_frame(true) {}
+		int topology_version;
+		bool needs_key_frame;
+	};
+	typedef std::map<websocketpp::connection_hdl, PoseStreamState, std::owner_less<websocketpp::connection_hdl> > PoseStreamMap;
+	PoseStreamMap pose_stream_map_;
+	// written by the ui thread
+	std::atomic<double> pose_stream_rate_;
+	bool is_pose_timer_pending_;
+	bool is_new_pose_;
+	int sent_topology_version_;
+	UMPoseEncoder pose_encoder_;
+	std::string pose_topology_message_;
+	std::string pose_key_frame_message_;
+	std::string pose_delta_frame_message_;
 };
 
 /**
@@ -385,4 +592,14 @@ void UMWSIO::set_connection_map(const std::map<umdraw::UMNodePtr, std::string>&
 	impl_->set_connection_map(connections);
 }
 
+void UMWSIO::set_pose_stream_rate(double fps)
+{
+	impl_->set_pose_stream_rate(fps);
+}
+
+void UMWSIO::publish_pose()
+{
+	impl_->publish_pose();
+}
+
 } // umwsio
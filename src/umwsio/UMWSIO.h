@@ -73,6 +73,18 @@ public:
 	
 	void set_connection_map(const std::map<umdraw::UMNodePtr, std::string>& connections);
 
+	/**
+	 * set frames per second of pose stream
+	 * @note clients send "start_pose_stream" to receive topology and pose frames.
+	 */
+	void set_pose_stream_rate(double fps);
+
+	/**
+	 * copy current pose of connected nodes for the websocket thread
+	 * @note call once per frame from the thread which updates the scene.
+	 */
+	void publish_pose();
+
 private:
 	class Impl;
 	typedef std::unique_ptr<Impl> ImplPtr;